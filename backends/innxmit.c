@@ -47,7 +47,8 @@
 */
 
 /*
-**  Max number of articles that can be streamed ahead.
+**  Default max number of articles that can be streamed ahead, changed with
+**  -w.
 */
 #define STNBUF             64
 
@@ -56,12 +57,6 @@
 */
 #define STNC               16
 
-/*
-**  Typical number of articles to stream.
-**  Must be able to fopen this many articles.
-*/
-#define STNBUFL            (STNBUF / 2)
-
 /*
 **  Number of retries before requeueing to disk.
 */
@@ -80,8 +75,8 @@
 **  next response received corresponds to stdoldest.
 **
 **  We always require:
-**     0 <= stnq <= STNBUF
-**     0 <= stoldest < STNBUF
+**     0 <= stnq <= stsize
+**     0 <= stoldest < stsize
 */
 struct stbufs {                      /* for each article we are procesing */
     char st_fname[SPOOLNAMEBUFF];    /* file name */
@@ -91,10 +86,28 @@ struct stbufs {                      /* for each article we are procesing */
     int st_hash;                     /* hash value to speed searches */
     long st_size;                    /* article size */
 };
-static struct stbufs stbuf[STNBUF]; /* we keep track of this many articles */
-static int stnq;      /* current number of active entries in stbuf */
-static long stnofail; /* Count of consecutive successful sends */
-static int stoldest;  /* Oldest allocated entry to stbuf (if stnq!=0) */
+static struct stbufs *stbuf; /* we keep track of stsize articles */
+static int stsize = STNBUF;  /* size of stbuf, the window of the pipeline */
+static int stnq;             /* current number of active entries in stbuf */
+static long stnofail;        /* Count of consecutive successful sends */
+static int stoldest;         /* Oldest allocated entry to stbuf (if stnq!=0) */
+
+/*
+**  Articles read ahead from the batch file while waiting for the replies
+**  of the server, so that retrieving them from the spool overlaps with the
+**  round trips.  pfbuf is a ring buffer of stsize entries like stbuf, the
+**  oldest one being sent next.
+*/
+struct pfbufs {
+    char *pf_fname;    /* file name or token */
+    char *pf_id;       /* Message-ID */
+    ARTHANDLE *pf_art; /* article contents */
+};
+static struct pfbufs *pfbuf;
+static int pfnq;          /* current number of articles read ahead */
+static int pfoldest;      /* oldest article read ahead (if pfnq!=0) */
+static char *pfArticle;   /* file name of the article being sent */
+static char *pfMessageID; /* and its Message-ID, if it was read ahead */
 
 static int TryStream = true;  /* Should attempt stream negotation? */
 static int CanStream = false; /* Result of stream negotation */
@@ -149,6 +162,9 @@ static jmp_buf JMPwhere;
 static char *REMbuffer;
 static char *REMbuffptr;
 static char *REMbuffend;
+static char REMinput[BUFSIZ];
+static char *REMinptr;
+static int REMincount;
 static unsigned long STATaccepted;
 static unsigned long STAToffered;
 static unsigned long STATrefused;
@@ -202,7 +218,7 @@ stindex(char *MessageID, int hash)
 {
     int i;
 
-    for (i = 0; i < STNBUF; i++) { /* linear search for ID */
+    for (i = 0; i < stsize; i++) { /* linear search for ID */
         if (stbuf[i].st_id[0] && (stbuf[i].st_hash == hash)) {
             int n;
 
@@ -217,7 +233,7 @@ stindex(char *MessageID, int hash)
                 break; /* found a match */
         }
     }
-    if (i >= STNBUF)
+    if (i >= stsize)
         i = -1; /* no match found ? */
     return (i);
 }
@@ -246,7 +262,7 @@ stidhash(char *MessageID)
 **
 **  Called just before issuing a CHECK (or TAKETHIS, if we're not doing CHECK)
 **  i.e. in streaming mode only.
-**  Should only be called if there are free slots, i.e. if sntq<STNBUF.
+**  Should only be called if there are free slots, i.e. if sntq<stsize.
 **/
 static int
 stalloc(const char *Article, const char *MessageID, ARTHANDLE *art, int hash,
@@ -254,12 +270,12 @@ stalloc(const char *Article, const char *MessageID, ARTHANDLE *art, int hash,
 {
     int i;
 
-    if (stnq >= STNBUF) { /* shouldn't be called if stnq>=STNBUF */
+    if (stnq >= stsize) { /* shouldn't be called if stnq>=stsize */
         syslog(L_ERROR, "stalloc: Internal error");
         return (-1);
     }
     /* Find the next free slot */
-    i = (stoldest + stnq) % STNBUF;
+    i = (stoldest + stnq) % stsize;
     if ((int) strlen(Article) >= SPOOLNAMEBUFF) {
         syslog(L_ERROR, "stalloc: filename longer than %d", SPOOLNAMEBUFF);
         return (-1);
@@ -291,7 +307,7 @@ strel(int i)
     stbuf[i].st_art = NULL;
     stbuf[i].st_id[0] = '\0';
     stbuf[i].st_fname[0] = '\0';
-    stoldest = (stoldest + 1) % STNBUF;
+    stoldest = (stoldest + 1) % stsize;
     stnq--;
     return 0;
 }
@@ -469,6 +485,12 @@ RequeueRestAndExit(char *Article, char *MessageID)
         }
     }
     Requeue(Article, MessageID);
+    while (pfnq > 0) { /* requeue articles read ahead */
+        Requeue(pfbuf[pfoldest].pf_fname, pfbuf[pfoldest].pf_id);
+        article_free(pfbuf[pfoldest].pf_art);
+        pfoldest = (pfoldest + 1) % stsize;
+        pfnq--;
+    }
 
     for (; BATCHqp;) {
         if ((p = QIOread(BATCHqp)) == NULL) {
@@ -521,9 +543,6 @@ REMclean(char *buff)
 static bool
 REMread(char *start, int size)
 {
-    static int count;
-    static char buffer[BUFSIZ];
-    static char *bp;
     char *p;
     char *q;
     char *end;
@@ -536,7 +555,7 @@ REMread(char *start, int size)
         return false;
 
     for (p = start, end = &start[size - 1];;) {
-        if (count == 0) {
+        if (REMincount == 0) {
             /* Fill the buffer. */
         Again:
             FD_ZERO(&rmask);
@@ -553,17 +572,19 @@ REMread(char *start, int size)
             }
             if (i == 0 || !FD_ISSET(FromServer, &rmask))
                 return false;
-            count = read(FromServer, buffer, sizeof buffer);
+            REMincount = read(FromServer, REMinput, sizeof REMinput);
             if (GotInterrupt)
                 return true;
-            if (count <= 0)
+            if (REMincount <= 0) {
+                REMincount = 0;
                 return false;
-            bp = buffer;
+            }
+            REMinptr = REMinput;
         }
 
         /* Process next character. */
-        count--;
-        c = *bp++;
+        REMincount--;
+        c = *REMinptr++;
         if (c == '\n')
             break;
         if (p < end)
@@ -587,6 +608,25 @@ REMread(char *start, int size)
 }
 
 
+/*
+**  Return true if a reply of the server can be read without waiting.
+*/
+static bool
+REMpending(void)
+{
+    struct timeval t;
+    fd_set rmask;
+
+    if (REMincount > 0)
+        return true;
+    FD_ZERO(&rmask);
+    FD_SET(FromServer, &rmask);
+    t.tv_sec = 0;
+    t.tv_usec = 0;
+    return select(FromServer + 1, &rmask, NULL, NULL, &t) > 0;
+}
+
+
 /*
 **  Handle the interrupt.
 */
@@ -784,7 +824,7 @@ CATCHalarm(int s UNUSED)
 static bool
 check(int i)
 {
-    char buff[NNTP_MAXLEN_COMMAND];
+    char buff[NNTP_MAXLEN_COMMAND + sizeof("CHECK ")];
 
     /* Send "CHECK <mid>" to the other system. */
     snprintf(buff, sizeof(buff), "CHECK %s", stbuf[i].st_id);
@@ -816,7 +856,7 @@ check(int i)
 static bool
 takethis(int i)
 {
-    char buff[NNTP_MAXLEN_COMMAND];
+    char buff[NNTP_MAXLEN_COMMAND + sizeof("TAKETHIS ")];
 
     if (!stbuf[i].st_art) {
         warn("internal error: null article for %s in takethis",
@@ -1009,7 +1049,7 @@ strlisten(void)
 static void
 Usage(void)
 {
-    die("Usage: innxmit [-acdHlprs] [-t#] [-T#] host file");
+    die("Usage: innxmit [-acdHlprs] [-t#] [-T#] [-w#] host file");
 }
 
 
@@ -1101,6 +1141,142 @@ article_free(ARTHANDLE *article)
 }
 
 
+/*
+**  Read the next article to send from the batch file and open it, skipping
+**  the lines which cannot be sent.  Returns false at the end of the file.
+*/
+static bool
+BATCHnext(char **ArticlePtr, char **MessageIDPtr, ARTHANDLE **artPtr)
+{
+    char *Article;
+    char *MessageID;
+    ARTHANDLE *art;
+    char *p;
+
+    while (BATCHqp != NULL) {
+        if ((Article = QIOread(BATCHqp)) == NULL) {
+            if (QIOtoolong(BATCHqp)) {
+                warn("skipping long line in %s", BATCHname);
+                continue;
+            }
+            if (QIOerror(BATCHqp)) {
+                syswarn("cannot read %s", BATCHname);
+                ExitWithStats(1);
+            }
+
+            /* Normal EOF -- we're done. */
+            QIOclose(BATCHqp);
+            BATCHqp = NULL;
+            return false;
+        }
+
+        /* Ignore blank lines. */
+        if (*Article == '\0')
+            continue;
+
+        /* Split the line into possibly two fields. */
+        if (Article[0] == '/' && Article[strlen(innconf->patharticles)] == '/'
+            && strncmp(Article, innconf->patharticles,
+                       strlen(innconf->patharticles))
+                   == 0)
+            Article += strlen(innconf->patharticles) + 1;
+        if ((MessageID = strchr(Article, ' ')) != NULL) {
+            *MessageID++ = '\0';
+            if (*MessageID != '<' || (p = strrchr(MessageID, '>')) == NULL
+                || *++p != '\0') {
+                warn("ignoring line %s %s...", Article, MessageID);
+                continue;
+            }
+        }
+
+        if (*Article == '\0') {
+            if (MessageID)
+                warn("empty file name for %s in %s", MessageID, BATCHname);
+            else
+                warn("empty file name, no Message-ID in %s", BATCHname);
+            /* We could do a history lookup. */
+            continue;
+        }
+
+        if (Purging && MessageID != NULL && !Expired(MessageID)) {
+            Requeue(Article, MessageID);
+            continue;
+        }
+
+        /* Drop articles with a Message-ID longer than NNTP_MAXLEN_MSGID to
+           avoid overrunning buffers and throwing the server on the
+           receiving end a blow from behind. */
+        if (MessageID != NULL && strlen(MessageID) > NNTP_MAXLEN_MSGID) {
+            warn("dropping article in %s: long Message-ID %s", BATCHname,
+                 MessageID);
+            continue;
+        }
+
+        art = article_open(Article, MessageID);
+        if (art == NULL)
+            continue;
+
+        if (Purging) {
+            article_free(art);
+            Requeue(Article, MessageID);
+            continue;
+        }
+
+        /* Get the Message-ID from the article if we need to. */
+        if (MessageID == NULL) {
+            if ((MessageID = GetMessageID(art)) == NULL) {
+                warn("Skipping \"%s\" -- %s?\n", Article, "no Message-ID");
+                article_free(art);
+                continue;
+            }
+        }
+
+        *ArticlePtr = Article;
+        *MessageIDPtr = MessageID;
+        *artPtr = art;
+        return true;
+    }
+    return false;
+}
+
+
+/*
+**  Read the next article of the batch file into the read-ahead ring.  The
+**  line returned by BATCHnext lives in the QIO buffer and does not survive
+**  the next read, so it is copied.  Returns false at the end of the file.
+*/
+static bool
+PrefetchOne(void)
+{
+    char *Article;
+    char *MessageID;
+    ARTHANDLE *art;
+    int i;
+
+    if (!BATCHnext(&Article, &MessageID, &art))
+        return false;
+    i = (pfoldest + pfnq) % stsize;
+    pfbuf[i].pf_fname = xstrdup(Article);
+    pfbuf[i].pf_id = xstrdup(MessageID);
+    pfbuf[i].pf_art = art;
+    pfnq++;
+    return true;
+}
+
+
+/*
+**  Read articles ahead from the batch file while no reply of the server is
+**  there to be read, until as many articles as the window holds are ready.
+*/
+static void
+Prefetch(void)
+{
+    while (pfnq < stsize && !GotInterrupt && !REMpending())
+        if (!PrefetchOne())
+            break;
+}
+
+
 int
 main(int ac, char *av[])
 {
@@ -1132,7 +1308,7 @@ main(int ac, char *av[])
     umask(NEWSUMASK);
 
     /* Parse JCL. */
-    while ((i = getopt(ac, av, "acdHlpP:rst:T:v")) != EOF)
+    while ((i = getopt(ac, av, "acdHlpP:rst:T:vw:")) != EOF)
         switch (i) {
         default:
             Usage();
@@ -1174,6 +1350,11 @@ main(int ac, char *av[])
         case 'v':
             STATprint = true;
             break;
+        case 'w':
+            stsize = atoi(optarg);
+            if (stsize < 2)
+                die("window of %s articles is too small", optarg);
+            break;
         }
     ac -= optind;
     av += optind;
@@ -1306,11 +1487,7 @@ main(int ac, char *av[])
                 }
             }
             if (CanStream) {
-                for (i = 0; i < STNBUF; i++) { /* reset buffers */
-                    stbuf[i].st_fname[0] = 0;
-                    stbuf[i].st_id[0] = 0;
-                    stbuf[i].st_art = NULL;
-                }
+                stbuf = xcalloc(stsize, sizeof(struct stbufs));
                 stnq = 0;
             }
         }
@@ -1354,6 +1531,10 @@ main(int ac, char *av[])
     History = HISopen(path, innconf->hismethod, HIS_RDONLY);
     free(path);
 
+    /* The read-ahead ring is used whether or not the server streams. */
+    pfbuf = xcalloc(stsize, sizeof(struct pfbufs));
+    pfnq = 0;
+
     /* Main processing loop. */
     GotInterrupt = false;
     GotAlarm = false;
@@ -1366,88 +1547,24 @@ main(int ac, char *av[])
         if (GotInterrupt)
             Interrupted(Article, MessageID);
 
-        if ((Article = QIOread(BATCHqp)) == NULL) {
-            if (QIOtoolong(BATCHqp)) {
-                warn("skipping long line in %s", BATCHname);
-                continue;
-            }
-            if (QIOerror(BATCHqp)) {
-                syswarn("cannot read %s", BATCHname);
-                ExitWithStats(1);
-            }
-
-            /* Normal EOF -- we're done. */
-            QIOclose(BATCHqp);
-            BATCHqp = NULL;
+        /* Every article goes through the read-ahead ring, so that Article
+           and MessageID stay valid while more lines are read. */
+        if (pfnq == 0 && !PrefetchOne())
             break;
-        }
-
-        /* Ignore blank lines. */
-        if (*Article == '\0')
-            continue;
-
-        /* Split the line into possibly two fields. */
-        if (Article[0] == '/' && Article[strlen(innconf->patharticles)] == '/'
-            && strncmp(Article, innconf->patharticles,
-                       strlen(innconf->patharticles))
-                   == 0)
-            Article += strlen(innconf->patharticles) + 1;
-        if ((MessageID = strchr(Article, ' ')) != NULL) {
-            *MessageID++ = '\0';
-            if (*MessageID != '<' || (p = strrchr(MessageID, '>')) == NULL
-                || *++p != '\0') {
-                warn("ignoring line %s %s...", Article, MessageID);
-                continue;
-            }
-        }
-
-        if (*Article == '\0') {
-            if (MessageID)
-                warn("empty file name for %s in %s", MessageID, BATCHname);
-            else
-                warn("empty file name, no Message-ID in %s", BATCHname);
-            /* We could do a history lookup. */
-            continue;
-        }
-
-        if (Purging && MessageID != NULL && !Expired(MessageID)) {
-            Requeue(Article, MessageID);
-            continue;
-        }
-
-        /* Drop articles with a Message-ID longer than NNTP_MAXLEN_MSGID to
-           avoid overrunning buffers and throwing the server on the
-           receiving end a blow from behind. */
-        if (MessageID != NULL && strlen(MessageID) > NNTP_MAXLEN_MSGID) {
-            warn("dropping article in %s: long Message-ID %s", BATCHname,
-                 MessageID);
-            continue;
-        }
-
-        art = article_open(Article, MessageID);
-        if (art == NULL)
-            continue;
 
-        if (Purging) {
-            article_free(art);
-            Requeue(Article, MessageID);
-            continue;
-        }
-
-        /* Get the Message-ID from the article if we need to. */
-        if (MessageID == NULL) {
-            if ((MessageID = GetMessageID(art)) == NULL) {
-                warn("Skipping \"%s\" -- %s?\n", Article, "no Message-ID");
-                article_free(art);
-                continue;
-            }
-        }
+        /* Take the oldest article read ahead. */
+        free(pfArticle);
+        free(pfMessageID);
+        Article = pfArticle = pfbuf[pfoldest].pf_fname;
+        MessageID = pfMessageID = pfbuf[pfoldest].pf_id;
+        art = pfbuf[pfoldest].pf_art;
+        pfoldest = (pfoldest + 1) % stsize;
+        pfnq--;
         if (GotInterrupt)
             Interrupted(Article, MessageID);
 
         /* Offer the article. */
         if (CanStream) {
-            int lim;
             int hash;
 
             hash = stidhash(MessageID);
@@ -1457,20 +1574,26 @@ main(int ac, char *av[])
                 article_free(art);
                 continue;
             }
-            /* This code tries to optimize by sending a burst of "check"
-             * commands before flushing the buffer.  This should result
-             * in several being sent in one packet reducing the network
-             * overhead.
+            /* Commands are buffered until we have to wait for a reply, so
+             * that several of them are sent in one packet.  The replies
+             * already received are processed first, then we only wait
+             * while the window is full, reading the next articles ahead
+             * meanwhile, so that the link never runs dry.  CHECK and
+             * TAKETHIS both use the whole window.
              */
-            if (DoCheck && (stnofail < STNC))
-                lim = STNBUF;
-            else
-                lim = STNBUFL;
-            if (stnq >= lim) {            /* need to empty a buffer */
-                while (stnq >= STNBUFL) { /* or several */
-                    if (strlisten()) {
-                        RequeueRestAndExit(Article, MessageID);
-                    }
+            while (stnq > 0 && REMpending()) {
+                if (strlisten()) {
+                    RequeueRestAndExit(Article, MessageID);
+                }
+            }
+            while (stnq >= stsize) {
+                if (!REMflush()) {
+                    syswarn("cannot send to %s", REMhost);
+                    RequeueRestAndExit(Article, MessageID);
+                }
+                Prefetch();
+                if (strlisten()) {
+                    RequeueRestAndExit(Article, MessageID);
                 }
             }
             /* save new article in the buffer */
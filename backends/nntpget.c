@@ -10,6 +10,7 @@
 #include <errno.h>
 #include <sys/stat.h>
 #include <sys/uio.h>
+#include <sys/wait.h>
 
 #ifdef HAVE_SYS_TIME_H
 #    include <sys/time.h>
@@ -28,6 +29,12 @@
 #include "inn/nntp.h"
 #include "inn/paths.h"
 
+/*
+**  Max number of Message-IDs offered and fetched at once, without waiting
+**  for the replies to the previous commands.
+*/
+#define STNBUF 32
+
 /*
 **  All information about a site we are connected to.
 */
@@ -40,6 +47,15 @@ typedef struct _SITE {
     int Count;
 } SITE;
 
+/*
+**  A Message-ID of the list being pulled.
+*/
+struct pull {
+    char mesgid[NNTP_MAXLEN_MSGID + 10];
+    bool wanted; /* To be fetched from the remote server. */
+    bool done;   /* Nothing left to do for it. */
+};
+
 
 /*
 **  Global variables.
@@ -52,6 +68,10 @@ static unsigned long STAToffered;
 static unsigned long STATsent;
 static unsigned long STATrejected;
 static struct history *History;
+static bool Offer = false;
+static bool Streaming = false;
+static bool Verbose = false;
+static unsigned long Workers = 1;
 
 
 /*
@@ -127,6 +147,25 @@ SITEwrite(SITE *sp, const char *p, int i)
 }
 
 
+/*
+**  Send a command with a Message-ID to the server.
+*/
+static bool
+SITEcommand(SITE *sp, const char *command, const char *mesgid)
+{
+    struct iovec vec[4];
+
+    vec[0].iov_base = (char *) command;
+    vec[0].iov_len = strlen(command);
+    vec[1].iov_base = (char *) " ";
+    vec[1].iov_len = 1;
+    vec[2].iov_base = (char *) mesgid;
+    vec[2].iov_len = strlen(mesgid);
+    vec[3] = SITEvec[1];
+    return xwritev(sp->Wfd, vec, 4) >= 0;
+}
+
+
 static SITE *
 SITEconnect(char *host)
 {
@@ -185,102 +224,224 @@ static void
 Usage(const char *p)
 {
     warn("%s", p);
-    fprintf(stderr, "Usage: nntpget"
-                    " [-ov] [-f file] [-n grps] [-t time] [-u file] host\n");
+    fprintf(stderr, "Usage: nntpget [-ov] [-f file] [-j workers] [-n grps]"
+                    " [-t time] [-u file] host\n");
     exit(1);
 }
 
 
-int
-main(int ac, char *av[])
+/*
+**  Format the modification time of a file for NEWNEWS.  Returns false if
+**  the file cannot be stat'ed.
+*/
+static bool
+FileSince(const char *file, char *buff, size_t len)
+{
+    struct stat Sb;
+    struct tm *gt;
+
+    if (stat(file, &Sb) < 0)
+        return false;
+    gt = gmtime(&Sb.st_mtime);
+    snprintf(buff, len, "%04d%02d%02d %02d%02d%02d GMT", gt->tm_year + 1900,
+             gt->tm_mon + 1, gt->tm_mday, gt->tm_hour, gt->tm_min,
+             gt->tm_sec);
+    return true;
+}
+
+
+/*
+**  Give up on a chunk, writing the Message-IDs not dealt with yet to the
+**  list of articles still needed.
+*/
+static bool
+PullFail(struct pull *chunk, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        if (!chunk[i].done)
+            printf("%s\n", chunk[i].mesgid);
+    return false;
+}
+
+
+/*
+**  Pull a chunk of Message-IDs.  All of them are offered at once to the
+**  local server if it streams (otherwise, chunks hold only one Message-ID
+**  offered with IHAVE), then all the wanted articles are asked for at once
+**  to the remote server and sent with TAKETHIS as they come.  The replies
+**  to TAKETHIS are read at the end.  Returns false on a fatal error.
+*/
+static bool
+PullChunk(SITE *Remote, SITE *Local, struct pull *chunk, int n)
 {
     char buff[NNTP_MAXLEN_COMMAND];
-    char mesgid[NNTP_MAXLEN_MSGID + 10];
-    char tbuff[SMBUF];
+    int i, j;
+
+    /* See which articles the local server wants. */
+    if (Offer) {
+        for (i = 0; i < n; i++) {
+            STAToffered++;
+            if (!SITEcommand(Local, Streaming ? "CHECK" : "IHAVE",
+                             chunk[i].mesgid)) {
+                syswarn("cannot offer %s", chunk[i].mesgid);
+                return PullFail(chunk, n);
+            }
+        }
+        for (i = 0; i < n; i++) {
+            if (!SITEread(Local, buff)) {
+                syswarn("cannot offer %s", chunk[i].mesgid);
+                return PullFail(chunk, n);
+            }
+            switch (atoi(buff)) {
+            case NNTP_CONT_IHAVE:
+            case NNTP_OK_CHECK:
+                chunk[i].wanted = true;
+                break;
+            case NNTP_FAIL_CHECK_DEFER:
+                printf("%s\n", chunk[i].mesgid);
+                chunk[i].done = true;
+                break;
+            default:
+                chunk[i].done = true;
+                break;
+            }
+        }
+    }
+
+    /* Ask for all of them. */
+    for (i = 0; i < n; i++) {
+        if (!chunk[i].wanted)
+            continue;
+        if (!SITEcommand(Remote, "ARTICLE", chunk[i].mesgid)) {
+            syswarn("cannot get %s", chunk[i].mesgid);
+            return PullFail(chunk, n);
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        if (!chunk[i].wanted)
+            continue;
+
+        /* Try to get the article. */
+        if (!SITEread(Remote, buff)) {
+            syswarn("cannot get %s", chunk[i].mesgid);
+            return PullFail(chunk, n);
+        }
+        if (atoi(buff) != NNTP_OK_ARTICLE) {
+            if (Offer && !Streaming) {
+                SITEwrite(Local, ".", 1);
+                if (!SITEread(Local, buff)) {
+                    syswarn("no reply after %s", chunk[i].mesgid);
+                    return PullFail(chunk, n);
+                }
+            }
+            chunk[i].wanted = false;
+            chunk[i].done = true;
+            continue;
+        }
+
+        if (Verbose)
+            notice("%s", chunk[i].mesgid);
+        if (Streaming) {
+            if (!SITEcommand(Local, "TAKETHIS", chunk[i].mesgid)) {
+                syswarn("cannot send %s", chunk[i].mesgid);
+                return PullFail(chunk, n);
+            }
+        }
+
+        /* Read each line in the article and write it. */
+        for (;;) {
+            if (!SITEread(Remote, buff)) {
+                syswarn("cannot read %s from %s", chunk[i].mesgid,
+                        Remote->Name);
+                return PullFail(chunk, n);
+            }
+            if (Offer) {
+                if (!SITEwrite(Local, buff, (int) strlen(buff))) {
+                    syswarn("cannot send %s", chunk[i].mesgid);
+                    return PullFail(chunk, n);
+                }
+            } else
+                printf("%s\n", buff);
+            if (strcmp(buff, ".") == 0)
+                break;
+        }
+        STATsent++;
+        if (!Offer)
+            chunk[i].done = true;
+        if (!Offer || Streaming)
+            continue;
+
+        /* How did the local server respond? */
+        if (!SITEread(Local, buff)) {
+            syswarn("no reply after %s", chunk[i].mesgid);
+            return PullFail(chunk, n);
+        }
+        j = atoi(buff);
+        if (j == NNTP_FAIL_IHAVE_DEFER)
+            return PullFail(chunk, n);
+        chunk[i].done = true;
+        if (j != NNTP_OK_IHAVE) {
+            syswarn("%s to %s", buff, chunk[i].mesgid);
+            STATrejected++;
+        }
+    }
+
+    /* Read the replies to TAKETHIS.  Articles the local server could not
+       take for now are still needed. */
+    for (i = 0; i < n; i++) {
+        if (!chunk[i].wanted || chunk[i].done)
+            continue;
+        if (!SITEread(Local, buff)) {
+            syswarn("no reply after %s", chunk[i].mesgid);
+            return PullFail(chunk, n);
+        }
+        chunk[i].done = true;
+        j = atoi(buff);
+        if (j == NNTP_OK_TAKETHIS)
+            continue;
+        if (j == NNTP_FAIL_TAKETHIS_REJECT) {
+            syswarn("%s to %s", buff, chunk[i].mesgid);
+            STATrejected++;
+        } else
+            printf("%s\n", chunk[i].mesgid);
+    }
+    return true;
+}
+
+
+/*
+**  Pull the articles of the given newsgroups from host, or those whose
+**  Message-IDs are on stdin.  Returns the exit status.
+*/
+static int
+Pull(char *host, const char *Groups, const char *Since, const char *Update)
+{
+    char buff[NNTP_MAXLEN_COMMAND];
+    struct pull chunk[STNBUF];
     char *msgidfile = NULL;
     int msgidfd;
-    const char *Groups;
-    char *Since;
     char *path;
-    int i;
-    struct tm *gt;
-    struct stat Sb;
+    int n;
     SITE *Remote;
     SITE *Local = NULL;
     FILE *F;
-    bool Offer;
-    bool Error;
-    bool Verbose = false;
-    char *Update;
     char *p;
 
-    /* First thing, set up our identity. */
-    message_program_name = "nntpget";
-
-    /* Set defaults. */
-    Groups = NULL;
-    Since = NULL;
-    Offer = false;
-    Update = NULL;
-    if (!innconf_read(NULL))
-        exit(1);
-
-    umask(NEWSUMASK);
-
-    /* Parse JCL. */
-    while ((i = getopt(ac, av, "f:n:t:ou:v")) != EOF)
-        switch (i) {
-        default:
-            Usage("bad flag");
-            /* NOTREACHED */
-        case 'u':
-            Update = optarg;
-            goto fallthrough;
-        case 'f':
-        fallthrough:
-            if (Since)
-                Usage("only one of -f, -t, or -u may be given");
-            if (stat(optarg, &Sb) < 0)
-                sysdie("cannot stat %s", optarg);
-            gt = gmtime(&Sb.st_mtime);
-            snprintf(tbuff, sizeof(tbuff), "%04d%02d%02d %02d%02d%02d GMT",
-                     gt->tm_year + 1900, gt->tm_mon + 1, gt->tm_mday,
-                     gt->tm_hour, gt->tm_min, gt->tm_sec);
-            Since = tbuff;
-            break;
-        case 'n':
-            Groups = optarg;
-            break;
-        case 'o':
-            /* Open the history file. */
-            path = concatpath(innconf->pathdb, INN_PATH_HISTORY);
-            History = HISopen(path, innconf->hismethod, HIS_RDONLY);
-            if (!History)
-                sysdie("cannot open history");
-            free(path);
-            Offer = true;
-            break;
-        case 't':
-            if (Since)
-                Usage("only one of -f, -t, or -u may be given");
-            Since = optarg;
-            break;
-        case 'v':
-            Verbose = true;
-            break;
-        }
-    ac -= optind;
-    av += optind;
-    if (ac != 1)
-        Usage("no host given");
-
-    /* Set up the scatter/gather vectors used by SITEwrite. */
-    SITEvec[1].iov_base = SITEv1;
-    SITEvec[1].iov_len = strlen(SITEv1);
+    /* Open the history file. */
+    if (Offer) {
+        path = concatpath(innconf->pathdb, INN_PATH_HISTORY);
+        History = HISopen(path, innconf->hismethod, HIS_RDONLY);
+        if (!History)
+            sysdie("cannot open history");
+        free(path);
+    }
 
     /* Connect to the remote server. */
-    if ((Remote = SITEconnect(av[0])) == NULL)
-        sysdie("cannot connect to %s", av[0]);
+    if ((Remote = SITEconnect(host)) == NULL)
+        sysdie("cannot connect to %s", host);
     if (!SITEwrite(Remote, READER, (int) strlen(READER))
         || !SITEread(Remote, buff))
         sysdie("cannot start reading");
@@ -317,7 +478,7 @@ main(int ac, char *av[])
                 syswarn("cannot read from %s", Remote->Name);
                 fclose(F);
                 SITEquit(Remote);
-                exit(1);
+                return 1;
             }
             if (strcmp(buff, ".") == 0)
                 break;
@@ -327,117 +488,55 @@ main(int ac, char *av[])
                 syswarn("cannot write %s", msgidfile);
                 fclose(F);
                 SITEquit(Remote);
-                exit(1);
+                return 1;
             }
         }
         if (fflush(F) == EOF) {
             syswarn("cannot flush %s", msgidfile);
             fclose(F);
             SITEquit(Remote);
-            exit(1);
+            return 1;
         }
         fseeko(F, 0, SEEK_SET);
     }
 
     if (Offer) {
-        /* Connect to the local server. */
+        /* Connect to the local server, and stream to it if it allows. */
         if ((Local = SITEconnect((char *) NULL)) == NULL) {
             syswarn("cannot connect to local server");
             fclose(F);
-            exit(1);
-        }
-    }
-
-    /* Loop through the list of Message-ID's. */
-    while (fgets(mesgid, sizeof mesgid, F) != NULL) {
-        STATgot++;
-        if ((p = strchr(mesgid, '\n')) != NULL)
-            *p = '\0';
-
-        if (Offer) {
-            /* See if the local server wants it. */
-            STAToffered++;
-            snprintf(buff, sizeof(buff), "IHAVE %s", mesgid);
-            if (!SITEwrite(Local, buff, (int) strlen(buff))
-                || !SITEread(Local, buff)) {
-                syswarn("cannot offer %s", mesgid);
-                break;
-            }
-            if (atoi(buff) != NNTP_CONT_IHAVE)
-                continue;
+            return 1;
         }
-
-        /* Try to get the article. */
-        snprintf(buff, sizeof(buff), "ARTICLE %s", mesgid);
-        if (!SITEwrite(Remote, buff, (int) strlen(buff))
-            || !SITEread(Remote, buff)) {
-            syswarn("cannot get %s", mesgid);
-            printf("%s\n", mesgid);
-            break;
-        }
-        if (atoi(buff) != NNTP_OK_ARTICLE) {
-            if (Offer) {
-                SITEwrite(Local, ".", 1);
-                if (!SITEread(Local, buff)) {
-                    syswarn("no reply after %s", mesgid);
-                    break;
-                }
-            }
-            continue;
+        if (!SITEwrite(Local, "MODE STREAM", 11) || !SITEread(Local, buff)) {
+            syswarn("cannot talk to local server");
+            fclose(F);
+            return 1;
         }
+        Streaming = (atoi(buff) == NNTP_OK_STREAM);
+    }
 
-        if (Verbose)
-            notice("%s", mesgid);
-
-        /* Read each line in the article and write it. */
-        for (Error = false;;) {
-            if (!SITEread(Remote, buff)) {
-                syswarn("cannot read %s from %s", mesgid, Remote->Name);
-                Error = true;
-                break;
-            }
-            if (Offer) {
-                if (!SITEwrite(Local, buff, (int) strlen(buff))) {
-                    syswarn("cannot send %s", mesgid);
-                    Error = true;
-                    break;
-                }
-            } else
-                printf("%s\n", buff);
-            if (strcmp(buff, ".") == 0)
+    /* Loop through the list of Message-IDs, a chunk at a time.  Without
+       streaming, IHAVE needs the article before the next command. */
+    for (;;) {
+        for (n = 0; n < (Offer && !Streaming ? 1 : STNBUF); n++) {
+            if (fgets(chunk[n].mesgid, sizeof chunk[n].mesgid, F) == NULL)
                 break;
+            STATgot++;
+            if ((p = strchr(chunk[n].mesgid, '\n')) != NULL)
+                *p = '\0';
+            chunk[n].wanted = !Offer;
+            chunk[n].done = false;
         }
-        if (Error) {
-            printf("%s\n", mesgid);
+        if (n == 0 || !PullChunk(Remote, Local, chunk, n))
             break;
-        }
-        STATsent++;
-
-        /* How did the local server respond? */
-        if (Offer) {
-            if (!SITEread(Local, buff)) {
-                syswarn("no reply after %s", mesgid);
-                printf("%s\n", mesgid);
-                break;
-            }
-            i = atoi(buff);
-            if (i == NNTP_OK_IHAVE)
-                continue;
-            if (i == NNTP_FAIL_IHAVE_DEFER) {
-                printf("%s\n", mesgid);
-                break;
-            }
-            syswarn("%s to %s", buff, mesgid);
-            STATrejected++;
-        }
     }
 
     /* Write rest of the list, close the input. */
     if (!feof(F))
-        while (fgets(mesgid, sizeof mesgid, F) != NULL) {
-            if ((p = strchr(mesgid, '\n')) != NULL)
+        while (fgets(buff, sizeof buff, F) != NULL) {
+            if ((p = strchr(buff, '\n')) != NULL)
                 *p = '\0';
-            printf("%s\n", mesgid);
+            printf("%s\n", buff);
             STATgot++;
         }
     fclose(F);
@@ -460,7 +559,137 @@ main(int ac, char *av[])
         if (ferror(F) || fclose(F) == EOF)
             sysdie("cannot update %s", Update);
     }
+    return 0;
+}
+
+
+/*
+**  Pull each pattern of the list of newsgroups in its own process, with its
+**  own connections, running at most Workers of them at once.  With -u,
+**  each pattern keeps its own timestamp file, named after the given one
+**  with the pattern appended, so that the next run resumes each pattern
+**  from its own last successful pull.  A pattern without such a file yet
+**  starts from the time of the given one.
+*/
+static int
+PullGroups(char *host, const char *Groups, const char *Since,
+           const char *Update)
+{
+    char tbuff[SMBUF];
+    char *list, *pattern, *state;
+    unsigned long running = 0;
+    int status, result = 0;
+    pid_t pid;
+
+    if (*Groups == '!' || strstr(Groups, ",!") != NULL)
+        Usage("negated patterns not allowed with -j");
+    list = xstrdup(Groups);
+    fflush(stdout);
+    for (pattern = strtok(list, ","); pattern != NULL;
+         pattern = strtok(NULL, ",")) {
+        if (running == Workers && wait(&status) > 0) {
+            running--;
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+                result = 1;
+        }
+        pid = fork();
+        if (pid < 0)
+            sysdie("cannot fork");
+        if (pid == 0) {
+            /* Keep the lines of the workers whole. */
+            setvbuf(stdout, NULL, _IOLBF, 0);
+            state = NULL;
+            if (Update != NULL) {
+                state = concat(Update, ".", pattern, (char *) 0);
+                if (FileSince(state, tbuff, sizeof(tbuff)))
+                    Since = tbuff;
+            }
+            exit(Pull(host, pattern, Since, state));
+        }
+        running++;
+    }
+    while (running > 0 && wait(&status) > 0) {
+        running--;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            result = 1;
+    }
+    free(list);
+    return result;
+}
 
-    exit(0);
+
+int
+main(int ac, char *av[])
+{
+    char tbuff[SMBUF];
+    const char *Groups;
+    char *Since;
+    int i;
+    char *Update;
+
+    /* First thing, set up our identity. */
+    message_program_name = "nntpget";
+
+    /* Set defaults. */
+    Groups = NULL;
+    Since = NULL;
+    Update = NULL;
+    if (!innconf_read(NULL))
+        exit(1);
+
+    umask(NEWSUMASK);
+
+    /* Parse JCL. */
+    while ((i = getopt(ac, av, "f:j:n:t:ou:v")) != EOF)
+        switch (i) {
+        default:
+            Usage("bad flag");
+            /* NOTREACHED */
+        case 'u':
+            Update = optarg;
+            goto fallthrough;
+        case 'f':
+        fallthrough:
+            if (Since)
+                Usage("only one of -f, -t, or -u may be given");
+            if (!FileSince(optarg, tbuff, sizeof(tbuff)))
+                sysdie("cannot stat %s", optarg);
+            Since = tbuff;
+            break;
+        case 'j':
+            Workers = strtoul(optarg, NULL, 10);
+            if (Workers == 0)
+                Usage("bad number of workers");
+            break;
+        case 'n':
+            Groups = optarg;
+            break;
+        case 'o':
+            Offer = true;
+            break;
+        case 't':
+            if (Since)
+                Usage("only one of -f, -t, or -u may be given");
+            Since = optarg;
+            break;
+        case 'v':
+            Verbose = true;
+            break;
+        }
+    ac -= optind;
+    av += optind;
+    if (ac != 1)
+        Usage("no host given");
+
+    /* Set up the scatter/gather vectors used by SITEwrite. */
+    SITEvec[1].iov_base = SITEv1;
+    SITEvec[1].iov_len = strlen(SITEv1);
+
+    if (Workers > 1) {
+        if (Groups == NULL || Since == NULL || !Offer)
+            Usage("-j needs -n, -o and one of -f, -t or -u");
+        exit(PullGroups(av[0], Groups, Since, Update));
+    }
+    exit(Pull(av[0], Groups, Since, Update));
     /* NOTREACHED */
 }
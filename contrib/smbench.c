@@ -0,0 +1,591 @@
+/*
+**  Benchmark the storage API.
+**
+**  For each storage method asked for, build a scratch spool in a temporary
+**  directory holding only that method, then time SMstore, sequential and
+**  random SMretrieve, header-only SMretrieve, an SMnext scan of the whole
+**  spool and SMcancel, over synthetic articles whose sizes follow a mix of
+**  text articles and binary parts.  Each method runs in its own child
+**  process, since the storage methods keep their state in static variables
+**  and cannot be reinitialized with a different configuration.
+**
+**  For every phase, the number of operations per second, the throughput in
+**  MB/s and the percentiles of the latency of one operation are printed.
+**  Reads are served from the page cache when the spool fits in memory, so
+**  use a number of articles large enough for the spool to exceed it when
+**  measuring disk performance.
+**
+**  Usage: smbench [-k] [-b percent] [-d dir] [-m methods] [-n articles]
+**                 [-r reads] [-s seed]
+*/
+
+#include "portable/system.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#include "inn/buffer.h"
+#include "inn/histogram.h"
+#include "inn/innconf.h"
+#include "inn/libinn.h"
+#include "inn/messages.h"
+#include "inn/storage.h"
+#include "inn/timer.h"
+
+/* Sizes of the synthetic articles.  Text articles are mostly small with a
+   long tail, binary parts are evenly spread over the usual yEnc part sizes.
+   Body lines are 128 bytes long, as in yEnc-encoded parts. */
+#define TEXT_MIN       600
+#define TEXT_SPREAD    3000
+#define TEXT_TAIL      60000
+#define BINARY_MIN     (200 * 1024)
+#define BINARY_SPREAD  (600 * 1024)
+#define LINE_LENGTH    128
+
+/* The storage methods that can be benchmarked, with the body of their
+   storage.conf entry. */
+static const struct method {
+    const char *name;
+    const char *options;
+} methods[] = {
+    {"cnfs",      "    options: BENCH\n"},
+    {"timecaf",   ""                     },
+    {"timehash",  ""                     },
+    {"tradspool", ""                     },
+};
+
+/* The synthetic articles. */
+struct article {
+    size_t size;   /* Size of the body. */
+    bool binary;   /* Whether it is posted to the binaries group. */
+    TOKEN token;   /* Token returned by SMstore. */
+    bool stored;   /* Whether SMstore succeeded. */
+};
+
+/* Statistics for one phase of the benchmark. */
+struct phase {
+    const char *name;
+    unsigned long ops;
+    unsigned long failed;
+    double bytes;
+    double elapsed;
+    struct histogram latency;
+};
+
+static const char usage[] = "\
+Usage: smbench [-k] [-b percent] [-d dir] [-m methods] [-n articles]\n\
+               [-r reads] [-s seed]\n\
+\n\
+    -b percent  Percentage of binary articles (default 5)\n\
+    -d dir      Directory in which to build the spools (default pathtmp)\n\
+    -k          Keep the spools after the benchmark\n\
+    -m methods  Comma-separated storage methods to benchmark (default\n\
+                cnfs,timecaf,timehash,tradspool)\n\
+    -n articles Number of articles to store (default 5000)\n\
+    -r reads    Number of random retrievals (default twice the articles)\n\
+    -s seed     Seed of the random generator (default 1)\n";
+
+/* Command-line options. */
+static unsigned long binary_percent = 5;
+static unsigned long narticles = 5000;
+static unsigned long nreads = 0;
+static unsigned int seed = 1;
+static bool keep = false;
+
+/* A block of body lines, from which the body of every article is taken. */
+static char *body;
+static size_t body_size;
+
+
+/*
+**  Write a file in the scratch spool, dying on failure.
+*/
+static void
+write_file(const char *dir, const char *name, const char *contents)
+{
+    char *path;
+    FILE *f;
+
+    path = concatpath(dir, name);
+    f = fopen(path, "w");
+    if (f == NULL)
+        sysdie("cannot create %s", path);
+    if (fputs(contents, f) == EOF || fclose(f) == EOF)
+        sysdie("cannot write %s", path);
+    free(path);
+}
+
+
+/*
+**  Create a directory in the scratch spool and return its path.
+*/
+static char *
+make_dir(const char *dir, const char *name)
+{
+    char *path;
+
+    path = concatpath(dir, name);
+    if (mkdir(path, 0755) < 0 && errno != EEXIST)
+        sysdie("cannot create %s", path);
+    return path;
+}
+
+
+/*
+**  Remove a directory tree.
+*/
+static void
+remove_tree(const char *path)
+{
+    DIR *dir;
+    struct dirent *de;
+    struct stat st;
+    char *child;
+
+    if (lstat(path, &st) < 0)
+        return;
+    if (S_ISDIR(st.st_mode)) {
+        dir = opendir(path);
+        if (dir != NULL) {
+            while ((de = readdir(dir)) != NULL) {
+                if (strcmp(de->d_name, ".") == 0
+                    || strcmp(de->d_name, "..") == 0)
+                    continue;
+                child = concatpath(path, de->d_name);
+                remove_tree(child);
+                free(child);
+            }
+            closedir(dir);
+        }
+        if (rmdir(path) < 0)
+            syswarn("cannot remove %s", path);
+    } else if (unlink(path) < 0)
+        syswarn("cannot remove %s", path);
+}
+
+
+/*
+**  Choose the sizes of the articles, returning the total size.
+*/
+static double
+make_articles(struct article *articles)
+{
+    unsigned long i;
+    double total = 0;
+
+    for (i = 0; i < narticles; i++) {
+        articles[i].binary =
+            (unsigned long) (random() % 100) < binary_percent;
+        if (articles[i].binary)
+            articles[i].size = BINARY_MIN + random() % BINARY_SPREAD;
+        else {
+            articles[i].size = TEXT_MIN + random() % TEXT_SPREAD;
+            if (random() % 10 == 0)
+                articles[i].size += random() % TEXT_TAIL;
+        }
+        total += articles[i].size;
+    }
+    return total;
+}
+
+
+/*
+**  Fill the block of body lines with random characters.  Lines never start
+**  with a period, so no dot-stuffing is needed.
+*/
+static void
+make_body(size_t size)
+{
+    static const char chars[] =
+        "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    size_t i;
+
+    body_size = (size / LINE_LENGTH + 1) * LINE_LENGTH;
+    body = xmalloc(body_size);
+    for (i = 0; i < body_size; i++) {
+        if (i % LINE_LENGTH == LINE_LENGTH - 2)
+            body[i] = '\r';
+        else if (i % LINE_LENGTH == LINE_LENGTH - 1)
+            body[i] = '\n';
+        else
+            body[i] = chars[random() % (sizeof(chars) - 1)];
+    }
+}
+
+
+/*
+**  Build article n in wire format into buffer, returning its length and
+**  setting groups to the Xref-style list of newsgroups the storage methods
+**  expect.
+*/
+static size_t
+format_article(struct buffer *buffer, const struct article *article,
+               unsigned long n, char **groups)
+{
+    const char *group;
+    size_t lines, offset, xref;
+
+    group = article->binary ? "bench.binaries" : "bench.text";
+    lines = article->size / LINE_LENGTH + 1;
+    offset = (random() % (body_size / LINE_LENGTH - lines + 1)) * LINE_LENGTH;
+    buffer_sprintf(buffer,
+                   "Path: bench!not-for-mail\r\n"
+                   "From: smbench <smbench@example.com>\r\n"
+                   "Newsgroups: %s\r\n"
+                   "Subject: smbench article %lu\r\n"
+                   "Message-ID: <%lu.%ld@smbench.example.com>\r\n"
+                   "Date: %s\r\n"
+                   "Lines: %lu\r\n"
+                   "Xref: bench ",
+                   group, n, n, (long) getpid(), "1 Jan 2024 00:00:00 +0000",
+                   (unsigned long) lines);
+    xref = buffer->left;
+    buffer_append_sprintf(buffer, "%s:%lu\r\n\r\n", group, n + 1);
+    buffer_append(buffer, body + offset, lines * LINE_LENGTH);
+    buffer_append(buffer, ".\r\n", 3);
+    *groups = buffer->data + xref;
+    return buffer->left;
+}
+
+
+/*
+**  Return the current time in seconds from a monotonic clock if there is
+**  one.  Only differences between two results matter.
+*/
+static double
+now(void)
+{
+#ifdef HAVE_CLOCK_GETTIME
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+        return (double) ts.tv_sec + (double) ts.tv_nsec * 1.0e-9;
+#endif
+    return TMRnow_double();
+}
+
+
+/*
+**  Start and end the timing of one operation of a phase.
+*/
+static double
+phase_start(void)
+{
+    return now();
+}
+
+static void
+phase_record(struct phase *phase, double start, size_t bytes, bool success)
+{
+    double elapsed;
+
+    elapsed = now() - start;
+    phase->elapsed += elapsed;
+    phase->ops++;
+    phase->bytes += bytes;
+    if (!success)
+        phase->failed++;
+    histogram_record(&phase->latency, (unsigned long) (elapsed * 1e6));
+}
+
+
+/*
+**  Print the results of one phase.
+*/
+static void
+phase_print(const struct phase *phase)
+{
+    const struct histogram *h = &phase->latency;
+    double elapsed, p50, p90, p99, max;
+
+    elapsed = phase->elapsed > 0 ? phase->elapsed : 1e-9;
+    p50 = histogram_percentile(h, 50);
+    p90 = histogram_percentile(h, 90);
+    p99 = histogram_percentile(h, 99);
+    max = h->max;
+    printf("%-10s %8lu %9.3f %10.1f %8.1f %8.3f %8.3f %8.3f %8.3f", phase->name,
+           phase->ops, phase->elapsed, phase->ops / elapsed,
+           phase->bytes / elapsed / (1024 * 1024), p50 / 1000, p90 / 1000,
+           p99 / 1000, max / 1000);
+    if (phase->failed > 0)
+        printf("  (%lu failed)", phase->failed);
+    printf("\n");
+}
+
+
+/*
+**  Build the scratch spool for a storage method under dir and point innconf
+**  at it.  cycsize is the size of the CNFS buffer in kilobytes.
+*/
+static void
+setup_spool(const struct method *method, const char *dir,
+            unsigned long cycsize)
+{
+    char *conf, *path;
+    int fd;
+
+    innconf->pathetc = make_dir(dir, "etc");
+    innconf->pathdb = make_dir(dir, "db");
+    innconf->pathspool = make_dir(dir, "spool");
+    innconf->patharticles = make_dir(innconf->pathspool, "articles");
+    innconf->storeonxref = true;
+
+    xasprintf(&conf, "method %s {\n    newsgroups: *\n    class: 0\n%s}\n",
+              method->name, method->options);
+    write_file(innconf->pathetc, "storage.conf", conf);
+    free(conf);
+    write_file(innconf->pathdb, "active",
+               "bench.binaries 0000000000 0000000001 y\n"
+               "bench.text 0000000000 0000000001 y\n");
+    write_file(innconf->pathspool, "tradspool.map", "");
+
+    if (strcmp(method->name, "cnfs") == 0) {
+        path = concatpath(innconf->pathspool, "cycbuff");
+        fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0 || ftruncate(fd, (off_t) cycsize * 1024) < 0)
+            sysdie("cannot create %s", path);
+        close(fd);
+        xasprintf(&conf,
+                  "cycbuffupdate:25\n"
+                  "refreshinterval:30\n"
+                  "cycbuff:BENCH1:%s:%lu\n"
+                  "metacycbuff:BENCH:BENCH1\n",
+                  path, cycsize);
+        write_file(innconf->pathetc, "cycbuff.conf", conf);
+        free(conf);
+        free(path);
+    }
+}
+
+
+/*
+**  Run the benchmark for one storage method, in a child process.
+*/
+static void
+run(const struct method *method, const char *dir, struct article *articles,
+    double total)
+{
+    struct phase store = {"store", 0, 0, 0, 0, {0, 0, 0, {0}}};
+    struct phase seq = {"seqread", 0, 0, 0, 0, {0, 0, 0, {0}}};
+    struct phase rnd = {"randread", 0, 0, 0, 0, {0, 0, 0, {0}}};
+    struct phase head = {"headread", 0, 0, 0, 0, {0, 0, 0, {0}}};
+    struct phase scan = {"scan", 0, 0, 0, 0, {0, 0, 0, {0}}};
+    struct phase cancel = {"cancel", 0, 0, 0, 0, {0, 0, 0, {0}}};
+    struct buffer *buffer;
+    ARTHANDLE handle = ARTHANDLE_INITIALIZER;
+    ARTHANDLE *art;
+    struct iovec iov;
+    double start;
+    unsigned long i, n, swap, *order;
+    bool value = true;
+    char *groups;
+
+    /* Leave room for the headers, and for CNFS block alignment. */
+    setup_spool(method, dir,
+                (unsigned long) ((total * 1.25 + narticles * 1024.0) / 1024)
+                    + 1024);
+    if (!SMsetup(SM_RDWR, &value) || !SMsetup(SM_PREOPEN, &value))
+        die("cannot set up the storage manager");
+    if (!SMinit())
+        die("cannot initialize the storage manager: %s", SMerrorstr);
+
+    buffer = buffer_new();
+    handle.type = TOKEN_EMPTY;
+    handle.iov = &iov;
+    handle.iovcnt = 1;
+    for (i = 0; i < narticles; i++) {
+        buffer_set(buffer, NULL, 0);
+        handle.len = format_article(buffer, &articles[i], i, &groups);
+        handle.data = buffer->data;
+        handle.groups = groups;
+        handle.groupslen = strcspn(groups, "\r");
+        handle.arrived = time(NULL);
+        iov.iov_base = buffer->data;
+        iov.iov_len = handle.len;
+        start = phase_start();
+        articles[i].token = SMstore(handle);
+        articles[i].stored = (articles[i].token.type != TOKEN_EMPTY);
+        phase_record(&store, start, handle.len, articles[i].stored);
+    }
+    start = phase_start();
+    SMflushcacheddata(SM_ALL);
+    store.elapsed += now() - start;
+    buffer_free(buffer);
+
+    for (i = 0; i < narticles; i++) {
+        if (!articles[i].stored)
+            continue;
+        start = phase_start();
+        art = SMretrieve(articles[i].token, RETR_ALL);
+        phase_record(&seq, start, art == NULL ? 0 : art->len, art != NULL);
+        if (art != NULL)
+            SMfreearticle(art);
+    }
+
+    for (n = 0; n < nreads; n++) {
+        i = random() % narticles;
+        if (!articles[i].stored)
+            continue;
+        start = phase_start();
+        art = SMretrieve(articles[i].token, RETR_ALL);
+        phase_record(&rnd, start, art == NULL ? 0 : art->len, art != NULL);
+        if (art != NULL)
+            SMfreearticle(art);
+    }
+
+    for (n = 0; n < nreads; n++) {
+        i = random() % narticles;
+        if (!articles[i].stored)
+            continue;
+        start = phase_start();
+        art = SMretrieve(articles[i].token, RETR_HEAD);
+        phase_record(&head, start, art == NULL ? 0 : art->len, art != NULL);
+        if (art != NULL)
+            SMfreearticle(art);
+    }
+
+    art = NULL;
+    for (;;) {
+        start = phase_start();
+        art = SMnext(art, RETR_ALL);
+        if (art == NULL)
+            break;
+        phase_record(&scan, start, art->len, art->len > 0);
+    }
+
+    /* Cancel in random order. */
+    order = xmalloc(narticles * sizeof(unsigned long));
+    for (i = 0; i < narticles; i++)
+        order[i] = i;
+    for (i = narticles; i > 1; i--) {
+        n = random() % i;
+        swap = order[i - 1];
+        order[i - 1] = order[n];
+        order[n] = swap;
+    }
+    for (n = 0; n < narticles; n++) {
+        i = order[n];
+        if (!articles[i].stored)
+            continue;
+        start = phase_start();
+        value = SMcancel(articles[i].token);
+        phase_record(&cancel, start, 0, value);
+    }
+    free(order);
+    SMshutdown();
+
+    printf("%s: %lu articles, %.1f MB\n", method->name, narticles,
+           total / (1024 * 1024));
+    printf("%-10s %8s %9s %10s %8s %8s %8s %8s %8s\n", "phase", "ops",
+           "seconds", "ops/s", "MB/s", "p50 ms", "p90 ms", "p99 ms",
+           "max ms");
+    phase_print(&store);
+    phase_print(&seq);
+    phase_print(&rnd);
+    phase_print(&head);
+    phase_print(&scan);
+    phase_print(&cancel);
+    printf("\n");
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    struct article *articles;
+    const struct method *method;
+    char *methodlist = NULL;
+    char *dir = NULL;
+    char *spool, *name;
+    double total;
+    pid_t pid;
+    int option, status;
+    size_t i;
+    bool failed = false;
+
+    message_program_name = "smbench";
+    while ((option = getopt(argc, argv, "b:d:km:n:r:s:")) != EOF) {
+        switch (option) {
+        case 'b':
+            binary_percent = strtoul(optarg, NULL, 10);
+            break;
+        case 'd':
+            dir = optarg;
+            break;
+        case 'k':
+            keep = true;
+            break;
+        case 'm':
+            methodlist = optarg;
+            break;
+        case 'n':
+            narticles = strtoul(optarg, NULL, 10);
+            break;
+        case 'r':
+            nreads = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "%s", usage);
+            exit(1);
+        }
+    }
+    if (argc != optind || narticles == 0 || binary_percent > 100)
+        die("%s", usage);
+    if (nreads == 0)
+        nreads = 2 * narticles;
+    if (methodlist == NULL)
+        methodlist = xstrdup("cnfs,timecaf,timehash,tradspool");
+
+    if (!innconf_read(NULL))
+        exit(1);
+    if (dir == NULL)
+        dir = innconf->pathtmp;
+
+    /* Every method gets the same articles. */
+    srandom(seed);
+    articles = xcalloc(narticles, sizeof(struct article));
+    total = make_articles(articles);
+    make_body(BINARY_MIN + BINARY_SPREAD);
+
+    for (name = strtok(methodlist, ","); name != NULL;
+         name = strtok(NULL, ",")) {
+        method = NULL;
+        for (i = 0; i < ARRAY_SIZE(methods); i++)
+            if (strcmp(methods[i].name, name) == 0)
+                method = &methods[i];
+        if (method == NULL)
+            die("unknown storage method %s", name);
+
+        xasprintf(&spool, "%s/smbench.%s.%ld", dir, name, (long) getpid());
+        if (mkdir(spool, 0755) < 0)
+            sysdie("cannot create %s", spool);
+        fflush(stdout);
+        pid = fork();
+        if (pid < 0)
+            sysdie("cannot fork");
+        if (pid == 0) {
+            srandom(seed);
+            run(method, spool, articles, total);
+            exit(0);
+        }
+        if (waitpid(pid, &status, 0) < 0)
+            sysdie("cannot wait for the %s benchmark", name);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            warn("%s benchmark failed", name);
+            failed = true;
+        }
+        if (!keep)
+            remove_tree(spool);
+        free(spool);
+    }
+    free(articles);
+    free(body);
+    exit(failed ? 1 : 0);
+}
@@ -0,0 +1,186 @@
+/*
+**  Display the timers exported by INN programs.
+**
+**  When the timerexport parameter is set in inn.conf, innd, nnrpd and
+**  innfeed keep a histogram of the durations of each of their timers in a
+**  file in pathrun (see TMRexport in include/inn/timer.h).  This program
+**  reads those files while the programs are running and prints the count,
+**  mean and percentiles of each timer, in milliseconds, or the same data in
+**  the Prometheus text format with -p.
+**
+**  Usage: timerstat [-p] [file ...]
+**
+**  Without any file, all the *.timers files in pathrun are read.
+*/
+
+#include "portable/system.h"
+
+#include "portable/mmap.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "inn/histogram.h"
+#include "inn/innconf.h"
+#include "inn/libinn.h"
+#include "inn/messages.h"
+#include "inn/timer.h"
+
+static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+
+/*
+**  Return a percentile of a histogram in seconds.
+*/
+static double
+seconds(const struct histogram *h, double percent)
+{
+    unsigned long value;
+
+    value = histogram_percentile(h, percent);
+    return (double) value / 1e6;
+}
+
+
+/*
+**  Print the timers of one export file.  The program name for Prometheus
+**  labels is the start of the file name.
+*/
+static void
+show(const char *path, bool prometheus)
+{
+    const struct timer_export *export;
+    const struct histogram *h;
+    struct stat st;
+    char *program, *p;
+    time_t started;
+    unsigned long slots, i;
+    size_t q;
+    bool running;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        syswarn("cannot open %s", path);
+        return;
+    }
+    if (fstat(fd, &st) < 0 || st.st_size != sizeof(struct timer_export)) {
+        warn("%s is not a timer export file", path);
+        close(fd);
+        return;
+    }
+    export = mmap(NULL, sizeof(struct timer_export), PROT_READ, MAP_SHARED,
+                  fd, 0);
+    close(fd);
+    if (export == MAP_FAILED) {
+        syswarn("cannot mmap %s", path);
+        return;
+    }
+    if (export->magic != TMR_EXPORT_MAGIC) {
+        warn("%s is not a timer export file", path);
+        munmap((void *) export, sizeof(struct timer_export));
+        return;
+    }
+
+    p = strrchr(path, '/');
+    program = xstrdup(p == NULL ? path : p + 1);
+    program[strcspn(program, "-.")] = '\0';
+    running = (kill((pid_t) export->pid, 0) == 0 || errno == EPERM);
+    slots = export->slots;
+    if (slots > TMR_EXPORT_SLOTS)
+        slots = TMR_EXPORT_SLOTS;
+
+    if (!prometheus) {
+        started = (time_t) export->started;
+        printf("%s: pid %ld%s, since %s", path, export->pid,
+               running ? "" : " (not running)", ctime(&started));
+        printf("%-32s %9s %9s %9s %9s %9s %9s\n", "timer (ms)", "count",
+               "mean", "p50", "p90", "p99", "max");
+    }
+    for (i = 0; i < slots; i++) {
+        h = &export->slot[i].latency;
+        if (prometheus) {
+            if (!running)
+                continue;
+            for (q = 0; q < ARRAY_SIZE(quantiles); q++)
+                printf("inn_timer_seconds{program=\"%s\",pid=\"%ld\","
+                       "timer=\"%.*s\",quantile=\"%g\"} %.6f\n",
+                       program, export->pid, TMR_EXPORT_NAMELEN,
+                       export->slot[i].name, quantiles[q],
+                       seconds(h, quantiles[q] * 100));
+            printf("inn_timer_seconds_sum{program=\"%s\",pid=\"%ld\","
+                   "timer=\"%.*s\"} %.6f\n",
+                   program, export->pid, TMR_EXPORT_NAMELEN,
+                   export->slot[i].name, h->total / 1e6);
+            printf("inn_timer_seconds_count{program=\"%s\",pid=\"%ld\","
+                   "timer=\"%.*s\"} %lu\n",
+                   program, export->pid, TMR_EXPORT_NAMELEN,
+                   export->slot[i].name, h->count);
+        } else {
+            printf("%-32.*s %9lu %9.3f %9.3f %9.3f %9.3f %9.3f\n",
+                   TMR_EXPORT_NAMELEN, export->slot[i].name, h->count,
+                   histogram_mean(h) / 1000., seconds(h, 50) * 1000.,
+                   seconds(h, 90) * 1000., seconds(h, 99) * 1000.,
+                   (double) h->max / 1000.);
+        }
+    }
+    if (!prometheus)
+        printf("\n");
+
+    free(program);
+    munmap((void *) export, sizeof(struct timer_export));
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    DIR *dir;
+    struct dirent *de;
+    bool prometheus = false;
+    char *path;
+    size_t len;
+    int option;
+
+    message_program_name = "timerstat";
+    while ((option = getopt(argc, argv, "p")) != EOF) {
+        switch (option) {
+        case 'p':
+            prometheus = true;
+            break;
+        default:
+            die("usage: timerstat [-p] [file ...]");
+        }
+    }
+    argc -= optind;
+    argv += optind;
+
+    if (prometheus) {
+        printf("# HELP inn_timer_seconds Durations of INN timers.\n");
+        printf("# TYPE inn_timer_seconds summary\n");
+    }
+    if (argc > 0) {
+        for (; *argv != NULL; argv++)
+            show(*argv, prometheus);
+        exit(0);
+    }
+
+    if (!innconf_read(NULL))
+        exit(1);
+    dir = opendir(innconf->pathrun);
+    if (dir == NULL)
+        sysdie("cannot open %s", innconf->pathrun);
+    while ((de = readdir(dir)) != NULL) {
+        len = strlen(de->d_name);
+        if (len <= 7 || strcmp(de->d_name + len - 7, ".timers") != 0)
+            continue;
+        path = concatpath(innconf->pathrun, de->d_name);
+        show(path, prometheus);
+        free(path);
+    }
+    closedir(dir);
+    exit(0);
+}
@@ -6,6 +6,9 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <syslog.h>
 #include <time.h>
@@ -45,7 +48,8 @@ getloadavg(double loadavg[], int nelem)
 #endif
 
 static const char usage[] = "\
-Usage: makehistory [-abFIOSx] [-f file] [-l count] [-L load] [-s size] [-T tmpdir]\n\
+Usage: makehistory [-abFIORSx] [-f file] [-l count] [-L load] [-P workers]\n\
+                   [-s size] [-T tmpdir]\n\
 \n\
     -a          open output history file in append mode\n\
     -b          delete bad articles from spool\n\
@@ -55,6 +59,8 @@ Usage: makehistory [-abFIOSx] [-f file] [-l count] [-L load] [-s size] [-T tmpdi
     -l count    size of overview updates (default 10000)\n\
     -L load     pause when load average exceeds threshold\n\
     -O          create overview entries for articles\n\
+    -P workers  walk the spool with that many parallel processes\n\
+    -R          write checkpoints and resume from the last one\n\
     -S          write overview data to standard output\n\
     -s size     size new history database for approximately size entries\n\
     -T tmpdir   use directory tmpdir for temporary files\n\
@@ -75,6 +81,12 @@ typedef struct _ARTOVERFIELD {
 
 #define DEFAULT_SEGSIZE 10000
 
+/* How often, in seconds, to write a checkpoint with -R. */
+#define CHECKPOINT_INTERVAL 300
+
+/* The largest number of workers -P accepts. */
+#define MAX_WORKERS 256
+
 static bool NukeBadArts;
 static char *ActivePath = NULL;
 static char *HistoryPath = NULL;
@@ -88,6 +100,10 @@ static int OverTmpSegSize, OverTmpSegCount;
 static FILE *OverTmpFile;
 static char *OverTmpPath = NULL;
 static bool NoHistory;
+static FILE *HistoryTmp = NULL;
+static char *CheckpointPath = NULL;
+static time_t CheckpointNext;
+static bool Resuming = false;
 static OVSORTTYPE sorttype;
 static bool WriteStdout = false;
 
@@ -142,6 +158,42 @@ GetMessageID(char *p)
 **  The sorting/batching helps improve efficiency.
 */
 
+/*
+**  Whether overview already has the data of an article.  It may when
+**  resuming, since the overview data written after the last checkpoint of
+**  the interrupted run is not rolled back.  The article is looked up in the
+**  first newsgroup of the last Xref header field, as OVadd uses.
+*/
+static bool
+OverviewPresent(const TOKEN *token, const char *data, int len)
+{
+    const char *xref = NULL;
+    const char *p, *group, *end;
+    char *name;
+    ARTNUM artnum;
+    TOKEN present;
+    bool found;
+
+    for (p = data; (p = memchr(p, 'X', len - (p - data))) != NULL; p++)
+        if (p != data && p[-1] == '\t' && len - (p - data) > 6
+            && memcmp(p, "Xref: ", 6) == 0)
+            xref = p + 6;
+    if (xref == NULL)
+        return false;
+    if ((group = memchr(xref, ' ', len - (xref - data))) == NULL)
+        return false;
+    group++;
+    if ((end = memchr(group, ':', len - (group - data))) == NULL)
+        return false;
+    artnum = strtoul(end + 1, NULL, 10);
+    name = xstrndup(group, end - group);
+    found = OVgetartinfo(name, artnum, &present) && present.type == token->type
+            && memcmp(present.token, token->token, sizeof(token->token)) == 0;
+    free(name);
+    return found;
+}
+
+
 /*
 **  Flush the unwritten OverTempFile data to disk, sort the file, read it
 **  back in, and add it to overview.
@@ -167,6 +219,7 @@ FlushOverTmpFile(void)
     if (fflush(OverTmpFile) == EOF || ferror(OverTmpFile)
         || fclose(OverTmpFile) == EOF)
         sysdie("cannot close temporary overview file");
+    OverTmpFile = NULL;
     if (Fork) {
         if (!first) { /* if previous one is running, wait for it */
             int status;
@@ -288,6 +341,8 @@ FlushOverTmpFile(void)
             expires = (time_t) atol(p);
         }
         token = TextToToken(q);
+        if (Resuming && OverviewPresent(&token, r, strlen(r)))
+            continue;
         if (OVadd(token, r, strlen(r), arrived, expires) == OVADDFAILED) {
             if (OVctl(OVSPACE, (void *) &f)
                 && (int) (f + 0.01f) == OV_NOSPACE) {
@@ -355,6 +410,8 @@ WriteOverLine(TOKEN *token, const char *xrefs, int xrefslen, char *overdata,
             if (fwrite(overdata, 1, overlen, Overchan) != (size_t) overlen)
                 sysdie("writing overview failed");
             fputc('\n', Overchan);
+        } else if (Resuming && OverviewPresent(token, overdata, overlen)) {
+            return;
         } else if (OVadd(*token, overdata, overlen, arrived, expires)
                    == OVADDFAILED) {
             if (OVctl(OVSPACE, (void *) &f)
@@ -828,7 +885,13 @@ DoArt(ARTHANDLE *art)
                       buffer.data, buffer.left, Arrived, Expires);
     }
 
-    if (!NoHistory) {
+    if (HistoryTmp != NULL) {
+        if (fprintf(HistoryTmp, "%s\t%ld\t%ld\t%ld\t%s\n", MessageID,
+                    (long) Arrived, (long) Posted, (long) Expires,
+                    TokenToText(*art->token))
+            == EOF)
+            sysdie("cannot write temporary history file");
+    } else if (!NoHistory) {
         bool r;
 
         r = HISwrite(History, MessageID, Arrived, Posted, Expires, art->token);
@@ -882,13 +945,321 @@ OverAddAllNewsgroups(void)
 }
 
 
+/*
+**  Guess how many entries the new history will have from the number of lines
+**  of the current history file, so that the dbz index is sized right from
+**  the start and doesn't need rebuilding with makedbz afterwards.  Returns 0
+**  if there is no current history file, for the default size.
+*/
+static size_t
+EstimatePairs(void)
+{
+    char *path;
+    char buff[64 * 1024];
+    const char *p, *end;
+    size_t count = 0;
+    ssize_t n;
+    int fd;
+
+    path = concatpath(innconf->pathdb, INN_PATH_HISTORY);
+    fd = open(path, O_RDONLY);
+    free(path);
+    if (fd < 0)
+        return 0;
+    while ((n = read(fd, buff, sizeof(buff))) > 0)
+        for (p = buff, end = buff + n;
+             (p = memchr(p, '\n', end - p)) != NULL; p++)
+            count++;
+    close(fd);
+    return count;
+}
+
+
+/*
+**  Record in the checkpoint file the last article handled, once the history
+**  and overview data of all the articles up to it are written.  The size of
+**  the history file is saved too, since the entries written after the last
+**  checkpoint are dropped when resuming: the dbz index on disk only knows
+**  about the ones before.
+*/
+static void
+WriteCheckpoint(const TOKEN *token)
+{
+    char *tmp;
+    FILE *F;
+    struct stat st;
+    off_t size = 0;
+
+    if (DoOverview && sorttype != OVNOSORT)
+        FlushOverTmpFile();
+    if (!NoHistory) {
+        if (!HISsync(History))
+            sysdie("cannot sync history file");
+        if (stat(HistoryPath, &st) < 0)
+            sysdie("cannot stat %s", HistoryPath);
+        size = st.st_size;
+    }
+    tmp = concat(CheckpointPath, ".new", (char *) 0);
+    if ((F = fopen(tmp, "w")) == NULL)
+        sysdie("cannot create %s", tmp);
+    fprintf(F, "%s %lu\n", TokenToText(*token), (unsigned long) size);
+    if (fflush(F) == EOF || ferror(F) || fsync(fileno(F)) < 0
+        || fclose(F) == EOF)
+        sysdie("cannot write %s", tmp);
+    if (rename(tmp, CheckpointPath) < 0)
+        sysdie("cannot rename %s to %s", tmp, CheckpointPath);
+    free(tmp);
+}
+
+
+/*
+**  Read the checkpoint file left by an interrupted run.  Returns false if
+**  there is none.
+*/
+static bool
+ReadCheckpoint(TOKEN *token, off_t *size)
+{
+    FILE *F;
+    char buff[SMBUF];
+    char *p;
+
+    if ((F = fopen(CheckpointPath, "r")) == NULL) {
+        if (errno == ENOENT)
+            return false;
+        sysdie("cannot open %s", CheckpointPath);
+    }
+    if (fgets(buff, sizeof(buff), F) == NULL || (p = strchr(buff, ' ')) == NULL)
+        die("bad checkpoint file %s", CheckpointPath);
+    fclose(F);
+    *p++ = '\0';
+    if (!IsToken(buff))
+        die("bad checkpoint file %s", CheckpointPath);
+    *token = TextToToken(buff);
+    *size = (off_t) strtoul(p, NULL, 10);
+    return true;
+}
+
+
+/*
+**  Scan the spool (or the part of it given to this process), nuke any bad
+**  arts if needed, and process each article.  We take a break when the load
+**  is too high.  When resuming, the storage manager starts the walk at the
+**  article of the checkpoint, which is checked and skipped.  The storage
+**  class is not compared since some methods only know it once the article
+**  is read.
+*/
+static void
+WalkSpool(int LoadAverage, const TOKEN *resume)
+{
+    ARTHANDLE *art = NULL;
+    double load[1];
+
+    CheckpointNext = time(NULL) + CHECKPOINT_INTERVAL;
+    if (resume != NULL) {
+        art = SMnext(NULL, RETR_STAT);
+        if (art == NULL || art->token == NULL
+            || art->token->type != resume->type
+            || memcmp(art->token->token, resume->token, sizeof(resume->token))
+                   != 0)
+            die("cannot find %s from the checkpoint in the spool",
+                TokenToText(*resume));
+    }
+
+    while ((art = SMnext(art, RETR_ALL)) != NULL) {
+        if (art->len == 0) {
+            if (NukeBadArts && art->data == NULL && art->token != NULL)
+                SMcancel(*art->token);
+            continue;
+        }
+
+        DoArt(art);
+
+        if (CheckpointPath != NULL && time(NULL) >= CheckpointNext) {
+            WriteCheckpoint(art->token);
+            CheckpointNext = time(NULL) + CHECKPOINT_INTERVAL;
+        }
+
+        if (LoadAverage > 0) {
+            while (getloadavg(load, 1) > 0 && (int) (load[0]) >= LoadAverage) {
+                sleep(1);
+            }
+        }
+    }
+}
+
+
+/*
+**  Start a worker walking one part of the spool.  Workers add overview data
+**  themselves, sorted by newsgroup in each of their batches, since all the
+**  overview methods accept several writers.  They cannot share the history
+**  file though, so they write their history entries to a temporary file the
+**  parent adds to history once all of them are done.
+*/
+static pid_t
+StartWorker(unsigned int part, unsigned int count, FILE *histtmp,
+            int LoadAverage)
+{
+    struct smpartition partition;
+    bool val;
+    pid_t pid;
+
+    fflush(stdout);
+    fflush(stderr);
+    pid = fork();
+    if (pid < 0)
+        sysdie("cannot fork worker");
+    if (pid > 0)
+        return pid;
+
+    HistoryTmp = histtmp;
+    partition.part = part;
+    partition.count = count;
+    val = true;
+    if (!SMsetup(SM_RDWR, (void *) &val)
+        || !SMsetup(SM_PREOPEN, (void *) &val)
+        || !SMsetup(SM_PARTITION, (void *) &partition))
+        sysdie("cannot set up storage manager");
+    if (!SMinit())
+        sysdie("cannot initialize storage manager: %s", SMerrorstr);
+    if (DoOverview) {
+        if (!OVopen(OV_WRITE))
+            sysdie("cannot open overview");
+        if (!OVctl(OVCUTOFFLOW, (void *) &Cutofflow))
+            die("cannot obtain overview cutoff information");
+    }
+
+    WalkSpool(LoadAverage, NULL);
+
+    if (DoOverview) {
+        if (sorttype != OVNOSORT)
+            FlushOverTmpFile();
+        OVclose();
+    }
+    SMshutdown();
+    if (HistoryTmp != NULL)
+        if (fflush(HistoryTmp) == EOF || ferror(HistoryTmp)
+            || fclose(HistoryTmp) == EOF)
+            sysdie("cannot close temporary history file");
+    exit(0);
+}
+
+
+/*
+**  Add to history the entries written by a worker to its temporary file,
+**  then remove it.
+*/
+static void
+ReplayHistory(const char *path)
+{
+    QIOSTATE *qp;
+    int count;
+    char *line;
+    char *fields[5];
+    time_t arrived, posted, expires;
+    TOKEN token;
+    int i;
+
+    if ((qp = QIOopen(path)) == NULL)
+        sysdie("cannot open temporary history file %s", path);
+    for (count = 1; (line = QIOread(qp)) != NULL; count++) {
+        fields[0] = line;
+        for (i = 1; i < 5; i++) {
+            fields[i] = strchr(fields[i - 1], '\t');
+            if (fields[i] == NULL)
+                break;
+            *fields[i]++ = '\0';
+        }
+        if (i < 5 || !IsToken(fields[4])) {
+            warn("temporary history file %s has a bad line at %d", path,
+                 count);
+            continue;
+        }
+        arrived = (time_t) atol(fields[1]);
+        posted = (time_t) atol(fields[2]);
+        expires = (time_t) atol(fields[3]);
+        token = TextToToken(fields[4]);
+        if (!HISwrite(History, fields[0], arrived, posted, expires, &token))
+            sysdie("cannot write history line");
+    }
+    if (QIOtoolong(qp))
+        die("temporary history file %s line %d is too long", path, count);
+    if (QIOerror(qp))
+        sysdie("cannot read %s around line %d", path, count);
+    QIOclose(qp);
+    unlink(path);
+}
+
+
+/*
+**  Walk the spool with count workers and wait for all of them.  Returns the
+**  paths of the temporary history files they wrote, empty if no history is
+**  generated.
+*/
+static struct vector *
+RunWorkers(unsigned int count, int LoadAverage)
+{
+    struct vector *paths;
+    pid_t *pids;
+    FILE *histtmp = NULL;
+    char *path;
+    unsigned int i, running;
+    int fd, status;
+    pid_t pid;
+
+    paths = vector_new();
+    pids = xcalloc(count, sizeof(pid_t));
+    for (i = 0; i < count; i++) {
+        if (!NoHistory) {
+            path = concatpath(TmpDir, "hisPXXXXXX");
+            fd = mkstemp(path);
+            if (fd < 0)
+                sysdie("cannot create temporary file");
+            histtmp = fdopen(fd, "w");
+            if (histtmp == NULL)
+                sysdie("cannot open %s", path);
+            vector_add(paths, path);
+            free(path);
+        }
+        pids[i] = StartWorker(i, count, histtmp, LoadAverage);
+        if (histtmp != NULL)
+            fclose(histtmp);
+    }
+
+    for (running = count; running > 0;) {
+        pid = wait(&status);
+        if (pid < 0) {
+            if (errno == EINTR)
+                continue;
+            sysdie("cannot wait for workers");
+        }
+        for (i = 0; i < count; i++)
+            if (pids[i] == pid)
+                break;
+        if (i == count)
+            continue;
+        pids[i] = 0;
+        running--;
+        if ((WIFEXITED(status) && WEXITSTATUS(status) != 0)
+            || WIFSIGNALED(status)) {
+            warn("worker %u failed", i);
+            for (i = 0; i < count; i++)
+                if (pids[i] != 0)
+                    kill(pids[i], SIGTERM);
+            for (i = 0; i < paths->count; i++)
+                unlink(paths->strings[i]);
+            exit(1);
+        }
+    }
+    free(pids);
+    return paths;
+}
+
+
 int
 main(int argc, char **argv)
 {
-    ARTHANDLE *art = NULL;
     bool AppendMode;
     int LoadAverage;
-    double load[1];
     int i;
     bool val;
     char *HistoryDir;
@@ -896,6 +1267,13 @@ main(int argc, char **argv)
     char *p;
     char *buff;
     size_t npairs = 0;
+    unsigned long count;
+    unsigned int Workers = 0;
+    struct vector *HistoryTmpPaths = NULL;
+    size_t j;
+    bool Resumable = false;
+    TOKEN ResumeToken;
+    off_t HistorySize = 0;
     FILE *F;
 
     /* First thing, set up logging and our identity. */
@@ -919,7 +1297,7 @@ main(int argc, char **argv)
     LoadAverage = 0;
     NoHistory = false;
 
-    while ((i = getopt(argc, argv, "abFf:Il:L:OSs:T:x")) != EOF) {
+    while ((i = getopt(argc, argv, "abFf:Il:L:OP:RSs:T:x")) != EOF) {
         switch (i) {
         case 'a':
             AppendMode = true;
@@ -945,6 +1323,21 @@ main(int argc, char **argv)
         case 'O':
             DoOverview = true;
             break;
+        case 'P':
+            errno = 0;
+            count = strtoul(optarg, &p, 10);
+            if (errno != 0 || p == optarg || *p != '\0' || count == 0
+                || count > MAX_WORKERS) {
+                warn("-P needs a number of workers between 1 and %d",
+                     MAX_WORKERS);
+                fprintf(stderr, "%s", usage);
+                exit(1);
+            }
+            Workers = count;
+            break;
+        case 'R':
+            Resumable = true;
+            break;
         case 'S':
             WriteStdout = true;
             OverTmpSegSize = 0;
@@ -969,6 +1362,12 @@ main(int argc, char **argv)
         fprintf(stderr, "%s", usage);
         exit(1);
     }
+    if (Workers > 0 && (Fork || WriteStdout))
+        die("-P cannot be used with -F or -S");
+    if (Resumable && (Fork || WriteStdout || Workers > 0))
+        die("-R cannot be used with -F, -P or -S");
+    if (Resumable)
+        CheckpointPath = concat(HistoryPath, ".checkpoint", (char *) 0);
 
     if (!NoHistory) {
         if ((p = strrchr(HistoryPath, '/')) == NULL) {
@@ -989,6 +1388,16 @@ main(int argc, char **argv)
             ensure_news_user_grp(true, true);
     }
 
+    /* Pick up where an interrupted run left off, dropping the history
+       entries written after its last checkpoint. */
+    if (CheckpointPath != NULL
+        && ReadCheckpoint(&ResumeToken, &HistorySize)) {
+        Resuming = true;
+        AppendMode = true;
+        if (!NoHistory && truncate(HistoryPath, HistorySize) < 0)
+            sysdie("cannot truncate %s", HistoryPath);
+    }
+
     /* Read in the overview schema. */
     ARTreadschema(DoOverview);
 
@@ -998,13 +1407,13 @@ main(int argc, char **argv)
             sysdie("cannot open overview");
         if (!OVctl(OVSORT, (void *) &sorttype))
             die("cannot obtain overview sort information");
-        if (!Fork) {
+        if (!Fork && Workers == 0) {
             if (!OVctl(OVCUTOFFLOW, (void *) &Cutofflow))
                 die("cannot obtain overview cutoff information");
             OverAddAllNewsgroups();
         } else {
             OverAddAllNewsgroups();
-            if (sorttype == OVNOSORT) {
+            if (Fork && sorttype == OVNOSORT) {
                 buff = concat(innconf->pathbin, "/", "overchan", NULL);
                 if ((Overchan = popen(buff, "w")) == NULL)
                     sysdie("cannot fork overchan process");
@@ -1014,20 +1423,29 @@ main(int argc, char **argv)
         }
     }
 
-    /* Init the Storage Manager. */
-    val = true;
-    if (!SMsetup(SM_RDWR, (void *) &val)
-        || !SMsetup(SM_PREOPEN, (void *) &val))
-        sysdie("cannot set up storage manager");
-    if (!SMinit())
-        sysdie("cannot initialize storage manager: %s", SMerrorstr);
+    /* Init the Storage Manager, or let the workers walk the spool before
+       opening history. */
+    if (Workers > 0)
+        HistoryTmpPaths = RunWorkers(Workers, LoadAverage);
+    else {
+        val = true;
+        if (!SMsetup(SM_RDWR, (void *) &val)
+            || !SMsetup(SM_PREOPEN, (void *) &val)
+            || (Resuming && !SMsetup(SM_RESUME, (void *) &ResumeToken)))
+            sysdie("cannot set up storage manager");
+        if (!SMinit())
+            sysdie("cannot initialize storage manager: %s", SMerrorstr);
+    }
 
     /* Initialize the history manager. */
     if (!NoHistory) {
         int flags = HIS_RDWR | HIS_INCORE;
 
-        if (!AppendMode)
+        if (!AppendMode) {
             flags |= HIS_CREAT;
+            if (npairs == 0)
+                npairs = EstimatePairs();
+        }
         History = HISopen(NULL, innconf->hismethod, flags);
         if (History == NULL)
             sysdie("cannot create history handle");
@@ -1036,26 +1454,12 @@ main(int argc, char **argv)
             sysdie("cannot open %s", HistoryPath);
     }
 
-    /*
-     * Scan the entire spool, nuke any bad arts if needed, and process each
-     * article.  We take a break when the load is too high.
-     */
-
-    while ((art = SMnext(art, RETR_ALL)) != NULL) {
-        if (art->len == 0) {
-            if (NukeBadArts && art->data == NULL && art->token != NULL)
-                SMcancel(*art->token);
-            continue;
-        }
-
-        DoArt(art);
-
-        if (LoadAverage > 0) {
-            while (getloadavg(load, 1) > 0 && (int) (load[0]) >= LoadAverage) {
-                sleep(1);
-            }
-        }
-    }
+    if (HistoryTmpPaths != NULL) {
+        for (j = 0; j < HistoryTmpPaths->count; j++)
+            ReplayHistory(HistoryTmpPaths->strings[j]);
+        vector_free(HistoryTmpPaths);
+    } else
+        WalkSpool(LoadAverage, Resuming ? &ResumeToken : NULL);
 
     if (!NoHistory) {
         /* Close history file. */
@@ -1082,7 +1486,10 @@ main(int argc, char **argv)
             fclose(F);
         }
     }
-    if (!Fork && !WriteStdout)
+    if (CheckpointPath != NULL && unlink(CheckpointPath) < 0
+        && errno != ENOENT)
+        syswarn("cannot remove %s", CheckpointPath);
+    if (!Fork && Workers == 0 && !WriteStdout)
         OVclose();
     exit(0);
 }
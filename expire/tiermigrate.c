@@ -0,0 +1,370 @@
+/*
+**  Move articles from one storage class to another.
+**
+**  Walks the history file and moves the articles of a storage class which
+**  arrived long enough ago, or have been read often or rarely enough lately,
+**  to another storage class, usually one on slower and cheaper disks, or the
+**  other way round.  Each article is stored again with the first entry of
+**  storage.conf of the new class, then its overview data and history entry
+**  are pointed at the new token and only then is the old copy cancelled, so
+**  that the article can be retrieved by message-ID all along.  Its overview
+**  entries are missing for a moment while they are replaced, since OVcancel
+**  goes by newsgroup and article number and would remove new entries added
+**  beforehand.
+**
+**  The articles are read around the shared article cache, so that moving
+**  them neither counts as reads, which -p and -r go by, nor fills the cache
+**  with articles nobody asked for.
+*/
+
+#include "portable/system.h"
+
+#include <sys/uio.h>
+#include <syslog.h>
+#include <time.h>
+
+#include "inn/history.h"
+#include "inn/innconf.h"
+#include "inn/libinn.h"
+#include "inn/messages.h"
+#include "inn/ov.h"
+#include "inn/paths.h"
+#include "inn/storage.h"
+#include "inn/wire.h"
+
+static const char usage[] = "\
+Usage: tiermigrate [-n] [-a days] [-f file] [-p reads] [-r reads]\n\
+                   -s class -t class\n";
+
+/* What to move, and what has been done so far. */
+struct migration {
+    struct history *history;
+    STORAGECLASS source;
+    STORAGECLASS target;
+    time_t cutoff;         /* If set, only move articles arrived before. */
+    unsigned int minreads; /* Only move articles read at least that often. */
+    unsigned int maxreads; /* Only move articles read less often than that. */
+    bool dryrun;
+    unsigned long moved;
+    unsigned long skipped;
+    unsigned long failed;
+};
+
+/* What became of an article Migrate was asked to move. */
+enum migrate_result {
+    MIGRATE_MOVED,
+    MIGRATE_SKIPPED, /* Already gone from the spool. */
+    MIGRATE_FAILED
+};
+
+
+/*
+**  Return a copy of the body of a header field of an article, or NULL if
+**  the article has none.
+*/
+static char *
+GetHeader(const ARTHANDLE *art, const char *name)
+{
+    const char *start, *end;
+
+    start = wire_findheader(art->data, art->len, name, true);
+    if (start == NULL)
+        return NULL;
+    end = wire_endheader(start, art->data + art->len - 1);
+    if (end == NULL || end - start < 1)
+        return NULL;
+    return xstrndup(start, end - start - 1);
+}
+
+
+/*
+**  Point the overview data of an article at its new token.  The data is
+**  read back from the entry of the first newsgroup of the Xref header
+**  field, as OVadd expects it, then all the entries of the article are
+**  replaced.  Returns false if the overview could not be changed.
+*/
+static bool
+MigrateOverview(TOKEN old, TOKEN new, const char *xref, time_t expires)
+{
+    char *group, *p, *data, *copy;
+    void *search;
+    ARTNUM artnum;
+    TOKEN token;
+    time_t arrived;
+    int len;
+    bool found = false;
+
+    /* Skip the server name and split the first group:number pair. */
+    p = strchr(xref, ' ');
+    if (p == NULL)
+        return false;
+    group = xstrdup(p + 1 + strspn(p + 1, " "));
+    group[strcspn(group, " \t\r\n")] = '\0';
+    p = strrchr(group, ':');
+    if (p == NULL) {
+        free(group);
+        return false;
+    }
+    *p = '\0';
+    artnum = strtoul(p + 1, NULL, 10);
+
+    search = OVopensearch(group, artnum, artnum);
+    free(group);
+    if (search == NULL)
+        return false;
+    copy = NULL;
+    while (OVsearch(search, &artnum, &data, &len, &token, &arrived)) {
+        if (memcmp(&token, &old, sizeof(token)) != 0)
+            continue;
+
+        /* Strip the article number and the trailing CRLF. */
+        p = memchr(data, '\t', len);
+        if (p == NULL)
+            break;
+        len -= p + 1 - data;
+        data = p + 1;
+        if (len >= 2 && data[len - 2] == '\r' && data[len - 1] == '\n')
+            len -= 2;
+        copy = xstrndup(data, len);
+        found = true;
+        break;
+    }
+    OVclosesearch(search);
+    if (!found)
+        return false;
+
+    /* The old article is still there, so that OVcancel can find the
+       newsgroups it is in.  The new entries have the same newsgroups and
+       article numbers, so they can only be added once the old ones are
+       gone.  If they cannot be added, put the old ones back. */
+    if (!OVcancel(old)) {
+        free(copy);
+        return false;
+    }
+    if (OVadd(new, copy, len, arrived, expires) != OVADDCOMPLETED) {
+        OVadd(old, copy, len, arrived, expires);
+        free(copy);
+        return false;
+    }
+    free(copy);
+    return true;
+}
+
+
+/*
+**  Move one article, given its history entry, and say whether it was moved,
+**  was already gone or could not be moved.
+*/
+static enum migrate_result
+Migrate(struct migration *m, time_t arrived, time_t posted, time_t expires,
+        TOKEN token)
+{
+    ARTHANDLE *art;
+    ARTHANDLE handle = ARTHANDLE_INITIALIZER;
+    struct iovec iov;
+    TOKEN new;
+    char *msgid, *xref, *groups;
+    enum migrate_result result = MIGRATE_FAILED;
+
+    art = SMretrieve(token, RETR_ALL);
+    if (art == NULL) {
+        /* Already expired or overwritten. */
+        return MIGRATE_SKIPPED;
+    }
+    msgid = GetHeader(art, "Message-ID");
+    xref = GetHeader(art, "Xref");
+    if (msgid == NULL || xref == NULL) {
+        warn("%s has no Message-ID or Xref header field", TokenToText(token));
+        goto done;
+    }
+
+    /* Store the article again, matching storage.conf on the same newsgroups
+       as innd did. */
+    if (innconf->storeonxref)
+        groups = strchr(xref, ' ');
+    else
+        groups = GetHeader(art, "Newsgroups");
+    if (groups == NULL) {
+        warn("%s has no newsgroups", TokenToText(token));
+        goto done;
+    }
+    iov.iov_base = (char *) art->data;
+    iov.iov_len = art->len;
+    handle.type = TOKEN_EMPTY;
+    handle.data = art->data;
+    handle.iov = &iov;
+    handle.iovcnt = 1;
+    handle.len = art->len;
+    handle.arrived = arrived;
+    handle.expires = expires;
+    handle.groups = groups + (innconf->storeonxref ? 1 : 0);
+    handle.groupslen = strlen(handle.groups);
+    new = SMstoreclass(handle, m->target);
+    if (!innconf->storeonxref)
+        free(groups);
+    if (new.type == TOKEN_EMPTY) {
+        warn("cannot store %s in class %u: %s", TokenToText(token), m->target,
+             SMerrorstr);
+        goto done;
+    }
+
+    if (innconf->enableoverview
+        && !MigrateOverview(token, new, xref, expires)) {
+        warn("cannot move the overview data of %s", TokenToText(token));
+        SMcancel(new);
+        goto done;
+    }
+    if (!HISreplace(m->history, msgid, arrived, posted, expires, &new)) {
+        warn("cannot update the history entry of %s", msgid);
+        if (innconf->enableoverview)
+            MigrateOverview(new, token, xref, expires);
+        SMcancel(new);
+        goto done;
+    }
+    SMfreearticle(art);
+    art = NULL;
+    if (!SMcancel(token) && SMerrno != SMERR_NOENT)
+        warn("cannot remove %s: %s", TokenToText(token), SMerrorstr);
+    result = MIGRATE_MOVED;
+
+done:
+    if (art != NULL)
+        SMfreearticle(art);
+    free(msgid);
+    free(xref);
+    return result;
+}
+
+
+/*
+**  History walk callback.  Decides whether an article has to move.
+*/
+static bool
+MigrateCallback(void *cookie, time_t arrived, time_t posted, time_t expires,
+                const TOKEN *token)
+{
+    struct migration *m = cookie;
+    TOKEN t;
+    unsigned int reads;
+
+    if (token->type == TOKEN_EMPTY || token->class != m->source
+        || (m->cutoff > 0 && arrived >= m->cutoff))
+        return true;
+    t = *token;
+    if (m->minreads > 0 || m->maxreads > 0) {
+        if (!SMprobe(READCOUNT, &t, &reads))
+            reads = 0;
+        if (reads < m->minreads || (m->maxreads > 0 && reads >= m->maxreads))
+            return true;
+    }
+    if (m->dryrun) {
+        printf("%s\n", TokenToText(t));
+        m->moved++;
+        return true;
+    }
+    switch (Migrate(m, arrived, posted, expires, t)) {
+    case MIGRATE_MOVED:
+        m->moved++;
+        break;
+    case MIGRATE_SKIPPED:
+        m->skipped++;
+        break;
+    case MIGRATE_FAILED:
+        m->failed++;
+        break;
+    }
+    return true;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    struct migration m;
+    const char *HistoryPath;
+    bool val;
+    bool source = false, target = false;
+    unsigned long days = 0;
+    int i;
+
+    /* First thing, set up logging and our identity. */
+    openlog("tiermigrate", L_OPENLOG_FLAGS | LOG_PID, LOG_INN_PROG);
+    message_program_name = "tiermigrate";
+
+    /* Set defaults. */
+    if (!innconf_read(NULL))
+        exit(1);
+    HistoryPath = concatpath(innconf->pathdb, INN_PATH_HISTORY);
+    memset(&m, 0, sizeof(m));
+
+    while ((i = getopt(argc, argv, "a:f:np:r:s:t:")) != EOF) {
+        switch (i) {
+        case 'a':
+            days = strtoul(optarg, NULL, 10);
+            break;
+        case 'f':
+            HistoryPath = optarg;
+            break;
+        case 'n':
+            m.dryrun = true;
+            break;
+        case 'p':
+            m.minreads = strtoul(optarg, NULL, 10);
+            break;
+        case 'r':
+            m.maxreads = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            m.source = atoi(optarg);
+            source = true;
+            break;
+        case 't':
+            m.target = atoi(optarg);
+            target = true;
+            break;
+        default:
+            fprintf(stderr, "%s", usage);
+            exit(1);
+        }
+    }
+    argc -= optind;
+    if (argc || !source || !target) {
+        fprintf(stderr, "%s", usage);
+        exit(1);
+    }
+    if (m.source == m.target)
+        die("source and target classes are the same");
+    if ((m.minreads > 0 || m.maxreads > 0) && innconf->articlecache == 0)
+        die("-p and -r need articlecache to be set in inn.conf");
+    if (days > 0)
+        m.cutoff = time(NULL) - days * 24 * 60 * 60;
+
+    val = true;
+    if (!SMsetup(SM_RDWR, (void *) &val))
+        die("cannot set up storage manager");
+    val = false;
+    if (!SMsetup(SM_ARTCACHE, (void *) &val))
+        die("cannot set up storage manager");
+    if (!SMinit())
+        die("cannot initialize storage manager: %s", SMerrorstr);
+    if (innconf->enableoverview && !m.dryrun && !OVopen(OV_READ | OV_WRITE))
+        die("cannot open overview");
+    m.history = HISopen(HistoryPath, innconf->hismethod,
+                        m.dryrun ? HIS_RDONLY : HIS_RDWR);
+    if (m.history == NULL)
+        sysdie("cannot open %s", HistoryPath);
+
+    if (!HISwalk(m.history, NULL, &m, MigrateCallback))
+        warn("cannot walk %s: %s", HistoryPath, HISerror(m.history));
+
+    if (!HISclose(m.history))
+        warn("cannot close %s", HistoryPath);
+    if (innconf->enableoverview && !m.dryrun)
+        OVclose();
+    SMshutdown();
+    if (!m.dryrun)
+        notice("moved %lu articles from class %u to class %u, %lu gone,"
+               " %lu failed",
+               m.moved, m.source, m.target, m.skipped, m.failed);
+    exit(m.failed > 0 ? 1 : 0);
+}
@@ -231,6 +231,60 @@ do_srch(struct reader *r)
     r->mode = MODE_WRITE;
 }
 
+/*
+ * Return several articles of a search at once, so that the client doesn't
+ * wait for a round trip per article.  The number of articles asked for is
+ * in cmd->artlo.
+ */
+static void
+do_srchbatch(struct reader *r)
+{
+    struct rs_cmd *cmd = r->buf;
+    struct rs_srchbatch *reply;
+    struct rs_srch srch;
+    char *data, *p;
+    size_t size, used;
+    uint32_t wanted;
+    int len;
+
+    wanted = cmd->artlo;
+    if (wanted == 0 || wanted > OVDB_SRCHBATCH_ARTS)
+        wanted = OVDB_SRCHBATCH_ARTS;
+    size = sizeof(struct rs_srchbatch) + 8192;
+    reply = xmalloc(size);
+    used = sizeof(struct rs_srchbatch);
+    reply->status = CMD_SRCHBATCH;
+    reply->count = 0;
+    reply->done = 0;
+
+    while (reply->count < wanted && used < OVDB_SRCHBATCH_SIZE) {
+        memset(&srch, 0, sizeof(srch));
+        if (!ovdb_search(cmd->handle, &srch.artnum, &data, &len, &srch.token,
+                         &srch.arrived)) {
+            reply->done = 1;
+            break;
+        }
+        srch.status = CMD_SRCH;
+        srch.len = len;
+        if (used + sizeof(struct rs_srch) + len > size) {
+            size = used + sizeof(struct rs_srch) + len + 8192;
+            reply = xrealloc(reply, size);
+        }
+        p = (char *) reply + used;
+        memcpy(p, &srch, sizeof(struct rs_srch));
+        memcpy(p + sizeof(struct rs_srch), data, len);
+        used += sizeof(struct rs_srch) + len;
+        reply->count++;
+    }
+    reply->len = used - sizeof(struct rs_srchbatch);
+
+    free(r->buf);
+    r->buf = reply;
+    r->buflen = used;
+    r->bufpos = 0;
+    r->mode = MODE_WRITE;
+}
+
 static void
 do_closesrch(struct reader *r)
 {
@@ -308,6 +362,9 @@ process_cmd(struct reader *r)
     case CMD_SRCH:
         do_srch(r);
         break;
+    case CMD_SRCHBATCH:
+        do_srchbatch(r);
+        break;
     case CMD_CLOSESRCH:
         do_closesrch(r);
         break;
@@ -32,6 +32,31 @@ typedef struct _HEADER {
     int size;
 } HEADER;
 
+/*
+**  Max number of CHECK and TAKETHIS commands waiting for their reply when
+**  the server supports streaming.
+*/
+#define STNBUF 64
+
+/*
+**  An article offered in streaming mode and still waiting for the reply of
+**  the server.  stbuf is a ring buffer holding them in the order the
+**  commands were sent, stoldest being the next one to get its reply.
+*/
+struct stbufs {
+    char *st_id;      /* Message-ID */
+    char *st_art;     /* article as read, for Reject */
+    size_t st_artlen; /* its length */
+    char *st_wire;    /* article in wire format, to send */
+    size_t st_len;    /* its length */
+    bool st_takethis; /* true once the article has been sent */
+    char st_path[40]; /* start of the Path header field, for -d */
+};
+static struct stbufs stbuf[STNBUF];
+static int stnq;     /* number of articles waiting for a reply */
+static int stoldest; /* oldest article waiting for a reply */
+static bool CanStream = false;
+
 
 static bool additionalUnpackers = true;
 static bool backupBad = false;
@@ -43,6 +68,7 @@ static char *PathBadNews = NULL;
 static char *remoteServer;
 static FILE *FromServer;
 static FILE *ToServer;
+static unsigned long Workers = 1;
 static char UNPACK[] = "gzip";
 /* clang-format off */
 static HEADER RequiredHeaders[] = {
@@ -209,6 +235,197 @@ Reject(const char *article, size_t length UNUSED, const char *reason,
 }
 
 
+/*
+**  Send the command for an article in streaming mode, with the article
+**  itself once the server wants it.  Return false on error.
+*/
+static bool
+StreamSend(struct stbufs *st)
+{
+    if (!st->st_takethis) {
+        fprintf(ToServer, "check %s\r\n", st->st_id);
+        return !ferror(ToServer);
+    }
+    fprintf(ToServer, "takethis %s\r\n", st->st_id);
+    if (fwrite(st->st_wire, st->st_len, 1, ToServer) != 1) {
+        sysnotice("cant sendarticle");
+        return false;
+    }
+    return true;
+}
+
+
+/*
+**  Free an article of the streaming ring buffer.
+*/
+static void
+StreamFree(struct stbufs *st)
+{
+    free(st->st_id);
+    free(st->st_art);
+    free(st->st_wire);
+    st->st_id = NULL;
+    st->st_art = NULL;
+    st->st_wire = NULL;
+}
+
+
+/*
+**  Forget all the articles waiting for a reply, after losing the server.
+*/
+static void
+StreamReset(void)
+{
+    while (stnq > 0) {
+        StreamFree(&stbuf[stoldest]);
+        stoldest = (stoldest + 1) % STNBUF;
+        stnq--;
+    }
+}
+
+
+/*
+**  Read the reply of the server for the oldest command in flight and act on
+**  it, sending the article if the server wants it.  Return false if the
+**  batch needs to be saved, as for a reply to IHAVE in Process.
+*/
+static bool
+StreamReply(void)
+{
+    struct stbufs st;
+    char buff[SMBUF];
+    int i;
+
+    if (fflush(ToServer) == EOF) {
+        syswarn("cant fflush after check");
+        StreamReset();
+        return false;
+    }
+    if (fgets(buff, sizeof buff, FromServer) == NULL) {
+        if (ferror(FromServer))
+            syswarn("cannot fgets after check");
+        else
+            warn("unexpected EOF from server after check");
+        StreamReset();
+        return false;
+    }
+    REMclean(buff);
+
+    /* Replies come in the order of the commands. */
+    st = stbuf[stoldest];
+    stoldest = (stoldest + 1) % STNBUF;
+    stnq--;
+    if (!isdigit((unsigned char) buff[0])) {
+        notice("bad_reply after %s %s", st.st_takethis ? "takethis" : "check",
+               buff);
+        StreamFree(&st);
+        return false;
+    }
+    switch (atoi(buff)) {
+    default:
+        notice("unknown_reply after %s %s",
+               st.st_takethis ? "takethis" : "check", buff);
+        StreamFree(&st);
+        return false;
+    case NNTP_FAIL_CHECK_DEFER:
+        StreamFree(&st);
+        return false;
+    case NNTP_OK_CHECK:
+        if (st.st_takethis)
+            break;
+
+        /* Send the article now; its reply comes after the commands already
+           sent. */
+        st.st_takethis = true;
+        i = (stoldest + stnq) % STNBUF;
+        stbuf[i] = st;
+        stnq++;
+        return StreamSend(&stbuf[i]);
+    case NNTP_FAIL_CHECK_REFUSE:
+        if (logDuplicates)
+            notice("duplicate %s %s", st.st_id, st.st_path);
+        break;
+    case NNTP_OK_TAKETHIS:
+        break;
+    case NNTP_FAIL_TAKETHIS_REJECT:
+        Reject(st.st_art, st.st_artlen, "rejected %s", buff);
+        break;
+    }
+    StreamFree(&st);
+    return true;
+}
+
+
+/*
+**  Offer an article in streaming mode, waiting for replies only when too
+**  many articles are in flight.  Takes ownership of wirefmt and msgid.
+**  Return false if the batch needs to be saved.
+*/
+static bool
+StreamOffer(const char *article, size_t artlen, char *wirefmt, size_t length,
+            char *msgid, const char *path)
+{
+    struct stbufs *st;
+
+    while (stnq >= STNBUF) {
+        if (!StreamReply()) {
+            free(wirefmt);
+            free(msgid);
+            return false;
+        }
+    }
+    if (UUCPHost)
+        notice("offered %s %s", msgid, UUCPHost);
+    st = &stbuf[(stoldest + stnq) % STNBUF];
+    st->st_id = msgid;
+    st->st_art = xmalloc(artlen + 1);
+    memcpy(st->st_art, article, artlen);
+    st->st_art[artlen] = '\0';
+    st->st_artlen = artlen;
+    st->st_wire = wirefmt;
+    st->st_len = length;
+    st->st_takethis = false;
+    strlcpy(st->st_path, path, sizeof(st->st_path));
+    stnq++;
+    return StreamSend(st);
+}
+
+
+/*
+**  Wait for the replies to all the articles still in flight at the end of
+**  a batch.  Return false if the batch needs to be saved.
+*/
+static bool
+StreamFlush(void)
+{
+    bool ok = true;
+
+    while (stnq > 0)
+        if (!StreamReply())
+            ok = false;
+    return ok;
+}
+
+
+/*
+**  Ask the server for streaming mode, so that articles can be offered
+**  without waiting for the reply to the previous one.
+*/
+static void
+StreamStart(void)
+{
+    char buff[SMBUF];
+
+    fprintf(ToServer, "mode stream\r\n");
+    if (fflush(ToServer) == EOF
+        || fgets(buff, sizeof buff, FromServer) == NULL) {
+        syswarn("cannot negotiate streaming");
+        return;
+    }
+    CanStream = (atoi(buff) == NNTP_OK_STREAM);
+}
+
+
 /*
 **  Process one article.  Return true if the article was okay; false if the
 **  whole batch needs to be saved (such as when the server goes down or if
@@ -229,6 +446,7 @@ Process(char *article, size_t artlen)
     /* Empty article? */
     if (*article == '\0')
         return true;
+    path[0] = '\0';
 
     /* Convert the article to wire format. */
     wirefmt = wire_from_native(article, artlen, &length);
@@ -262,6 +480,8 @@ Process(char *article, size_t artlen)
         return true;
     }
     msgid = xstrndup(id, p - id);
+    if (CanStream)
+        return StreamOffer(article, artlen, wirefmt, length, msgid, path);
     fprintf(ToServer, "ihave %s\r\n", msgid);
     fflush(ToServer);
     if (UUCPHost)
@@ -661,11 +881,17 @@ Unspool(void)
             continue;
         }
 
-        /* Make sure multiple Unspools don't stomp on eachother. */
+        /* Make sure multiple Unspools don't stomp on eachother.  Another one
+           may also have finished with the file and removed it between our
+           readdir and our lock. */
         if (!inn_lock_file(fd, INN_LOCK_WRITE, 0)) {
             close(fd);
             continue;
         }
+        if (fstat(fd, &Sb) < 0 || Sb.st_nlink == 0) {
+            close(fd);
+            continue;
+        }
 
         /* Get UUCP host from spool file, deleting the mktemp XXXXXX suffix. */
         uuhost = UUCPHost;
@@ -679,6 +905,8 @@ Unspool(void)
             UUCPHost = hostname;
         }
         ok = UnpackOne(&fd, &i);
+        if (CanStream && !StreamFlush())
+            ok = false;
         WaitForChildren(i);
         UUCPHost = uuhost;
 
@@ -824,6 +1052,11 @@ main(int ac, char *av[])
     int mode;
     char buff[SMBUF];
     int port = NNTP_PORT;
+    pid_t *workers = NULL;
+    unsigned long w;
+    pid_t pid;
+    int status;
+    bool failed = false;
 
     /* First thing, set up logging and our identity. */
     openlog("rnews", L_OPENLOG_FLAGS, LOG_INN_PROG);
@@ -884,7 +1117,7 @@ main(int ac, char *av[])
     /* Parse JCL. */
     fd = STDIN_FILENO;
     mode = '\0';
-    while ((i = getopt(ac, av, "abdh:NP:r:S:Uv")) != EOF)
+    while ((i = getopt(ac, av, "abdh:j:NP:r:S:Uv")) != EOF)
         switch (i) {
         default:
             die("usage error");
@@ -901,6 +1134,11 @@ main(int ac, char *av[])
         case 'h':
             UUCPHost = *optarg ? optarg : NULL;
             break;
+        case 'j':
+            Workers = strtoul(optarg, NULL, 10);
+            if (Workers == 0)
+                die("usage error");
+            break;
         case 'N':
         case 'U':
             mode = i;
@@ -936,6 +1174,25 @@ main(int ac, char *av[])
         break;
     }
 
+    /* When unspooling with several workers, each one opens its own link to
+       the server and walks the spool directory; the lock on each batch makes
+       sure that only one of them unpacks it. */
+    if (mode == 'U' && Workers > 1) {
+        workers = xcalloc(Workers - 1, sizeof(pid_t));
+        for (w = 0; w < Workers - 1; w++) {
+            workers[w] = fork();
+            if (workers[w] < 0) {
+                syswarn("cannot fork worker");
+                break;
+            }
+            if (workers[w] == 0) {
+                free(workers);
+                workers = NULL;
+                break;
+            }
+        }
+    }
+
     /* Open the link to the server. */
     if (remoteServer != NULL) {
         if (!OpenRemote(remoteServer, port, buff, sizeof(buff)))
@@ -960,12 +1217,13 @@ main(int ac, char *av[])
     }
     fdflag_close_exec(fileno(FromServer), true);
     fdflag_close_exec(fileno(ToServer), true);
+    StreamStart();
 
     /* Execute the command. */
     if (mode == 'U')
         Unspool();
     else {
-        if (!UnpackOne(&fd, &count)) {
+        if (!UnpackOne(&fd, &count) || (CanStream && !StreamFlush())) {
             lseek(fd, 0, 0);
             Spool(fd, mode);
         }
@@ -980,7 +1238,20 @@ main(int ac, char *av[])
         /* ignore: we don't care if we don't get the server reply */
     }
 
+    /* Wait for the other workers, if we started some, and fail if one of
+       them did. */
+    if (workers != NULL) {
+        for (w = 0; w < Workers - 1 && workers[w] > 0; w++) {
+            while ((pid = waitpid(workers[w], &status, 0)) < 0
+                   && errno == EINTR)
+                ;
+            if (pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+                failed = true;
+        }
+        free(workers);
+    }
+
     /* Return the appropriate status. */
-    exit(0);
+    exit(failed ? 1 : 0);
     /* NOTREACHED */
 }
@@ -0,0 +1,56 @@
+/*
+**  Latency histogram interface.
+**
+**  A histogram counts values (normally durations in microseconds) in
+**  log-linear buckets: every power of two is split into HISTOGRAM_SUB equal
+**  sub-buckets, so any reported percentile is within about 6% of the true
+**  value while the whole structure stays a fixed-size array that can be
+**  merged by simple addition.  Values larger than HISTOGRAM_MAX are counted
+**  in the last bucket.
+*/
+
+#ifndef INN_HISTOGRAM_H
+#define INN_HISTOGRAM_H 1
+
+#include "inn/macros.h"
+
+/* Sub-buckets per power of two, as a number of bits, and the resulting
+   bucket count covering values up to HISTOGRAM_MAX. */
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_SUB      (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS  ((32 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB)
+#define HISTOGRAM_MAX      0xffffffffUL
+
+struct histogram {
+    unsigned long count; /* Number of recorded values. */
+    unsigned long max;   /* Largest recorded value. */
+    double total;        /* Sum of all recorded values. */
+    unsigned long buckets[HISTOGRAM_BUCKETS];
+};
+
+BEGIN_DECLS
+
+/* Allocate a new, empty histogram, and free one. */
+struct histogram *histogram_new(void);
+void histogram_free(struct histogram *);
+
+/* Empty a histogram without freeing it. */
+void histogram_reset(struct histogram *);
+
+/* Record one value. */
+void histogram_record(struct histogram *, unsigned long value);
+
+/* Add all the values recorded in the second histogram to the first one. */
+void histogram_merge(struct histogram *, const struct histogram *);
+
+/* Return the mean of the recorded values, or 0 if there are none. */
+double histogram_mean(const struct histogram *);
+
+/* Return the value below which the given percentage (between 0 and 100) of
+   recorded values fall, as the upper bound of the bucket holding it but
+   never more than the largest recorded value.  Returns 0 if empty. */
+unsigned long histogram_percentile(const struct histogram *, double);
+
+END_DECLS
+
+#endif /* INN_HISTOGRAM_H */
@@ -47,6 +47,9 @@ struct innconf {
     char *bindaddress6;         /* Which interface IPv6 to bind to */
     char *docancels;            /* Which cancels to process */
     bool dontrejectfiltered;    /* Don't reject filtered article? */
+    bool filterworkerreject;    /* Reject if a filter worker fails? */
+    unsigned long filterworkers; /* Number of article filter workers */
+    unsigned long filterworkertimeout; /* Max wait for a filter verdict */
     unsigned long hiscachesize; /* Size of the history cache in kB */
     bool ignorenewsgroups;      /* Propagate cmsgs by affected group? */
     bool immediatecancel;       /* Immediately cancel timecaf messages? */
@@ -80,6 +83,7 @@ struct innconf {
     bool mergetogroups;          /* Refile articles from to.* into to */
     bool nfswriter;              /* Use NFS writer functionality */
     unsigned long overcachesize; /* fd size cache for tradindexed */
+    unsigned long overcachereadersize; /* Same for overview readers */
     char *ovgrouppat;            /* Newsgroups to store overview for */
     char *ovmethod;              /* Which overview method to use */
     bool storeonxref;            /* SMstore use Xref to detemine class? */
@@ -89,6 +93,8 @@ struct innconf {
 
     /* Reading */
     bool allownewnews;            /* Allow use of the NEWNEWS command */
+    unsigned long articlecache;   /* Size of the shared article cache */
+    bool articlecachestore;       /* Cache articles when storing them? */
     bool articlemmap;             /* Use mmap to read articles? */
     unsigned long clienttimeout;  /* How long nnrpd can be inactive */
     unsigned long initialtimeout; /* How long nnrpd waits for first command */
@@ -103,6 +109,7 @@ struct innconf {
     bool readerswhenstopped;      /* Allow nnrpd when server is paused */
     bool readertrack;             /* Use the reader tracking system? */
     bool tradindexedmmap;         /* Whether to mmap for tradindexed */
+    bool tradindexedpacked;       /* Write packed tradindexed index files? */
 
     /* Reading -- Keyword Support */
     bool keywords;             /* Generate keywords in overview? */
@@ -180,8 +187,10 @@ struct innconf {
     bool nnrpdoverstats;      /* Log overview statistics? */
     bool nntplinklog;         /* Put storage token into the log? */
     char *stathist;           /* Filename for history profiler outputs */
+    bool statssocket;         /* Answer statistics queries on a socket? */
     unsigned long status;     /* Status file update interval */
     unsigned long timer;      /* Performance monitoring interval */
+    bool timerexport;         /* Export timers to files in pathrun? */
 
     /* System Tuning */
     unsigned long badiocount;    /* Failure count before dropping channel */
@@ -113,6 +113,12 @@ typedef unsigned long ARTNUM;
 /* Default buffer size for outgoing feeds from innd. */
 #define SITE_BUFFER_SIZE         (16 * 1024)
 
+/* How long, in seconds, data for an outgoing file feed may wait in innd
+   before being written out, when there is not enough to fill a buffer.
+   Waiting data is only looked at once a second, so it may wait up to one
+   second more. */
+#define SITE_FLUSH_TIME          1
+
 /* Maximum size of a pathname in the spool directory. */
 #define SPOOLNAMEBUFF            512
 
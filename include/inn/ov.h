@@ -19,7 +19,8 @@ typedef enum {
     OVSTATICSEARCH,
     OVSTATALL,
     OVCACHEKEEP,
-    OVCACHEFREE
+    OVCACHEFREE,
+    OVCACHESTATS
 } OVCTLTYPE;
 #define OV_NOSPACE 100
 typedef enum {
@@ -33,6 +34,16 @@ typedef enum {
     OVADDGROUPNOMATCH
 } OVADDRESULT;
 
+/* Statistics of the cache of open newsgroups of an overview method, returned
+   by OVctl(OVCACHESTATS). */
+struct ovcachestats {
+    unsigned long size;      /* Maximum number of cached newsgroups. */
+    unsigned long count;     /* Newsgroups currently cached. */
+    unsigned long lookups;   /* Lookups in the cache. */
+    unsigned long hits;      /* Lookups that found the newsgroup. */
+    unsigned long evictions; /* Newsgroups dropped to make room. */
+};
+
 typedef struct _OVGE {
     bool delayrm;          /* append tokens to filename if true */
     bool usepost;          /* posting date is used to determine expiry
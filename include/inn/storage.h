@@ -26,9 +26,20 @@ typedef enum {
 
 typedef enum {
     SM_RDWR,
-    SM_PREOPEN
+    SM_PREOPEN,
+    SM_PARTITION,
+    SM_RESUME,
+    SM_ARTCACHE
 } SMSETUP;
 
+/* Used with SM_PARTITION to have SMnext walk only one part of the spool, so
+   that several processes can walk it in parallel.  Each method splits its
+   spool along its own units (cycbuffs, time ranges, newsgroups). */
+struct smpartition {
+    unsigned int part;  /* Part to walk, from 0 to count - 1 */
+    unsigned int count; /* Number of parts */
+};
+
 #define NUM_STORAGE_CLASSES 256
 typedef unsigned char STORAGECLASS;
 typedef unsigned char STORAGETYPE;
@@ -79,7 +90,8 @@ extern char *SMerrorstr;
 typedef enum {
     SELFEXPIRE,
     SMARTNGNUM,
-    EXPENSIVESTAT
+    EXPENSIVESTAT,
+    READCOUNT
 } PROBETYPE;
 
 typedef enum {
@@ -102,6 +114,7 @@ bool IsToken(const char *text);
 bool SMsetup(SMSETUP type, void *value);
 bool SMinit(void);
 TOKEN SMstore(const ARTHANDLE article);
+TOKEN SMstoreclass(const ARTHANDLE article, const STORAGECLASS storageclass);
 ARTHANDLE *SMretrieve(const TOKEN token, const RETRTYPE amount);
 ARTHANDLE *SMnext(ARTHANDLE *article, const RETRTYPE amount);
 void SMfreearticle(ARTHANDLE *article);
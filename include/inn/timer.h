@@ -4,13 +4,41 @@
 **  An interface to a simple profiling library.  An application can declare
 **  its intent to use n timers by calling TMRinit(n), and then start and
 **  stop numbered timers with TMRstart and TMRstop.  TMRsummary logs the
-**  results to syslog given labels for each numbered timer.
+**  results to syslog given labels for each numbered timer.  TMRexport
+**  additionally keeps a histogram of the durations of each timer in a
+**  memory-mapped file that monitoring tools can read at any time, and
+**  TMRexportclean removes the files of processes that died.
 */
 
 #ifndef INN_TIMER_H
 #define INN_TIMER_H 1
 
+#include "inn/histogram.h"
 #include "inn/macros.h"
+#include "inn/portable-stdbool.h"
+
+/* Layout of the file written by TMRexport.  Only the exporting program
+   writes to it, updating the histograms in place as timers stop, so a
+   reader may see a slot in the middle of an update but never has to lock
+   anything.  Slots are only ever added, and a slot is filled before slots
+   is increased.  Durations are in microseconds and accumulate from the
+   call to TMRexport. */
+#define TMR_EXPORT_MAGIC   0x544d5201UL
+#define TMR_EXPORT_SLOTS   128
+#define TMR_EXPORT_NAMELEN 64
+
+struct timer_export_slot {
+    char name[TMR_EXPORT_NAMELEN]; /* Labels as in TMRsummary. */
+    struct histogram latency;
+};
+
+struct timer_export {
+    unsigned long magic;
+    unsigned long slots; /* Number of slots in use. */
+    long pid;            /* Process writing the file. */
+    long started;        /* When the export began, in seconds since epoch. */
+    struct timer_export_slot slot[TMR_EXPORT_SLOTS];
+};
 
 BEGIN_DECLS
 
@@ -26,6 +54,8 @@ void TMRinit(unsigned int);
 void TMRstart(unsigned int);
 void TMRstop(unsigned int);
 void TMRsummary(const char *prefix, const char *const *labels);
+bool TMRexport(const char *path, const char *const *labels);
+int TMRexportclean(const char *dir);
 unsigned long TMRnow(void);
 void TMRfree(void);
 
@@ -1995,6 +1995,7 @@ ARTpost(CHANNEL *cp)
     char *filterrc;
 #endif
     OVADDRESULT result;
+    struct timeval start;
 
     /* Check whether we are receiving the article via IHAVE or TAKETHIS. */
     ihave = (cp->Sendid.size > 3) ? false : true;
@@ -2054,7 +2055,7 @@ ARTpost(CHANNEL *cp)
 
     hash = HashMessageID(HDR(HDR__MESSAGE_ID));
     data->Hash = &hash;
-    if (HIScheck(History, HDR(HDR__MESSAGE_ID))) {
+    if (InndHisCheck(cp, HDR(HDR__MESSAGE_ID))) {
         snprintf(cp->Error, sizeof(cp->Error), "%d Duplicate",
                  ihave ? NNTP_FAIL_IHAVE_REJECT : NNTP_FAIL_TAKETHIS_REJECT);
         ARTlog(data, ART_REJECT, cp->Error);
@@ -2107,11 +2108,17 @@ ARTpost(CHANNEL *cp)
         }
     }
 
+    /* The filters may already have been run by a filter worker, in which
+       case only their verdicts are left to apply. */
 #if defined(DO_PYTHON)
-    TMRstart(TMR_PYTHON);
-    filterrc = PYartfilter(data, article->data + data->Body,
-                           cp->Next - data->Body, data->Lines);
-    TMRstop(TMR_PYTHON);
+    if (cp->FilterDone)
+        filterrc = cp->FilterPython;
+    else {
+        TMRstart(TMR_PYTHON);
+        filterrc = PYartfilter(data, article->data + data->Body,
+                               cp->Next - data->Body, data->Lines);
+        TMRstop(TMR_PYTHON);
+    }
     if (filterrc != NULL) {
         if (innconf->dontrejectfiltered) {
             Filtered = true;
@@ -2140,10 +2147,14 @@ ARTpost(CHANNEL *cp)
     /* I suppose some masochist will run with Python and Perl in together */
 
 #if defined(DO_PERL)
-    TMRstart(TMR_PERL);
-    filterrc = PLartfilter(data, article->data + data->Body,
-                           cp->Next - data->Body, data->Lines);
-    TMRstop(TMR_PERL);
+    if (cp->FilterDone)
+        filterrc = cp->FilterPerl;
+    else {
+        TMRstart(TMR_PERL);
+        filterrc = PLartfilter(data, article->data + data->Body,
+                               cp->Next - data->Body, data->Lines);
+        TMRstop(TMR_PERL);
+    }
     if (filterrc) {
         if (innconf->dontrejectfiltered) {
             Filtered = true;
@@ -2573,7 +2584,9 @@ ARTpost(CHANNEL *cp)
     for (i = 0; (ngp = GroupPointers[i]) != NULL; i++)
         ngp->PostCount = 0;
 
+    gettimeofday(&start, NULL);
     token = ARTstore(cp);
+    STATUSlatency(cp, LATstore, &start);
     /* Change trailing '\r\n' to '\0\n' of all system header fields. */
     for (i = 0; i < MAX_ARTHEADER; i++) {
         if (HDR_FOUND(i)) {
@@ -2597,10 +2610,11 @@ ARTpost(CHANNEL *cp)
         TMRstart(TMR_OVERV);
         ARTmakeoverview(cp);
         if (innconf->enableoverview && !innconf->useoverchan) {
-            if ((result =
-                     OVadd(token, data->Overview.data, data->Overview.left,
-                           data->Arrived, data->Expires))
-                == OVADDFAILED) {
+            gettimeofday(&start, NULL);
+            result = OVadd(token, data->Overview.data, data->Overview.left,
+                           data->Arrived, data->Expires);
+            STATUSlatency(cp, LAToverview, &start);
+            if (result == OVADDFAILED) {
                 if (OVctl(OVSPACE, (void *) &f)
                     && (int) (f + 0.01f) == OV_NOSPACE)
                     IOError("creating overview", ENOSPC);
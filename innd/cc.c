@@ -634,6 +634,7 @@ CCperl(char *av[] UNUSED)
         PerlFilter(false);
         break;
     }
+    FILTERrestart();
     return NULL;
 #else
     return "1 Perl filtering support not compiled in";
@@ -645,7 +646,11 @@ static const char *
 CCpython(char *av[] UNUSED)
 {
 #ifdef DO_PYTHON
-    return PYcontrol(av);
+    const char *p;
+
+    p = PYcontrol(av);
+    FILTERrestart();
+    return p;
 #else
     return "1 Python filtering support not compiled in";
 #endif
@@ -1037,6 +1042,9 @@ CCnameWriteInfo(struct buffer *buffer, CHANNEL *cp)
     case CTcontrol:
         buffer_append_sprintf(buffer, ":control::");
         break;
+    case CTstats:
+        buffer_append_sprintf(buffer, ":stats::");
+        break;
     case CTfile:
         buffer_append_sprintf(buffer, "::");
         break;
@@ -1479,6 +1487,7 @@ CCreload(char *av[])
         if (PYreadfilter())
             syslog(L_NOTICE, "reloaded pyfilter OK");
 #endif
+        FILTERrestart();
         p = "all";
     } else if (strcmp(p, "active") == 0 || strcmp(p, "newsfeeds") == 0) {
         /* Check the syntax of the newsfeeds file before reloading. */
@@ -1546,12 +1555,14 @@ CCreload(char *av[])
             return BADPERLRELOAD;
         }
         free(path);
+        FILTERrestart();
     }
 #endif
 #ifdef DO_PYTHON
     else if (strcmp(p, "filter.python") == 0) {
         if (!PYreadfilter())
             return BADPYRELOAD;
+        FILTERrestart();
     }
 #endif
     else
@@ -1769,10 +1780,7 @@ CCtimer(char *av[])
         value = strtoul(av[0], NULL, 10);
     }
     innconf->timer = value;
-    if (innconf->timer != 0)
-        TMRinit(TMR_MAX);
-    else
-        TMRinit(0);
+    CHANsetuptimers();
     return NULL;
 }
 
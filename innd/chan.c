@@ -299,6 +299,7 @@ CHANtracing(CHANNEL *cp, bool flag)
 static void
 CHANclose_nntp(CHANNEL *cp, const char *name)
 {
+    FILTERcancel(cp);
     WIPprecomfree(cp);
     NCclearwip(cp);
     if (cp->State == CScancel)
@@ -405,6 +406,8 @@ CHANclose(CHANNEL *cp, const char *name)
     if (cp->Type == CTfree)
         warn("%s internal closing free channel %d", name, cp->fd);
     else {
+        if (cp->Type == CTfilter)
+            FILTERchanclose(cp);
         if (cp->Type == CTnntp)
             CHANclose_nntp(cp, name);
         else if (cp->Type == CTreject)
@@ -417,6 +420,7 @@ CHANclose(CHANNEL *cp, const char *name)
         WCHANremove(cp);
         RCHANremove(cp);
         SCHANremove(cp);
+        STATUSchanclose(cp);
         if (cp->fd >= 0 && close(cp->fd) < 0)
             syswarn("%s cant close %s", LogName, name);
         for (i = 0; i < channels.prioritized_size; i++)
@@ -511,6 +515,12 @@ CHANname(CHANNEL *cp)
     case CTcontrol:
         snprintf(cp->Name, sizeof(cp->Name), "control:%d", cp->fd);
         break;
+    case CTfilter:
+        snprintf(cp->Name, sizeof(cp->Name), "filter:%d", cp->fd);
+        break;
+    case CTstats:
+        snprintf(cp->Name, sizeof(cp->Name), "stats:%d", cp->fd);
+        break;
     case CTexploder:
     case CTfile:
     case CTprocess:
@@ -1150,6 +1160,30 @@ CHANhandle_write(CHANNEL *cp)
 }
 
 
+/*
+**  Start or stop the timers according to inn.conf, exporting them if wanted.
+**  Called at startup and when the timer interval is changed.  The export
+**  files of programs that died are removed then, and after each summary.
+*/
+void
+CHANsetuptimers(void)
+{
+    char *path;
+
+    if (innconf->timer == 0) {
+        TMRinit(0);
+        return;
+    }
+    TMRinit(TMR_MAX);
+    if (innconf->timerexport) {
+        TMRexportclean(innconf->pathrun);
+        path = concatpath(innconf->pathrun, "innd.timers");
+        TMRexport(path, timer_name);
+        free(path);
+    }
+}
+
+
 /*
 **  Main I/O loop.  Wait for data, call the channel's handler when there is
 **  something to read or when the queued write is finished.  In order to be
@@ -1190,10 +1224,19 @@ CHANreadloop(void)
             else {
                 TMRsummary("ME", timer_name);
                 InndHisLogStats();
+                if (innconf->timerexport)
+                    TMRexportclean(innconf->pathrun);
                 tv.tv_sec = innconf->timer;
             }
         }
 
+        /* Articles waiting for a filter worker have to be timed out, and
+           file feeds waiting to be written out have to be flushed. */
+        if ((FILTERpending() || SITEflushneeded()) && tv.tv_sec > 1) {
+            tv.tv_sec = 1;
+            tv.tv_usec = 0;
+        }
+
         /* Mask signals when not in select to prevent a signal handler
            from accessing data that the main code is mutating. */
         TMRstart(TMR_IDLE);
@@ -1234,6 +1277,7 @@ CHANreadloop(void)
             }
             last_sync = Now.tv_sec;
         }
+        SITEflushpending();
 
         /* If no channels are active, flush and skip if nobody's sleeping. */
         if (count == 0) {
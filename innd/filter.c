@@ -0,0 +1,682 @@
+/*
+**  Out-of-process article filter workers.
+**
+**  When filterworkers is set in inn.conf, innd forks that many copies of
+**  itself right after loading the Perl and Python filters.  A worker does
+**  nothing but run filter_art() on the articles innd hands it over a
+**  socketpair, and send back the verdicts.  While an article is being
+**  filtered, the NNTP channel it came from is parked in the CSfilter state
+**  and does not read anything, but the main loop goes on serving all the
+**  other channels instead of waiting for a slow filter.
+**
+**  The message-ID filters and filter_mode() are still run inline.  The
+**  requests and replies are exchanged between copies of the same binary on
+**  the same host, so they are sent as native structs.
+*/
+
+#include "portable/system.h"
+
+#include "inn/innconf.h"
+#include "innd.h"
+#include "innperl.h"
+
+/* A request sent to a worker.  It is followed by nfields header fields, each
+   one made of a struct filter_field and the field body, and then by the
+   article body. */
+struct filter_request {
+    unsigned long seq;
+    int lines;
+    int nfields;
+    size_t bodylen;
+};
+
+struct filter_field {
+    int index;
+    int length;
+};
+
+/* The reply of a worker, followed by the Python and then the Perl rejection
+   messages (which are empty if the article was accepted). */
+struct filter_reply {
+    unsigned long seq;
+    unsigned int flags;
+    size_t pythonlen;
+    size_t perllen;
+};
+
+/* Set in a reply when filter_art() died in the worker, which disabled its
+   Perl filter. */
+#define FILTER_PERL_DIED 0x01
+
+/* What innd knows about one of its workers. */
+struct worker {
+    CHANNEL *cp;        /* Channel to the worker, NULL if not running. */
+    pid_t pid;          /* Process ID of the worker. */
+    CHANNEL *client;    /* Channel whose article is being filtered. */
+    unsigned long seq;  /* Sequence number of that request. */
+    time_t retry;       /* When to try again after a failed fork. */
+};
+
+static struct worker *FILTERworkers;
+static int FILTERcount;
+
+/* Channels waiting for an idle worker, in the order they arrived. */
+static CHANNEL **FILTERqueue;
+static int FILTERqueued;
+
+static unsigned long FILTERseq;
+static int FILTERparked;
+
+static void FILTERchild(int fd) __attribute__((__noreturn__));
+static void FILTERdispatch(void);
+static void FILTERreader(CHANNEL *cp);
+static void FILTERwritedone(CHANNEL *cp);
+
+
+/*
+**  Whether there is any article filter to run.
+*/
+static bool
+FILTERactive(void)
+{
+#if defined(DO_PYTHON)
+    if (PythonFilterActive)
+        return true;
+#endif
+#if defined(DO_PERL)
+    if (PerlFilterActive)
+        return true;
+#endif
+    return false;
+}
+
+
+/*
+**  Find the worker talking to innd over the given channel.
+*/
+static struct worker *
+FILTERfind(CHANNEL *cp)
+{
+    int i;
+
+    for (i = 0; i < FILTERcount; i++)
+        if (FILTERworkers[i].cp == cp)
+            return &FILTERworkers[i];
+    return NULL;
+}
+
+
+/*
+**  Main loop of a worker.  Read a request, rebuild just enough of an
+**  ARTDATA for the filters, run them and write back the verdicts.  Exit
+**  when innd goes away.
+*/
+static void
+FILTERchild(int fd)
+{
+    static ARTDATA data;
+    HDRCONTENT *hc = data.HdrContent;
+    struct filter_request request;
+    struct filter_field field;
+    struct filter_reply reply;
+    struct buffer article = {0, 0, 0, NULL};
+    size_t offset[MAX_ARTHEADER];
+    size_t body;
+    const char *python, *perl;
+    int i;
+#if defined(DO_PERL)
+    bool wasactive;
+#endif
+
+    for (;;) {
+        if (xread(fd, (char *) &request, sizeof(request)) < 0)
+            _exit(0);
+        memset(hc, 0, sizeof(data.HdrContent));
+        article.used = 0;
+        for (i = 0; i < request.nfields; i++) {
+            if (xread(fd, (char *) &field, sizeof(field)) < 0)
+                _exit(0);
+            if (field.index < 0 || field.index >= MAX_ARTHEADER
+                || field.length <= 0) {
+                warn("SERVER filter worker bad request %lu", request.seq);
+                _exit(1);
+            }
+            buffer_resize(&article, article.used + field.length + 1);
+            if (xread(fd, article.data + article.used, field.length) < 0)
+                _exit(0);
+            offset[field.index] = article.used;
+            hc[field.index].Length = field.length;
+            article.used += field.length;
+            article.data[article.used++] = '\0';
+        }
+        buffer_resize(&article, article.used + request.bodylen + 1);
+        if (xread(fd, article.data + article.used, request.bodylen) < 0)
+            _exit(0);
+        body = article.used;
+        article.data[body + request.bodylen] = '\0';
+
+        /* The buffer may have moved while growing, so only set the pointers
+           to the header field bodies now. */
+        for (i = 0; i < MAX_ARTHEADER; i++)
+            if (HDR_FOUND(i))
+                hc[i].Value = article.data + offset[i];
+        data.Lines = request.lines;
+
+        /* Same order and same short-circuit as in ARTpost. */
+        python = NULL;
+        perl = NULL;
+        reply.seq = request.seq;
+        reply.flags = 0;
+#if defined(DO_PYTHON)
+        python = PYartfilter(&data, article.data + body, request.bodylen,
+                             data.Lines);
+#endif
+#if defined(DO_PERL)
+        if (python == NULL || innconf->dontrejectfiltered) {
+            wasactive = PerlFilterActive;
+            perl = PLartfilter(&data, article.data + body, request.bodylen,
+                               data.Lines);
+            if (wasactive && !PerlFilterActive)
+                reply.flags |= FILTER_PERL_DIED;
+        }
+#endif
+        reply.pythonlen = (python == NULL) ? 0 : strlen(python);
+        reply.perllen = (perl == NULL) ? 0 : strlen(perl);
+        if (xwrite(fd, &reply, sizeof(reply)) < 0
+            || (reply.pythonlen > 0
+                && xwrite(fd, python, reply.pythonlen) < 0)
+            || (reply.perllen > 0 && xwrite(fd, perl, reply.perllen) < 0))
+            _exit(0);
+    }
+}
+
+
+/*
+**  Start a worker.  The child gets rid of every descriptor innd uses for
+**  its channels, so that connections are really closed when innd closes
+**  them, and then never returns.
+*/
+static bool
+FILTERspawn(struct worker *wp)
+{
+    int pair[2];
+    int i;
+    pid_t pid;
+    CHANNEL *cp;
+
+    if (socketpair(PF_UNIX, SOCK_STREAM, 0, pair) < 0) {
+        syswarn("%s cant socketpair for filter worker", LogName);
+        wp->retry = Now.tv_sec + innconf->chanretrytime;
+        return false;
+    }
+    pid = fork();
+    if (pid < 0) {
+        syswarn("%s cant fork filter worker", LogName);
+        close(pair[0]);
+        close(pair[1]);
+        wp->retry = Now.tv_sec + innconf->chanretrytime;
+        return false;
+    }
+    if (pid == 0) {
+        xsignal_forked();
+        close(pair[0]);
+        i = 0;
+        while ((cp = CHANiter(&i, CTany)) != NULL)
+            if (cp->fd >= 0 && cp->fd != pair[1])
+                close(cp->fd);
+        FILTERchild(pair[1]);
+    }
+
+    close(pair[1]);
+    wp->pid = pid;
+    wp->client = NULL;
+    wp->seq = 0;
+    wp->retry = 0;
+    wp->cp = CHANcreate(pair[0], CTfilter, CSwaiting, FILTERreader,
+                        FILTERwritedone);
+    RCHANadd(wp->cp);
+    notice("%s spawned filter worker %ld", LogName, (long) pid);
+    return true;
+}
+
+
+/*
+**  Hand the article of a parked channel to a worker.
+*/
+static void
+FILTERsend(struct worker *wp, CHANNEL *client)
+{
+    const ARTDATA *data = &client->Data;
+    const HDRCONTENT *hc = data->HdrContent;
+    struct filter_request request;
+    struct filter_field field;
+    int i;
+
+    request.seq = client->FilterSeq;
+    request.lines = data->Lines;
+    request.nfields = 0;
+    request.bodylen = client->Next - data->Body;
+    for (i = 0; i < MAX_ARTHEADER; i++)
+        if (HDR_FOUND(i))
+            request.nfields++;
+
+    WCHANappend(wp->cp, (const char *) &request, sizeof(request));
+    for (i = 0; i < MAX_ARTHEADER; i++) {
+        if (!HDR_FOUND(i))
+            continue;
+        field.index = i;
+        field.length = HDR_LEN(i);
+        WCHANappend(wp->cp, (const char *) &field, sizeof(field));
+        WCHANappend(wp->cp, HDR(i), HDR_LEN(i));
+    }
+    WCHANappend(wp->cp, client->In.data + data->Body, request.bodylen);
+    WCHANadd(wp->cp);
+
+    wp->client = client;
+    wp->seq = client->FilterSeq;
+}
+
+
+/*
+**  Remove a channel from the queue of articles waiting for a worker.
+*/
+static bool
+FILTERdequeue(CHANNEL *cp)
+{
+    int i;
+
+    for (i = 0; i < FILTERqueued; i++)
+        if (FILTERqueue[i] == cp) {
+            FILTERqueued--;
+            memmove(&FILTERqueue[i], &FILTERqueue[i + 1],
+                    (FILTERqueued - i) * sizeof(CHANNEL *));
+            return true;
+        }
+    return false;
+}
+
+
+/*
+**  Unpark a channel, either from the main loop or once a worker answered.
+**  The verdicts are already in the channel, unless the filters have to be
+**  run inline after all.
+*/
+static void
+FILTERresume(CHANNEL *cp)
+{
+    if (cp->State != CSfilter)
+        return;
+    SCHANremove(cp);
+    cp->FilterSeq = 0;
+    FILTERparked--;
+    NCfilterdone(cp);
+}
+
+
+/*
+**  Store the verdicts of a worker in the channel.
+*/
+static void
+FILTERverdict(CHANNEL *cp, const char *python, size_t pythonlen,
+              const char *perl, size_t perllen)
+{
+    FILTERclear(cp);
+    cp->FilterDone = true;
+    if (pythonlen > 0)
+        cp->FilterPython = xstrndup(python, pythonlen);
+    if (perllen > 0)
+        cp->FilterPerl = xstrndup(perl, perllen);
+}
+
+
+/*
+**  No verdict could be obtained for the article of this channel.  Either
+**  accept it or reject it on behalf of whichever filter is enabled.
+*/
+static void
+FILTERfail(CHANNEL *cp, const char *why)
+{
+    FILTERclear(cp);
+    cp->FilterDone = true;
+    if (!innconf->filterworkerreject)
+        return;
+#if defined(DO_PYTHON)
+    if (PythonFilterActive) {
+        cp->FilterPython = xstrdup(why);
+        return;
+    }
+#endif
+    cp->FilterPerl = xstrdup(why);
+}
+
+
+/*
+**  A request was fully sent to a worker; nothing to do but wait for the
+**  reply.
+*/
+static void
+FILTERwritedone(CHANNEL *cp UNUSED)
+{
+}
+
+
+/*
+**  Read the replies of a worker and resume the channels they are about.
+*/
+static void
+FILTERreader(CHANNEL *cp)
+{
+    struct worker *wp;
+    struct buffer *bp = &cp->In;
+    struct filter_reply reply;
+    CHANNEL *client;
+    const char *p;
+    size_t used, size;
+    bool perldied = false;
+    int i;
+
+    i = CHANreadtext(cp);
+    if (i == -2)
+        return;
+    if (i <= 0) {
+        CHANclose(cp, CHANname(cp));
+        return;
+    }
+
+    wp = FILTERfind(cp);
+    for (used = 0; bp->used - used >= sizeof(reply); used += size) {
+        memcpy(&reply, &bp->data[used], sizeof(reply));
+        size = sizeof(reply) + reply.pythonlen + reply.perllen;
+        if (bp->used - used < size)
+            break;
+        p = &bp->data[used + sizeof(reply)];
+        if (reply.flags & FILTER_PERL_DIED)
+            perldied = true;
+
+        /* Discard the verdict if the channel timed out or was closed in the
+           meantime. */
+        client = NULL;
+        if (wp != NULL && wp->client != NULL && wp->seq == reply.seq) {
+            client = wp->client;
+            wp->client = NULL;
+        }
+        if (client != NULL && client->State == CSfilter
+            && client->FilterSeq == reply.seq) {
+            FILTERverdict(client, p, reply.pythonlen, p + reply.pythonlen,
+                          reply.perllen);
+            FILTERresume(client);
+        }
+    }
+    if (used > 0) {
+        memmove(bp->data, &bp->data[used], bp->used - used);
+        bp->used -= used;
+    }
+
+    /* The Perl filter is disabled in innd too, and the workers restarted so
+       that they all agree with it. */
+    if (perldied) {
+#if defined(DO_PERL)
+        PerlFilter(false);
+#endif
+        FILTERrestart();
+        return;
+    }
+    FILTERdispatch();
+}
+
+
+/*
+**  A parked channel waited too long.  Kill the worker, which is probably
+**  stuck, and go on without a verdict.
+*/
+static void
+FILTERtimeout(CHANNEL *cp)
+{
+    int i;
+    struct worker *wp;
+
+    if (cp->State != CSfilter)
+        return;
+    warn("%s filter timeout", CHANname(cp));
+    if (!FILTERdequeue(cp))
+        for (i = 0; i < FILTERcount; i++) {
+            wp = &FILTERworkers[i];
+            if (wp->cp != NULL && wp->client == cp) {
+                wp->client = NULL;
+                if (kill(wp->pid, SIGKILL) < 0 && errno != ESRCH)
+                    syswarn("%s cant kill filter worker %ld", LogName,
+                            (long) wp->pid);
+                CHANclose(wp->cp, CHANname(wp->cp));
+                break;
+            }
+        }
+    FILTERfail(cp, "Filter timeout");
+    FILTERresume(cp);
+    FILTERdispatch();
+}
+
+
+/*
+**  Give queued articles to idle workers, starting new workers if needed.
+**  If there is no filter left to run, resume all the queued channels so
+**  that ARTpost handles them as usual.
+*/
+static void
+FILTERdispatch(void)
+{
+    struct worker *wp;
+    CHANNEL *cp;
+    int i;
+
+    if (!FILTERactive()) {
+        while (FILTERqueued > 0) {
+            cp = FILTERqueue[0];
+            FILTERdequeue(cp);
+            FILTERresume(cp);
+        }
+        return;
+    }
+    for (i = 0; i < FILTERcount && FILTERqueued > 0; i++) {
+        wp = &FILTERworkers[i];
+        if (wp->cp == NULL
+            && (wp->retry > Now.tv_sec || !FILTERspawn(wp)))
+            continue;
+        if (wp->client != NULL)
+            continue;
+        cp = FILTERqueue[0];
+        FILTERdequeue(cp);
+        FILTERsend(wp, cp);
+    }
+}
+
+
+/*
+**  Park a channel that has a complete article until the workers have run
+**  the filters on it.  Returns false if the article should be posted right
+**  away instead.
+*/
+bool
+FILTERsubmit(CHANNEL *cp)
+{
+    if (FILTERcount == 0 || cp->FilterDone || Mode != OMrunning
+        || !FILTERactive())
+        return false;
+
+    /* NCpostit answers straight away to a TAKETHIS that was refused. */
+    if (cp->Sendid.size > 3 && cp->Sendid.data[0] != NNTP_CLASS_OK)
+        return false;
+
+    if (++FILTERseq == 0)
+        FILTERseq = 1;
+    cp->FilterSeq = FILTERseq;
+    cp->State = CSfilter;
+    FILTERparked++;
+    RCHANremove(cp);
+    SCHANadd(cp, Now.tv_sec + innconf->filterworkertimeout, NULL,
+             FILTERtimeout, NULL);
+    FILTERqueue[FILTERqueued++] = cp;
+    FILTERdispatch();
+    return true;
+}
+
+
+/*
+**  Whether some channels are waiting for a verdict.  The main loop then
+**  wakes up often enough to notice the timeouts.
+*/
+bool
+FILTERpending(void)
+{
+    return FILTERparked > 0;
+}
+
+
+/*
+**  Forget the verdicts stored in a channel.
+*/
+void
+FILTERclear(CHANNEL *cp)
+{
+    cp->FilterDone = false;
+    if (cp->FilterPython != NULL) {
+        free(cp->FilterPython);
+        cp->FilterPython = NULL;
+    }
+    if (cp->FilterPerl != NULL) {
+        free(cp->FilterPerl);
+        cp->FilterPerl = NULL;
+    }
+}
+
+
+/*
+**  An NNTP channel is being closed.  If it was parked, drop its request;
+**  a worker still busy with it will have its verdict discarded.
+*/
+void
+FILTERcancel(CHANNEL *cp)
+{
+    int i;
+
+    if (cp->State == CSfilter) {
+        FILTERdequeue(cp);
+        for (i = 0; i < FILTERcount; i++)
+            if (FILTERworkers[i].client == cp)
+                FILTERworkers[i].client = NULL;
+        cp->FilterSeq = 0;
+        FILTERparked--;
+    }
+    FILTERclear(cp);
+}
+
+
+/*
+**  The channel to a worker is being closed, because the worker died or was
+**  killed.  A new one is started when there is work for it.  An article it
+**  was filtering gets no verdict: it may well be the one that made the
+**  worker crash, so it is not given to another worker.
+*/
+void
+FILTERchanclose(CHANNEL *cp)
+{
+    struct worker *wp;
+    CHANNEL *client;
+
+    wp = FILTERfind(cp);
+    if (wp == NULL)
+        return;
+    client = wp->client;
+    wp->cp = NULL;
+    wp->client = NULL;
+    if (client != NULL && client->State == CSfilter
+        && client->FilterSeq == wp->seq) {
+        warn("%s filter worker %ld died", CHANname(client), (long) wp->pid);
+        FILTERfail(client, "Filter worker died");
+
+        /* Resume it from the main loop rather than while a channel is
+           being closed. */
+        SCHANadd(client, Now.tv_sec, NULL, FILTERresume, NULL);
+    }
+}
+
+
+/*
+**  Restart all the workers so that they pick up the filters as they are
+**  now in innd.  Articles being filtered are filtered again by the new
+**  workers.
+*/
+void
+FILTERrestart(void)
+{
+    struct worker *wp;
+    CHANNEL *client;
+    int i;
+
+    for (i = 0; i < FILTERcount; i++) {
+        wp = &FILTERworkers[i];
+        if (wp->cp == NULL)
+            continue;
+        client = wp->client;
+        wp->client = NULL;
+        if (client != NULL && client->State == CSfilter
+            && client->FilterSeq == wp->seq) {
+            memmove(&FILTERqueue[1], &FILTERqueue[0],
+                    FILTERqueued * sizeof(CHANNEL *));
+            FILTERqueue[0] = client;
+            FILTERqueued++;
+        }
+        if (kill(wp->pid, SIGTERM) < 0 && errno != ESRCH)
+            syswarn("%s cant kill filter worker %ld", LogName,
+                    (long) wp->pid);
+        CHANclose(wp->cp, CHANname(wp->cp));
+        wp->retry = 0;
+    }
+    FILTERdispatch();
+}
+
+
+/*
+**  Set up the workers, once the filters are loaded.
+*/
+void
+FILTERsetup(void)
+{
+    int i;
+
+    if (innconf->filterworkers == 0)
+        return;
+    FILTERcount = innconf->filterworkers;
+    FILTERworkers = xcalloc(FILTERcount, sizeof(struct worker));
+    FILTERqueue = xcalloc(getfdlimit(), sizeof(CHANNEL *));
+    if (!FILTERactive())
+        return;
+    for (i = 0; i < FILTERcount; i++)
+        FILTERspawn(&FILTERworkers[i]);
+}
+
+
+/*
+**  Stop the workers.
+*/
+void
+FILTERclose(void)
+{
+    struct worker *wp;
+    int i;
+
+    for (i = 0; i < FILTERcount; i++) {
+        wp = &FILTERworkers[i];
+        if (wp->cp == NULL)
+            continue;
+        if (kill(wp->pid, SIGTERM) < 0 && errno != ESRCH)
+            syswarn("%s cant kill filter worker %ld", LogName,
+                    (long) wp->pid);
+        CHANclose(wp->cp, CHANname(wp->cp));
+    }
+    free(FILTERworkers);
+    free(FILTERqueue);
+    FILTERworkers = NULL;
+    FILTERqueue = NULL;
+    FILTERcount = 0;
+    FILTERqueued = 0;
+}
@@ -293,6 +293,7 @@ JustCleanup(void)
     SITEflushall(false);
     CCclose();
     LCclose();
+    STATUSclose();
     NCclose();
     RCclose();
     ICDclose();
@@ -302,6 +303,8 @@ JustCleanup(void)
         OVclose();
     NGclose();
     SMshutdown();
+    FILTERclose();
+    TMRfree();
 
 #if DO_PERL
     PerlFilter(false);
@@ -735,14 +738,14 @@ main(int ac, char *av[])
         InndHisOpen();
     CCsetup();
     LCsetup();
+    STATUSsetup();
     RCsetup();
     PROCsetup(10);
     WIPsetup();
     NCsetup();
     ARTsetup();
     ICDsetup(true);
-    if (innconf->timer != 0)
-        TMRinit(TMR_MAX);
+    CHANsetuptimers();
 
     /* Initialize the storage subsystem. */
     flag = true;
@@ -799,6 +802,9 @@ main(int ac, char *av[])
         PYfilter(false);
 #endif /* DO_PYTHON */
 
+    /* Fork the filter workers, if any, now that the filters are loaded. */
+    FILTERsetup();
+
     /* And away we go... */
     if (ShouldRenumber) {
         syslog(LOG_NOTICE, "SERVER renumbering");
@@ -43,6 +43,7 @@
 #include <time.h>
 
 #include "inn/buffer.h"
+#include "inn/histogram.h"
 #include "inn/history.h"
 #include "inn/libinn.h"
 #include "inn/messages.h"
@@ -291,7 +292,9 @@ enum channel_type {
     CTcontrol,
     CTfile,
     CTexploder,
-    CTprocess
+    CTprocess,
+    CTfilter,
+    CTstats
 };
 
 /* The state a channel is in.  Interpretation of this depends on the channel's
@@ -312,7 +315,19 @@ enum channel_state {
     CSeatarticle,
     CSeatcommand,
     CSgetxbatch,
-    CScancel
+    CScancel,
+    CSfilter
+};
+
+
+/* Latencies kept as histograms by status.c, per channel and globally. */
+enum latency_type {
+    LATcheck,    /* From a CHECK command to its reply */
+    LATtakethis, /* From a TAKETHIS command to its reply */
+    LAThistory,  /* Looking up a message-ID in history */
+    LATstore,    /* Storing an article */
+    LAToverview, /* Adding overview data */
+    LATmax
 };
 
 
@@ -395,6 +410,7 @@ typedef struct _CHANNEL {
     struct buffer In;
     struct buffer Out;
     bool Tracing;
+    bool Batching; /* Replies queued until the end of NCproc */
     struct buffer Sendid;
     HASH CurrentMessageIDHash;
     struct _WIP *PrecommitWIP[PRECOMMITCACHESIZE];
@@ -411,6 +427,14 @@ typedef struct _CHANNEL {
                           it indicates offset from bp->Data */
     size_t Next;       /* next pointer to read
                           it indicates offset from bp->Data */
+    unsigned long FilterSeq; /* Request sent to the filter workers */
+    bool FilterDone;         /* Whether the verdicts below are known */
+    char *FilterPython;      /* Python verdict, NULL if accepted */
+    char *FilterPerl;        /* Perl verdict, NULL if accepted */
+    bool Timing;             /* Whether a command is being timed */
+    enum latency_type TimingType;
+    struct timeval TimingStart;
+    struct histogram *Latency[LATmax]; /* Allocated on first use */
     char Error[SMBUF]; /* error buffer */
     ARTDATA Data;      /* used for processing article */
     char Name[SMBUF];  /* storage for CHANname */
@@ -534,6 +558,10 @@ typedef struct _SITE {
     size_t Flushpoint;
     struct buffer Buffer;
     bool Buffered;
+    time_t FlushStart;         /* When unwritten data started to wait. */
+    bool FlushFull;            /* Full buffer handed to the main loop. */
+    unsigned long SizeFlushes; /* Times a file feed was written when full */
+    unsigned long TimeFlushes; /* and when its data had waited enough. */
     char **Originator;
     HASHFEEDLIST *HashFeedList;
     int Next;
@@ -698,6 +726,7 @@ extern void InndHisClose(void);
 extern bool InndHisWrite(const char *key, time_t arrived, time_t posted,
                          time_t expires, TOKEN *token);
 extern bool InndHisRemember(const char *key, time_t posted);
+extern bool InndHisCheck(CHANNEL *cp, const char *key);
 extern void InndHisLogStats(void);
 extern bool FormatLong(char *p, unsigned long value, int width);
 extern bool NeedShell(char *p, const char **av, const char **end);
@@ -738,6 +767,7 @@ extern int CHANreadtext(CHANNEL *cp);
 extern void CHANclose(CHANNEL *cp, const char *name);
 extern void CHANreadloop(void) __attribute__((__noreturn__));
 extern void CHANsetup(int count);
+extern void CHANsetuptimers(void);
 extern void CHANshutdown(void);
 extern void CHANtracing(CHANNEL *cp, bool flag);
 extern void CHANcount_active(CHANNEL *cp);
@@ -774,6 +804,15 @@ extern void ICDwriteactive(void);
 extern void CCclose(void);
 extern void CCsetup(void);
 
+extern bool FILTERpending(void);
+extern bool FILTERsubmit(CHANNEL *cp);
+extern void FILTERcancel(CHANNEL *cp);
+extern void FILTERchanclose(CHANNEL *cp);
+extern void FILTERclear(CHANNEL *cp);
+extern void FILTERclose(void);
+extern void FILTERrestart(void);
+extern void FILTERsetup(void);
+
 extern void KEYgenerate(HDRCONTENT *, const char *, size_t);
 
 extern void LCclose(void);
@@ -789,6 +828,7 @@ extern bool NGlowmark(NEWSGROUP *ngp, long lomark);
 
 extern void NCclearwip(CHANNEL *cp);
 extern void NCclose(void);
+extern void NCfilterdone(CHANNEL *cp);
 extern void NCsetup(void);
 extern void NCwritereply(CHANNEL *cp, const char *text);
 extern void NCwriteshutdown(CHANNEL *cp, const char *text);
@@ -837,10 +877,17 @@ extern void SITEinfo(struct buffer *bp, SITE *sp, bool Verbose);
 extern void SITEparsefile(bool StartSite);
 extern void SITEprocdied(SITE *sp, int process, PROCESS *pp);
 extern void SITEsend(SITE *sp, ARTDATA *Data);
+extern void SITEflushpending(void);
+extern bool SITEflushneeded(void);
 extern void SITEwrite(SITE *sp, const char *text);
 
+extern void STATUSchanclose(CHANNEL *cp);
+extern void STATUSclose(void);
 extern void STATUSinit(void);
+extern void STATUSlatency(CHANNEL *cp, enum latency_type type,
+                          const struct timeval *start);
 extern void STATUSmainloophook(void);
+extern void STATUSsetup(void);
 
 extern void WIPsetup(void);
 extern WIP *WIPnew(const char *messageid, CHANNEL *cp);
@@ -12,6 +12,10 @@
 
 #define BAD_COMMAND_COUNT 10
 
+/* Replies to pipelined streaming commands are coalesced into a single write
+   per batch, but written as soon as that many bytes are waiting. */
+#define NC_BATCH_SIZE 4096
+
 /*
 **  An entry in the dispatch table.  The name, and implementing function,
 **  of every command we support.
@@ -49,6 +53,7 @@ static void NC_unimp(CHANNEL *cp);
 
 /* Supporting functions. */
 static void NCwritedone(CHANNEL *cp);
+static void NCwriteout(CHANNEL *cp);
 
 /* Set up the dispatch table for all of the commands. */
 #define NC_any -1
@@ -141,6 +146,10 @@ NCclearwip(CHANNEL *cp)
 **  changes).  Else, NCwritedone will be called from the main select loop
 **  later.
 **
+**  While NCproc goes through a batch of pipelined streaming commands, the
+**  reply is only queued; NCproc writes all the replies of the batch at once,
+**  in order, when it runs out of complete commands.
+**
 **  If the reply that we are writing now is associated with a state change,
 **  then cp->State must be set to its new value *before* NCwritereply is
 **  called.
@@ -149,7 +158,7 @@ void
 NCwritereply(CHANNEL *cp, const char *text)
 {
     struct buffer *bp;
-    int i;
+    size_t left;
 
     /* XXX could do RCHANremove(cp) here, as the old NCwritetext() used to
      * do, but that would be wrong if the channel is streaming (because it
@@ -157,36 +166,69 @@ NCwritereply(CHANNEL *cp, const char *text)
      * never calling RCHANremove here. */
 
     bp = &cp->Out;
-    i = bp->left;
+    left = bp->left;
     WCHANappend(cp, text, strlen(text));     /* Text in buffer. */
     WCHANappend(cp, NCterm, strlen(NCterm)); /* Add CR LF to text. */
+    if (Tracing || cp->Tracing)
+        syslog(L_TRACE, "%s > %s", CHANname(cp), text);
 
-    if (i == 0) { /* If only new data, then try to write directly. */
-        i = write(cp->fd, &bp->data[bp->used], bp->left);
-        if (Tracing || cp->Tracing)
-            syslog(L_TRACE, "%s NCwritereply %d=write(%d, \"%.15s\", %lu)",
-                   CHANname(cp), i, cp->fd, &bp->data[bp->used],
-                   (unsigned long) bp->left);
-        if (i > 0)
-            bp->used += i;
-        if (bp->used == bp->left) {
-            /* All the data was written. */
-            bp->used = bp->left = 0;
-            NCwritedone(cp);
-        } else {
-            if (i > 0) {
-                bp->left -= i;
-            }
-            i = 0;
-        }
-    } else {
-        i = 0;
+    /* This is the reply to the command being timed, if any. */
+    if (cp->Timing) {
+        cp->Timing = false;
+        STATUSlatency(cp, cp->TimingType, &cp->TimingStart);
     }
-    if (i <= 0) { /* Write failed, queue it for later. */
+
+    if (cp->Batching) {
+        if (bp->left >= NC_BATCH_SIZE)
+            NCwriteout(cp);
+    } else if (left == 0) { /* If only new data, then try to write directly. */
+        NCwriteout(cp);
+    } else { /* Queue it after what is already waiting. */
         WCHANadd(cp);
     }
+}
+
+
+/*
+**  Start timing a command, until the next reply is written.
+*/
+static void
+NCtime(CHANNEL *cp, enum latency_type type)
+{
+    cp->Timing = true;
+    cp->TimingType = type;
+    gettimeofday(&cp->TimingStart, NULL);
+}
+
+
+/*
+**  Try to write the whole output buffer right away.  If it cannot be done,
+**  queue the rest for the main select loop and stop batching replies.
+*/
+static void
+NCwriteout(CHANNEL *cp)
+{
+    struct buffer *bp;
+    ssize_t i;
+
+    bp = &cp->Out;
+    i = write(cp->fd, &bp->data[bp->used], bp->left);
     if (Tracing || cp->Tracing)
-        syslog(L_TRACE, "%s > %s", CHANname(cp), text);
+        syslog(L_TRACE, "%s NCwriteout %ld=write(%d, \"%.15s\", %lu)",
+               CHANname(cp), (long) i, cp->fd, &bp->data[bp->used],
+               (unsigned long) bp->left);
+    if (i > 0) {
+        bp->used += i;
+        bp->left -= i;
+    }
+    if (bp->left == 0) {
+        /* All the data was written. */
+        bp->used = 0;
+        NCwritedone(cp);
+    } else { /* Write failed, queue it for later. */
+        cp->Batching = false;
+        WCHANadd(cp);
+    }
 }
 
 /*
@@ -334,6 +376,10 @@ NCwritedone(CHANNEL *cp)
     case CScancel:
         RCHANadd(cp);
         break;
+
+    case CSfilter:
+        /* Reading starts again once the article has been posted. */
+        break;
     }
 }
 
@@ -720,7 +766,7 @@ NCihave(CHANNEL *cp)
     }
 #endif
 
-    if (HIScheck(History, cp->av[1]) || cp->Ignore) {
+    if (InndHisCheck(cp, cp->av[1]) || cp->Ignore) {
         cp->Refused++;
         cp->Ihave_Duplicate++;
         xasprintf(&buff, "%d Duplicate", NNTP_FAIL_IHAVE_REFUSE);
@@ -1097,7 +1143,7 @@ NC_unimp(CHANNEL *cp)
 **  full amount (i.e., the command or the whole article) process it.
 */
 static void
-NCproc(CHANNEL *cp)
+NCprocess(CHANNEL *cp)
 {
     char *p, *q;
     NCDISPATCH *dp;
@@ -1447,7 +1493,7 @@ NCproc(CHANNEL *cp)
                     HDR_PARSE_START(HDR__MESSAGE_ID);
                     /* The article posting time has not been parsed.  We cannot
                      * give it to InndHisRemember. */
-                    if (!HIScheck(History, HDR(HDR__MESSAGE_ID))
+                    if (!InndHisCheck(cp, HDR(HDR__MESSAGE_ID))
                         && !InndHisRemember(HDR(HDR__MESSAGE_ID), 0))
                         syslog(L_ERROR, "%s cant write history %s %m", LogName,
                                HDR(HDR__MESSAGE_ID));
@@ -1502,7 +1548,12 @@ NCproc(CHANNEL *cp)
                 free(cp->Argument);
                 cp->Argument = NULL;
             }
+            /* Let a filter worker look at the article first, if any; the
+             * channel is resumed by NCfilterdone. */
+            if (FILTERsubmit(cp))
+                return;
             NCpostit(cp);
+            FILTERclear(cp);
             /* Clear the work-in-progress entry. */
             NCclearwip(cp);
             if (cp->State == CSwritegoodbye)
@@ -1692,6 +1743,29 @@ NCproc(CHANNEL *cp)
 }
 
 
+/*
+**  Process the data available on the channel.  Streaming peers pipeline
+**  their CHECK and TAKETHIS commands, so the replies to everything found in
+**  the buffer are coalesced and written together at the end instead of one
+**  write per command, unless some output is already waiting.
+*/
+static void
+NCproc(CHANNEL *cp)
+{
+    if (StreamingOff || !cp->Streaming || cp->Out.left > 0) {
+        NCprocess(cp);
+        return;
+    }
+    cp->Batching = true;
+    NCprocess(cp);
+    if (cp->Batching) {
+        cp->Batching = false;
+        if (cp->Type == CTnntp && cp->Out.left > 0)
+            NCwriteout(cp);
+    }
+}
+
+
 /*
 **  Read whatever data is available on the channel.  If we got the
 **  full amount (i.e., the command or the whole article) process it.
@@ -1727,6 +1801,18 @@ NCreader(CHANNEL *cp)
 }
 
 
+/*
+**  The filter workers are done with the article of a parked channel.  Post
+**  it, and go on with whatever else the peer already sent.
+*/
+void
+NCfilterdone(CHANNEL *cp)
+{
+    cp->State = CSgotarticle;
+    NCproc(cp);
+}
+
+
 /*
 **  Set up the NNTP channel state.
 */
@@ -1853,6 +1939,7 @@ NCcheck(CHANNEL *cp)
 
     cp->Check++;
     cp->Start = cp->Next;
+    NCtime(cp, LATcheck);
 
     idlen = strlen(cp->av[1]);
     msglen = idlen + 5; /* 3 digits + space + id + null. */
@@ -1911,7 +1998,7 @@ NCcheck(CHANNEL *cp)
     }
 #endif /* defined(DO_PYTHON) */
 
-    if (HIScheck(History, cp->av[1]) || cp->Ignore) {
+    if (InndHisCheck(cp, cp->av[1]) || cp->Ignore) {
         cp->Refused++;
         cp->Check_got++;
         snprintf(cp->Sendid.data, cp->Sendid.size, "%d %s Duplicate",
@@ -1956,6 +2043,7 @@ NCtakethis(CHANNEL *cp)
 
     cp->Takethis++;
     cp->Start = cp->Next;
+    NCtime(cp, LATtakethis);
 
     /* Check the syntax and authentication here because
      * it is not done before (TAKETHIS has to eat
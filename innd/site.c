@@ -14,6 +14,32 @@ static int SITEcount;
 static int SITEhead = NOSITE;
 static int SITEtail = NOSITE;
 static char SITEshell[] = "/bin/sh";
+static bool SITEpending = false;
+
+/*
+**  Fields of the article being sent which take some work to format.  They
+**  are formatted for the first site which wants them, and then copied as is
+**  to the buffer of the other sites the article is sent to.
+*/
+struct sitefield {
+    bool done;
+    size_t length;
+    char text[sizeof(HASH) * 2 + 3]; /* Room for "[hash]" or a time. */
+};
+
+static struct {
+    const ARTDATA *Data;
+    HASH Hash;
+    time_t Arrived;
+    struct sitefield MessageHash;
+    struct sitefield TimeReceived;
+    struct sitefield TimePosted;
+    struct sitefield TimeExpired;
+    bool PathDone;
+    struct buffer Path;
+    bool NamesDone;
+    struct buffer Names;
+} SITEfields;
 
 
 /*
@@ -221,6 +247,66 @@ SITECHANbilge(SITE *sp)
     return true;
 }
 
+/*
+**  Write out the data of the file feeds which has waited in memory for
+**  SITE_FLUSH_TIME.  Called from the main loop; only looks at the sites
+**  once a second, and only when some data is known to wait.  If a write
+**  fails, or the channel already had trouble, the data is left to the main
+**  loop, which knows how to back off.
+*/
+void
+SITEflushpending(void)
+{
+    static time_t last = 0;
+    SITE *sp;
+    CHANNEL *cp;
+    int i;
+
+    if (!SITEpending || Now.tv_sec == last)
+        return;
+    last = Now.tv_sec;
+    SITEpending = false;
+    for (sp = Sites, i = nSites; --i >= 0; sp++) {
+        if (sp->FlushStart == 0)
+            continue;
+        if (sp->Name == NULL || sp->Type != FTfile || sp->Buffered
+            || sp->Channel == NULL || sp->Channel->Out.left == 0) {
+            sp->FlushStart = 0;
+            continue;
+        }
+        if (Now.tv_sec - sp->FlushStart < SITE_FLUSH_TIME) {
+            SITEpending = true;
+            continue;
+        }
+        sp->FlushStart = 0;
+        cp = sp->Channel;
+        if (CHANsleeping(cp))
+            continue;
+        if (cp->BadWrites > 0 || !WCHANflush(cp)) {
+            WCHANadd(cp);
+            continue;
+        }
+
+        /* The channel was not in the write set, so WCHANremove did not
+           reset the buffer; do it so that it does not keep growing. */
+        cp->Out.used = 0;
+        cp->Out.left = 0;
+        sp->TimeFlushes++;
+    }
+}
+
+
+/*
+**  Whether some file feed has data waiting to be written out, so that the
+**  main loop does not sleep for too long.
+*/
+bool
+SITEflushneeded(void)
+{
+    return SITEpending;
+}
+
+
 /*
 **  Check if we need to write out the site's buffer.  If we're buffered
 **  or the feed is backed up, this gets a bit complicated.
@@ -253,6 +339,30 @@ SITEflushcheck(SITE *sp, struct buffer *bp)
     /* Handle buffering. */
     cp = sp->Channel;
     i = cp->Out.left;
+
+    /* Unless told otherwise with B, file feeds are not written once per
+       article, but by the main loop once there is enough data for a full
+       buffer, or by SITEflushpending once the data has waited for
+       SITE_FLUSH_TIME. */
+    if (sp->Type == FTfile && sp->StartWriting == 0) {
+        cp->LastActive = Now.tv_sec;
+        if (i < SITE_BUFFER_SIZE) {
+            sp->FlushFull = false;
+            if (sp->FlushStart == 0) {
+                sp->FlushStart = Now.tv_sec;
+                SITEpending = true;
+            }
+            return;
+        }
+        sp->FlushStart = 0;
+        if (!sp->FlushFull) {
+            sp->FlushFull = true;
+            sp->SizeFlushes++;
+        }
+        if (!CHANsleeping(cp))
+            WCHANadd(cp);
+        return;
+    }
     if (i < sp->StopWriting)
         WCHANremove(cp);
     if ((sp->StartWriting == 0 || i > sp->StartWriting) && !CHANsleeping(cp)) {
@@ -320,6 +430,42 @@ SITEwrite(SITE *sp, const char *text)
 }
 
 
+/*
+**  Forget the formatted fields when they are for another article.
+*/
+static void
+SITEfieldsreset(const ARTDATA *Data)
+{
+    if (SITEfields.Data == Data && SITEfields.Arrived == Data->Arrived
+        && memcmp(&SITEfields.Hash, Data->Hash, sizeof(HASH)) == 0)
+        return;
+    SITEfields.Data = Data;
+    SITEfields.Hash = *(Data->Hash);
+    SITEfields.Arrived = Data->Arrived;
+    SITEfields.MessageHash.done = false;
+    SITEfields.TimeReceived.done = false;
+    SITEfields.TimePosted.done = false;
+    SITEfields.TimeExpired.done = false;
+    SITEfields.PathDone = false;
+    SITEfields.NamesDone = false;
+}
+
+
+/*
+**  Append a time to a site buffer, formatting it first if needed.
+*/
+static void
+SITEappendtime(struct buffer *bp, struct sitefield *field, time_t when)
+{
+    if (!field->done) {
+        field->length =
+            snprintf(field->text, sizeof(field->text), "%ld", (long) when);
+        field->done = true;
+    }
+    buffer_append(bp, field->text, field->length);
+}
+
+
 /*
 **  Send the desired data about an article down a channel.
 */
@@ -329,7 +475,7 @@ SITEwritefromflags(SITE *sp, ARTDATA *Data)
     HDRCONTENT *hc = Data->HdrContent;
     static char ITEMSEP[] = " ";
     static char NL[] = "\n";
-    char pbuff[32];
+    struct buffer *path;
     char *p;
     bool Dirty;
     struct buffer *bp;
@@ -346,6 +492,7 @@ SITEwritefromflags(SITE *sp, ARTDATA *Data)
             return;
         bp = &sp->Channel->Out;
     }
+    SITEfieldsreset(Data);
     for (Dirty = false, p = sp->FileFlags; *p; p++) {
         switch (*p) {
         default:
@@ -366,9 +513,15 @@ SITEwritefromflags(SITE *sp, ARTDATA *Data)
         case FEED_HASH:
             if (Dirty)
                 buffer_append(bp, ITEMSEP, strlen(ITEMSEP));
-            buffer_append(bp, "[", 1);
-            buffer_append(bp, HashToText(*(Data->Hash)), sizeof(HASH) * 2);
-            buffer_append(bp, "]", 1);
+            if (!SITEfields.MessageHash.done) {
+                SITEfields.MessageHash.length =
+                    snprintf(SITEfields.MessageHash.text,
+                             sizeof(SITEfields.MessageHash.text), "[%s]",
+                             HashToText(*(Data->Hash)));
+                SITEfields.MessageHash.done = true;
+            }
+            buffer_append(bp, SITEfields.MessageHash.text,
+                          SITEfields.MessageHash.length);
             break;
         case FEED_HDR_DISTRIB:
             if (Dirty)
@@ -394,18 +547,24 @@ SITEwritefromflags(SITE *sp, ARTDATA *Data)
         case FEED_PATH:
             if (Dirty)
                 buffer_append(bp, ITEMSEP, strlen(ITEMSEP));
-            if (!Data->Hassamepath || Data->AddAlias || Pathcluster.used) {
-                if (Pathcluster.used)
-                    buffer_append(bp, Pathcluster.data, Pathcluster.used);
-                buffer_append(bp, Path.data, Path.used);
-                if (Data->AddAlias)
-                    buffer_append(bp, Pathalias.data, Pathalias.used);
+            path = &SITEfields.Path;
+            if (!SITEfields.PathDone) {
+                buffer_set(path, "", 0);
+                if (!Data->Hassamepath || Data->AddAlias || Pathcluster.used) {
+                    if (Pathcluster.used)
+                        buffer_append(path, Pathcluster.data, Pathcluster.used);
+                    buffer_append(path, Path.data, Path.used);
+                    if (Data->AddAlias)
+                        buffer_append(path, Pathalias.data, Pathalias.used);
+                }
+                if (Data->Hassamecluster)
+                    buffer_append(path, HDR(HDR__PATH) + Pathcluster.used,
+                                  HDR_LEN(HDR__PATH) - Pathcluster.used);
+                else
+                    buffer_append(path, HDR(HDR__PATH), HDR_LEN(HDR__PATH));
+                SITEfields.PathDone = true;
             }
-            if (Data->Hassamecluster)
-                buffer_append(bp, HDR(HDR__PATH) + Pathcluster.used,
-                              HDR_LEN(HDR__PATH) - Pathcluster.used);
-            else
-                buffer_append(bp, HDR(HDR__PATH), HDR_LEN(HDR__PATH));
+            buffer_append(bp, path->data, path->left);
             break;
         case FEED_REPLIC:
             if (Dirty)
@@ -421,20 +580,17 @@ SITEwritefromflags(SITE *sp, ARTDATA *Data)
         case FEED_TIMERECEIVED:
             if (Dirty)
                 buffer_append(bp, ITEMSEP, strlen(ITEMSEP));
-            snprintf(pbuff, sizeof(pbuff), "%ld", (long) Data->Arrived);
-            buffer_append(bp, pbuff, strlen(pbuff));
+            SITEappendtime(bp, &SITEfields.TimeReceived, Data->Arrived);
             break;
         case FEED_TIMEPOSTED:
             if (Dirty)
                 buffer_append(bp, ITEMSEP, strlen(ITEMSEP));
-            snprintf(pbuff, sizeof(pbuff), "%ld", (long) Data->Posted);
-            buffer_append(bp, pbuff, strlen(pbuff));
+            SITEappendtime(bp, &SITEfields.TimePosted, Data->Posted);
             break;
         case FEED_TIMEEXPIRED:
             if (Dirty)
                 buffer_append(bp, ITEMSEP, strlen(ITEMSEP));
-            snprintf(pbuff, sizeof(pbuff), "%ld", (long) Data->Expires);
-            buffer_append(bp, pbuff, strlen(pbuff));
+            SITEappendtime(bp, &SITEfields.TimeExpired, Data->Expires);
             break;
         case FEED_MESSAGEID:
             if (Dirty)
@@ -448,14 +604,28 @@ SITEwritefromflags(SITE *sp, ARTDATA *Data)
                     buffer_append(bp, ITEMSEP, strlen(ITEMSEP));
                 buffer_append(bp, sp->FNLnames.data, sp->FNLnames.left);
             } else {
-                /* Not funnel; write names of all sites that got it. */
-                for (spx = Sites, i = nSites; --i >= 0; spx++)
-                    if (spx->Sendit) {
-                        if (Dirty)
-                            buffer_append(bp, ITEMSEP, strlen(ITEMSEP));
-                        buffer_append(bp, spx->Name, spx->NameLength);
-                        Dirty = true;
-                    }
+                /* Not funnel; write names of all sites that got it.  They
+                   are the same for all the sites, so only gather them once
+                   per article. */
+                if (!SITEfields.NamesDone) {
+                    buffer_set(&SITEfields.Names, "", 0);
+                    for (spx = Sites, i = nSites; --i >= 0; spx++)
+                        if (spx->Sendit) {
+                            if (SITEfields.Names.left != 0)
+                                buffer_append(&SITEfields.Names, ITEMSEP,
+                                              strlen(ITEMSEP));
+                            buffer_append(&SITEfields.Names, spx->Name,
+                                          spx->NameLength);
+                        }
+                    SITEfields.NamesDone = true;
+                }
+                if (SITEfields.Names.left != 0) {
+                    if (Dirty)
+                        buffer_append(bp, ITEMSEP, strlen(ITEMSEP));
+                    buffer_append(bp, SITEfields.Names.data,
+                                  SITEfields.Names.left);
+                    Dirty = true;
+                }
             }
             break;
         case FEED_NEWSGROUP:
@@ -1220,6 +1390,11 @@ SITEinfo(struct buffer *bp, SITE *sp, const bool Verbose)
             buffer_append_sprintf(bp, "%sSpool @ %ld", sep, sp->StartSpooling);
             sep = "; ";
         }
+        if (sp->SizeFlushes || sp->TimeFlushes) {
+            buffer_append_sprintf(bp, "%sFlushed %lu full, %lu timed", sep,
+                                  sp->SizeFlushes, sp->TimeFlushes);
+            sep = "; ";
+        }
         if (sep[0] != '\t')
             buffer_append(bp, "\n", 1);
         if (sp->Spooling && sp->SpoolName)
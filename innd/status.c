@@ -6,12 +6,19 @@
 
 #include "portable/socket.h"
 
+#include "inn/buffer.h"
+#include "inn/histogram.h"
 #include "inn/innconf.h"
 #include "inn/network.h"
+#include "inn/ov.h"
 #include "inn/version.h"
 #include "innd.h"
 #include "innperl.h"
 
+#ifdef HAVE_UNIX_DOMAIN_SOCKETS
+#    include "portable/socket-unix.h"
+#endif
+
 #define MIN_REFRESH 60 /* 1 min */
 
 typedef struct _STATUS {
@@ -47,12 +54,25 @@ typedef struct _STATUS {
     unsigned long Ihave_Duplicate;
     unsigned long Ihave_Deferred;
     unsigned long Ihave_SendIt;
+    struct histogram *latency[LATmax];
     struct _STATUS *next;
 } STATUS;
 
 static unsigned STATUSlast_time;
 static char start_time[50];
 
+/* Latencies since startup, for all channels. */
+static struct histogram *STATUSlatencies[LATmax];
+
+/* Names of the latencies, indexed by enum latency_type. */
+static const char *const STATUSlatencynames[LATmax] = {
+    "check", "takethis", "history", "store", "overview",
+};
+
+/* The statistics socket. */
+static char *STATUSpath = NULL;
+static CHANNEL *STATUSchan = NULL;
+
 static unsigned
 STATUSgettime(void)
 {
@@ -91,53 +111,68 @@ PrettySize(float size, char *str)
     return (str);
 }
 
-static void
-STATUSsummary(void)
+/*
+**  Record how long something took since start, for a channel (which may be
+**  NULL) and globally.
+*/
+void
+STATUSlatency(CHANNEL *cp, enum latency_type type, const struct timeval *start)
+{
+    struct timeval now;
+    double elapsed;
+    unsigned long value;
+
+    gettimeofday(&now, NULL);
+    elapsed = (double) (now.tv_sec - start->tv_sec) * 1000000.
+              + (double) (now.tv_usec - start->tv_usec);
+    if (elapsed < 0) /* The clock went backwards. */
+        value = 0;
+    else if (elapsed > (double) HISTOGRAM_MAX)
+        value = HISTOGRAM_MAX;
+    else
+        value = (unsigned long) elapsed;
+
+    if (STATUSlatencies[type] == NULL)
+        STATUSlatencies[type] = histogram_new();
+    histogram_record(STATUSlatencies[type], value);
+    if (cp != NULL && cp->Type == CTnntp) {
+        if (cp->Latency[type] == NULL)
+            cp->Latency[type] = histogram_new();
+        histogram_record(cp->Latency[type], value);
+    }
+}
+
+
+/*
+**  Forget the latencies of a channel being closed.
+*/
+void
+STATUSchanclose(CHANNEL *cp)
 {
-    FILE *F;
     int i;
+
+    for (i = 0; i < LATmax; i++)
+        if (cp->Latency[i] != NULL) {
+            histogram_free(cp->Latency[i]);
+            cp->Latency[i] = NULL;
+        }
+}
+
+
+/*
+**  Build the list of peers with one STATUS per host name, gathering the
+**  counters and latencies of all the current NNTP channels.  Returns the
+**  head of the list, to be freed with STATUSfree.
+*/
+static STATUS *
+STATUSgather(void)
+{
+    int i, j;
     CHANNEL *cp;
-    int activeCxn = 0;
-    int sleepingCxns = 0;
-    time_t seconds = 0;
-    unsigned long duplicate = 0;
-    unsigned long offered;
-    unsigned long accepted = 0;
-    unsigned long refused = 0;
-    unsigned long rejected = 0;
-    float size = 0;
-    float DuplicateSize = 0;
-    float RejectSize = 0;
-    int peers = 0;
     char TempString[SMBUF];
-    char *path;
     char other_ip_addr[INET6_ADDRSTRLEN];
     char *p;
     STATUS *head, *status, *tmp;
-    char str[315]; /* Maximum buffer size for PrettySize() */
-    time_t now;
-
-    if (innconf->htmlstatus) {
-        path = concatpath(innconf->pathhttp, "inn_status.html");
-    } else {
-        path = concatpath(innconf->pathlog, "inn.status");
-    }
-    if ((F = Fopen(path, "w", TEMPORARYOPEN)) == NULL) {
-        syswarn("SERVER cant open %s", path);
-        return;
-    }
-
-    /* HTML header. */
-    if (innconf->htmlstatus) {
-        fprintf(F, "<!DOCTYPE html>\n<html lang=\"en\">\n<head>\n");
-        fprintf(F, "<meta http-equiv=\"refresh\" content=\"%lu\">\n",
-                innconf->status < MIN_REFRESH ? MIN_REFRESH : innconf->status);
-        fprintf(F, "<title>%s: incoming feeds</title>\n", innconf->pathhost);
-        fprintf(F, "</head>\n<body>\n<pre>\n");
-    }
-
-    fprintf(F, "%s\n", INN_VERSION_STRING);
-    fprintf(F, "pid %d started %s\n", (int) getpid(), start_time);
 
     tmp = head = NULL;
     for (i = 0; (cp = CHANiter(&i, CTnntp)) != NULL;) {
@@ -149,34 +184,16 @@ STATUSsummary(void)
                 break;
         }
         if (status == NULL) {
-            status = xmalloc(sizeof(STATUS));
-            peers++; /* A new peer. */
+            status = xcalloc(1, sizeof(STATUS));
             strlcpy(status->name, TempString, sizeof(status->name));
-            if (cp->Address.ss_family == 0) {
-                /* Connections from lc.c do not have an IP address. */
-                memset(&status->ip_addr, 0, sizeof(status->ip_addr));
-            } else {
+            /* Connections from lc.c do not have an IP address. */
+            if (cp->Address.ss_family != 0) {
                 network_sockaddr_sprint(status->ip_addr,
                                         sizeof(status->ip_addr),
                                         (struct sockaddr *) &cp->Address);
             }
             status->can_stream = cp->Streaming;
             status->maxCxn = cp->MaxCnx;
-            status->seconds = 0;
-            status->Size = status->DuplicateSize = 0;
-            status->RejectSize = 0;
-            status->Ihave = status->Ihave_Duplicate = status->Ihave_Deferred =
-                status->Ihave_SendIt = 0;
-            status->Check = status->Check_send = status->Check_deferred =
-                status->Check_got = 0;
-            status->Takethis = status->Takethis_Ok = status->Takethis_Err = 0;
-            status->activeCxn = status->sleepingCxns = 0;
-            status->accepted = 0;
-            status->refused = status->rejected = 0;
-            status->Duplicate = status->Unwanted_u = 0;
-            status->Unwanted_d = status->Unwanted_g = 0;
-            status->Unwanted_s = status->Unwanted_f = 0;
-            status->next = NULL;
             if (head == NULL)
                 head = status;
             else
@@ -201,16 +218,10 @@ STATUSsummary(void)
 
         if (Now.tv_sec - cp->Started > status->seconds)
             status->seconds = Now.tv_sec - cp->Started;
-        if (Now.tv_sec - cp->Started > seconds)
-            seconds = Now.tv_sec - cp->Started;
         status->accepted += cp->Received;
-        accepted += cp->Received;
         status->refused += cp->Refused;
-        refused += cp->Refused;
         status->rejected += cp->Rejected;
-        rejected += cp->Rejected;
         status->Duplicate += cp->Duplicate;
-        duplicate += cp->Duplicate;
         status->Unwanted_u += cp->Unwanted_u;
         status->Unwanted_d += cp->Unwanted_d;
         status->Unwanted_g += cp->Unwanted_g;
@@ -230,17 +241,157 @@ STATUSsummary(void)
         status->Size += cp->Size;
         status->DuplicateSize += cp->DuplicateSize;
         status->RejectSize += cp->RejectSize;
-        size += cp->Size;
-        DuplicateSize += cp->DuplicateSize;
-        RejectSize += cp->RejectSize;
-        if (CHANsleeping(cp)) {
-            sleepingCxns++;
+        if (CHANsleeping(cp))
             status->sleepingCxns++;
-        } else {
-            activeCxn++;
+        else
             status->activeCxn++;
+        for (j = 0; j < LATmax; j++) {
+            if (cp->Latency[j] == NULL)
+                continue;
+            if (status->latency[j] == NULL)
+                status->latency[j] = histogram_new();
+            histogram_merge(status->latency[j], cp->Latency[j]);
         }
     }
+    return head;
+}
+
+
+/*
+**  Free a list returned by STATUSgather.
+*/
+static void
+STATUSfree(STATUS *head)
+{
+    STATUS *status;
+    int i;
+
+    while (head != NULL) {
+        status = head;
+        head = head->next;
+        for (i = 0; i < LATmax; i++)
+            if (status->latency[i] != NULL)
+                histogram_free(status->latency[i]);
+        free(status);
+    }
+}
+
+
+/*
+**  Return a percentile of a histogram as a double, for computations.
+*/
+static double
+STATUSpercentile(const struct histogram *h, double percent)
+{
+    unsigned long value;
+
+    value = histogram_percentile(h, percent);
+    return (double) value;
+}
+
+
+/*
+**  Print a table of latencies in milliseconds, skipping the ones without
+**  any value.
+*/
+static void
+STATUSprintlatency(FILE *F, struct histogram *const *latency)
+{
+    const struct histogram *h;
+    bool header = false;
+    int i;
+
+    for (i = 0; i < LATmax; i++) {
+        h = latency[i];
+        if (h == NULL || h->count == 0)
+            continue;
+        if (!header) {
+            fprintf(F, "  Latency (ms):  count      mean       p50       p90"
+                       "       p99       max\n");
+            header = true;
+        }
+        fprintf(F, "%11s: %9lu %9.3f %9.3f %9.3f %9.3f %9.3f\n",
+                STATUSlatencynames[i], h->count, histogram_mean(h) / 1000.,
+                STATUSpercentile(h, 50) / 1000.,
+                STATUSpercentile(h, 90) / 1000.,
+                STATUSpercentile(h, 99) / 1000., (double) h->max / 1000.);
+    }
+}
+
+
+/*
+**  Get the statistics of the cache of open newsgroups of the overview method,
+**  returning false if it doesn't have any.
+*/
+static bool
+STATUSovcache(struct ovcachestats *stats)
+{
+    if (!innconf->enableoverview)
+        return false;
+    return OVctl(OVCACHESTATS, stats);
+}
+
+
+static void
+STATUSsummary(void)
+{
+    FILE *F;
+    int activeCxn = 0;
+    int sleepingCxns = 0;
+    time_t seconds = 0;
+    unsigned long duplicate = 0;
+    unsigned long offered;
+    unsigned long accepted = 0;
+    unsigned long refused = 0;
+    unsigned long rejected = 0;
+    float size = 0;
+    float DuplicateSize = 0;
+    float RejectSize = 0;
+    struct ovcachestats ovcache;
+    int peers = 0;
+    char TempString[SMBUF];
+    char *path;
+    STATUS *head, *status;
+    char str[315]; /* Maximum buffer size for PrettySize() */
+    time_t now;
+
+    if (innconf->htmlstatus) {
+        path = concatpath(innconf->pathhttp, "inn_status.html");
+    } else {
+        path = concatpath(innconf->pathlog, "inn.status");
+    }
+    if ((F = Fopen(path, "w", TEMPORARYOPEN)) == NULL) {
+        syswarn("SERVER cant open %s", path);
+        return;
+    }
+
+    /* HTML header. */
+    if (innconf->htmlstatus) {
+        fprintf(F, "<!DOCTYPE html>\n<html lang=\"en\">\n<head>\n");
+        fprintf(F, "<meta http-equiv=\"refresh\" content=\"%lu\">\n",
+                innconf->status < MIN_REFRESH ? MIN_REFRESH : innconf->status);
+        fprintf(F, "<title>%s: incoming feeds</title>\n", innconf->pathhost);
+        fprintf(F, "</head>\n<body>\n<pre>\n");
+    }
+
+    fprintf(F, "%s\n", INN_VERSION_STRING);
+    fprintf(F, "pid %d started %s\n", (int) getpid(), start_time);
+
+    head = STATUSgather();
+    for (status = head; status != NULL; status = status->next) {
+        peers++;
+        if (status->seconds > seconds)
+            seconds = status->seconds;
+        accepted += status->accepted;
+        refused += status->refused;
+        rejected += status->rejected;
+        duplicate += status->Duplicate;
+        size += status->Size;
+        DuplicateSize += status->DuplicateSize;
+        RejectSize += status->RejectSize;
+        activeCxn += status->activeCxn;
+        sleepingCxns += status->sleepingCxns;
+    }
 
     /* Header */
     now = time(NULL);
@@ -316,6 +467,17 @@ STATUSsummary(void)
             (double) (DuplicateSize / size * 100));
     fprintf(F, "   rejected size: %-7s    %%rejected size: %.1f%%\n",
             PrettySize(RejectSize, str), (double) (RejectSize / size * 100));
+    STATUSprintlatency(F, STATUSlatencies);
+    if (STATUSovcache(&ovcache)) {
+        fprintf(F, "  overview cache: %lu of %lu groups\n", ovcache.count,
+                ovcache.size);
+        fprintf(F, "overview lookups: %-9lu           %%hits: %.1f%%\n",
+                ovcache.lookups,
+                (double) ovcache.hits
+                    / (double) (ovcache.lookups > 0 ? ovcache.lookups : 1)
+                    * 100);
+        fprintf(F, "overview evicted: %-9lu\n", ovcache.evictions);
+    }
     fputc('\n', F);
 
     if (innconf->logstatus) {
@@ -327,7 +489,7 @@ STATUSsummary(void)
     }
 
     /* Incoming Feeds */
-    for (status = head; status != NULL;) {
+    for (status = head; status != NULL; status = status->next) {
         fprintf(F, "%s\n", status->name);
         fprintf(F, " ip address: %s\n", status->ip_addr);
         fprintf(F, "    seconds: %-7ld  ", (long) status->seconds);
@@ -368,6 +530,7 @@ STATUSsummary(void)
         fprintf(F, "   Takethis: %-6lu     Ok[%d]: %-6lu  Error[%d]: %-6lu\n",
                 status->Takethis, NNTP_OK_TAKETHIS, status->Takethis_Ok,
                 NNTP_FAIL_TAKETHIS_REJECT, status->Takethis_Err);
+        STATUSprintlatency(F, status->latency);
         fputc('\n', F);
 
         if (innconf->logstatus) {
@@ -380,11 +543,8 @@ STATUSsummary(void)
                 (double) status->Size, (double) status->DuplicateSize,
                 (double) status->RejectSize);
         }
-
-        tmp = status->next;
-        free(status);
-        status = tmp;
     }
+    STATUSfree(head);
 
     /* HTML footer. */
     if (innconf->htmlstatus) {
@@ -409,3 +569,357 @@ STATUSmainloophook(void)
         STATUSlast_time = now;
     }
 }
+
+
+/*
+**  Append a string to a buffer, escaped for a JSON string or a Prometheus
+**  label value (the escapes needed by the latter are a subset of JSON's).
+*/
+static void
+STATUSappendescaped(struct buffer *bp, const char *string)
+{
+    const char *p;
+
+    for (p = string; *p != '\0'; p++) {
+        if (*p == '"' || *p == '\\')
+            buffer_append_sprintf(bp, "\\%c", *p);
+        else if (*p == '\n')
+            buffer_append(bp, "\\n", 2);
+        else if ((unsigned char) *p < 0x20)
+            buffer_append_sprintf(bp, "\\u%04x", (unsigned char) *p);
+        else
+            buffer_append(bp, p, 1);
+    }
+}
+
+
+/*
+**  Append one latency histogram as a Prometheus summary, in seconds.  peer
+**  is NULL for the global latencies.
+*/
+static void
+STATUSprometheuslatency(struct buffer *bp, const char *metric,
+                        const char *peer, enum latency_type type,
+                        const struct histogram *h)
+{
+    static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    struct buffer labels = {0, 0, 0, NULL};
+    size_t i;
+
+    if (peer != NULL) {
+        buffer_append_sprintf(&labels, "peer=\"");
+        STATUSappendescaped(&labels, peer);
+        buffer_append_sprintf(&labels, "\",");
+    }
+    buffer_append_sprintf(&labels, "operation=\"%s\"",
+                          STATUSlatencynames[type]);
+    buffer_append(&labels, "", 1);
+
+    for (i = 0; i < ARRAY_SIZE(quantiles); i++)
+        buffer_append_sprintf(bp, "%s{%s,quantile=\"%g\"} %.6f\n", metric,
+                              labels.data, quantiles[i],
+                              STATUSpercentile(h, quantiles[i] * 100) / 1e6);
+    buffer_append_sprintf(bp, "%s_sum{%s} %.6f\n", metric, labels.data,
+                          h->total / 1e6);
+    buffer_append_sprintf(bp, "%s_count{%s} %lu\n", metric, labels.data,
+                          h->count);
+    free(labels.data);
+}
+
+
+/*
+**  Append all the statistics in the Prometheus text exposition format.
+*/
+static void
+STATUSprometheus(struct buffer *bp, STATUS *head)
+{
+    STATUS *status;
+    struct ovcachestats ovcache;
+    int i;
+
+    buffer_append_sprintf(bp, "# HELP innd_latency_seconds Latency of innd "
+                              "operations since startup.\n");
+    buffer_append_sprintf(bp, "# TYPE innd_latency_seconds summary\n");
+    for (i = 0; i < LATmax; i++)
+        if (STATUSlatencies[i] != NULL)
+            STATUSprometheuslatency(bp, "innd_latency_seconds", NULL, i,
+                                    STATUSlatencies[i]);
+
+    buffer_append_sprintf(bp, "# HELP innd_peer_latency_seconds Latency of "
+                              "operations for connected peers.\n");
+    buffer_append_sprintf(bp, "# TYPE innd_peer_latency_seconds summary\n");
+    for (status = head; status != NULL; status = status->next)
+        for (i = 0; i < LATmax; i++)
+            if (status->latency[i] != NULL)
+                STATUSprometheuslatency(bp, "innd_peer_latency_seconds",
+                                        status->name, i, status->latency[i]);
+
+    buffer_append_sprintf(bp, "# HELP innd_peer_articles Articles offered "
+                              "by connected peers.\n");
+    buffer_append_sprintf(bp, "# TYPE innd_peer_articles gauge\n");
+    for (status = head; status != NULL; status = status->next) {
+        const char *results[] = {"accepted", "refused", "rejected",
+                                 "duplicate"};
+        unsigned long counts[4];
+
+        counts[0] = status->accepted;
+        counts[1] = status->refused;
+        counts[2] = status->rejected;
+        counts[3] = status->Duplicate;
+        for (i = 0; i < 4; i++) {
+            buffer_append_sprintf(bp, "innd_peer_articles{peer=\"");
+            STATUSappendescaped(bp, status->name);
+            buffer_append_sprintf(bp, "\",result=\"%s\"} %lu\n", results[i],
+                                  counts[i]);
+        }
+    }
+
+    buffer_append_sprintf(bp, "# HELP innd_peer_connections Connections "
+                              "from peers.\n");
+    buffer_append_sprintf(bp, "# TYPE innd_peer_connections gauge\n");
+    for (status = head; status != NULL; status = status->next) {
+        buffer_append_sprintf(bp, "innd_peer_connections{peer=\"");
+        STATUSappendescaped(bp, status->name);
+        buffer_append_sprintf(bp, "\"} %u\n",
+                              status->activeCxn + status->sleepingCxns);
+    }
+
+    if (STATUSovcache(&ovcache)) {
+        buffer_append_sprintf(bp, "# HELP innd_overview_cache_groups "
+                                  "Newsgroups in the overview cache.\n");
+        buffer_append_sprintf(bp, "# TYPE innd_overview_cache_groups gauge\n");
+        buffer_append_sprintf(bp, "innd_overview_cache_groups %lu\n",
+                              ovcache.count);
+        buffer_append_sprintf(bp, "# HELP innd_overview_cache_total Lookups, "
+                                  "hits and evictions of the overview "
+                                  "cache.\n");
+        buffer_append_sprintf(bp, "# TYPE innd_overview_cache_total counter\n");
+        buffer_append_sprintf(bp,
+                              "innd_overview_cache_total{event=\"lookup\"} "
+                              "%lu\n",
+                              ovcache.lookups);
+        buffer_append_sprintf(bp,
+                              "innd_overview_cache_total{event=\"hit\"} "
+                              "%lu\n",
+                              ovcache.hits);
+        buffer_append_sprintf(bp,
+                              "innd_overview_cache_total{event=\"eviction\"} "
+                              "%lu\n",
+                              ovcache.evictions);
+    }
+}
+
+
+/*
+**  Append a JSON object with the latencies that have values, in seconds.
+*/
+static void
+STATUSjsonlatency(struct buffer *bp, struct histogram *const *latency)
+{
+    const struct histogram *h;
+    bool first = true;
+    int i;
+
+    buffer_append(bp, "{", 1);
+    for (i = 0; i < LATmax; i++) {
+        h = latency[i];
+        if (h == NULL || h->count == 0)
+            continue;
+        buffer_append_sprintf(
+            bp,
+            "%s\"%s\":{\"count\":%lu,\"mean\":%.6f,\"p50\":%.6f,"
+            "\"p90\":%.6f,\"p99\":%.6f,\"p999\":%.6f,\"max\":%.6f}",
+            first ? "" : ",", STATUSlatencynames[i], h->count,
+            histogram_mean(h) / 1e6, STATUSpercentile(h, 50) / 1e6,
+            STATUSpercentile(h, 90) / 1e6, STATUSpercentile(h, 99) / 1e6,
+            STATUSpercentile(h, 99.9) / 1e6, (double) h->max / 1e6);
+        first = false;
+    }
+    buffer_append(bp, "}", 1);
+}
+
+
+/*
+**  Append all the statistics as a JSON object.
+*/
+static void
+STATUSjson(struct buffer *bp, STATUS *head)
+{
+    STATUS *status;
+    struct ovcachestats ovcache;
+
+    buffer_append_sprintf(bp, "{\"version\":\"");
+    STATUSappendescaped(bp, INN_VERSION_STRING);
+    buffer_append_sprintf(bp, "\",\"pid\":%d,\"latency\":", (int) getpid());
+    STATUSjsonlatency(bp, STATUSlatencies);
+    buffer_append_sprintf(bp, ",\"peers\":[");
+    for (status = head; status != NULL; status = status->next) {
+        buffer_append_sprintf(bp, "%s{\"name\":\"", status == head ? "" : ",");
+        STATUSappendescaped(bp, status->name);
+        buffer_append_sprintf(
+            bp,
+            "\",\"connections\":%u,\"seconds\":%ld,\"accepted\":%lu,"
+            "\"refused\":%lu,\"rejected\":%lu,\"duplicate\":%lu,"
+            "\"latency\":",
+            status->activeCxn + status->sleepingCxns, (long) status->seconds,
+            status->accepted, status->refused, status->rejected,
+            status->Duplicate);
+        STATUSjsonlatency(bp, status->latency);
+        buffer_append(bp, "}", 1);
+    }
+    buffer_append(bp, "]", 1);
+    if (STATUSovcache(&ovcache))
+        buffer_append_sprintf(
+            bp,
+            ",\"overview_cache\":{\"size\":%lu,\"groups\":%lu,"
+            "\"lookups\":%lu,\"hits\":%lu,\"evictions\":%lu}",
+            ovcache.size, ovcache.count, ovcache.lookups, ovcache.hits,
+            ovcache.evictions);
+    buffer_append_sprintf(bp, "}\n");
+}
+
+
+#ifdef HAVE_UNIX_DOMAIN_SOCKETS
+
+/*
+**  Read function for a client of the statistics socket.  The first read
+**  holds the request, which is the name of the wanted format; an empty
+**  request gets the Prometheus format.  Queue the answer and stop reading.
+*/
+static void
+STATUSreader(CHANNEL *cp)
+{
+    char buff[SMBUF];
+    ssize_t n;
+    STATUS *head;
+
+    n = read(cp->fd, buff, sizeof(buff) - 1);
+    if (n < 0) {
+        if (errno == EAGAIN || errno == EINTR)
+            return;
+        syswarn("%s cant read", CHANname(cp));
+        CHANclose(cp, CHANname(cp));
+        return;
+    }
+    buff[n] = '\0';
+    buff[strcspn(buff, " \t\r\n")] = '\0';
+    RCHANremove(cp);
+    SCHANremove(cp);
+
+    head = STATUSgather();
+    if (strcasecmp(buff, "json") == 0)
+        STATUSjson(&cp->Out, head);
+    else if (buff[0] == '\0' || strcasecmp(buff, "prometheus") == 0)
+        STATUSprometheus(&cp->Out, head);
+    else
+        buffer_append_sprintf(&cp->Out, "unknown format %s\n",
+                              MaxLength(buff, buff));
+    STATUSfree(head);
+    WCHANadd(cp);
+}
+
+
+/*
+**  Write-done function for a client of the statistics socket.  One answer
+**  per connection.
+*/
+static void
+STATUSwritedone(CHANNEL *cp)
+{
+    CHANclose(cp, CHANname(cp));
+}
+
+
+/*
+**  Drop a client of the statistics socket that does not ask for anything.
+*/
+static void
+STATUStimeout(CHANNEL *cp)
+{
+    notice("%s timeout", CHANname(cp));
+    CHANclose(cp, CHANname(cp));
+}
+
+
+/*
+**  Read function for the statistics socket.  Accept the connection and
+**  wait for the request.
+*/
+static void
+STATUSaccept(CHANNEL *cp)
+{
+    int fd;
+    CHANNEL *new;
+
+    if ((fd = accept(cp->fd, NULL, NULL)) < 0) {
+        syswarn("%s cant accept %s", LogName, CHANname(cp));
+        return;
+    }
+    new = CHANcreate(fd, CTstats, CSgetcmd, STATUSreader, STATUSwritedone);
+    RCHANadd(new);
+    SCHANadd(new, Now.tv_sec + REJECT_TIMEOUT, NULL, STATUStimeout, NULL);
+}
+
+#endif /* HAVE_UNIX_DOMAIN_SOCKETS */
+
+
+/*
+**  Create the statistics socket, if wanted.  Failing to do so is not fatal
+**  since the server can work without it.
+*/
+void
+STATUSsetup(void)
+{
+#if defined(HAVE_UNIX_DOMAIN_SOCKETS)
+    int fd;
+    struct sockaddr_un server;
+
+    if (!innconf->statssocket)
+        return;
+    if (STATUSpath == NULL)
+        STATUSpath = concatpath(innconf->pathrun, INN_PATH_STATSSOCKET);
+    if (unlink(STATUSpath) < 0 && errno != ENOENT) {
+        syswarn("SERVER cant unlink %s", STATUSpath);
+        return;
+    }
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        syswarn("SERVER cant socket %s", STATUSpath);
+        return;
+    }
+    memset(&server, 0, sizeof server);
+    server.sun_family = AF_UNIX;
+    strlcpy(server.sun_path, STATUSpath, sizeof(server.sun_path));
+    if (bind(fd, (struct sockaddr *) &server, SUN_LEN(&server)) < 0) {
+        syswarn("SERVER cant bind %s", STATUSpath);
+        close(fd);
+        return;
+    }
+    if (listen(fd, innconf->maxlisten) < 0) {
+        syswarn("SERVER cant listen %s", STATUSpath);
+        close(fd);
+        return;
+    }
+    STATUSchan = CHANcreate(fd, CTstats, CSwaiting, STATUSaccept, NULL);
+    notice("SERVER statssetup %s", CHANname(STATUSchan));
+    RCHANadd(STATUSchan);
+#endif /* defined(HAVE_UNIX_DOMAIN_SOCKETS) */
+}
+
+
+/*
+**  Close the statistics socket.
+*/
+void
+STATUSclose(void)
+{
+#if defined(HAVE_UNIX_DOMAIN_SOCKETS)
+    if (STATUSchan == NULL)
+        return;
+    CHANclose(STATUSchan, CHANname(STATUSchan));
+    STATUSchan = NULL;
+    if (unlink(STATUSpath) < 0)
+        syswarn("SERVER cant unlink %s", STATUSpath);
+    free(STATUSpath);
+    STATUSpath = NULL;
+#endif /* defined(HAVE_UNIX_DOMAIN_SOCKETS) */
+}
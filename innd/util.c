@@ -370,6 +370,22 @@ InndHisRemember(const char *key, time_t posted)
     return r;
 }
 
+/*
+**  Check whether a message-ID is in history, keeping track of how long the
+**  lookup took for the channel asking.
+*/
+bool
+InndHisCheck(CHANNEL *cp, const char *key)
+{
+    struct timeval start;
+    bool r;
+
+    gettimeofday(&start, NULL);
+    r = HIScheck(History, key);
+    STATUSlatency(cp, LAThistory, &start);
+    return r;
+}
+
 void
 InndHisLogStats(void)
 {
@@ -1538,6 +1538,27 @@ endpointConfigLoadCbk(void *data)
 }
 
 
+/* Start the timers, exporting them to a file named after our process ID if
+   wanted.  The file is removed when exiting. */
+void
+endpointTimers(void)
+{
+    char *name, *path;
+
+    if (innconf->timer == 0)
+        return;
+    TMRinit(TMR_MAX);
+    if (innconf->timerexport) {
+        xasprintf(&name, "innfeed-%ld.timers", (long) getpid());
+        path = concatpath(innconf->pathrun, name);
+        if (TMRexport(path, timer_name))
+            atexit(TMRfree);
+        free(path);
+        free(name);
+    }
+}
+
+
 static void
 endpointCleanup(void)
 {
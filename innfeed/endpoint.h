@@ -162,4 +162,7 @@ void freeTimeoutQueue(void);
 
 int endpointConfigLoadCbk(void *data);
 
+/* start the timers if innconf wants them, exporting them if asked to */
+void endpointTimers(void);
+
 #endif /* ENDPOINT_H */
@@ -419,8 +419,7 @@ main(int argc, char **argv)
             syswarn("ME oserr setrlimit(RLIM_NOFILE,%ld)",
                     innconf->rlimitnofile);
 
-    if (innconf->timer != 0)
-        TMRinit(TMR_MAX);
+    endpointTimers();
 
     configHosts(talkToSelf);
 
@@ -0,0 +1,138 @@
+/*
+**  Latency histograms.
+**
+**  Values below HISTOGRAM_SUB each get their own bucket.  Above that, a
+**  value v with 2^(s + SUB_BITS) <= v < 2^(s + SUB_BITS + 1) goes into
+**  bucket s * HISTOGRAM_SUB + (v >> s), so each power of two is covered by
+**  HISTOGRAM_SUB buckets of equal width and the relative error of a bucket
+**  never exceeds 1 / HISTOGRAM_SUB.  This is the same layout as an HDR
+**  histogram with a single significant figure of precision, which is all
+**  that is needed to tell a p99 of 2ms from one of 200ms.
+*/
+
+#include "portable/system.h"
+
+#include "inn/histogram.h"
+#include "inn/xmalloc.h"
+
+
+/*
+**  Return the bucket a value is counted in.
+*/
+static unsigned int
+histogram_index(unsigned long value)
+{
+    unsigned int shift = 0;
+
+    if (value > HISTOGRAM_MAX)
+        value = HISTOGRAM_MAX;
+    if (value < HISTOGRAM_SUB)
+        return value;
+    while ((value >> shift) >= 2 * HISTOGRAM_SUB)
+        shift++;
+    return shift * HISTOGRAM_SUB + (value >> shift);
+}
+
+
+/*
+**  Return the largest value counted in a given bucket.
+*/
+static unsigned long
+histogram_upper(unsigned int index)
+{
+    unsigned int shift;
+
+    if (index < 2 * HISTOGRAM_SUB)
+        return index;
+    shift = index / HISTOGRAM_SUB - 1;
+    return ((unsigned long) (index - shift * HISTOGRAM_SUB + 1) << shift) - 1;
+}
+
+
+struct histogram *
+histogram_new(void)
+{
+    struct histogram *h;
+
+    h = xmalloc(sizeof(struct histogram));
+    histogram_reset(h);
+    return h;
+}
+
+
+void
+histogram_free(struct histogram *h)
+{
+    free(h);
+}
+
+
+void
+histogram_reset(struct histogram *h)
+{
+    memset(h, 0, sizeof(struct histogram));
+}
+
+
+void
+histogram_record(struct histogram *h, unsigned long value)
+{
+    h->buckets[histogram_index(value)]++;
+    h->count++;
+    h->total += value;
+    if (value > h->max)
+        h->max = value;
+}
+
+
+void
+histogram_merge(struct histogram *h, const struct histogram *other)
+{
+    unsigned int i;
+
+    if (other->count == 0)
+        return;
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+        h->buckets[i] += other->buckets[i];
+    h->count += other->count;
+    h->total += other->total;
+    if (other->max > h->max)
+        h->max = other->max;
+}
+
+
+double
+histogram_mean(const struct histogram *h)
+{
+    if (h->count == 0)
+        return 0;
+    return h->total / h->count;
+}
+
+
+unsigned long
+histogram_percentile(const struct histogram *h, double percent)
+{
+    unsigned long rank, seen;
+    unsigned long value;
+    unsigned int i;
+
+    if (h->count == 0)
+        return 0;
+    if (percent >= 100)
+        return h->max;
+
+    /* The rank of the value we want, counting from 1. */
+    rank = (unsigned long) (percent / 100 * h->count + 0.5);
+    if (rank == 0)
+        rank = 1;
+    for (seen = 0, i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank)
+            break;
+    }
+    if (i == HISTOGRAM_BUCKETS)
+        return h->max;
+    value = histogram_upper(i);
+    return value > h->max ? h->max : value;
+}
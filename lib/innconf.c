@@ -86,6 +86,7 @@ static const struct config config_table[] = {
     {K(sourceaddress6),             STRING(NULL)      },
     {K(syntaxchecks),               LIST(NULL)        },
     {K(timer),                      UNUMBER(600)      },
+    {K(timerexport),                BOOL(false)       },
 
     {K(runasuser),                  STRING(RUNASUSER) },
     {K(runasgroup),                 STRING(RUNASGROUP)},
@@ -118,6 +119,9 @@ static const struct config config_table[] = {
     {K(datamovethreshold),          UNUMBER(16384)    },
     {K(docancels),                  STRING(NULL)      },
     {K(dontrejectfiltered),         BOOL(false)       },
+    {K(filterworkerreject),         BOOL(false)       },
+    {K(filterworkers),              UNUMBER(0)        },
+    {K(filterworkertimeout),        UNUMBER(10)       },
     {K(hiscachesize),               UNUMBER(256)      },
     {K(htmlstatus),                 BOOL(true)        },
     {K(icdsynccount),               UNUMBER(10)       },
@@ -143,6 +147,7 @@ static const struct config config_table[] = {
     {K(readerswhenstopped),         BOOL(false)       },
     {K(remembertrash),              BOOL(true)        },
     {K(stathist),                   STRING(NULL)      },
+    {K(statssocket),                BOOL(false)       },
     {K(status),                     UNUMBER(600)      },
     {K(verifygroups),               BOOL(false)       },
     {K(wanttrash),                  BOOL(false)       },
@@ -203,6 +208,8 @@ static const struct config config_table[] = {
     {K(nnrpdpostport),              UNUMBER(119)      },
 
  /* The following settings are specific to the storage subsystem. */
+    {K(articlecache),               UNUMBER(0)        },
+    {K(articlecachestore),          BOOL(false)       },
     {K(articlemmap),                BOOL(true)        },
     {K(cnfscheckfudgesize),         UNUMBER(0)        },
     {K(immediatecancel),            BOOL(false)       },
@@ -210,9 +217,11 @@ static const struct config config_table[] = {
     {K(nfswriter),                  BOOL(false)       },
     {K(nnrpdcheckart),              BOOL(true)        },
     {K(overcachesize),              UNUMBER(128)      },
+    {K(overcachereadersize),        UNUMBER(1)        },
     {K(ovgrouppat),                 STRING(NULL)      },
     {K(storeonxref),                BOOL(true)        },
     {K(tradindexedmmap),            BOOL(true)        },
+    {K(tradindexedpacked),          BOOL(false)       },
     {K(useoverchan),                BOOL(false)       },
     {K(wireformat),                 BOOL(true)        },
 
@@ -30,14 +30,28 @@
 **  be a sub-timer of more than one timer or a timer without a parent, and
 **  each of those counts will be reported separately.
 **
+**  Durations are measured in microseconds with a monotonic clock when the
+**  system has one, so that they are not skewed by changes of the system
+**  time, and are still reported in milliseconds by TMRsummary.  If TMRexport
+**  has been called, each timer also records its durations in a histogram
+**  kept in a shared memory-mapped file, so that tail latencies can be
+**  followed live by an external tool without waiting for a summary.
+**
 **  Note that this code is not thread-safe and in fact would need to be
 **  completely overhauled for a threaded server (since the idea of global
 **  timing statistics doesn't make as much sense when different tasks are
-**  done in different threads).
+**  done in different threads).  Each process has its own timers and its own
+**  export file, which is the only writer of that file.
 */
 
 #include "portable/system.h"
 
+#include "portable/mmap.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
 #include <syslog.h>
 
 #ifdef HAVE_SYS_TIME_H
@@ -65,13 +79,16 @@
    Note that without the parent pointer, this is a tree.  id is the
    identifier of the timer.  start stores the time (relative to the last
    summary) at which TMRstart was last called for each timer.  total is
-   the total time accrued by that timer since the last summary.  count is
-   the number of times the timer has been stopped since the last summary. */
+   the total time accrued by that timer since the last summary, in
+   microseconds.  count is the number of times the timer has been stopped
+   since the last summary.  latency points to the histogram of the timer in
+   the export file, if any. */
 struct timer {
     unsigned int id;
     unsigned long start;
-    unsigned long total;
+    double total;
     unsigned long count;
+    struct histogram *latency;
 
     struct timer *parent;
     struct timer *brother;
@@ -81,6 +98,12 @@ static struct timer **timers = NULL;
 static struct timer *timer_current = NULL;
 static unsigned int timer_count = 0;
 
+/* The export file, if any, and the labels to name its slots with. */
+static struct timer_export *timer_export = NULL;
+static char *timer_export_path = NULL;
+static const char *const *timer_export_labels = NULL;
+static bool timer_export_full = false;
+
 /* Names for all of the timers.  These must be given in the same order
    as the definition of the enum in timer.h. */
 static const char *const timer_name[TMR_APPLICATION] = {
@@ -106,6 +129,41 @@ TMRnow_double(void)
 }
 
 
+/*
+**  Get the current time from a monotonic clock if there is one, or else
+**  from the system time.  Only differences between two results matter.
+*/
+static void
+TMRclock(struct timeval *tv)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+        tv->tv_sec = ts.tv_sec;
+        tv->tv_usec = ts.tv_nsec / 1000;
+        return;
+    }
+#endif
+    gettimeofday(tv, NULL);
+}
+
+
+/*
+**  Returns the current time in microseconds, modulo the size of an unsigned
+**  long.  The difference between two results is right as long as it fits,
+**  which is more than an hour even with 32-bit longs.
+*/
+static unsigned long
+TMRgetusec(void)
+{
+    struct timeval tv;
+
+    TMRclock(&tv);
+    return (unsigned long) tv.tv_sec * 1000000UL + (unsigned long) tv.tv_usec;
+}
+
+
 /*
 **  Returns the number of milliseconds since the base time.  This gives
 **  better resolution than time, but the return value is a lot easier to
@@ -127,7 +185,7 @@ TMRgettime(bool reset)
        arithmetic, this approach is less confusing to follow. */
     static struct timeval base;
 
-    gettimeofday(&tv, NULL);
+    TMRclock(&tv);
     now = (unsigned long) (tv.tv_sec - base.tv_sec) * 1000u;
     usec = tv.tv_usec - base.tv_usec; /* maybe negative */
     msec = usec / 1000;               /* still maybe negative */
@@ -176,7 +234,8 @@ TMRfreeone(struct timer *timer)
 
 
 /*
-**  Free all timers and the resources devoted to them.
+**  Free all timers and the resources devoted to them, including the export
+**  file which is removed.
 */
 void
 TMRfree(void)
@@ -188,7 +247,87 @@ TMRfree(void)
             TMRfreeone(timers[i]);
     free(timers);
     timers = NULL;
+    timer_current = NULL;
     timer_count = 0;
+
+    if (timer_export != NULL) {
+        if (munmap((void *) timer_export, sizeof(struct timer_export)) < 0)
+            syswarn("cannot munmap %s", timer_export_path);
+        if (unlink(timer_export_path) < 0 && errno != ENOENT)
+            syswarn("cannot remove %s", timer_export_path);
+        free(timer_export_path);
+        timer_export = NULL;
+        timer_export_path = NULL;
+        timer_export_labels = NULL;
+        timer_export_full = false;
+    }
+}
+
+
+/*
+**  Return the label associated with timer number id.  Used internally
+**  to do the right thing when fetching from the timer_name or labels
+**  arrays
+*/
+static const char *
+TMRlabel(const char *const *labels, unsigned int id)
+{
+    if (id >= TMR_APPLICATION)
+        return labels[id - TMR_APPLICATION];
+    else
+        return timer_name[id];
+}
+
+
+/*
+**  Give a timer node a slot in the export file, if there is one and it is
+**  not full, naming it like TMRsumone does.
+*/
+static void
+TMRexportone(struct timer *timer)
+{
+    struct timer_export_slot *slot;
+    struct timer *node;
+    size_t off = 0;
+    int rc;
+
+    if (timer_export == NULL || timer->latency != NULL)
+        return;
+    if (timer_export->slots >= TMR_EXPORT_SLOTS) {
+        if (!timer_export_full)
+            warn("too many timers to export, ignoring the others");
+        timer_export_full = true;
+        return;
+    }
+    slot = &timer_export->slot[timer_export->slots];
+    histogram_reset(&slot->latency);
+    for (node = timer; node != NULL && off < sizeof(slot->name);
+         node = node->parent) {
+        rc = snprintf(slot->name + off, sizeof(slot->name) - off, "%s/",
+                      TMRlabel(timer_export_labels, node->id));
+        if (rc > 0)
+            off += rc;
+    }
+    if (off > sizeof(slot->name))
+        off = sizeof(slot->name);
+    if (off > 0)
+        slot->name[off - 1] = '\0';
+    timer->latency = &slot->latency;
+    timer_export->slots++;
+}
+
+
+/*
+**  Recursively give slots in the export file to a tree of existing timers.
+*/
+static void
+TMRexporttree(struct timer *timer)
+{
+    if (timer == NULL)
+        return;
+    TMRexportone(timer);
+    TMRexporttree(timer->child);
+    TMRexporttree(timer->brother);
 }
 
 
@@ -208,6 +347,8 @@ TMRnew(unsigned int id, struct timer *parent)
     timer->start = 0;
     timer->total = 0;
     timer->count = 0;
+    timer->latency = NULL;
+    TMRexportone(timer);
     return timer;
 }
 
@@ -258,7 +399,7 @@ TMRstart(unsigned int timer)
             }
         }
     }
-    timer_current->start = TMRgettime(false);
+    timer_current->start = TMRgetusec();
 }
 
 
@@ -269,6 +410,8 @@ TMRstart(unsigned int timer)
 void
 TMRstop(unsigned int timer)
 {
+    unsigned long elapsed;
+
     if (timer_count == 0) {
         /* this should happen if innconf->timer == 0 */
         return;
@@ -279,8 +422,11 @@ TMRstop(unsigned int timer)
         warn("timer %u stopped doesn't match running timer %u", timer,
              timer_current->id);
     else {
-        timer_current->total += TMRgettime(false) - timer_current->start;
+        elapsed = TMRgetusec() - timer_current->start;
+        timer_current->total += elapsed;
         timer_current->count++;
+        if (timer_current->latency != NULL)
+            histogram_record(timer_current->latency, elapsed);
         timer_current = timer_current->parent;
     }
 }
@@ -298,21 +444,6 @@ TMRnow(void)
 }
 
 
-/*
-**  Return the label associated with timer number id.  Used internally
-**  to do the right thing when fetching from the timer_name or labels
-**  arrays
-*/
-static const char *
-TMRlabel(const char *const *labels, unsigned int id)
-{
-    if (id >= TMR_APPLICATION)
-        return labels[id - TMR_APPLICATION];
-    else
-        return timer_name[id];
-}
-
-
 /*
 **  Recursively summarize a single timer tree into the supplied buffer,
 **  returning the number of characters added to the buffer.
@@ -342,8 +473,8 @@ TMRsumone(const char *const *labels, struct timer *timer, char *buf,
     if (off > 0)
         off--;
 
-    rc = snprintf(buf + off, len - off, " %lu(%lu) ", timer->total,
-                  timer->count);
+    rc = snprintf(buf + off, len - off, " %lu(%lu) ",
+                  (unsigned long) (timer->total / 1000), timer->count);
     if (rc < 0) {
         /* Do nothing. */
     } else if ((size_t) rc >= len - off) {
@@ -418,3 +549,103 @@ TMRsummary(const char *prefix, const char *const *labels)
     notice("%s", buf);
     free(buf);
 }
+
+
+/*
+**  Export the timers to the given file, creating or truncating it, and keep
+**  updating it until TMRfree.  Must be called after TMRinit, with the labels
+**  that will be given to TMRsummary.  Returns false on failure, after
+**  reporting the error with syswarn.
+*/
+bool
+TMRexport(const char *path, const char *const *labels)
+{
+    int fd;
+    void *p;
+    unsigned int i;
+
+    if (timer_count == 0 || timer_export != NULL)
+        return false;
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        syswarn("cannot open %s", path);
+        return false;
+    }
+    if (ftruncate(fd, sizeof(struct timer_export)) < 0) {
+        syswarn("cannot extend %s", path);
+        close(fd);
+        unlink(path);
+        return false;
+    }
+    p = mmap(NULL, sizeof(struct timer_export), PROT_READ | PROT_WRITE,
+             MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        syswarn("cannot mmap %s", path);
+        unlink(path);
+        return false;
+    }
+    timer_export = p;
+    timer_export_path = xstrdup(path);
+    timer_export_labels = labels;
+    timer_export->pid = (long) getpid();
+    timer_export->started = (long) time(NULL);
+    timer_export->slots = 0;
+    timer_export->magic = TMR_EXPORT_MAGIC;
+    for (i = 0; i < timer_count; i++)
+        TMRexporttree(timers[i]);
+    return true;
+}
+
+
+/*
+**  Remove the export files left in dir by processes that died without
+**  calling TMRfree, such as a crashed nnrpd.  Only files named *.timers with
+**  a complete header are looked at, so that a file still being set up by
+**  TMRexport is left alone.  Returns the number of files removed.
+*/
+int
+TMRexportclean(const char *dir)
+{
+    DIR *d;
+    struct dirent *de;
+    struct timer_export header;
+    struct stat st;
+    char *path;
+    size_t len;
+    ssize_t got;
+    int fd;
+    int count = 0;
+
+    d = opendir(dir);
+    if (d == NULL) {
+        syswarn("cannot open %s", dir);
+        return 0;
+    }
+    while ((de = readdir(d)) != NULL) {
+        len = strlen(de->d_name);
+        if (len <= 7 || strcmp(de->d_name + len - 7, ".timers") != 0)
+            continue;
+        path = concatpath(dir, de->d_name);
+        fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            free(path);
+            continue;
+        }
+        got = -1;
+        if (fstat(fd, &st) == 0 && st.st_size == sizeof(struct timer_export))
+            got = read(fd, &header, offsetof(struct timer_export, slot));
+        close(fd);
+        if (got == (ssize_t) offsetof(struct timer_export, slot)
+            && header.magic == TMR_EXPORT_MAGIC && header.pid > 0
+            && kill((pid_t) header.pid, 0) < 0 && errno == ESRCH) {
+            if (unlink(path) < 0 && errno != ENOENT)
+                syswarn("cannot remove %s", path);
+            else
+                count++;
+        }
+        free(path);
+    }
+    closedir(d);
+    return count;
+}
@@ -0,0 +1,30 @@
+dnl Check for support for the __atomic builtins.
+dnl
+dnl Provides INN_C_ATOMIC_BUILTINS, which checks whether the compiler supports
+dnl the __atomic builtins of GCC 4.7 and later (also provided by Clang) on
+dnl unsigned int, without needing an additional library.  Sets
+dnl HAVE_ATOMIC_BUILTINS if so.
+dnl
+dnl Copyright 2026 Internet Systems Consortium, Inc. ("ISC")
+dnl
+dnl SPDX-License-Identifier: ISC
+
+AC_DEFUN([_INN_C_ATOMIC_BUILTINS_SOURCE], [[
+unsigned int counter;
+
+int
+main(void) {
+    __atomic_fetch_add(&counter, 1, __ATOMIC_SEQ_CST);
+    __atomic_fetch_sub(&counter, 1, __ATOMIC_SEQ_CST);
+    return (int) __atomic_load_n(&counter, __ATOMIC_SEQ_CST);
+}
+]])
+
+AC_DEFUN([INN_C_ATOMIC_BUILTINS],
+[AC_CACHE_CHECK([for __atomic builtins], [inn_cv_c_atomic_builtins],
+    [AC_LINK_IFELSE([AC_LANG_SOURCE([_INN_C_ATOMIC_BUILTINS_SOURCE])],
+        [inn_cv_c_atomic_builtins=yes],
+        [inn_cv_c_atomic_builtins=no])])
+ AS_IF([test x"$inn_cv_c_atomic_builtins" = xyes],
+    [AC_DEFINE([HAVE_ATOMIC_BUILTINS], 1,
+        [Define if the compiler supports the __atomic builtins.])])])
@@ -197,6 +197,7 @@ static const char *const timer_name[] = {
 void
 ExitWithStats(int x, bool readconf)
 {
+    struct ovcachestats ovcache;
     double usertime;
     double systime;
 
@@ -233,12 +234,18 @@ ExitWithStats(int x, bool readconf)
         syslog(L_NOTICE, "%s artstats get %ld time %ld size %ld", Client.host,
                ARTget, ARTgettime, ARTgetsize);
     if (!readconf && PERMaccessconf && PERMaccessconf->nnrpdoverstats
-        && OVERcount)
+        && OVERcount) {
         syslog(L_NOTICE,
                "%s overstats count %ld hit %ld miss %ld time %ld size %ld dbz "
                "%ld seek %ld get %ld artcheck %ld",
                Client.host, OVERcount, OVERhit, OVERmiss, OVERtime, OVERsize,
                OVERdbz, OVERseek, OVERget, OVERartcheck);
+        if (OVctl(OVCACHESTATS, &ovcache))
+            syslog(L_NOTICE,
+                   "%s overcache size %lu lookups %lu hits %lu evictions %lu",
+                   Client.host, ovcache.size, ovcache.lookups, ovcache.hits,
+                   ovcache.evictions);
+    }
 
 #ifdef HAVE_OPENSSL
     if (tls_conn) {
@@ -904,6 +911,28 @@ WaitChild(int s NO_SIGACTION_UNUSED)
 }
 
 
+/*
+**  Start the timers if wanted, exporting them to a file named after our
+**  process ID.  The file is removed by TMRfree when exiting.
+*/
+static void
+SetupTimers(void)
+{
+    char *path, *name;
+
+    if (innconf->timer == 0)
+        return;
+    TMRinit(TMR_MAX);
+    if (innconf->timerexport) {
+        xasprintf(&name, "nnrpd-%ld.timers", (long) getpid());
+        path = concatpath(innconf->pathrun, name);
+        TMRexport(path, timer_name);
+        free(path);
+        free(name);
+    }
+}
+
+
 static void
 SetupDaemon(void)
 {
@@ -1317,8 +1346,7 @@ main(int argc, char *argv[])
         close(fd);
         dup2(0, 1);
         dup2(0, 2);
-        if (innconf->timer != 0)
-            TMRinit(TMR_MAX);
+        SetupTimers();
         STATstart = TMRnow_double();
         SetupDaemon();
 
@@ -1333,8 +1361,7 @@ main(int argc, char *argv[])
         xsignal(SIGCHLD, SIG_DFL);
 
     } else {
-        if (innconf->timer != 0)
-            TMRinit(TMR_MAX);
+        SetupTimers();
         STATstart = TMRnow_double();
         SetupDaemon();
         /* Arrange to toggle tracing. */
@@ -1926,6 +1926,9 @@ sub collect($$$$$$) {
         return 1
           if $left
           =~ /^\S+ overstats count \d+ hit \d+ miss \d+ time \d+ size \d+ dbz \d+ seek \d+ get \d+ artcheck \d+$/o;
+        return 1
+          if $left
+          =~ /^\S+ overcache size \d+ lookups \d+ hits \d+ evictions \d+$/o;
         # starttls
         return 1
           if $left
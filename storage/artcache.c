@@ -0,0 +1,489 @@
+/*
+**  Shared cache of articles in front of the storage methods.
+**
+**  When articlecache is set in inn.conf, SMretrieve first looks for whole
+**  articles in a cache in System V shared memory, shared by all the
+**  processes using the storage API on the system, so that an article many
+**  readers ask for at the same time (a FAQ, or a new binary part) is only
+**  read from the spool once.  The cache is a ring of article data, written
+**  over oldest first, with an index of the tokens of the articles in it.
+**
+**  An article only gets in once it has been missed ARTCACHE_ADMIT times,
+**  according to a small table of counters halved from time to time, so
+**  that the many articles read only once do not push the popular ones out.
+**  Hits are counted too, so that the counters also tell tiermigrate how
+**  often an article has been read lately.
+**  innd may also put the articles it stores in the cache straight away if
+**  articlecachestore is set.
+**
+**  The cache is protected by the shared and exclusive locks of the
+**  semaphore that comes with the shared memory segment.  Lookups only take
+**  the shared lock, so the statistics and the admission counters they
+**  update may miss a few increments when readers race; they are only
+**  estimates anyway.
+**
+**  An article is retrieved from its storage method between the miss and
+**  its insertion, without any lock, so it may be cancelled meanwhile.  A
+**  generation counter bumped by each cancel is noted on the miss, and the
+**  article is not inserted if it changed.  The cache does not see articles
+**  expire or get overwritten in the spool either, so SMretrieve checks
+**  with the storage method that a hit is still there.
+*/
+
+#include "portable/system.h"
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <time.h>
+
+#include "buffindexed/shmem.h"
+#include "inn/innconf.h"
+#include "inn/libinn.h"
+#include "inn/messages.h"
+#include "interface.h"
+
+#define ARTCACHE_MAGIC   0x41525432 /* "ART2" */
+#define ARTCACHE_ADMIT   2          /* Misses before an article gets in */
+#define ARTCACHE_PROBES  4          /* Index slots where a token may be */
+#define ARTCACHE_AVERAGE 4096       /* Average article size, for the index */
+
+/* Header of the shared memory segment, followed by the index, the
+   admission counters and the ring of article data. */
+struct artcache_header {
+    uint32_t magic;
+    uint32_t nslots;       /* Number of slots of the index */
+    uint32_t ncounters;    /* Number of admission counters */
+    uint32_t increments;   /* Counter increments since they were halved */
+    uint64_t datasize;     /* Size of the ring */
+    uint64_t head;         /* Bytes ever written to the ring */
+    unsigned long cancels; /* Generation, bumped by each cancel */
+    struct artcache_stats stats;
+};
+
+/* A slot of the index, free if len is 0.  The article is at position pos
+   of the ring, modulo its size, and is still there as long as no more than
+   datasize bytes have been written to the ring since. */
+struct artcache_slot {
+    TOKEN token;
+    uint32_t len;
+    uint64_t pos;
+    time_t arrived;
+};
+
+/* Articles returned from the cache are allocated with their token and data
+   in one block, and told apart by their private pointer. */
+struct artcache_handle {
+    ARTHANDLE art;
+    TOKEN token;
+};
+
+static smcd_t *cache = NULL;
+static struct artcache_header *header;
+static struct artcache_slot *slots;
+static unsigned char *counters;
+static char *ring;
+static char owner;
+
+
+/*
+**  Return the offset of the ring in the segment, after the index and the
+**  counters described by the header.
+*/
+static size_t
+artcache_ringoffset(void)
+{
+    size_t offset;
+
+    offset = sizeof(struct artcache_header)
+             + header->nslots * sizeof(struct artcache_slot)
+             + header->ncounters;
+    if (offset % 8 != 0)
+        offset += 8 - offset % 8;
+    return offset;
+}
+
+
+/*
+**  Lay out a new cache in size bytes of shared memory.
+*/
+static void
+artcache_layout(size_t size)
+{
+    size_t used;
+
+    header->nslots = size / ARTCACHE_AVERAGE;
+    if (header->nslots < ARTCACHE_PROBES)
+        header->nslots = ARTCACHE_PROBES;
+    header->ncounters = header->nslots * 4;
+    header->increments = 0;
+    used = artcache_ringoffset();
+    header->datasize = (size > used) ? size - used : 0;
+    header->head = 0;
+    header->cancels = 0;
+    memset(&header->stats, 0, sizeof(header->stats));
+    header->magic = ARTCACHE_MAGIC;
+}
+
+
+/*
+**  Attach the cache, creating it if it does not exist yet.  Return false if
+**  articlecache is not set or the cache cannot be used.
+*/
+bool
+artcache_open(void)
+{
+    char *path;
+    size_t size;
+    int fd;
+
+    if (cache != NULL)
+        return true;
+    if (innconf->articlecache == 0)
+        return false;
+    if (innconf->articlecache > INT_MAX / 1024) {
+        warn("SM: articlecache is too large, the cache is not used");
+        return false;
+    }
+    size = innconf->articlecache * 1024;
+
+    /* The key of the segment comes from the inode of this file. */
+    path = concatpath(innconf->pathrun, "artcache");
+    fd = open(path, O_WRONLY | O_CREAT, 0664);
+    if (fd < 0) {
+        syswarn("SM: cannot create %s", path);
+        free(path);
+        return false;
+    }
+    close(fd);
+    cache = smcGetShmemBuffer(path, size);
+    if (cache == NULL)
+        cache = smcCreateShmemBuffer(path, size);
+    free(path);
+    if (cache == NULL) {
+        warn("SM: cannot attach the article cache");
+        return false;
+    }
+
+    header = (struct artcache_header *) (void *) cache->addr;
+    if (smcGetExclusiveLock(cache) < 0) {
+        smcClose(cache);
+        cache = NULL;
+        return false;
+    }
+    if (header->magic != ARTCACHE_MAGIC)
+        artcache_layout(size);
+    smcReleaseExclusiveLock(cache);
+    if (header->datasize < ARTCACHE_AVERAGE) {
+        warn("SM: articlecache is too small, the cache is not used");
+        artcache_close();
+        return false;
+    }
+    slots = (struct artcache_slot *) (void *) (header + 1);
+    counters = (unsigned char *) (slots + header->nslots);
+    ring = (char *) header + artcache_ringoffset();
+    return true;
+}
+
+
+/*
+**  Detach the cache.  The segment goes away with the last process using it.
+*/
+void
+artcache_close(void)
+{
+    if (cache == NULL)
+        return;
+    smcClose(cache);
+    cache = NULL;
+}
+
+
+/*
+**  Return the slot holding an article, or NULL if it is not in the cache.
+*/
+static struct artcache_slot *
+artcache_find(const TOKEN *token, const HASH *hash)
+{
+    struct artcache_slot *slot;
+    uint32_t index;
+    int i;
+
+    memcpy(&index, hash->hash, sizeof(index));
+    for (i = 0; i < ARTCACHE_PROBES; i++) {
+        slot = &slots[(index + i) % header->nslots];
+        if (slot->len > 0 && header->head - slot->pos <= header->datasize
+            && memcmp(&slot->token, token, sizeof(TOKEN)) == 0)
+            return slot;
+    }
+    return NULL;
+}
+
+
+/*
+**  Set first and second to the two admission counters of an article.
+*/
+static void
+artcache_counters(const HASH *hash, unsigned char **first,
+                  unsigned char **second)
+{
+    uint32_t a, b;
+
+    memcpy(&a, hash->hash + 4, sizeof(a));
+    memcpy(&b, hash->hash + 8, sizeof(b));
+    *first = &counters[a % header->ncounters];
+    *second = &counters[b % header->ncounters];
+}
+
+
+/*
+**  Count a read of an article and return whether it has been read often
+**  enough to get in the cache.  The counters are only an estimate: two
+**  counters are bumped per article and the lower one is used.
+*/
+static bool
+artcache_count(const HASH *hash)
+{
+    unsigned char *first, *second;
+
+    artcache_counters(hash, &first, &second);
+    if (*first < UCHAR_MAX)
+        (*first)++;
+    if (*second < UCHAR_MAX)
+        (*second)++;
+    header->increments++;
+    return *first >= ARTCACHE_ADMIT && *second >= ARTCACHE_ADMIT;
+}
+
+
+/*
+**  Halve the admission counters once they have seen as many misses as there
+**  are counters, so that articles which were popular a while ago do not
+**  keep getting in.  Called with the exclusive lock.
+*/
+static void
+artcache_age(void)
+{
+    uint32_t i;
+
+    if (header->increments < header->ncounters)
+        return;
+    for (i = 0; i < header->ncounters; i++)
+        counters[i] /= 2;
+    header->increments = 0;
+}
+
+
+/*
+**  Put an article in the cache, given as an iovec, unless it is already
+**  there.  Called with the exclusive lock.
+*/
+static void
+artcache_put(const TOKEN *token, const HASH *hash, const struct iovec *iov,
+             int iovcnt, size_t len, time_t arrived)
+{
+    struct artcache_slot *slot, *victim;
+    uint64_t pos;
+    uint32_t index;
+    char *p;
+    int i;
+
+    if (artcache_find(token, hash) != NULL)
+        return;
+
+    /* An article is never split, so skip the end of the ring if it does not
+       fit there. */
+    pos = header->head;
+    if (pos % header->datasize + len > header->datasize)
+        pos += header->datasize - pos % header->datasize;
+    header->head = pos + len;
+    for (p = ring + pos % header->datasize, i = 0; i < iovcnt; i++) {
+        memcpy(p, iov[i].iov_base, iov[i].iov_len);
+        p += iov[i].iov_len;
+    }
+
+    /* Take the first free or outdated slot, else the oldest one. */
+    memcpy(&index, hash->hash, sizeof(index));
+    victim = NULL;
+    for (i = 0; i < ARTCACHE_PROBES; i++) {
+        slot = &slots[(index + i) % header->nslots];
+        if (slot->len == 0 || header->head - slot->pos > header->datasize) {
+            victim = slot;
+            break;
+        }
+        if (victim == NULL || slot->pos < victim->pos)
+            victim = slot;
+    }
+    victim->token = *token;
+    victim->len = len;
+    victim->pos = pos;
+    victim->arrived = arrived;
+    header->stats.admissions++;
+}
+
+
+/*
+**  Look for an article in the cache and return a copy of it, to be freed
+**  with artcache_free.  On a miss, set admit to whether the article should
+**  be given to artcache_insert once retrieved, along with the generation
+**  of the cache set here.
+*/
+ARTHANDLE *
+artcache_lookup(const TOKEN token, bool *admit, unsigned long *generation)
+{
+    struct artcache_handle *handle;
+    struct artcache_slot *slot;
+    HASH hash;
+    char *data;
+
+    *admit = false;
+    if (cache == NULL)
+        return NULL;
+    hash = Hash(&token, sizeof(token));
+    if (smcGetSharedLock(cache) < 0)
+        return NULL;
+    header->stats.lookups++;
+    slot = artcache_find(&token, &hash);
+    if (slot == NULL) {
+        *admit = artcache_count(&hash);
+        *generation = header->cancels;
+        smcReleaseSharedLock(cache);
+        return NULL;
+    }
+    header->stats.hits++;
+    artcache_count(&hash);
+    handle = xmalloc(sizeof(struct artcache_handle) + slot->len);
+    data = (char *) (handle + 1);
+    memcpy(data, ring + slot->pos % header->datasize, slot->len);
+    memset(&handle->art, 0, sizeof(handle->art));
+    handle->art.type = token.type;
+    handle->art.data = data;
+    handle->art.len = slot->len;
+    handle->art.arrived = slot->arrived;
+    handle->art.private = &owner;
+    handle->token = token;
+    handle->art.token = &handle->token;
+    smcReleaseSharedLock(cache);
+    return &handle->art;
+}
+
+
+/*
+**  Put an article retrieved after a miss in the cache, unless an article
+**  was cancelled since the miss, which may be this one.  Articles larger
+**  than an eighth of the cache are not worth pushing that much out.
+*/
+void
+artcache_insert(const TOKEN token, const ARTHANDLE *art,
+                unsigned long generation)
+{
+    struct iovec iov;
+    HASH hash;
+
+    if (cache == NULL || art->len > header->datasize / 8)
+        return;
+    hash = Hash(&token, sizeof(token));
+    iov.iov_base = (void *) art->data;
+    iov.iov_len = art->len;
+    if (smcGetExclusiveLock(cache) < 0)
+        return;
+    artcache_age();
+    if (header->cancels == generation)
+        artcache_put(&token, &hash, &iov, 1, art->len, art->arrived);
+    smcReleaseExclusiveLock(cache);
+}
+
+
+/*
+**  Put an article just stored in the cache, if articlecachestore is set.
+**  The article is given as passed to SMstore.
+*/
+void
+artcache_store(const TOKEN token, const ARTHANDLE *article)
+{
+    HASH hash;
+
+    if (cache == NULL || !innconf->articlecachestore
+        || article->len > header->datasize / 8)
+        return;
+    hash = Hash(&token, sizeof(token));
+    if (smcGetExclusiveLock(cache) < 0)
+        return;
+    artcache_put(&token, &hash, article->iov, article->iovcnt, article->len,
+                 article->arrived == 0 ? time(NULL) : article->arrived);
+    smcReleaseExclusiveLock(cache);
+}
+
+
+/*
+**  Drop a cancelled article from the cache, and keep the inserts racing
+**  with the cancel from putting it back.  Called once the article is gone
+**  from its storage method, so that the later misses do not find it.
+*/
+void
+artcache_cancel(const TOKEN token)
+{
+    struct artcache_slot *slot;
+    HASH hash;
+
+    if (cache == NULL)
+        return;
+    hash = Hash(&token, sizeof(token));
+    if (smcGetExclusiveLock(cache) < 0)
+        return;
+    slot = artcache_find(&token, &hash);
+    if (slot != NULL)
+        slot->len = 0;
+    header->cancels++;
+    smcReleaseExclusiveLock(cache);
+}
+
+
+/*
+**  Free an article if it comes from the cache.  Return false if it does
+**  not, in which case its storage method has to free it.
+*/
+bool
+artcache_free(ARTHANDLE *art)
+{
+    if (art->private != &owner)
+        return false;
+    free(art);
+    return true;
+}
+
+
+/*
+**  Return an estimate of how many times an article has been read lately,
+**  or 0 if the cache is not used.
+*/
+unsigned int
+artcache_reads(const TOKEN token)
+{
+    unsigned char *first, *second;
+    unsigned int reads;
+    HASH hash;
+
+    if (cache == NULL)
+        return 0;
+    hash = Hash(&token, sizeof(token));
+    if (smcGetSharedLock(cache) < 0)
+        return 0;
+    artcache_counters(&hash, &first, &second);
+    reads = (*first < *second) ? *first : *second;
+    smcReleaseSharedLock(cache);
+    return reads;
+}
+
+
+/*
+**  Return the statistics of the cache, all zero if it is not used.
+*/
+void
+artcache_stats(struct artcache_stats *stats)
+{
+    if (cache == NULL) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    *stats = header->stats;
+}
@@ -70,10 +70,17 @@
 */
 #define OV_HDR_MIN_PAGESIZE 16384
 
+/*
+** Blocks are OV_BLOCKSIZE bytes unless a larger multiple of it, up to
+** OV_MAXBLOCKSIZE, is configured for an ovbuff.  Overview records are still
+** limited to OV_BLOCKSIZE bytes, so that they fit in a block of any ovbuff.
+*/
 #define OV_BEFOREBITF       (1 * OV_BLOCKSIZE)
 #define OV_BLOCKSIZE        8192
+#define OV_MAXBLOCKSIZE     (1024 * 1024)
 #define OV_FUDGE            1024
-#define OV_OFFSET(block)    (block * (off_t) OV_BLOCKSIZE)
+#define OV_OFFSET(ovbuff, block) \
+    ((block) * (off_t) (ovbuff)->blocksize)
 
 /* ovblock pointer */
 typedef struct _OV {
@@ -97,6 +104,7 @@ typedef struct {
     int version;          /* magic version number */
     unsigned int freeblk; /* next free block number */
     unsigned int usedblk; /* number of used blocks */
+    unsigned int blocksize; /* size of blocks, 0 for OV_BLOCKSIZE */
 } OVBUFFHEAD;
 
 /* ovbuff info */
@@ -111,6 +119,8 @@ typedef struct _OVBUFF {
                                freeblk left if equals totalblk */
     unsigned int totalblk;  /* number of total blocks */
     unsigned int usedblk;   /* number of used blocks */
+    unsigned int blocksize; /* size of blocks, in bytes */
+    unsigned int nextrun;   /* where to look for the next free run */
     time_t updated;         /* Time of last update to header */
     void *bitfield;         /* Bitfield for ovbuff block in use */
     unsigned long dirty;    /* OVBUFFHEAD dirty count */
@@ -141,6 +151,11 @@ typedef struct _OVINDEX {
 
 #define OVINDEXMAX ((OV_BLOCKSIZE - sizeof(OVINDEXHEAD)) / sizeof(OVINDEX))
 
+/* Number of index entries in a block of an ovbuff. */
+#define OVINDEXCOUNT(ovbuff) \
+    (((ovbuff)->blocksize - sizeof(OVINDEXHEAD)) / sizeof(OVINDEX))
+
+/* Index blocks of ovbuffs with larger blocks hold OVINDEXCOUNT entries. */
 typedef struct _OVBLOCK {
     OVINDEXHEAD ovindexhead;     /* overview index header */
     OVINDEX ovindex[OVINDEXMAX]; /* overview index */
@@ -220,6 +235,58 @@ typedef struct _GIBLIST {
     struct _GIBLIST *next;
 } GIBLIST;
 
+/*
+** Readers don't lock a group to look at its entry and its index.  Instead,
+** the groups are spread over GROUPSEQSIZE slots in shared memory.  Writers
+** count themselves in the slot of a group while they hold its lock and bump
+** the version of the slot when they release it; a reader copies what it
+** needs and starts over if the version changed in the meantime.  Fences
+** keep the copy between the two looks at the slot, and the changes of a
+** writer between its count and the new version.  Expiry also bumps freed
+** before releasing the blocks of a group, so that a search can tell
+** whether the data blocks it found may have been reused since.  A reader
+** seeing a writer active, or failing GROUPSEQRETRIES times, takes the lock
+** of the group as before.
+**
+** The slots outlive a writer dying with the lock of a group, and would then
+** send the readers of that slot to the lock for good.  Writers only count
+** themselves while holding the lock of their group, so when a process
+** opening the group index for writing manages to lock all of it, it clears
+** the counts left behind.
+*/
+#define GROUPSEQSIZE    4096
+#define GROUPSEQRETRIES 10
+
+typedef struct {
+    unsigned int writers; /* writers holding the lock of a group */
+    unsigned int version; /* bumped each time such a lock is released */
+    unsigned int freed;   /* bumped before blocks of a group are freed */
+} GROUPSEQ;
+
+/* What a reader saw in the slot of a group before copying it. */
+typedef struct {
+    GROUPSEQ *slot;
+    unsigned int version;
+    unsigned int freed;
+} GROUPSEQREAD;
+
+#ifdef HAVE_ATOMIC_BUILTINS
+#    define ATOMIC_LOAD(p)     __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#    define ATOMIC_STORE(p, n) __atomic_store_n((p), (n), __ATOMIC_SEQ_CST)
+#    define ATOMIC_ADD(p, n)   __atomic_fetch_add((p), (n), __ATOMIC_SEQ_CST)
+#    define ATOMIC_SUB(p, n)   __atomic_fetch_sub((p), (n), __ATOMIC_SEQ_CST)
+#    define ATOMIC_ACQUIRE()   __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#    define ATOMIC_RELEASE()   __atomic_thread_fence(__ATOMIC_RELEASE)
+#else
+/* Never used, since GROUPseq is then left NULL. */
+#    define ATOMIC_LOAD(p)     (*(p))
+#    define ATOMIC_STORE(p, n) (*(p) = (n))
+#    define ATOMIC_ADD(p, n)   (*(p) += (n))
+#    define ATOMIC_SUB(p, n)   (*(p) -= (n))
+#    define ATOMIC_ACQUIRE()   /* empty */
+#    define ATOMIC_RELEASE()   /* empty */
+#endif
+
 typedef struct _GDB {
     OV datablk;
     void *addr;
@@ -238,6 +305,11 @@ typedef struct {
     GROUPLOC gloc;
     int count;
     GROUPDATABLOCK gdb; /* used for caching current block */
+    bool locked;        /* whether we hold the read lock of the group */
+    bool lockfree;      /* whether the index was copied without locking */
+    GROUPSEQREAD seq;   /* slot of the group when the index was copied */
+    char *buf;          /* copy of the data returned when lockfree */
+    size_t bufsize;
 } OVSEARCH;
 
 #define GROUPDATAHASHSIZE 25
@@ -259,13 +331,22 @@ static long pagesize = 0;
 static long hdr_pagesize = OV_HDR_MIN_PAGESIZE;
 static OVBUFF *ovbufftab = NULL;
 static OVBUFF *ovbuffnext = NULL;
+static unsigned int OVsmallblock = OV_BLOCKSIZE; /* smallest block size */
+static unsigned int OVbigblock = OV_BLOCKSIZE;   /* largest block size */
 static int GROUPfd;
+static smcd_t *GROUPseqsmc = NULL;
+static GROUPSEQ *GROUPseq = NULL;
+static GROUPLOC *GROUPwriting = NULL; /* groups we hold the write lock of */
+static int GROUPwritingcount = 0;
+static int GROUPwritingsize = 0;
 static GROUPHEADER *GROUPheader = NULL;
 static GROUPENTRY *GROUPentries = NULL;
 static int GROUPcount = 0;
 static GROUPLOC GROUPemptyloc = {-1};
 #define NULLINDEX (-1)
 static OV ovnull = {0, NULLINDEX};
+static OV Defragdata = {0, NULLINDEX};  /* first data block of a rewrite */
+static OV Defragindex = {0, NULLINDEX}; /* first index block of a rewrite */
 typedef unsigned long ULONG;
 static ULONG onarray[64], offarray[64];
 static int longsize = sizeof(long);
@@ -283,6 +364,13 @@ static void GROUPLOCclear(GROUPLOC *loc);
 static bool GROUPLOCempty(GROUPLOC loc);
 static bool GROUPlockhash(enum inn_locktype type);
 static bool GROUPlock(GROUPLOC gloc, enum inn_locktype type);
+static void GROUPseqopen(const char *groupfn);
+static void GROUPseqclose(void);
+static void GROUPseqbegin(GROUPLOC gloc);
+static void GROUPseqend(GROUPLOC gloc);
+static void GROUPseqfree(GROUPLOC gloc);
+static bool GROUPcopy(GROUPLOC gloc, GROUPENTRY *ge, GROUPSEQREAD *seq);
+static bool GROUPseqvalid(const GROUPSEQREAD *seq);
 static off_t GROUPfilesize(int count);
 static bool GROUPexpand(int mode);
 static void *ovopensearch(const char *group, ARTNUM low, ARTNUM high,
@@ -329,6 +417,7 @@ ovparse_part_line(char *l)
     char *p;
     struct stat sb;
     off_t len, base;
+    unsigned long blocksize;
     int tonextblock;
     OVBUFF *ovbuff, *tmp = ovbufftab;
 
@@ -370,13 +459,28 @@ ovparse_part_line(char *l)
 
     /* Length/size of symbolic partition in KB */
     len = strtoul(l, NULL, 10) * (off_t) 1024;
+
+    /* Optional block size in KB */
+    blocksize = OV_BLOCKSIZE;
+    if ((p = strchr(l, ':')) != NULL) {
+        blocksize = strtoul(p + 1, NULL, 10) * 1024;
+        if (blocksize < OV_BLOCKSIZE || blocksize > OV_MAXBLOCKSIZE
+            || blocksize % OV_BLOCKSIZE != 0) {
+            warn("buffindexed: bad block size in line '%s'", l);
+            free(ovbuff);
+            return false;
+        }
+    }
+    ovbuff->blocksize = blocksize;
+    ovbuff->nextrun = 0;
+
     /*
     ** The minimum article offset will be the size of the bitfield itself,
     ** len / (blocksize * 8), plus however many additional blocks the
     *OVBUFFHEAD
     ** external header occupies ... then round up to the next block.
     */
-    base = len / (OV_BLOCKSIZE * 8) + OV_BEFOREBITF;
+    base = len / (blocksize * 8) + OV_BEFOREBITF;
     tonextblock = hdr_pagesize - (base & (hdr_pagesize - 1));
     ovbuff->base = base + tonextblock;
     if (S_ISREG(sb.st_mode)
@@ -419,6 +523,7 @@ static bool
 ovbuffread_config(void)
 {
     char *path, *config, *from, *to, **ctab = (char **) NULL;
+    OVBUFF *tmp;
     int ctab_free = 0; /* Index to next free slot in ctab */
     int ctab_i;
 
@@ -479,6 +584,13 @@ ovbuffread_config(void)
         warn("buffindexed: no buffindexed defined");
         return false;
     }
+    OVsmallblock = OVbigblock = ovbufftab->blocksize;
+    for (tmp = ovbufftab->next; tmp != NULL; tmp = tmp->next) {
+        if (tmp->blocksize < OVsmallblock)
+            OVsmallblock = tmp->blocksize;
+        if (tmp->blocksize > OVbigblock)
+            OVbigblock = tmp->blocksize;
+    }
     return true;
 }
 
@@ -593,6 +705,7 @@ ovflushhead(OVBUFF *ovbuff)
     rpx.version = OVBUFF_VERSION;
     rpx.freeblk = ovbuff->freeblk;
     rpx.usedblk = ovbuff->usedblk;
+    rpx.blocksize = ovbuff->blocksize;
     memcpy(ovbuff->bitfield, &rpx, sizeof(OVBUFFHEAD));
 
     if (pwrite(ovbuff->fd, ovbuff->bitfield, ovbuff->base, 0) != ovbuff->base)
@@ -709,6 +822,15 @@ ovbuffinit_disks(void)
                 ovlock(ovbuff, INN_LOCK_UNLOCK);
                 return false;
             }
+            if ((dpx.blocksize == 0 ? OV_BLOCKSIZE : dpx.blocksize)
+                != ovbuff->blocksize) {
+                warn("buffindexed: Mismatch: block size %u for buffindexed "
+                     "%s",
+                     dpx.blocksize == 0 ? OV_BLOCKSIZE : dpx.blocksize,
+                     ovbuff->path);
+                ovlock(ovbuff, INN_LOCK_UNLOCK);
+                return false;
+            }
 
             /*
              * compare shared memory with disk data.
@@ -753,7 +875,8 @@ ovbuffinit_disks(void)
              */
             memset(rpx, 0, ovbuff->base);
 
-            ovbuff->totalblk = (ovbuff->len - ovbuff->base) / OV_BLOCKSIZE;
+            ovbuff->totalblk =
+                (ovbuff->len - ovbuff->base) / ovbuff->blocksize;
             if (ovbuff->totalblk < 1) {
                 warn("buffindexed: too small length '%lu' for buffindexed %s",
                      (unsigned long) ovbuff->len, ovbuff->path);
@@ -865,75 +988,114 @@ getovbuff(OV ov)
     return NULL;
 }
 
+/* Return the block following ov in its ovbuff. */
+static OV
+ovnextov(OV ov)
+{
+    if (ov.index != NULLINDEX)
+        ov.blocknum++;
+    return ov;
+}
+
+/*
+** Return the next ovbuff, in turn, that has blocks of the given size (or of
+** any size if 0) and a free block, locked and with its freeblk set to that
+** block.  Returns NULL if there is none.
+*/
+static OVBUFF *
+ovbufffree(unsigned int blocksize)
+{
+    OVBUFF *ovbuff;
+
+    if (ovbuffnext == NULL)
+        ovbuffnext = ovbufftab;
+    ovbuff = ovbuffnext;
+    do {
+        if (blocksize == 0 || ovbuff->blocksize == blocksize) {
+            ovlock(ovbuff, INN_LOCK_WRITE);
+            ovreadhead(ovbuff);
+            if (ovbuff->totalblk != ovbuff->usedblk
+                && ovbuff->freeblk == ovbuff->totalblk) {
+                ovnextblock(ovbuff);
+            }
+            if (ovbuff->totalblk != ovbuff->usedblk
+                && ovbuff->freeblk != ovbuff->totalblk)
+                return ovbuff;
+            /* no space left for this ovbuff */
+            ovlock(ovbuff, INN_LOCK_UNLOCK);
+        }
+        ovbuff = ovbuff->next;
+        if (ovbuff == NULL)
+            ovbuff = ovbufftab;
+    } while (ovbuff != ovbuffnext);
+    return NULL;
+}
+
+/*
+** Allocate a new block.  want is the block that would keep the blocks of the
+** group consecutive, usually the one following its last block: it is used
+** if free.  Otherwise, busy groups (those that already filled a block) get
+** a block from the ovbuffs with the largest blocks, and other groups from
+** those with the smallest blocks, so that only busy groups use up large
+** blocks.  Any ovbuff is used if those are full.
+*/
 #ifdef OV_DEBUG
 static OV
-ovblocknew(GROUPENTRY *ge)
+ovblocknew(OV want, bool busy, GROUPENTRY *ge)
 {
 #else
 static OV
-ovblocknew(void)
+ovblocknew(OV want, bool busy)
 {
 #endif /* OV_DEBUG */
     OVBUFF *ovbuff;
     OV ov;
+    unsigned int blocknum;
     bool done = false;
 #ifdef OV_DEBUG
     int recno;
     struct ov_trace_array *trace;
 #endif /* OV_DEBUG */
 
-    if (ovbuffnext == NULL)
-        ovbuffnext = ovbufftab;
-
     /*
      * We will try to recover broken overview possibly due to unsync.
      * The recovering is inactive for OV_DEBUG mode.
      */
 
 retry:
-    for (ovbuff = ovbuffnext; ovbuff != (OVBUFF *) NULL;
-         ovbuff = ovbuff->next) {
+    ovbuff = NULL;
+    if (want.index != NULLINDEX && (ovbuff = getovbuff(want)) != NULL) {
         ovlock(ovbuff, INN_LOCK_WRITE);
         ovreadhead(ovbuff);
-        if (ovbuff->totalblk != ovbuff->usedblk
-            && ovbuff->freeblk == ovbuff->totalblk) {
-            ovnextblock(ovbuff);
-        }
-        if (ovbuff->totalblk == ovbuff->usedblk
-            || ovbuff->freeblk == ovbuff->totalblk) {
-            /* no space left for this ovbuff */
+        if (want.blocknum >= ovbuff->totalblk
+            || ovusedblock(ovbuff, want.blocknum, false, false)) {
             ovlock(ovbuff, INN_LOCK_UNLOCK);
-            continue;
+            ovbuff = NULL;
         }
-        break;
     }
-    if (ovbuff == NULL) {
-        for (ovbuff = ovbufftab; ovbuff != ovbuffnext; ovbuff = ovbuff->next) {
-            ovlock(ovbuff, INN_LOCK_WRITE);
-            ovreadhead(ovbuff);
-            if (ovbuff->totalblk == ovbuff->usedblk
-                || ovbuff->freeblk == ovbuff->totalblk) {
-                /* no space left for this ovbuff */
-                ovlock(ovbuff, INN_LOCK_UNLOCK);
-                continue;
-            }
-            break;
-        }
-        if (ovbuff == ovbuffnext) {
+    if (ovbuff != NULL) {
+        blocknum = want.blocknum;
+        want = ovnull;
+    } else {
+        ovbuff = ovbufffree(busy ? OVbigblock : OVsmallblock);
+        if (ovbuff == NULL && OVsmallblock != OVbigblock)
+            ovbuff = ovbufffree(0);
+        if (ovbuff == NULL) {
             Nospace = true;
             return ovnull;
         }
+        blocknum = ovbuff->freeblk;
     }
 #ifdef OV_DEBUG
     recno = ((char *) ge - (char *) &GROUPentries[0]) / sizeof(GROUPENTRY);
-    if (ovusedblock(ovbuff, ovbuff->freeblk, false, true)) {
+    if (ovusedblock(ovbuff, blocknum, false, true)) {
         warn("buffindexed: 0x%08x trying to occupy new block(%d, %d), but "
              "already occupied",
-             recno, ovbuff->index, ovbuff->freeblk);
+             recno, ovbuff->index, blocknum);
         buffindexed_close();
         abort();
     }
-    trace = &ovbuff->trace[ovbuff->freeblk];
+    trace = &ovbuff->trace[blocknum];
     if (trace->ov_trace == NULL) {
         trace->ov_trace = xcalloc(OV_TRACENUM, sizeof(struct ov_trace));
         trace->max = OV_TRACENUM;
@@ -952,12 +1114,12 @@ retry:
 #endif /* OV_DEBUG */
 
     ov.index = ovbuff->index;
-    ov.blocknum = ovbuff->freeblk;
+    ov.blocknum = blocknum;
 
 #ifndef OV_DEBUG
-    if (ovusedblock(ovbuff, ovbuff->freeblk, false, true)) {
+    if (ovusedblock(ovbuff, blocknum, false, true)) {
         notice("buffindexed: fixing invalid free block(%d, %d).",
-               ovbuff->index, ovbuff->freeblk);
+               ovbuff->index, blocknum);
     } else
         done = true;
 #endif /* OV_DEBUG */
@@ -965,7 +1127,8 @@ retry:
     /* mark it as allocated */
     ovusedblock(ovbuff, ov.blocknum, true, true);
 
-    ovnextblock(ovbuff);
+    if (blocknum == ovbuff->freeblk)
+        ovnextblock(ovbuff);
     ovbuff->usedblk++;
     ovbuff->dirty++;
     ovflushhead(ovbuff);
@@ -1143,6 +1306,7 @@ buffindexed_open(int mode)
         }
     }
     fdflag_close_exec(GROUPfd, true);
+    GROUPseqopen(groupfn);
 
     free(groupfn);
     Cutofflow = false;
@@ -1180,21 +1344,26 @@ buffindexed_groupstats(const char *group, int *lo, int *hi, int *count,
                        int *flag)
 {
     GROUPLOC gloc;
+    GROUPENTRY ge;
+    GROUPSEQREAD seq;
 
     gloc = GROUPfind(group, false);
     if (GROUPLOCempty(gloc)) {
         return false;
     }
-    GROUPlock(gloc, INN_LOCK_READ);
+    if (!GROUPcopy(gloc, &ge, &seq)) {
+        GROUPlock(gloc, INN_LOCK_READ);
+        ge = GROUPentries[gloc.recno];
+        GROUPlock(gloc, INN_LOCK_UNLOCK);
+    }
     if (lo != NULL)
-        *lo = GROUPentries[gloc.recno].low;
+        *lo = ge.low;
     if (hi != NULL)
-        *hi = GROUPentries[gloc.recno].high;
+        *hi = ge.high;
     if (count != NULL)
-        *count = GROUPentries[gloc.recno].count;
+        *count = ge.count;
     if (flag != NULL)
-        *flag = GROUPentries[gloc.recno].flag;
-    GROUPlock(gloc, INN_LOCK_UNLOCK);
+        *flag = ge.flag;
     return true;
 }
 
@@ -1229,7 +1398,9 @@ buffindexed_groupadd(const char *group, ARTNUM lo, ARTNUM hi, char *flag)
         ge = &GROUPentries[gloc.recno];
         if (GROUPentries[gloc.recno].deleted != 0) {
             grouphash = Hash(group, strlen(group));
+            GROUPlock(gloc, INN_LOCK_WRITE);
             setinitialge(ge, grouphash, flag, ge->next, lo, hi);
+            GROUPlock(gloc, INN_LOCK_UNLOCK);
         } else {
             ge->flag = *flag;
         }
@@ -1406,13 +1577,173 @@ GROUPlockhash(enum inn_locktype type)
     return inn_lock_range(GROUPfd, type, true, 0, sizeof(GROUPHEADER));
 }
 
+static GROUPSEQ *
+GROUPseqslot(GROUPLOC gloc)
+{
+    return &GROUPseq[gloc.recno % GROUPSEQSIZE];
+}
+
+#ifdef HAVE_ATOMIC_BUILTINS
+/*
+** Clear the writer counts of the slots if no group is locked, which is
+** checked by locking all the entries without waiting.  Counts left there
+** then come from writers that died with the lock of a group.
+*/
+static void
+GROUPseqreset(void)
+{
+    int i;
+
+    if (!inn_lock_range(GROUPfd, INN_LOCK_WRITE, false, sizeof(GROUPHEADER),
+                        0))
+        return;
+    for (i = 0; i < GROUPSEQSIZE; i++)
+        if (ATOMIC_LOAD(&GROUPseq[i].writers) != 0) {
+            ATOMIC_ADD(&GROUPseq[i].version, 1);
+            ATOMIC_STORE(&GROUPseq[i].writers, 0);
+        }
+    inn_lock_range(GROUPfd, INN_LOCK_UNLOCK, false, sizeof(GROUPHEADER), 0);
+}
+#endif
+
+/*
+** Attach the slots shared by all the users of the group index, creating
+** them if needed.  Readers keep locking groups if this fails.
+*/
+static void
+GROUPseqopen(const char *groupfn)
+{
+#ifdef HAVE_ATOMIC_BUILTINS
+    size_t size = GROUPSEQSIZE * sizeof(GROUPSEQ);
+
+    GROUPseqsmc = smcGetShmemBuffer(groupfn, size);
+    if (GROUPseqsmc == NULL)
+        GROUPseqsmc = smcCreateShmemBuffer(groupfn, size);
+    if (GROUPseqsmc == NULL) {
+        warn("buffindexed: cant create shmem for %s, readers will lock",
+             groupfn);
+        return;
+    }
+    GROUPseq = (void *) GROUPseqsmc->addr;
+    if (ovbuffmode & OV_WRITE)
+        GROUPseqreset();
+#else
+    (void) groupfn;
+#endif
+}
+
+static void
+GROUPseqclose(void)
+{
+    if (GROUPseqsmc != NULL)
+        smcClose(GROUPseqsmc);
+    GROUPseqsmc = NULL;
+    GROUPseq = NULL;
+    GROUPwritingcount = 0;
+}
+
+/* Note that we start changing a group whose write lock we just got. */
+static void
+GROUPseqbegin(GROUPLOC gloc)
+{
+    int i;
+
+    if (GROUPseq == NULL)
+        return;
+    for (i = 0; i < GROUPwritingcount; i++)
+        if (GROUPwriting[i].recno == gloc.recno)
+            return;
+    if (GROUPwritingcount == GROUPwritingsize) {
+        GROUPwritingsize += 8;
+        GROUPwriting =
+            xrealloc(GROUPwriting, GROUPwritingsize * sizeof(GROUPLOC));
+    }
+    GROUPwriting[GROUPwritingcount++] = gloc;
+    ATOMIC_ADD(&GROUPseqslot(gloc)->writers, 1);
+    ATOMIC_RELEASE();
+}
+
+/* Note that we are done changing a group, if we were. */
+static void
+GROUPseqend(GROUPLOC gloc)
+{
+    GROUPSEQ *slot;
+    int i;
+
+    if (GROUPseq == NULL)
+        return;
+    for (i = 0; i < GROUPwritingcount; i++)
+        if (GROUPwriting[i].recno == gloc.recno)
+            break;
+    if (i == GROUPwritingcount)
+        return;
+    GROUPwriting[i] = GROUPwriting[--GROUPwritingcount];
+    slot = GROUPseqslot(gloc);
+    ATOMIC_RELEASE();
+    ATOMIC_ADD(&slot->version, 1);
+    ATOMIC_SUB(&slot->writers, 1);
+}
+
+/* Warn the searches of a group that its blocks are about to be freed. */
+static void
+GROUPseqfree(GROUPLOC gloc)
+{
+    if (GROUPseq != NULL) {
+        ATOMIC_ADD(&GROUPseqslot(gloc)->freed, 1);
+        ATOMIC_RELEASE();
+    }
+}
+
+/* Check that nothing copied since seq was filled in has changed. */
+static bool
+GROUPseqvalid(const GROUPSEQREAD *seq)
+{
+    ATOMIC_ACQUIRE();
+    return ATOMIC_LOAD(&seq->slot->writers) == 0
+           && ATOMIC_LOAD(&seq->slot->version) == seq->version;
+}
+
+/*
+** Copy the entry of a group without locking it.  Returns false if no
+** consistent copy could be made, in which case the caller should lock the
+** group.  seq is filled in to check later whether the group has changed.
+*/
+static bool
+GROUPcopy(GROUPLOC gloc, GROUPENTRY *ge, GROUPSEQREAD *seq)
+{
+    int i;
+
+    if (GROUPseq == NULL)
+        return false;
+    seq->slot = GROUPseqslot(gloc);
+    for (i = 0; i < GROUPSEQRETRIES; i++) {
+        if (ATOMIC_LOAD(&seq->slot->writers) != 0)
+            return false;
+        seq->version = ATOMIC_LOAD(&seq->slot->version);
+        seq->freed = ATOMIC_LOAD(&seq->slot->freed);
+        memcpy(ge, &GROUPentries[gloc.recno], sizeof(GROUPENTRY));
+        if (GROUPseqvalid(seq))
+            return true;
+    }
+    return false;
+}
+
 static bool
 GROUPlock(GROUPLOC gloc, enum inn_locktype type)
 {
-    return inn_lock_range(GROUPfd, type, true,
-                          sizeof(GROUPHEADER)
-                              + (sizeof(GROUPENTRY) * gloc.recno),
-                          sizeof(GROUPENTRY));
+    bool ret;
+
+    /* Writers are done before they release the lock, so that nobody can
+       lock all the groups while they are still counted. */
+    if (type == INN_LOCK_UNLOCK)
+        GROUPseqend(gloc);
+    ret = inn_lock_range(GROUPfd, type, true,
+                         sizeof(GROUPHEADER)
+                             + (sizeof(GROUPENTRY) * gloc.recno),
+                         sizeof(GROUPENTRY));
+    if (type == INN_LOCK_WRITE && ret)
+        GROUPseqbegin(gloc);
+    return ret;
 }
 
 #ifdef OV_DEBUG
@@ -1425,14 +1756,19 @@ ovsetcurindexblock(GROUPENTRY *ge)
 {
 #endif /* OV_DEBUG */
     OVBUFF *ovbuff;
-    OV ov;
+    OV ov, want;
     OVINDEXHEAD ovindexhead;
 
     /* there is no index */
+    if (ge->baseindex.index == NULLINDEX)
+        want = Defragindex;
+    else
+        want = ovnextov(ge->curindex);
 #ifdef OV_DEBUG
-    ov = ovblocknew(georig ? georig : ge);
+    ov = ovblocknew(want, ge->baseindex.index != NULLINDEX,
+                    georig ? georig : ge);
 #else
-    ov = ovblocknew();
+    ov = ovblocknew(want, ge->baseindex.index != NULLINDEX);
 #endif /* OV_DEBUG */
     if (ov.index == NULLINDEX) {
         warn("buffindexed: ovsetcurindexblock could not get new block");
@@ -1448,7 +1784,7 @@ ovsetcurindexblock(GROUPENTRY *ge)
     ovindexhead.low = 0;
     ovindexhead.high = 0;
     if (PWRITE(ovbuff->fd, &ovindexhead, sizeof(OVINDEXHEAD),
-               ovbuff->base + OV_OFFSET(ov.blocknum))
+               ovbuff->base + OV_OFFSET(ovbuff, ov.blocknum))
         != sizeof(OVINDEXHEAD)) {
         syswarn(
             "buffindexed: could not write index record index '%d', blocknum"
@@ -1475,7 +1811,7 @@ ovsetcurindexblock(GROUPENTRY *ge)
         ovindexhead.low = ge->curlow;
         ovindexhead.high = ge->curhigh;
         if (PWRITE(ovbuff->fd, &ovindexhead, sizeof(OVINDEXHEAD),
-                   ovbuff->base + OV_OFFSET(ge->curindex.blocknum))
+                   ovbuff->base + OV_OFFSET(ovbuff, ge->curindex.blocknum))
             != sizeof(OVINDEXHEAD)) {
             syswarn("buffindexed: could not write index record index '%d', "
                     "blocknum"
@@ -1517,9 +1853,9 @@ ovaddrec(GROUPENTRY *ge, ARTNUM artnum, TOKEN token, char *data, int len,
     if (ge->curdata.index == NULLINDEX) {
         /* no data block allocated */
 #ifdef OV_DEBUG
-        ov = ovblocknew(georig ? georig : ge);
+        ov = ovblocknew(Defragdata, false, georig ? georig : ge);
 #else
-        ov = ovblocknew();
+        ov = ovblocknew(Defragdata, false);
 #endif /* OV_DEBUG */
         if (ov.index == NULLINDEX) {
             warn("buffindexed: ovaddrec could not get new block");
@@ -1535,12 +1871,12 @@ ovaddrec(GROUPENTRY *ge, ARTNUM artnum, TOKEN token, char *data, int len,
         ge->curoffset = 0;
     } else if ((ovbuff = getovbuff(ge->curdata)) == NULL)
         return false;
-    else if (OV_BLOCKSIZE - ge->curoffset < len) {
+    else if (ovbuff->blocksize - ge->curoffset < len) {
         /* too short to store data, allocate new block */
 #ifdef OV_DEBUG
-        ov = ovblocknew(georig ? georig : ge);
+        ov = ovblocknew(ovnextov(ge->curdata), true, georig ? georig : ge);
 #else
-        ov = ovblocknew();
+        ov = ovblocknew(ovnextov(ge->curdata), true);
 #endif /* OV_DEBUG */
         if (ov.index == NULLINDEX) {
             warn("buffindexed: ovaddrec could not get new block");
@@ -1568,7 +1904,8 @@ ovaddrec(GROUPENTRY *ge, ARTNUM artnum, TOKEN token, char *data, int len,
     }
 
     if (PWRITE(ovbuff->fd, data, len,
-               ovbuff->base + OV_OFFSET(ge->curdata.blocknum) + ge->curoffset)
+               ovbuff->base + OV_OFFSET(ovbuff, ge->curdata.blocknum)
+                   + ge->curoffset)
         != len) {
         syswarn("buffindexed: could not append overview record index '%d',"
                 " blocknum '%d'",
@@ -1585,7 +1922,11 @@ ovaddrec(GROUPENTRY *ge, ARTNUM artnum, TOKEN token, char *data, int len,
     ie.arrived = arrived;
     ie.expires = expires;
 
-    if (ge->baseindex.index == NULLINDEX || ge->curindexoffset == OVINDEXMAX) {
+    if (ge->baseindex.index != NULLINDEX
+        && (ovbuff = getovbuff(ge->curindex)) == NULL)
+        return false;
+    if (ge->baseindex.index == NULLINDEX
+        || ge->curindexoffset == (int) OVINDEXCOUNT(ovbuff)) {
 #ifdef OV_DEBUG
         if (!ovsetcurindexblock(ge, georig)) {
 #else
@@ -1609,7 +1950,7 @@ ovaddrec(GROUPENTRY *ge, ARTNUM artnum, TOKEN token, char *data, int len,
 #endif /* OV_DEBUG */
     }
     if (PWRITE(ovbuff->fd, &ie, sizeof(ie),
-               ovbuff->base + OV_OFFSET(ge->curindex.blocknum)
+               ovbuff->base + OV_OFFSET(ovbuff, ge->curindex.blocknum)
                    + sizeof(OVINDEXHEAD) + sizeof(ie) * ge->curindexoffset)
         != sizeof(ie)) {
         syswarn(
@@ -1631,7 +1972,7 @@ ovaddrec(GROUPENTRY *ge, ARTNUM artnum, TOKEN token, char *data, int len,
         ovindexhead.low = ge->curlow;
         ovindexhead.high = ge->curhigh;
         if (PWRITE(ovbuff->fd, &ovindexhead, sizeof(OVINDEXHEAD),
-                   ovbuff->base + OV_OFFSET(ge->curindex.blocknum))
+                   ovbuff->base + OV_OFFSET(ovbuff, ge->curindex.blocknum))
             != sizeof(OVINDEXHEAD)) {
             syswarn("buffindexed: could not write index record index '%d', "
                     "blocknum"
@@ -1788,15 +2129,22 @@ INDEXcompare(const void *p1, const void *p2)
     return oi1->artnum - oi2->artnum;
 }
 
+/*
+** Read the index of a group.  When seq isn't NULL, the group isn't locked,
+** and reading stops as soon as a writer is seen to change it.
+*/
 static bool
-ovgroupmmap(GROUPENTRY *ge, ARTNUM low, ARTNUM high, bool needov)
+ovgroupmmap(GROUPENTRY *ge, ARTNUM low, ARTNUM high, bool needov,
+            const GROUPSEQREAD *seq)
 {
     OV ov = ge->baseindex;
     OVBUFF *ovbuff;
     GROUPDATABLOCK *gdb;
     int pagefudge, limit, i, count, len;
     off_t offset, mmapoffset;
+    unsigned long size;
     OVBLOCK *ovblock;
+    OVINDEX *ovindex;
     void *addr;
     GIBLIST *giblist;
 
@@ -1818,10 +2166,10 @@ ovgroupmmap(GROUPENTRY *ge, ARTNUM low, ARTNUM high, bool needov)
             ovgroupunmap();
             return false;
         }
-        offset = ovbuff->base + OV_OFFSET(ov.blocknum);
+        offset = ovbuff->base + OV_OFFSET(ovbuff, ov.blocknum);
         pagefudge = offset % pagesize;
         mmapoffset = offset - pagefudge;
-        len = pagefudge + OV_BLOCKSIZE;
+        len = pagefudge + ovbuff->blocksize;
         if ((addr = mmap(NULL, len, PROT_READ, MAP_SHARED, ovbuff->fd,
                          mmapoffset))
             == MAP_FAILED) {
@@ -1830,18 +2178,19 @@ ovgroupmmap(GROUPENTRY *ge, ARTNUM low, ARTNUM high, bool needov)
             return false;
         }
         ovblock = (void *) ((char *) addr + pagefudge);
+        ovindex = ovblock->ovindex;
         if (ov.index == ge->curindex.index
             && ov.blocknum == ge->curindex.blocknum) {
             limit = ge->curindexoffset;
         } else {
-            limit = OVINDEXMAX;
+            limit = OVINDEXCOUNT(ovbuff);
         }
         for (i = 0; i < limit; i++) {
             if (Gibcount == count) {
                 Gibcount += OV_FUDGE;
                 Gib = xrealloc(Gib, Gibcount * sizeof(OVINDEX));
             }
-            Gib[count++] = ovblock->ovindex[i];
+            Gib[count++] = ovindex[i];
         }
         giblist = xmalloc(sizeof(GIBLIST));
         giblist->ov = ov;
@@ -1849,6 +2198,10 @@ ovgroupmmap(GROUPENTRY *ge, ARTNUM low, ARTNUM high, bool needov)
         Giblist = giblist;
         ov = ovblock->ovindexhead.next;
         munmap(addr, len);
+        if (seq != NULL && !GROUPseqvalid(seq)) {
+            ovgroupunmap();
+            return false;
+        }
     }
     Gibcount = count;
     qsort(Gib, Gibcount, sizeof(OVINDEX), INDEXcompare);
@@ -1862,6 +2215,7 @@ ovgroupmmap(GROUPENTRY *ge, ARTNUM low, ARTNUM high, bool needov)
     if (!needov)
         return true;
     count = 0;
+    size = 0;
     for (i = 0; i < Gibcount; i++) {
         if (Gib[i].artnum == 0 || Gib[i].artnum < low || Gib[i].artnum > high)
             continue;
@@ -1879,10 +2233,11 @@ ovgroupmmap(GROUPENTRY *ge, ARTNUM low, ARTNUM high, bool needov)
         gdb->mmapped = false;
         insertgdb(&ov, gdb);
         count++;
+        size += ovbuff->blocksize;
     }
     if (count == 0)
         return true;
-    if ((unsigned) count * OV_BLOCKSIZE > innconf->keepmmappedthreshold * 1024)
+    if (size > innconf->keepmmappedthreshold * 1024)
         /* large retrieval, mmap is done in ovsearch() */
         return true;
     /* Data blocks are being mmapped, not copied. */
@@ -1898,10 +2253,10 @@ ovgroupmmap(GROUPENTRY *ge, ARTNUM low, ARTNUM high, bool needov)
                 ovgroupunmap();
                 return false;
             }
-            offset = ovbuff->base + OV_OFFSET(ov.blocknum);
+            offset = ovbuff->base + OV_OFFSET(ovbuff, ov.blocknum);
             pagefudge = offset % pagesize;
             mmapoffset = offset - pagefudge;
-            gdb->len = pagefudge + OV_BLOCKSIZE;
+            gdb->len = pagefudge + ovbuff->blocksize;
             if ((gdb->addr = mmap(NULL, gdb->len, PROT_READ, MAP_SHARED,
                                   ovbuff->fd, mmapoffset))
                 == MAP_FAILED) {
@@ -1934,7 +2289,7 @@ ovopensearch(const char *group, ARTNUM low, ARTNUM high, bool needov)
     if (high > ge->high)
         high = ge->high;
 
-    if (!ovgroupmmap(ge, low, high, needov)) {
+    if (!ovgroupmmap(ge, low, high, needov, NULL)) {
         return NULL;
     }
 
@@ -1947,15 +2302,138 @@ ovopensearch(const char *group, ARTNUM low, ARTNUM high, bool needov)
     search->gloc = gloc;
     search->count = ge->count;
     search->gdb.mmapped = false;
+    search->locked = false;
+    search->lockfree = false;
+    search->buf = NULL;
+    search->bufsize = 0;
     return (void *) search;
 }
 
-void *
-buffindexed_opensearch(const char *group, int low, int high)
+/* Release the index read for a search, before reading it again. */
+static void
+ovsearchunmap(OVSEARCH *search)
+{
+    GROUPDATABLOCK *gdb;
+    int i;
+
+    for (i = 0; i < GROUPDATAHASHSIZE; i++) {
+        for (gdb = groupdatablock[i]; gdb != NULL; gdb = gdb->next) {
+            if (gdb->mmapped)
+                munmap(gdb->addr, gdb->len);
+        }
+    }
+    if (search->gdb.mmapped)
+        munmap(search->gdb.addr, search->gdb.len);
+    search->gdb.mmapped = false;
+    ovgroupunmap();
+    if (Gib != NULL) {
+        free(Gib);
+        Gib = NULL;
+    }
+    Gibcount = 0;
+}
+
+static bool
+ovsnapshotge(OVSEARCH *search, GROUPENTRY *ge, ARTNUM low, ARTNUM high,
+             const GROUPSEQREAD *seq)
+{
+    search->lo = low < ge->low ? ge->low : low;
+    search->hi = high > ge->high ? ge->high : high;
+    search->cur = 0;
+    search->count = ge->count;
+    return ovgroupmmap(ge, search->lo, search->hi, search->needov, seq);
+}
+
+/*
+** Read the index of the group of a search between low and high without
+** locking the group.  If no writer left it alone long enough, the group is
+** read-locked while its index is read.  Without shared slots, it stays
+** locked until the search is closed.
+*/
+static bool
+ovsnapshot(OVSEARCH *search, ARTNUM low, ARTNUM high)
+{
+    GROUPENTRY ge;
+    GROUPSEQREAD seq;
+    bool ok;
+    int i;
+
+    for (i = 0; i < GROUPSEQRETRIES; i++) {
+        if (!GROUPcopy(search->gloc, &ge, &seq))
+            break;
+        ok = ovsnapshotge(search, &ge, low, high, &seq);
+        if (GROUPseqvalid(&seq)) {
+            search->lockfree = ok;
+            search->seq = seq;
+            return ok;
+        }
+        ovsearchunmap(search);
+    }
+    if (!search->locked) {
+        GROUPlock(search->gloc, INN_LOCK_READ);
+        search->locked = true;
+    }
+    search->lockfree = false;
+    if (GROUPseq != NULL) {
+        /* Nobody can expire the group while we hold its lock. */
+        search->seq.slot = GROUPseqslot(search->gloc);
+        search->seq.freed = ATOMIC_LOAD(&search->seq.slot->freed);
+        search->lockfree = true;
+    }
+    ok = ovsnapshotge(search, &GROUPentries[search->gloc.recno], low, high,
+                      NULL);
+    if (!ok || search->lockfree) {
+        GROUPlock(search->gloc, INN_LOCK_UNLOCK);
+        search->locked = false;
+        search->lockfree = ok && search->lockfree;
+    }
+    return ok;
+}
+
+/* Open a search for a reader, see ovsnapshot. */
+static void *
+ovopensearchnolock(const char *group, ARTNUM low, ARTNUM high, bool needov)
 {
     GROUPLOC gloc;
-    void *handle;
+    OVSEARCH *search;
 
+    gloc = GROUPfind(group, false);
+    if (GROUPLOCempty(gloc))
+        return NULL;
+
+    search = xcalloc(1, sizeof(OVSEARCH));
+    search->group = xstrdup(group);
+    search->needov = needov;
+    search->gloc = gloc;
+    if (!ovsnapshot(search, low, high)) {
+        free(search->group);
+        free(search);
+        return NULL;
+    }
+    return (void *) search;
+}
+
+/*
+** Copy the data found by a search without locking, so that it cannot change
+** under the caller.  Returns false if the blocks of the group may have been
+** freed since its index was read, in which case the copy is worthless.
+*/
+static bool
+ovsearchcopy(OVSEARCH *search, char **data, int len)
+{
+    if ((size_t) len > search->bufsize) {
+        search->bufsize = len + 1024;
+        search->buf = xrealloc(search->buf, search->bufsize);
+    }
+    memcpy(search->buf, *data, len);
+    *data = search->buf;
+    ATOMIC_ACQUIRE();
+    return ATOMIC_LOAD(&search->seq.slot->freed) == search->seq.freed;
+}
+
+void *
+buffindexed_opensearch(const char *group, int low, int high)
+{
     if (Gib != NULL) {
         free(Gib);
         Gib = NULL;
@@ -1965,14 +2443,7 @@ buffindexed_opensearch(const char *group, int low, int high)
             Cachesearch = NULL;
         }
     }
-    gloc = GROUPfind(group, false);
-    if (GROUPLOCempty(gloc)) {
-        return NULL;
-    }
-    GROUPlock(gloc, INN_LOCK_WRITE);
-    if ((handle = ovopensearch(group, low, high, true)) == NULL)
-        GROUPlock(gloc, INN_LOCK_UNLOCK);
-    return (handle);
+    return ovopensearchnolock(group, low, high, true);
 }
 
 static bool
@@ -1984,9 +2455,11 @@ ovsearch(void *handle, ARTNUM *artnum, char **data, int *len, TOKEN *token,
     GROUPDATABLOCK *gdb;
     off_t offset, mmapoffset;
     OVBUFF *ovbuff;
+    ARTNUM restart;
     int pagefudge;
     bool newblock;
 
+again:
     if (search->cur == Gibcount) {
         return false;
     }
@@ -2047,10 +2520,11 @@ ovsearch(void *handle, ARTNUM *artnum, char **data, int *len, TOKEN *token,
                                  srchov.index, srchov.blocknum);
                             return false;
                         }
-                        offset = ovbuff->base + OV_OFFSET(srchov.blocknum);
+                        offset =
+                            ovbuff->base + OV_OFFSET(ovbuff, srchov.blocknum);
                         pagefudge = offset % pagesize;
                         mmapoffset = offset - pagefudge;
-                        search->gdb.len = pagefudge + OV_BLOCKSIZE;
+                        search->gdb.len = pagefudge + ovbuff->blocksize;
                         if ((search->gdb.addr =
                                  mmap(NULL, search->gdb.len, PROT_READ,
                                       MAP_SHARED, ovbuff->fd, mmapoffset))
@@ -2065,6 +2539,15 @@ ovsearch(void *handle, ARTNUM *artnum, char **data, int *len, TOKEN *token,
                     }
                 }
                 *data = (char *) gdb->data + Gib[search->cur].offset;
+                if (search->lockfree
+                    && !ovsearchcopy(search, data, Gib[search->cur].len)) {
+                    /* The group was expired, find its new blocks. */
+                    restart = Gib[search->cur].artnum;
+                    ovsearchunmap(search);
+                    if (!ovsnapshot(search, restart, search->hi))
+                        return false;
+                    goto again;
+                }
             }
         }
     }
@@ -2105,6 +2588,9 @@ ovclosesearch(void *handle, bool freeblock)
     }
     if (search->gdb.mmapped)
         munmap(search->gdb.addr, search->gdb.len);
+    free(search->buf);
+    search->buf = NULL;
+    search->bufsize = 0;
     if (freeblock) {
 #ifdef OV_DEBUG
         gloc = GROUPfind(search->group, false);
@@ -2131,10 +2617,13 @@ buffindexed_closesearch(void *handle)
 {
     OVSEARCH *search = (OVSEARCH *) handle;
     GROUPLOC gloc;
+    bool locked;
 
     gloc = search->gloc;
+    locked = search->locked;
     ovclosesearch(handle, false);
-    GROUPlock(gloc, INN_LOCK_UNLOCK);
+    if (locked)
+        GROUPlock(gloc, INN_LOCK_UNLOCK);
 }
 
 /* get token from sorted index */
@@ -2190,7 +2679,7 @@ buffindexed_getartinfo(const char *group, ARTNUM artnum, TOKEN *token)
 {
     GROUPLOC gloc;
     void *handle;
-    bool retval, grouplocked = false;
+    bool retval;
 
     if (Gib != NULL) {
         if (Cachesearch != NULL && strcmp(Cachesearch->group, group) != 0) {
@@ -2208,15 +2697,12 @@ buffindexed_getartinfo(const char *group, ARTNUM artnum, TOKEN *token)
                 if (GROUPLOCempty(gloc)) {
                     return false;
                 }
-                GROUPlock(gloc, INN_LOCK_WRITE);
                 if ((Cachesearch != NULL)
                     && (GROUPentries[gloc.recno].count
                         == Cachesearch->count)) {
                     /* no new overview data is stored */
-                    GROUPlock(gloc, INN_LOCK_UNLOCK);
                     return false;
                 } else {
-                    grouplocked = true;
                     free(Gib);
                     Gib = NULL;
                     if (Cachesearch != NULL) {
@@ -2228,20 +2714,11 @@ buffindexed_getartinfo(const char *group, ARTNUM artnum, TOKEN *token)
             }
         }
     }
-    gloc = GROUPfind(group, false);
-    if (GROUPLOCempty(gloc)) {
-        return false;
-    }
-    if (!grouplocked) {
-        GROUPlock(gloc, INN_LOCK_WRITE);
-    }
-    if (!(handle = ovopensearch(group, artnum, artnum, false))) {
-        GROUPlock(gloc, INN_LOCK_UNLOCK);
+    if (!(handle = ovopensearchnolock(group, artnum, artnum, false))) {
         return false;
     }
     retval = buffindexed_search(handle, NULL, NULL, NULL, token, NULL);
-    ovclosesearch(handle, false);
-    GROUPlock(gloc, INN_LOCK_UNLOCK);
+    buffindexed_closesearch(handle);
     return retval;
 }
 
@@ -2273,7 +2750,7 @@ buffindexed_expiregroup(const char *group, int *lo, struct history *h)
                 GROUPlock(gloc, INN_LOCK_UNLOCK);
                 continue;
             }
-            if (!ovgroupmmap(ge, ge->low, ge->high, true)) {
+            if (!ovgroupmmap(ge, ge->low, ge->high, true, NULL)) {
                 GROUPlock(gloc, INN_LOCK_UNLOCK);
                 warn("buffindexed: could not mmap overview for hidden "
                      "groups(%d)",
@@ -2291,6 +2768,7 @@ buffindexed_expiregroup(const char *group, int *lo, struct history *h)
                     OVgroupbasedexpire(token, ".", data, len, arrived,
                                        expires);
             }
+            GROUPseqfree(gloc);
 #ifdef OV_DEBUG
             freegroupblock(ge);
 #else
@@ -2365,7 +2843,7 @@ buffindexed_expiregroup(const char *group, int *lo, struct history *h)
                  "'%s'",
                  group);
             /* Clean just reserved overview entries. */
-            if (!ovgroupmmap(&newge, newge.low, newge.high, true)) {
+            if (!ovgroupmmap(&newge, newge.low, newge.high, true, NULL)) {
                 warn("buffindexed: cannot prepare free operation");
                 return false;
             }
@@ -2395,6 +2873,7 @@ buffindexed_expiregroup(const char *group, int *lo, struct history *h)
     if (lo != NULL) {
         *lo = ge->low;
     }
+    GROUPseqfree(gloc);
     ovclosesearch(handle, true);
     ge->expired = time(NULL);
     GROUPlock(gloc, INN_LOCK_UNLOCK);
@@ -2404,7 +2883,8 @@ buffindexed_expiregroup(const char *group, int *lo, struct history *h)
 bool
 buffindexed_ctl(OVCTLTYPE type, void *val)
 {
-    int total, used, *i, j;
+    double total, used;
+    int *i, j;
     float *f;
     OVBUFF *ovbuff = ovbufftab;
     OVSORTTYPE *sorttype;
@@ -2417,12 +2897,12 @@ buffindexed_ctl(OVCTLTYPE type, void *val)
              ovbuff = ovbuff->next) {
             ovlock(ovbuff, INN_LOCK_READ);
             ovreadhead(ovbuff);
-            total += ovbuff->totalblk;
-            used += ovbuff->usedblk;
+            total += (double) ovbuff->totalblk * ovbuff->blocksize;
+            used += (double) ovbuff->usedblk * ovbuff->blocksize;
             ovlock(ovbuff, INN_LOCK_UNLOCK);
         }
         f = (float *) val;
-        *f = ((float) used / (float) total) * 100;
+        *f = (float) (used / total * 100);
         return true;
     case OVSORT:
         sorttype = (OVSORTTYPE *) val;
@@ -2542,6 +3022,7 @@ buffindexed_close(void)
     if (fstat(GROUPfd, &sb) < 0)
         return;
     close(GROUPfd);
+    GROUPseqclose();
 
     if (GROUPheader) {
         if (munmap((void *) GROUPheader, GROUPfilesize(GROUPcount)) < 0) {
@@ -2584,6 +3065,259 @@ countgdb(void)
     return count;
 }
 
+/*
+** Find a run of count free blocks in a locked ovbuff, looking first after
+** the last run found.  Returns false if there is none.
+*/
+static bool
+ovfindrun(OVBUFF *ovbuff, unsigned int count, unsigned int *start)
+{
+    ULONG *table;
+    unsigned int from, blocknum, run, bits = sizeof(long) * 8;
+
+    table = ((ULONG *) ovbuff->bitfield + (OV_BEFOREBITF / sizeof(long)));
+    from = ovbuff->nextrun < ovbuff->totalblk ? ovbuff->nextrun : 0;
+    for (;;) {
+        run = 0;
+        for (blocknum = from; blocknum < ovbuff->totalblk; blocknum++) {
+            if (blocknum % bits == 0 && table[blocknum / bits] == ~0UL) {
+                run = 0;
+                blocknum += bits - 1;
+                continue;
+            }
+            if (ovusedblock(ovbuff, blocknum, false, false)) {
+                run = 0;
+                continue;
+            }
+            if (++run == count) {
+                *start = blocknum + 1 - count;
+                ovbuff->nextrun = blocknum + 1;
+                return true;
+            }
+        }
+        if (from == 0)
+            return false;
+        from = 0;
+    }
+}
+
+static int
+OVcompare(const void *p1, const void *p2)
+{
+    const OV *ov1 = p1;
+    const OV *ov2 = p2;
+
+    if (ov1->index != ov2->index)
+        return ov1->index - ov2->index;
+    if (ov1->blocknum != ov2->blocknum)
+        return ov1->blocknum < ov2->blocknum ? -1 : 1;
+    return 0;
+}
+
+/* Whether blocks are consecutive in a single ovbuff.  Sorts them. */
+static bool
+ovconsecutive(OV *blocks, int count)
+{
+    int i;
+
+    qsort(blocks, count, sizeof(OV), OVcompare);
+    for (i = 1; i < count; i++) {
+        if (blocks[i].index != blocks[0].index
+            || blocks[i].blocknum != blocks[i - 1].blocknum + 1)
+            return false;
+    }
+    return true;
+}
+
+/*
+** Rewrite the overview of a group into consecutive blocks, so that reading
+** it is sequential: data blocks first, then index blocks, in a free run
+** large enough for both.  moved is set if the group was rewritten; groups
+** already in consecutive blocks are left alone.  Returns false if no run
+** was found or the group could not be rewritten.
+*/
+static bool
+ovdefraggroup(GROUPLOC gloc, bool *moved)
+{
+    GROUPENTRY newge, *ge;
+    OVSEARCH search;
+    GROUPDATABLOCK *gdb;
+    GIBLIST *giblist;
+    OVBUFF *ovbuff;
+    OV *datablks, *indexblks;
+    ARTNUM artnum = 0;
+    TOKEN token;
+    char *data = NULL, flag;
+    int len = 0, ndata, nindex, i, pass;
+    unsigned long datasize = 0;
+    unsigned int start, need, nd;
+    time_t arrived = 0, expires = 0;
+    bool ok;
+
+    *moved = false;
+    GROUPlock(gloc, INN_LOCK_WRITE);
+    ge = &GROUPentries[gloc.recno];
+    if (ge->deleted != 0 || ge->count == 0) {
+        GROUPlock(gloc, INN_LOCK_UNLOCK);
+        return true;
+    }
+    if (!ovgroupmmap(ge, ge->low, ge->high, true, NULL)) {
+        GROUPlock(gloc, INN_LOCK_UNLOCK);
+        return false;
+    }
+    memset(&search, 0, sizeof(search));
+
+    ndata = countgdb();
+    for (nindex = 0, giblist = Giblist; giblist != NULL;
+         giblist = giblist->next)
+        nindex++;
+    datablks = xmalloc((ndata + 1) * sizeof(OV));
+    indexblks = xmalloc((nindex + 1) * sizeof(OV));
+    for (ndata = 0, i = 0; i < GROUPDATAHASHSIZE; i++) {
+        for (gdb = groupdatablock[i]; gdb != NULL; gdb = gdb->next) {
+            datablks[ndata++] = gdb->datablk;
+            if ((ovbuff = getovbuff(gdb->datablk)) != NULL)
+                datasize += ovbuff->blocksize;
+        }
+    }
+    for (nindex = 0, giblist = Giblist; giblist != NULL;
+         giblist = giblist->next)
+        indexblks[nindex++] = giblist->ov;
+    ok = ovconsecutive(datablks, ndata) && ovconsecutive(indexblks, nindex);
+    free(datablks);
+    free(indexblks);
+    if (ok) {
+        ovsearchunmap(&search);
+        GROUPlock(gloc, INN_LOCK_UNLOCK);
+        return true;
+    }
+
+    /* Groups with several data blocks go to the largest blocks. */
+    for (pass = 0; pass < 2 && Defragdata.index == NULLINDEX; pass++) {
+        for (ovbuff = ovbufftab; ovbuff != NULL; ovbuff = ovbuff->next) {
+            if (pass == 0
+                && ovbuff->blocksize
+                       != (ndata > 1 ? OVbigblock : OVsmallblock))
+                continue;
+            nd = datasize / ovbuff->blocksize + 1;
+            need = nd + (ge->count + OVINDEXCOUNT(ovbuff) - 1)
+                            / OVINDEXCOUNT(ovbuff);
+            ovlock(ovbuff, INN_LOCK_WRITE);
+            ok = ovfindrun(ovbuff, need, &start);
+            ovlock(ovbuff, INN_LOCK_UNLOCK);
+            if (ok) {
+                Defragdata.index = Defragindex.index = ovbuff->index;
+                Defragdata.blocknum = start;
+                Defragindex.blocknum = start + nd;
+                break;
+            }
+        }
+    }
+    if (Defragdata.index == NULLINDEX) {
+        ovsearchunmap(&search);
+        GROUPlock(gloc, INN_LOCK_UNLOCK);
+        return false;
+    }
+
+    newge = *ge;
+    flag = ge->flag;
+    setinitialge(&newge, ge->hash, &flag, ge->next, ge->low, ge->high);
+    search.lo = ge->low;
+    search.hi = ge->high;
+    search.needov = true;
+    ok = true;
+    while (ovsearch((void *) &search, &artnum, &data, &len, &token, &arrived,
+                    &expires)) {
+        if (len == 0)
+            continue;
+#ifdef OV_DEBUG
+        if (!ovaddrec(&newge, artnum, token, data, len, arrived, expires,
+                      ge)) {
+#else
+        if (!ovaddrec(&newge, artnum, token, data, len, arrived, expires)) {
+#endif /* OV_DEBUG */
+            ok = false;
+            break;
+        }
+    }
+    Defragdata = Defragindex = ovnull;
+    if (!ok) {
+        /* Free the new blocks and keep the old ones. */
+        ovsearchunmap(&search);
+        if (ovgroupmmap(&newge, newge.low, newge.high, true, NULL)) {
+#ifdef OV_DEBUG
+            freegroupblock(ge);
+#else
+            freegroupblock();
+#endif /* OV_DEBUG */
+        }
+        ovsearchunmap(&search);
+        GROUPlock(gloc, INN_LOCK_UNLOCK);
+        return false;
+    }
+    newge.low = ge->low;
+    newge.high = ge->high;
+    newge.expired = ge->expired;
+    *ge = newge;
+    GROUPseqfree(gloc);
+#ifdef OV_DEBUG
+    freegroupblock(ge);
+#else
+    freegroupblock();
+#endif /* OV_DEBUG */
+    ovsearchunmap(&search);
+    GROUPlock(gloc, INN_LOCK_UNLOCK);
+    *moved = true;
+    return true;
+}
+
+/* Defragment a group, counting the result. */
+static void
+defraggroup(GROUPLOC gloc, int *moved, int *failed)
+{
+    bool done;
+
+    if (!ovdefraggroup(gloc, &done)) {
+        fprintf(stderr, "cannot defragment group %d\n", gloc.recno);
+        (*failed)++;
+    } else if (done)
+        (*moved)++;
+}
+
+/*
+** Defragment the given groups, or all of them.  Runs alongside innd like
+** expireover does.
+*/
+static int
+defrag(char **groups)
+{
+    GROUPLOC gloc;
+    int i, moved = 0, failed = 0;
+
+    if (!buffindexed_open(OV_READ | OV_WRITE)) {
+        fprintf(stderr, "buffindexed_open failed\n");
+        exit(1);
+    }
+    if (*groups == NULL) {
+        for (i = 0; i < GROUPcount; i++) {
+            gloc.recno = i;
+            defraggroup(gloc, &moved, &failed);
+        }
+    }
+    for (; *groups != NULL; groups++) {
+        gloc = GROUPfind(*groups, false);
+        if (GROUPLOCempty(gloc)) {
+            fprintf(stderr, "%s: no such group\n", *groups);
+            failed++;
+            continue;
+        }
+        defraggroup(gloc, &moved, &failed);
+    }
+    fprintf(stdout, "%d group(s) defragmented, %d failed\n", moved, failed);
+    buffindexed_close();
+    return failed == 0 ? 0 : 1;
+}
+
 int
 main(int argc, char **argv)
 {
@@ -2594,10 +3328,6 @@ main(int argc, char **argv)
     GROUPLOC gloc;
     GIBLIST *giblist;
 
-    if (argc != 2) {
-        fprintf(stderr, "only one argument can be specified\n");
-        exit(1);
-    }
     /* if innconf isn't already read in, do so. */
     if (innconf == NULL) {
         if (!innconf_read(NULL)) {
@@ -2605,6 +3335,12 @@ main(int argc, char **argv)
             exit(1);
         }
     }
+    if (argc >= 2 && strcmp(argv[1], "-d") == 0)
+        exit(defrag(argv + 2));
+    if (argc != 2) {
+        fprintf(stderr, "only one argument can be specified\n");
+        exit(1);
+    }
     if (!buffindexed_open(OV_READ)) {
         fprintf(stderr, "buffindexed_open failed\n");
         exit(1);
@@ -2621,7 +3357,7 @@ main(int argc, char **argv)
             GROUPlock(gloc, INN_LOCK_UNLOCK);
             exit(0);
         }
-        if (!ovgroupmmap(ge, ge->low, ge->high, true)) {
+        if (!ovgroupmmap(ge, ge->low, ge->high, true, NULL)) {
             fprintf(stderr, "ovgroupmmap failed\n");
             GROUPlock(gloc, INN_LOCK_UNLOCK);
         }
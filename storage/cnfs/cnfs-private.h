@@ -28,6 +28,14 @@
 /* Amount of data stored at beginning of CYCBUFF before the bitfield */
 #define CNFS_BEFOREBITF     512 /* Rounded up to CNFS_HDR_PAGESIZE */
 
+/* Offset in the header of the redo log, and number of records in it.  The
+   records fit between CYCBUFFEXTERN and the bitfield. */
+#define CNFS_REDOOFFSET     256
+#define CNFS_REDOCOUNT      8
+
+/* How far ahead cnfs_next asks the kernel to read when walking a cycbuff */
+#define CNFS_READAHEAD      (4 * 1024 * 1024)
+
 struct metacycbuff; /* Definition comes below */
 
 #define CNFSMAXCYCBUFFNAME 8
@@ -55,6 +63,7 @@ typedef struct _CYCBUFF {
     bool currentbuff;         /* true if this cycbuff is currently used */
     char metaname[CNFSNASIZ]; /* Symbolic name of meta */
     int order;                /* Order in meta, start from 1 not 0 */
+    uint64_t redoseq;         /* Sequence number of last redo record */
 } CYCBUFF;
 
 /*
@@ -73,8 +82,24 @@ typedef struct {
     char orderinmeta[CNFSLASIZ];
     char currentbuff[CNFSMASIZ];
     char blksza[CNFSLASIZ]; /* ASCII version of blksz */
+    char checksuma[CNFSLASIZ]; /* ASCII checksum of the above, or empty */
 } CYCBUFFEXTERN;
 
+/*
+** A record of the redo log, written in binary each time articles are marked
+** as stored, so that the free pointer and cycle number can be rolled
+** forward at startup when the header lags behind after a crash, or taken
+** instead of those of a header failing its checksum.
+*/
+typedef struct {
+    uint64_t sequence; /* Increases with each record, 0 = unused */
+    uint64_t free;     /* Free pointer after the stored articles */
+    uint32_t cyclenum; /* Current cycle */
+    uint32_t blksz;    /* Block size */
+    uint32_t checksum; /* Checksum of the above */
+    uint32_t unused;   /* Always 0, keeps records 64-bit aligned */
+} CNFSREDO;
+
 #define METACYCBUFF_UPDATE 25
 #define REFRESH_INTERVAL   30
 
@@ -64,6 +64,12 @@ static long pagesize = 0;
 static int metabuff_update = METACYCBUFF_UPDATE;
 static int refresh_interval = REFRESH_INTERVAL;
 
+/* The part of a cycbuff cnfs_next last asked the kernel to read ahead, so
+   that walking the spool reads it in large sequential reads. */
+static CYCBUFF *readahead_cycbuff = NULL;
+static off_t readahead_start = 0;
+static off_t readahead_end = 0;
+
 static CYCBUFF *CNFSgetcycbuffbyname(char *name);
 
 
@@ -231,6 +237,114 @@ CNFShex2offt(char *hex)
     }
 }
 
+/*
+** Return a checksum of some bytes of the header, for CYCBUFFEXTERN and the
+** records of the redo log.
+*/
+static uint32_t
+CNFSchecksum(const void *data, size_t len)
+{
+    HASH hash;
+    uint32_t sum;
+
+    hash = Hash(data, len);
+    memcpy(&sum, hash.hash, sizeof(sum));
+    return sum;
+}
+
+/*
+** Check the checksum of a header.  Headers written by older versions of INN
+** or by cnfsheadconf have none and are taken as they are.
+*/
+static bool
+CNFScheckhead(const CYCBUFFEXTERN *rpx)
+{
+    char buf[64];
+
+    if (rpx->checksuma[0] == '\0')
+        return true;
+    memcpy(buf, rpx->checksuma, CNFSLASIZ);
+    buf[CNFSLASIZ] = '\0';
+    return CNFShex2offt(buf)
+           == (off_t) CNFSchecksum(rpx, offsetof(CYCBUFFEXTERN, checksuma));
+}
+
+/*
+** Return the cycle number following the current one of a cycbuff.
+*/
+static uint32_t
+CNFSnextcycle(const CYCBUFF *cycbuff)
+{
+    uint32_t cyclenum = cycbuff->cyclenum + 1;
+
+    if (cycbuff->magicver <= 3) {
+        if (cyclenum == 0)
+            cyclenum += 2; /* cnfs_next() needs this */
+    } else {
+        if ((cyclenum & 0xFFFFFF) == 0) /* 24 bits max */
+            cyclenum = 2; /* cnfs_next() needs this */
+    }
+    return cyclenum;
+}
+
+/*
+** Find the newest valid record of the redo log of a cycbuff.  Returns false
+** if there is none.
+*/
+static bool
+CNFSlastredo(CYCBUFF *cycbuff, CNFSREDO *last)
+{
+    CNFSREDO redo;
+    const char *log;
+    int i;
+
+    memset(last, 0, sizeof(*last));
+    log = (const char *) cycbuff->bitfield + CNFS_REDOOFFSET;
+    for (i = 0; i < CNFS_REDOCOUNT; i++) {
+        memcpy(&redo, log + i * sizeof(redo), sizeof(redo));
+        if (redo.sequence == 0
+            || redo.checksum
+                   != CNFSchecksum(&redo, offsetof(CNFSREDO, checksum)))
+            continue;
+        if (redo.sequence > last->sequence)
+            *last = redo;
+    }
+    if (last->sequence == 0)
+        return false;
+    if (last->sequence > cycbuff->redoseq)
+        cycbuff->redoseq = last->sequence;
+    return true;
+}
+
+/*
+** Set the free pointer and cycle number of a cycbuff from the newest record
+** of its redo log.  If the header can be trusted, the record is only used if
+** it is ahead of it, so that a stale one never moves it backwards: a later
+** free pointer in the same cycle, or the next cycle.  Otherwise the header
+** may be wrong anywhere, and the record, which is never behind it, is taken
+** as it is.  Returns true if the cycbuff was changed.
+*/
+static bool
+CNFSreadredo(CYCBUFF *cycbuff, bool trusthead)
+{
+    CNFSREDO last;
+
+    if (!CNFSlastredo(cycbuff, &last))
+        return false;
+    if ((off_t) last.free < cycbuff->minartoffset
+        || (off_t) last.free > cycbuff->len)
+        return false;
+    if (last.cyclenum == cycbuff->cyclenum) {
+        if ((off_t) last.free == cycbuff->free
+            || (trusthead && (off_t) last.free < cycbuff->free))
+            return false;
+    } else if (trusthead && last.cyclenum != CNFSnextcycle(cycbuff))
+        return false;
+    cycbuff->free = last.free;
+    cycbuff->cyclenum = last.cyclenum;
+    return true;
+}
+
 static bool
 CNFSflushhead(CYCBUFF *cycbuff)
 {
@@ -270,6 +384,11 @@ CNFSflushhead(CYCBUFF *cycbuff)
             strncpy(rpx.currentbuff, "FALSE", CNFSMASIZ);
         }
         strncpy(rpx.blksza, CNFSofft2hex(cycbuff->blksz, true), CNFSLASIZ);
+        strncpy(rpx.checksuma,
+                CNFSofft2hex(
+                    CNFSchecksum(&rpx, offsetof(CYCBUFFEXTERN, checksuma)),
+                    true),
+                CNFSLASIZ);
 #if __GNUC__ > 7
 #    pragma GCC diagnostic warning "-Wstringop-truncation"
 #endif
@@ -388,7 +507,7 @@ CNFSflushallheads(void)
 
 /*
 ** CNFSReadFreeAndCycle() -- Read from disk the current values of CYCBUFF's
-** free pointer and cycle number.  Return 1 on success, 0 otherwise.
+** free pointer and cycle number, rolled forward with the redo log.
 */
 
 static void
@@ -408,7 +527,7 @@ CNFSReadFreeAndCycle(CYCBUFF *cycbuff)
     strncpy(buf, rpx.cyclenuma, CNFSLASIZ);
     buf[CNFSLASIZ] = '\0';
     cycbuff->cyclenum = CNFShex2offt(buf);
-    return;
+    CNFSreadredo(cycbuff, CNFScheckhead(&rpx));
 }
 
 static bool
@@ -478,6 +597,7 @@ CNFSparse_part_line(char *l)
     cycbuff->needflush = false;
     cycbuff->bitfield = NULL;
     cycbuff->minartoffset = 0;
+    cycbuff->redoseq = 0;
     if (cycbufftab == (CYCBUFF *) NULL)
         cycbufftab = cycbuff;
     else {
@@ -641,11 +761,12 @@ CNFSinit_disks(CYCBUFF *cycbuff)
 {
     char buf[64];
     CYCBUFFEXTERN *rpx;
+    CNFSREDO redo;
     int fd;
     int tonextblock;
     off_t tmpo;
     off_t minartoffset;
-    bool oneshot;
+    bool oneshot, headok, fresh;
 
     /*
     ** Discover the state of our cycbuffs.  If any of them are in icky shape,
@@ -692,6 +813,8 @@ CNFSinit_disks(CYCBUFF *cycbuff)
         */
         rpx = (CYCBUFFEXTERN *) cycbuff->bitfield;
         cycbuff->magicver = 0;
+        headok = true;
+        fresh = false;
         if (strncmp(rpx->magic, CNFS_MAGICV3, strlen(CNFS_MAGICV3)) == 0) {
             cycbuff->magicver = 3;
             cycbuff->blksz = 512;
@@ -699,6 +822,16 @@ CNFSinit_disks(CYCBUFF *cycbuff)
         if (strncmp(rpx->magic, CNFS_MAGICV4, strlen(CNFS_MAGICV4)) == 0)
             cycbuff->magicver = 4;
         if (cycbuff->magicver >= 3) {
+            headok = CNFScheckhead(rpx);
+            if (!headok) {
+                if (!CNFSlastredo(cycbuff, &redo)) {
+                    warn("CNFS: header checksum mismatch for cycbuff %s and"
+                         " no redo log to recover it from", cycbuff->name);
+                    return false;
+                }
+                warn("CNFS: header checksum mismatch for cycbuff %s,"
+                     " recovering it from its redo log", cycbuff->name);
+            }
             if (strncmp(rpx->name, cycbuff->name, CNFSNASIZ) != 0) {
                 warn("CNFS: Mismatch 3: read %s for cycbuff %s", rpx->name,
                      cycbuff->name);
@@ -737,6 +870,8 @@ CNFSinit_disks(CYCBUFF *cycbuff)
                 buf[CNFSLASIZ] = '\0';
                 cycbuff->blksz = CNFShex2offt(buf);
             }
+            if (!headok)
+                cycbuff->blksz = redo.blksz;
             if (cycbuff->blksz < 512 || cycbuff->blksz > CNFS_MAX_BLOCKSIZE
                 || 2 * (cycbuff->blksz / 2) != cycbuff->blksz) {
                 warn("CNFS: Invalid: read 0x%s blocksize for cycbuff %s",
@@ -756,6 +891,7 @@ CNFSinit_disks(CYCBUFF *cycbuff)
             cycbuff->blksz = CNFS_DFL_BLOCKSIZE;
             cycbuff->free = 0;
             memset(cycbuff->metaname, '\0', CNFSNASIZ);
+            fresh = true;
         }
         /*
         ** The minimum article offset will be the size of the bitfield itself,
@@ -785,6 +921,32 @@ CNFSinit_disks(CYCBUFF *cycbuff)
 
         if (cycbuff->free == 0)
             cycbuff->free = cycbuff->minartoffset;
+
+        /*
+        ** The header is only written every cycbuffupdate articles, so after
+        ** a crash it may lag behind the articles already stored.  Roll it
+        ** forward with the redo log, or forget the log of a previous use of
+        ** a cycbuff being initialized.  The free pointer and cycle number
+        ** of a header failing its checksum are replaced by those of the log.
+        */
+        if (fresh) {
+            if (SMopenmode)
+                memset((char *) cycbuff->bitfield + CNFS_REDOOFFSET, 0,
+                       CNFS_REDOCOUNT * sizeof(CNFSREDO));
+        } else if (!headok
+                   && ((off_t) redo.free < cycbuff->minartoffset
+                       || (off_t) redo.free > cycbuff->len)) {
+            warn("CNFS: invalid free pointer 0x%s in the redo log of"
+                 " cycbuff %s",
+                 CNFSofft2hex((off_t) redo.free, false), cycbuff->name);
+            return false;
+        } else if (CNFSreadredo(cycbuff, headok) || !headok) {
+            notice("CNFS: rolled cycbuff %s forward to cycle 0x%x free 0x%s",
+                   cycbuff->name, cycbuff->cyclenum,
+                   CNFSofft2hex(cycbuff->free, false));
+            if (SMopenmode)
+                cycbuff->needflush = true;
+        }
         if (cycbuff->needflush && !CNFSflushhead(cycbuff))
             return false;
 
@@ -1115,6 +1277,97 @@ CNFSUsedBlock(CYCBUFF *cycbuff, off_t offset, bool set_operation,
         return 0;
 }
 
+/*
+** Return the offset of the first used block from start (on a block boundary)
+** up to end, or the first block boundary at or after end if there is none.
+** Used to walk the bitfield when scanning a cycbuff, a whole long of unused
+** blocks at a time instead of bit by bit with CNFSUsedBlock.
+*/
+static off_t
+CNFSnextusedblock(CYCBUFF *cycbuff, off_t start, off_t end)
+{
+    const int bits = sizeof(ULONG) * 8;
+    off_t blocknum, lastblock;
+    ULONG *bitfield, bitlong;
+    int bitoffset;
+
+    if (end > cycbuff->len)
+        end = cycbuff->len;
+    if (start >= end)
+        return start;
+    bitfield = (ULONG *) cycbuff->bitfield + (CNFS_BEFOREBITF / sizeof(ULONG));
+    blocknum = start / cycbuff->blksz;
+    lastblock = (end + cycbuff->blksz - 1) / cycbuff->blksz;
+    while (blocknum < lastblock) {
+        bitoffset = blocknum % bits;
+
+        /* Bits are numbered from the left side of the long, so drop the
+           ones of the blocks before blocknum. */
+        bitlong = bitfield[blocknum / bits] & (ULONG_MAX >> bitoffset);
+        if (bitlong == 0) {
+            blocknum += bits - bitoffset;
+            continue;
+        }
+        for (; bitoffset < bits; bitoffset++, blocknum++)
+            if (bitlong & ((ULONG) 1 << (bits - 1 - bitoffset)))
+                break;
+        break;
+    }
+    if (blocknum > lastblock)
+        blocknum = lastblock;
+    return blocknum * cycbuff->blksz;
+}
+
+/*
+** Append a record of the free pointer end and of the current cycle to the
+** redo log of a cycbuff, unless the last one is already past it.
+*/
+static void
+CNFSwriteredo(CYCBUFF *cycbuff, off_t end)
+{
+    CNFSREDO redo;
+    char *log;
+
+    log = (char *) cycbuff->bitfield + CNFS_REDOOFFSET;
+    if (cycbuff->redoseq > 0) {
+        memcpy(&redo,
+               log + (cycbuff->redoseq % CNFS_REDOCOUNT) * sizeof(redo),
+               sizeof(redo));
+        if (redo.cyclenum == cycbuff->cyclenum && (off_t) redo.free >= end)
+            return;
+    }
+    redo.sequence = ++cycbuff->redoseq;
+    redo.free = end;
+    redo.cyclenum = cycbuff->cyclenum;
+    redo.blksz = cycbuff->blksz;
+    redo.unused = 0;
+    redo.checksum = CNFSchecksum(&redo, offsetof(CNFSREDO, checksum));
+    log += (redo.sequence % CNFS_REDOCOUNT) * sizeof(redo);
+    memcpy(log, &redo, sizeof(redo));
+    if (innconf->nfswriter)
+        cnfs_mapcntl(log, sizeof(redo), MS_ASYNC);
+}
+
+/*
+** Mark the blocks of a written article, from offset up to end, as used.
+** Only the first block of an article has its bit set.
+*/
+static void
+CNFSmarkarticle(CYCBUFF *cycbuff, off_t offset, off_t end)
+{
+    off_t middle;
+
+    CNFSUsedBlock(cycbuff, offset, true, true);
+    for (middle = offset + cycbuff->blksz; middle < end;
+         middle += cycbuff->blksz) {
+        CNFSUsedBlock(cycbuff, middle, true, false);
+    }
+    CNFSwriteredo(cycbuff, end);
+    if (innconf->nfswriter) {
+        cnfs_mapcntl(NULL, 0, MS_ASYNC);
+    }
+}
+
 static int
 CNFSArtMayBeHere(CYCBUFF *cycbuff, off_t offset, uint32_t cycnum)
 {
@@ -1294,14 +1547,7 @@ cnfs_store(const ARTHANDLE article, const STORAGECLASS class)
             cnfs_mapcntl(NULL, 0, MS_ASYNC);
         }
         cycbuff->free = cycbuff->minartoffset;
-        cycbuff->cyclenum++;
-        if (cycbuff->magicver <= 3) {
-            if (cycbuff->cyclenum == 0)
-                cycbuff->cyclenum += 2; /* cnfs_next() needs this */
-        } else {
-            if ((cycbuff->cyclenum & 0xFFFFFF) == 0) /* 24 bits max */
-                cycbuff->cyclenum = 2; /* cnfs_next() needs this */
-        }
+        cycbuff->cyclenum = CNFSnextcycle(cycbuff);
         cycbuff->needflush = true;
         if (metacycbuff->metamode == INTERLEAVE) {
             CNFSflushhead(cycbuff); /* Flush, just for giggles */
@@ -1400,14 +1646,7 @@ cnfs_store(const ARTHANDLE article, const STORAGECLASS class)
             CNFSflushhead(metacycbuff->members[i]);
         }
     }
-    CNFSUsedBlock(cycbuff, artoffset, true, true);
-    for (middle = artoffset + cycbuff->blksz; middle < cycbuff->free;
-         middle += cycbuff->blksz) {
-        CNFSUsedBlock(cycbuff, middle, true, false);
-    }
-    if (innconf->nfswriter) {
-        cnfs_mapcntl(NULL, 0, MS_ASYNC);
-    }
+    CNFSmarkarticle(cycbuff, artoffset, cycbuff->free);
     if (!SMpreopen)
         CNFSshutdowncycbuff(cycbuff);
     return CNFSMakeToken(artcycbuffname, artoffset, cycbuff->blksz,
@@ -1727,11 +1966,38 @@ cnfs_cancel(TOKEN token)
     return true;
 }
 
+#if HAVE_POSIX_FADVISE
+/*
+** Ask the kernel to read the part of a cycbuff after offset, where cnfs_next
+** will find the next articles, once it gets within half of CNFS_READAHEAD
+** of the end of the part it was last asked to read.
+*/
+static void
+CNFSreadahead(CYCBUFF *cycbuff, off_t offset)
+{
+    if (cycbuff == readahead_cycbuff && offset >= readahead_start
+        && readahead_end - offset > CNFS_READAHEAD / 2)
+        return;
+    if (cycbuff != readahead_cycbuff || offset < readahead_start
+        || offset >= readahead_end)
+        readahead_start = readahead_end = offset;
+    posix_fadvise(cycbuff->fd, readahead_end, CNFS_READAHEAD,
+                  POSIX_FADV_WILLNEED);
+    readahead_cycbuff = cycbuff;
+    readahead_end += CNFS_READAHEAD;
+}
+#else
+static void
+CNFSreadahead(CYCBUFF *cycbuff UNUSED, off_t offset UNUSED)
+{
+}
+#endif
+
 ARTHANDLE *
 cnfs_next(ARTHANDLE *article, const RETRTYPE amount)
 {
     ARTHANDLE *art;
-    CYCBUFF *cycbuff;
+    CYCBUFF *cycbuff, *walk;
     PRIV_CNFS priv, *private;
     off_t middle = 0, limit;
     CNFSARTHEADER cah;
@@ -1742,15 +2008,32 @@ cnfs_next(ARTHANDLE *article, const RETRTYPE amount)
     off_t mmapoffset;
     char *p;
     int plusoffset = 0;
+    unsigned long unit;
+    const TOKEN *resume;
+    char cycbuffname[CNFSMAXCYCBUFFNAME + 1];
+    uint32_t blk, cycnum;
+    bool seek = false;
 
     if (article == NULL) {
         if ((cycbuff = cycbufftab) == NULL)
             return NULL;
+        readahead_cycbuff = NULL;
         priv.offset = 0;
         priv.rollover = false;
         priv.len = 0;
         priv.base = NULL;
         priv.cycbuff = NULL;
+
+        /* When resuming a walk, go straight to the cycbuff of the token.
+           The offset and whether it is in the current cycle are only known
+           once the cycbuff is initialized. */
+        resume = SMresumepoint(TOKEN_CNFS);
+        if (resume != NULL
+            && CNFSBreakToken(*resume, cycbuffname, &blk, &cycnum)
+            && (walk = CNFSgetcycbuffbyname(cycbuffname)) != NULL) {
+            cycbuff = walk;
+            seek = true;
+        }
     } else {
         priv = *(PRIV_CNFS *) article->private;
         free(article->private);
@@ -1773,10 +2056,25 @@ cnfs_next(ARTHANDLE *article, const RETRTYPE amount)
     for (; cycbuff != (CYCBUFF *) NULL;
          cycbuff = cycbuff->next, priv.offset = 0) {
 
+        /* Each cycbuff is a unit of the spool when walking it in parts;
+           they are numbered in the order of cycbuff.conf. */
+        if (priv.offset == 0) {
+            for (unit = 0, walk = cycbufftab; walk != cycbuff;
+                 walk = walk->next)
+                unit++;
+            if (!SMpartitioned(unit))
+                continue;
+        }
+
         if (!SMpreopen && !CNFSinit_disks(cycbuff)) {
             SMseterror(SMERR_INTERNAL, "cycbuff initialization fail");
             continue;
         }
+        if (seek) {
+            priv.offset = (off_t) blk * cycbuff->blksz;
+            priv.rollover = priv.offset < cycbuff->free;
+            seek = false;
+        }
         /* If a roll over is expected but offset is too far, go to the
          * beginning of the next cycbuff. */
         if (priv.rollover && priv.offset >= cycbuff->free) {
@@ -1805,12 +2103,8 @@ cnfs_next(ARTHANDLE *article, const RETRTYPE amount)
         }
         if (!priv.rollover) {
             /* Treat the articles until the end of the cycbuff is reached. */
-            for (middle = priv.offset;
-                 middle < cycbuff->len - cycbuff->blksz - 1;
-                 middle += cycbuff->blksz) {
-                if (CNFSUsedBlock(cycbuff, middle, false, false) != 0)
-                    break;
-            }
+            middle = CNFSnextusedblock(cycbuff, priv.offset,
+                                       cycbuff->len - cycbuff->blksz - 1);
             /* The end of the cycbuff has been reached.  Ask for a roll over,
              * and go back to the beginning of this cycbuff to treat the
              * articles of the current cycle number. */
@@ -1833,11 +2127,7 @@ cnfs_next(ARTHANDLE *article, const RETRTYPE amount)
         } else {
             /* Treat the articles of the current cycle number, up to where
              * articles of the previous cycle number still are. */
-            for (middle = priv.offset; middle < cycbuff->free;
-                 middle += cycbuff->blksz) {
-                if (CNFSUsedBlock(cycbuff, middle, false, false) != 0)
-                    break;
-            }
+            middle = CNFSnextusedblock(cycbuff, priv.offset, cycbuff->free);
             /* Time to go to the next cycbuff? */
             if (middle >= cycbuff->free) {
                 /* priv.offset will be set to 0 in the loop clause. */
@@ -1854,6 +2144,7 @@ cnfs_next(ARTHANDLE *article, const RETRTYPE amount)
         return (ARTHANDLE *) NULL;
 
     offset = middle;
+    CNFSreadahead(cycbuff, offset);
     if (pread(cycbuff->fd, &cah, sizeof(cah), offset) != sizeof(cah)) {
         if (!SMpreopen)
             CNFSshutdowncycbuff(cycbuff);
@@ -1900,13 +2191,10 @@ cnfs_next(ARTHANDLE *article, const RETRTYPE amount)
     limit = private->offset + sizeof(cah) + plusoffset + ntohl(cah.size)
             - blockfudge + cycbuff->blksz;
     if (offset < cycbuff->free) {
-        for (middle = offset + cycbuff->blksz;
-             (middle < cycbuff->free) && (middle < limit);
-             middle += cycbuff->blksz) {
-            if (CNFSUsedBlock(cycbuff, middle, false, false) != 0)
-                /* Bitmap set.  This article assumes to be broken */
-                break;
-        }
+        /* A used block before limit means this article is broken. */
+        middle = CNFSnextusedblock(cycbuff, offset + cycbuff->blksz,
+                                   limit < cycbuff->free ? limit
+                                                         : cycbuff->free);
         if ((middle > cycbuff->free) || (middle != limit)) {
             private->offset = middle;
             art->data = NULL;
@@ -1917,13 +2205,9 @@ cnfs_next(ARTHANDLE *article, const RETRTYPE amount)
             return art;
         }
     } else {
-        for (middle = offset + cycbuff->blksz;
-             (middle < cycbuff->len) && (middle < limit);
-             middle += cycbuff->blksz) {
-            if (CNFSUsedBlock(cycbuff, middle, false, false) != 0)
-                /* Bitmap set.  This article assumes to be broken */
-                break;
-        }
+        middle = CNFSnextusedblock(cycbuff, offset + cycbuff->blksz,
+                                   limit < cycbuff->len ? limit
+                                                        : cycbuff->len);
         if ((middle >= cycbuff->len) || (middle != limit)) {
             private->offset = middle;
             art->data = NULL;
@@ -1957,6 +2241,19 @@ cnfs_next(ARTHANDLE *article, const RETRTYPE amount)
                                                     : cycbuff->cyclenum,
                           cah.class);
     art->token = &token;
+
+    /* Only the token is wanted, for instance to skip to a known position;
+       don't read the article. */
+    if (amount == RETR_STAT) {
+        art->data = NULL;
+        art->len = 0;
+        private->base = NULL;
+        private->len = 0;
+        if (!SMpreopen)
+            CNFSshutdowncycbuff(cycbuff);
+        return art;
+    }
+
     offset += sizeof(cah) + plusoffset;
     if (innconf->articlemmap) {
         pagefudge = offset % pagesize;
@@ -2074,6 +2371,7 @@ cnfs_printfiles(FILE *file, TOKEN token, char **xref UNUSED,
 void
 cnfs_shutdown(void)
 {
+    readahead_cycbuff = NULL;
     CNFScleancycbuff();
     CNFScleanmetacycbuff();
     CNFScleanexpirerule();
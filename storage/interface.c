@@ -38,6 +38,10 @@ char *SMerrorstr = NULL;
 static bool Initialized = false;
 bool SMopenmode = false;
 bool SMpreopen = false;
+static bool SMartcache = true;
+static struct smpartition SMpart = {0, 1};
+static TOKEN SMresume;
+static bool SMresuming = false;
 
 /*
 ** Checks to see if the token is valid.
@@ -481,12 +485,51 @@ SMsetup(SMSETUP type, void *value)
     case SM_PREOPEN:
         SMpreopen = *(bool *) value;
         break;
+    case SM_PARTITION:
+        if (((struct smpartition *) value)->count == 0
+            || ((struct smpartition *) value)->part
+                   >= ((struct smpartition *) value)->count)
+            return false;
+        SMpart = *(struct smpartition *) value;
+        break;
+    case SM_RESUME:
+        SMresume = *(TOKEN *) value;
+        SMresuming = true;
+        break;
+    case SM_ARTCACHE:
+        SMartcache = *(bool *) value;
+        break;
     default:
         return false;
     }
     return true;
 }
 
+/*
+** Whether the given unit of a spool belongs to the part SMnext should walk.
+** Methods number their units as they see fit and call this to skip the
+** ones given to other walkers.
+*/
+bool
+SMpartitioned(unsigned long unit)
+{
+    return (unit % SMpart.count) == SMpart.part;
+}
+
+/*
+** The token of the article the walk should start at, for the method of the
+** given type when it starts walking its spool.  It is only handed out once,
+** so later walks start from the beginning.
+*/
+const TOKEN *
+SMresumepoint(STORAGETYPE type)
+{
+    if (!SMresuming || SMresume.type != type)
+        return NULL;
+    SMresuming = false;
+    return &SMresume;
+}
+
 /*
 ** Calls the setup function for all of the configured methods and returns
 ** true if they all initialize ok, false if they don't
@@ -543,6 +586,10 @@ SMinit(void)
         return false;
     }
     once = true;
+
+    /* The article cache is only an optimization, so do without it if it
+       cannot be used. */
+    artcache_open();
     return true;
 }
 
@@ -622,8 +669,12 @@ MatchGroups(const char *g, int len, const char *pattern, bool exactmatch)
     return wanted;
 }
 
-STORAGE_SUB *
-SMgetsub(const ARTHANDLE article)
+/*
+**  Return the first storage.conf entry matching an article, only looking at
+**  the entries of the given storage class unless it is negative.
+*/
+static STORAGE_SUB *
+SMmatchsub(const ARTHANDLE article, int class)
 {
     STORAGE_SUB *sub;
 
@@ -636,6 +687,8 @@ SMgetsub(const ARTHANDLE article)
         return NULL;
 
     for (sub = subscriptions; sub != NULL; sub = sub->next) {
+        if (class >= 0 && sub->class != class)
+            continue;
         if (!(method_data[typetoindex[sub->type]].initialized == INIT_FAIL)
             && (article.len >= sub->minsize)
             && (!sub->maxsize || (article.len <= sub->maxsize))
@@ -652,8 +705,18 @@ SMgetsub(const ARTHANDLE article)
     return NULL;
 }
 
-TOKEN
-SMstore(const ARTHANDLE article)
+STORAGE_SUB *
+SMgetsub(const ARTHANDLE article)
+{
+    return SMmatchsub(article, -1);
+}
+
+/*
+**  Store an article with the first storage.conf entry of the given class
+**  matching it, or the first entry matching it if class is negative.
+*/
+static TOKEN
+SMstoresub(const ARTHANDLE article, int class)
 {
     STORAGE_SUB *sub;
     TOKEN result;
@@ -665,16 +728,33 @@ SMstore(const ARTHANDLE article)
         return result;
     }
     result.type = TOKEN_EMPTY;
-    if ((sub = SMgetsub(article)) == NULL) {
+    if ((sub = SMmatchsub(article, class)) == NULL) {
         return result;
     }
-    return storage_methods[typetoindex[sub->type]].store(article, sub->class);
+    result = storage_methods[typetoindex[sub->type]].store(article, sub->class);
+    if (result.type != TOKEN_EMPTY)
+        artcache_store(result, &article);
+    return result;
+}
+
+TOKEN
+SMstore(const ARTHANDLE article)
+{
+    return SMstoresub(article, -1);
+}
+
+TOKEN
+SMstoreclass(const ARTHANDLE article, const STORAGECLASS storageclass)
+{
+    return SMstoresub(article, storageclass);
 }
 
 ARTHANDLE *
 SMretrieve(const TOKEN token, const RETRTYPE amount)
 {
-    ARTHANDLE *art;
+    ARTHANDLE *art, *stat;
+    bool admit = false;
+    unsigned long generation = 0;
 
     if (method_data[typetoindex[token.type]].initialized == INIT_FAIL) {
         SMseterror(SMERR_UNINIT, NULL);
@@ -688,9 +768,28 @@ SMretrieve(const TOKEN token, const RETRTYPE amount)
         SMseterror(SMERR_UNINIT, NULL);
         return NULL;
     }
+    if (amount == RETR_ALL && SMartcache) {
+        art = artcache_lookup(token, &admit, &generation);
+        if (art != NULL) {
+            /* The article may have expired or been overwritten in the spool
+               since it got in the cache, so ask its method whether it is
+               still there, which is cheap with RETR_STAT. */
+            stat = storage_methods[typetoindex[token.type]].retrieve(
+                token, RETR_STAT);
+            if (stat != NULL) {
+                storage_methods[typetoindex[token.type]].freearticle(stat);
+                return art;
+            }
+            artcache_free(art);
+            artcache_cancel(token);
+            return NULL;
+        }
+    }
     art = storage_methods[typetoindex[token.type]].retrieve(token, amount);
     if (art)
         art->nextmethod = 0;
+    if (art != NULL && admit)
+        artcache_insert(token, art, generation);
     return art;
 }
 
@@ -702,7 +801,7 @@ SMnext(ARTHANDLE *article, const RETRTYPE amount)
     ARTHANDLE *newart;
 
     if (article == NULL)
-        start = 0;
+        start = SMresuming ? typetoindex[SMresume.type] : 0;
     else
         start = article->nextmethod;
 
@@ -732,6 +831,8 @@ SMnext(ARTHANDLE *article, const RETRTYPE amount)
 void
 SMfreearticle(ARTHANDLE *article)
 {
+    if (artcache_free(article))
+        return;
     if (method_data[typetoindex[article->type]].initialized == INIT_FAIL) {
         return;
     }
@@ -746,6 +847,8 @@ SMfreearticle(ARTHANDLE *article)
 bool
 SMcancel(TOKEN token)
 {
+    bool cancelled;
+
     if (!SMopenmode) {
         SMseterror(SMERR_INTERNAL, "read only storage api");
         return false;
@@ -760,7 +863,11 @@ SMcancel(TOKEN token)
         warn("SM: can't cancel article with uninitialized method");
         return false;
     }
-    return storage_methods[typetoindex[token.type]].cancel(token);
+    /* Drop the article from the cache only once it is gone from the spool,
+       so that a reader missing it in between cannot put it back. */
+    cancelled = storage_methods[typetoindex[token.type]].cancel(token);
+    artcache_cancel(token);
+    return cancelled;
 }
 
 bool
@@ -819,6 +926,11 @@ SMprobe(PROBETYPE type, TOKEN *token, void *value)
         }
     case EXPENSIVESTAT:
         return (method_data[typetoindex[token->type]].expensivestat);
+    case READCOUNT:
+        if (value == NULL || !artcache_open())
+            return false;
+        *(unsigned int *) value = artcache_reads(*token);
+        return true;
     default:
         return false;
     }
@@ -884,6 +996,7 @@ SMshutdown(void)
         free(old->options);
         free(old);
     }
+    artcache_close();
     Initialized = false;
 }
 
@@ -48,11 +48,33 @@ typedef struct __S_SUB__ {
     struct __S_SUB__ *next;
 } STORAGE_SUB;
 
+/* Statistics of the shared article cache. */
+struct artcache_stats {
+    unsigned long lookups;    /* Articles looked for */
+    unsigned long hits;       /* Articles found */
+    unsigned long admissions; /* Articles put in the cache */
+};
+
 extern bool SMopenmode;
 extern bool SMpreopen;
+bool SMpartitioned(unsigned long unit);
+const TOKEN *SMresumepoint(STORAGETYPE type);
 char *SMFindBody(char *article, int len);
 STORAGE_SUB *SMGetConfig(STORAGETYPE type, STORAGE_SUB *sub);
 STORAGE_SUB *SMgetsub(const ARTHANDLE article);
 void SMseterror(int errorno, const char *error);
 
+/* Shared article cache, in artcache.c. */
+bool artcache_open(void);
+void artcache_close(void);
+ARTHANDLE *artcache_lookup(const TOKEN token, bool *admit,
+                           unsigned long *generation);
+void artcache_insert(const TOKEN token, const ARTHANDLE *art,
+                     unsigned long generation);
+void artcache_store(const TOKEN token, const ARTHANDLE *article);
+void artcache_cancel(const TOKEN token);
+bool artcache_free(ARTHANDLE *art);
+unsigned int artcache_reads(const TOKEN token);
+void artcache_stats(struct artcache_stats *stats);
+
 #endif /* __INTERFACE_H__ */
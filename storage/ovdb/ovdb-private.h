@@ -122,15 +122,22 @@ bool ovdb_check_user(void);
 #    define CMD_SRCH             0x04
 #    define CMD_CLOSESRCH        0x05
 #    define CMD_ARTINFO          0x06
+#    define CMD_SRCHBATCH        0x07
 #    define CMD_MASK             0x0F
 #    define RPLY_OK              0x00
 #    define RPLY_ERROR           0x10
 #    define OVDB_SERVER          (1 << 4)
-#    define OVDB_SERVER_BANNER   "ovdb read protocol 1"
+#    define OVDB_SERVER_BANNER   "ovdb read protocol 2"
 #    define OVDB_SERVER_PORT \
         32323 /* only used if don't have unix domain sockets */
 #    define OVDB_SERVER_SOCKET "ovdb.server"
 
+/* Limits on the articles returned by one CMD_SRCHBATCH.  A batch ends at
+   whichever limit is reached first, so that a long search doesn't keep
+   the other clients of the same read server waiting. */
+#    define OVDB_SRCHBATCH_ARTS  128
+#    define OVDB_SRCHBATCH_SIZE  (64 * 1024)
+
 struct rs_cmd {
     uint32_t what;
     uint32_t grouplen;
@@ -163,6 +170,16 @@ struct rs_srch {
     /* char data */
 };
 
+/* Reply to CMD_SRCHBATCH, followed by count struct rs_srch, each followed
+   by its data; len is the total length of all of them.  done is set when
+   the search is over and no more batches must be requested. */
+struct rs_srchbatch {
+    uint32_t status;
+    uint32_t count;
+    uint32_t len;
+    uint32_t done;
+};
+
 struct rs_artinfo {
     uint32_t status;
     TOKEN token;
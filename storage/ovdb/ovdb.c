@@ -257,6 +257,52 @@ static CONFTOKEN toks[] = {
 
 static int clientfd = -1;
 
+/* A search done through the readserver.  Articles are fetched in batches,
+   and the next batch is asked for as soon as the previous one arrives, so
+   that the server looks them up while we're sending the previous ones to
+   the reader.  The batch being read and the next one are kept in separate
+   buffers, so that the data returned by ovdb_search stays valid until the
+   next call even if the next batch arrives in the meantime. */
+struct rs_search {
+    void *handle; /* search handle in the server */
+    char *cur;    /* batch being read */
+    char *spare;  /* next batch, once received */
+    size_t cursize, sparesize;
+    size_t pos, end;
+    size_t sparelen;
+    bool ready; /* whether the next batch has been received */
+    bool done;  /* whether the server has no more batches */
+};
+
+/* The search whose next batch has been asked for but not yet received.
+   Its reply must be read before anything else is sent to the server. */
+static struct rs_search *pending = NULL;
+
+static int crecv(void *data, int n);
+
+/* Receive a batch of articles into the spare buffer of a search. */
+static void
+client_recvbatch(struct rs_search *s)
+{
+    struct rs_srchbatch repl;
+
+    crecv(&repl, sizeof(repl));
+    s->ready = true;
+    s->sparelen = 0;
+    if (repl.status != CMD_SRCHBATCH) {
+        s->done = true;
+        return;
+    }
+    if (repl.len > s->sparesize) {
+        s->sparesize = repl.len + 1024;
+        s->spare = xrealloc(s->spare, s->sparesize);
+    }
+    crecv(s->spare, repl.len);
+    s->sparelen = repl.len;
+    if (repl.done || repl.count == 0)
+        s->done = true;
+}
+
 /* read client send and receive functions. */
 
 static int
@@ -266,6 +312,12 @@ csend(const void *data, int n)
 
     if (n == 0)
         return 0;
+    if (pending != NULL) {
+        struct rs_search *s = pending;
+
+        pending = NULL;
+        client_recvbatch(s);
+    }
     status = xwrite(clientfd, data, n);
     if (status < 0)
         syswarn("OVDB: rc: cant write");
@@ -388,6 +440,22 @@ client_connect(void)
     return 0;
 }
 
+/* Ask the server for the next batch of articles of a search. */
+static bool
+client_askbatch(struct rs_search *s)
+{
+    struct rs_cmd rs;
+
+    memset(&rs, 0, sizeof(rs));
+    rs.what = CMD_SRCHBATCH;
+    rs.artlo = OVDB_SRCHBATCH_ARTS;
+    rs.handle = s->handle;
+    if (csend(&rs, sizeof(rs)) < 0)
+        return false;
+    pending = s;
+    return true;
+}
+
 static void
 client_disconnect(void)
 {
@@ -2225,6 +2293,7 @@ ovdb_opensearch(const char *group, int low, int high)
     if (clientmode) {
         struct rs_cmd rs;
         struct rs_opensrch repl;
+        struct rs_search *rsearch;
 
         rs.what = CMD_OPENSRCH;
         rs.grouplen = strlen(group) + 1;
@@ -2240,7 +2309,9 @@ ovdb_opensearch(const char *group, int low, int high)
         if (repl.status != CMD_OPENSRCH)
             return NULL;
 
-        return repl.handle;
+        rsearch = xcalloc(1, sizeof(struct rs_search));
+        rsearch->handle = repl.handle;
+        return rsearch;
     }
 
     ret = ovdb_getgroupinfo(group, &gi, true, NULL, 0);
@@ -2303,31 +2374,41 @@ ovdb_search(void *handle, ARTNUM *artnum, char **data, int *len, TOKEN *token,
     char *dp;
 
     if (clientmode) {
-        struct rs_cmd rs;
+        struct rs_search *rsearch = handle;
         struct rs_srch repl;
-        static char *databuf;
-        static int buflen = 0;
-
-        rs.what = CMD_SRCH;
-        rs.handle = handle;
+        char *swap;
+        size_t swapsize;
 
-        if (csend(&rs, sizeof(rs)) < 0)
-            return false;
-        if (crecv(&repl, sizeof(repl)) < 0)
+        if (rsearch->pos >= rsearch->end) {
+            if (!rsearch->ready) {
+                if (rsearch->done)
+                    return false;
+                if (pending != rsearch && !client_askbatch(rsearch))
+                    return false;
+                pending = NULL;
+                client_recvbatch(rsearch);
+            }
+            swap = rsearch->cur;
+            swapsize = rsearch->cursize;
+            rsearch->cur = rsearch->spare;
+            rsearch->cursize = rsearch->sparesize;
+            rsearch->spare = swap;
+            rsearch->sparesize = swapsize;
+            rsearch->pos = 0;
+            rsearch->end = rsearch->sparelen;
+            rsearch->ready = false;
+            if (!rsearch->done)
+                client_askbatch(rsearch);
+        }
+        if (rsearch->end - rsearch->pos < sizeof(repl))
             return false;
-
-        if (repl.status != CMD_SRCH)
+        memcpy(&repl, rsearch->cur + rsearch->pos, sizeof(repl));
+        rsearch->pos += sizeof(repl);
+        if (repl.len < 0 || rsearch->end - rsearch->pos < (size_t) repl.len) {
+            rsearch->pos = rsearch->end;
+            rsearch->done = true;
             return false;
-        if (repl.len > buflen) {
-            if (buflen == 0) {
-                buflen = repl.len + 512;
-                databuf = xmalloc(buflen);
-            } else {
-                buflen = repl.len + 512;
-                databuf = xrealloc(databuf, buflen);
-            }
         }
-        crecv(databuf, repl.len);
 
         if (artnum)
             *artnum = repl.artnum;
@@ -2338,7 +2419,8 @@ ovdb_search(void *handle, ARTNUM *artnum, char **data, int *len, TOKEN *token,
         if (len)
             *len = repl.len;
         if (data)
-            *data = databuf;
+            *data = rsearch->cur + rsearch->pos;
+        rsearch->pos += repl.len;
         return true;
     }
 
@@ -2474,12 +2556,17 @@ ovdb_closesearch(void *handle)
 {
     int i;
     if (clientmode) {
+        struct rs_search *rsearch = handle;
         struct rs_cmd rs;
 
+        /* csend reads the batch still on its way, if any */
         rs.what = CMD_CLOSESRCH;
-        rs.handle = handle;
+        rs.handle = rsearch->handle;
         csend(&rs, sizeof(rs));
         /* no reply is sent for a CMD_CLOSESRCH */
+        free(rsearch->cur);
+        free(rsearch->spare);
+        free(rsearch);
     } else {
         struct ovdbsearch *s = (struct ovdbsearch *) handle;
 
@@ -2,6 +2,7 @@
 
 #ifdef HAVE_SQLITE3
 
+#    include "inn/messages.h"
 #    include "inn/xmalloc.h"
 #    include <string.h>
 
@@ -53,4 +54,271 @@ pack_later(buffer_t *dst, size_t count)
     return result;
 }
 
+#    ifdef HAVE_ZLIB
+
+/* clang-format off */
+static uint32_t const pack_length_bias[5] =
+{
+             0,
+          0x80,
+        0x4080,
+      0x204080,
+    0x10204080,
+};
+/* clang-format on */
+
+void
+pack_length(z_stream *stream, uint32_t length)
+{
+    unsigned int lenlen, n;
+    uint8_t *walk;
+
+    lenlen = 1;
+    while (lenlen < 5 && length >= pack_length_bias[lenlen])
+        lenlen++;
+    length -= pack_length_bias[lenlen - 1];
+    if (stream->avail_out < lenlen) {
+        die("BUG!  pack_length called with insufficient buffer space (%u<%u)",
+            stream->avail_out, lenlen);
+    }
+    walk = stream->next_out + lenlen;
+    stream->next_out = walk;
+    stream->avail_out -= lenlen;
+    for (n = lenlen; n > 1; n--) {
+        *--walk = length;
+        length >>= 8;
+    }
+    *--walk = length | (~0U << (9 - lenlen));
+}
+
+uint32_t
+unpack_length(z_stream *stream)
+{
+    uint8_t *walk;
+    unsigned int c, lenlen, n;
+    uint32_t length;
+
+    if (stream->avail_in <= 0)
+        die("BUG!  unpack_length called with empty buffer");
+    walk = stream->next_in;
+    c = *walk++;
+    lenlen = 1;
+    while (c & (1U << (8 - lenlen)))
+        lenlen++;
+    if (lenlen > 5 || lenlen > stream->avail_in)
+        return ~0U;
+    length = c & ~(~0U << (8 - lenlen));
+    for (n = lenlen - 1; n > 0; n--)
+        length = (length << 8) | *walk++;
+    length += pack_length_bias[lenlen - 1];
+    stream->next_in = walk;
+    stream->avail_in -= lenlen;
+    return length;
+}
+
+static void
+add_dict(ovsqlite_dicts *dicts, unsigned long version, char const *hierarchy,
+         void const *data, size_t len)
+{
+    ovsqlite_dict *dict;
+
+    dicts->dict =
+        xreallocarray(dicts->dict, dicts->count + 1, sizeof(ovsqlite_dict));
+    dict = dicts->dict + dicts->count++;
+    dict->version = version;
+    dict->hierarchy = hierarchy ? xstrdup(hierarchy) : NULL;
+    dict->hierarchy_len = hierarchy ? strlen(hierarchy) : 0;
+    dict->len = len;
+    dict->size = OVSQLITE_DICT_SIZE;
+    dict->data = xmalloc(dict->size);
+    memcpy(dict->data, data, len);
+}
+
+bool
+ovsqlite_dicts_load(ovsqlite_dicts *dicts, sqlite3_stmt *getmisc,
+                    sqlite3_stmt *list_dicts)
+{
+    void const *data;
+    size_t size;
+    int status;
+
+    dicts->version = 0;
+    dicts->count = 0;
+    dicts->dict = NULL;
+
+    sqlite3_bind_text(getmisc, 1, "basedict", -1, SQLITE_STATIC);
+    status = sqlite3_step(getmisc);
+    data = NULL;
+    size = 0;
+    if (status == SQLITE_ROW) {
+        data = sqlite3_column_blob(getmisc, 0);
+        size = sqlite3_column_bytes(getmisc, 0);
+    }
+    if (data == NULL || size >= OVSQLITE_DICT_SIZE) {
+        warn("invalid compression dictionary in database");
+        sqlite3_reset(getmisc);
+        sqlite3_clear_bindings(getmisc);
+        return false;
+    }
+    add_dict(dicts, 0, NULL, data, size);
+    sqlite3_reset(getmisc);
+    sqlite3_clear_bindings(getmisc);
+
+    sqlite3_bind_text(getmisc, 1, "dictversion", -1, SQLITE_STATIC);
+    if (sqlite3_step(getmisc) == SQLITE_ROW)
+        dicts->version = sqlite3_column_int64(getmisc, 0);
+    sqlite3_reset(getmisc);
+    sqlite3_clear_bindings(getmisc);
+
+    /* Keys are "dict:<version>:<hierarchy>", with an empty hierarchy for
+       global dictionaries. */
+    while ((status = sqlite3_step(list_dicts)) == SQLITE_ROW) {
+        char const *key;
+        char *end;
+        unsigned long version;
+
+        key = (char const *) sqlite3_column_text(list_dicts, 0);
+        data = sqlite3_column_blob(list_dicts, 1);
+        size = sqlite3_column_bytes(list_dicts, 1);
+        if (key == NULL || strncmp(key, "dict:", 5) != 0)
+            continue;
+        version = strtoul(key + 5, &end, 10);
+        if (*end != ':' || version == 0 || data == NULL
+            || size > OVSQLITE_DICT_SIZE - 0x400) {
+            warn("invalid compression dictionary %s in database", key);
+            continue;
+        }
+        add_dict(dicts, version, end[1] == '\0' ? NULL : end + 1, data,
+                 size);
+    }
+    sqlite3_reset(list_dicts);
+    if (status != SQLITE_DONE) {
+        warn("cannot load compression dictionaries: %s",
+             sqlite3_errstr(status));
+        ovsqlite_dicts_free(dicts);
+        return false;
+    }
+    return true;
+}
+
+void
+ovsqlite_dicts_free(ovsqlite_dicts *dicts)
+{
+    size_t ix;
+
+    for (ix = 0; ix < dicts->count; ix++) {
+        free(dicts->dict[ix].hierarchy);
+        free(dicts->dict[ix].data);
+    }
+    free(dicts->dict);
+    dicts->dict = NULL;
+    dicts->count = 0;
+    dicts->version = 0;
+}
+
+ovsqlite_dict *
+ovsqlite_dicts_pick(ovsqlite_dicts *dicts, char const *groupname,
+                    size_t groupname_len)
+{
+    ovsqlite_dict *dict, *global;
+    char const *dot;
+    size_t ix, len;
+
+    if (dicts->version == 0)
+        return dicts->dict;
+    dot = memchr(groupname, '.', groupname_len);
+    len = dot ? (size_t) (dot - groupname) : groupname_len;
+    global = dicts->dict;
+    for (ix = 1; ix < dicts->count; ix++) {
+        dict = dicts->dict + ix;
+        if (dict->version != dicts->version)
+            continue;
+        if (dict->hierarchy == NULL)
+            global = dict;
+        else if (dict->hierarchy_len == len
+                 && memcmp(dict->hierarchy, groupname, len) == 0)
+            return dict;
+    }
+    return global;
+}
+
+size_t
+ovsqlite_dict_make(ovsqlite_dict *dict, char const *groupname,
+                   size_t groupname_len, uint64_t artnum)
+{
+    char *suffix;
+
+    suffix = (char *) dict->data + dict->len;
+    sqlite3_snprintf(dict->size - dict->len, suffix, "%.*s:%llu\r\n",
+                     (int) groupname_len, groupname,
+                     (unsigned long long) artnum);
+    return dict->len + strlen(suffix);
+}
+
+/*
+ * How to be excessively clever and make the corner cases
+ * work for you instead of against you, part 2.
+ * a) inflation.avail_out is set to the expected uncompressed size.
+ * b) When inflate returns Z_STREAM_END, we know that everything
+ *    went well _and_ that the uncompressed data isn't larger
+ *    than expected.
+ * c) We still need to check that the uncompressed data isn't
+ *    smaller than expected.
+ */
+bool
+ovsqlite_inflate(z_stream *inflation, buffer_t *flate, ovsqlite_dicts *dicts,
+                 char const *groupname, size_t groupname_len, uint64_t artnum,
+                 uint8_t const **overview, uint32_t *overview_len)
+{
+    ovsqlite_dict *first, *dict;
+    uint32_t raw_len;
+    size_t ix;
+    int status;
+
+    if (*overview_len == 0 || dicts->count == 0)
+        return false;
+    inflation->next_in = (uint8_t *) *overview;
+    inflation->avail_in = *overview_len;
+    raw_len = unpack_length(inflation);
+    if (raw_len > 100000)
+        return false;
+    if (raw_len == 0) {
+        (*overview)++;
+        (*overview_len)--;
+        return true;
+    }
+    buffer_resize(flate, raw_len);
+    inflation->next_out = (uint8_t *) flate->data;
+    inflation->avail_out = raw_len;
+    status = inflate(inflation, Z_FINISH);
+    if (status == Z_NEED_DICT) {
+        /* Data compressed before the last training uses another one. */
+        first = ovsqlite_dicts_pick(dicts, groupname, groupname_len);
+        status = inflateSetDictionary(
+            inflation, first->data,
+            ovsqlite_dict_make(first, groupname, groupname_len, artnum));
+        for (ix = 0; status == Z_DATA_ERROR && ix < dicts->count; ix++) {
+            dict = dicts->dict + ix;
+            if (dict == first)
+                continue;
+            status = inflateSetDictionary(
+                inflation, dict->data,
+                ovsqlite_dict_make(dict, groupname, groupname_len, artnum));
+        }
+        if (status == Z_OK)
+            status = inflate(inflation, Z_FINISH);
+    }
+    flate->left = (char *) inflation->next_out - flate->data;
+    inflation->next_in = NULL;
+    inflation->avail_in = 0;
+    inflateReset(inflation);
+    if (status != Z_STREAM_END || inflation->avail_out > 0)
+        return false;
+    *overview = (uint8_t *) flate->data;
+    *overview_len = flate->left;
+    return true;
+}
+
+#    endif /* HAVE_ZLIB */
+
 #endif /* HAVE_SQLITE3 */
@@ -7,11 +7,18 @@
 
 #    include "inn/buffer.h"
 
+#    ifdef HAVE_ZLIB
+#        include <sqlite3.h>
+#        include <zlib.h>
+#    endif
+
 #    define OVSQLITE_SCHEMA_VERSION   1
 #    define OVSQLITE_PROTOCOL_VERSION 1
 
 #    define OVSQLITE_SERVER_SOCKET    "ovsqlite.sock"
+#    define OVSQLITE_READER_SOCKET    "ovsqlite-ro.sock"
 #    define OVSQLITE_SERVER_PIDFILE   "ovsqlite.pid"
+#    define OVSQLITE_DB_FILE          "ovsqlite.db"
 
 #    ifndef HAVE_UNIX_DOMAIN_SOCKETS
 
@@ -103,6 +110,85 @@ extern size_t pack_now(buffer_t *dst, void const *bytes, size_t count);
 
 extern size_t pack_later(buffer_t *dst, size_t count);
 
+#    ifdef HAVE_ZLIB
+
+/*
+ * Store or fetch the uncompressed length in front of compressed overview
+ * data.  Both the server and clients reading the database directly need
+ * these.
+ */
+
+extern void pack_length(z_stream *stream, uint32_t length);
+
+extern uint32_t unpack_length(z_stream *stream);
+
+/*
+ * Preset dictionaries for overview compression.  The base dictionary made
+ * when the database is created has version 0 and is used for all groups.
+ * Dictionaries trained by ovsqlite-server -T have increasing versions and
+ * are either global (hierarchy is NULL) or for the groups of a single
+ * hierarchy.  Older versions are kept until the database is recompressed,
+ * so that overview data compressed with them can still be read.
+ *
+ * The group name and article number of each article are appended to its
+ * dictionary, in the space between len and size.
+ */
+
+#        define OVSQLITE_DICT_SIZE 0x8000
+
+typedef struct ovsqlite_dict {
+    unsigned long version;
+    char *hierarchy;
+    size_t hierarchy_len;
+    size_t len;
+    size_t size;
+    uint8_t *data;
+} ovsqlite_dict;
+
+typedef struct ovsqlite_dicts {
+    unsigned long version;
+    size_t count;
+    ovsqlite_dict *dict;
+} ovsqlite_dicts;
+
+/*
+ * Load all the dictionaries from the misc table, using the getmisc and
+ * list_dicts statements of sql-main.sql.  Warns and returns false on error.
+ */
+extern bool ovsqlite_dicts_load(ovsqlite_dicts *dicts, sqlite3_stmt *getmisc,
+                                sqlite3_stmt *list_dicts);
+
+extern void ovsqlite_dicts_free(ovsqlite_dicts *dicts);
+
+/*
+ * Return the dictionary new overview data for a group is compressed with.
+ */
+extern ovsqlite_dict *ovsqlite_dicts_pick(ovsqlite_dicts *dicts,
+                                          char const *groupname,
+                                          size_t groupname_len);
+
+/*
+ * Append the group name and article number to a dictionary and return the
+ * length of the result.
+ */
+extern size_t ovsqlite_dict_make(ovsqlite_dict *dict, char const *groupname,
+                                 size_t groupname_len, uint64_t artnum);
+
+/*
+ * Decompress overview data as stored in the database.  On success, the
+ * overview and overview_len arguments are updated to point to the data,
+ * either in flate or past the length prefix of data stored uncompressed.
+ * Returns false if the data is corrupted or compressed with an unknown
+ * dictionary.
+ */
+extern bool ovsqlite_inflate(z_stream *inflation, buffer_t *flate,
+                             ovsqlite_dicts *dicts, char const *groupname,
+                             size_t groupname_len, uint64_t artnum,
+                             uint8_t const **overview,
+                             uint32_t *overview_len);
+
+#    endif /* HAVE_ZLIB */
+
 END_DECLS
 
 #endif /* HAVE_SQLITE3 */
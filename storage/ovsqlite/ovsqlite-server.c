@@ -23,6 +23,7 @@
 #        include <sys/time.h>
 #    endif
 #    include <sys/stat.h>
+#    include <sys/wait.h>
 
 #    include "portable/setproctitle.h"
 #    include "portable/socket.h"
@@ -33,6 +34,7 @@
 #    include "inn/concat.h"
 #    include "inn/confparse.h"
 #    include "inn/fdflag.h"
+#    include "inn/hashtab.h"
 #    include "inn/innconf.h"
 #    include "inn/libinn.h"
 #    include "inn/storage.h"
@@ -41,12 +43,8 @@
 #    include "sql-init.h"
 #    include "sql-main.h"
 
-#    define OVSQLITE_DB_FILE "ovsqlite.db"
-
 #    ifdef HAVE_ZLIB
 
-#        define USE_DICTIONARY 1
-
 #        include <zlib.h>
 
 static z_stream deflation;
@@ -54,29 +52,13 @@ static z_stream inflation;
 
 static buffer_t *flate;
 
-/* clang-format off */
-static uint32_t const pack_length_bias[5] =
-{
-             0,
-          0x80,
-        0x4080,
-      0x204080,
-    0x10204080,
-};
-/* clang-format on */
-
-#        ifdef USE_DICTIONARY
-
 static char const basedict_format[] =
     "\tRe: =?UTF-8?Q? =?UTF-8?B? the The and for "
     "\tMon, \tTue, \tWed, \tThu, \tFri, \tSat, \tSun, "
     "Jan Feb Mar Apr May Jun Jul Aug Sep Oct Nov Dec "
     "GMT\t (UTC)\tXref: %s ";
 
-static char dictionary[0x8000];
-static unsigned int basedict_len;
-
-#        endif /* USE_DICTIONARY */
+static ovsqlite_dicts dicts;
 
 #    endif /* HAVE_ZLIB */
 
@@ -116,9 +98,18 @@ static sql_main_t sql_main;
 static bool use_compression;
 static unsigned long pagesize;
 static unsigned long cachesize;
+static unsigned long mmapsize;
+static bool directread;
+static unsigned long dictsize = 4096;
 static struct timeval transaction_time_limit = {10, 0};
 static unsigned long transaction_row_limit = 10000;
 
+/* Reader processes, serving read-only clients from WAL snapshots. */
+static unsigned long readers;
+static bool reader;
+static pid_t *reader_pids;
+static char *reader_socket;
+
 static bool in_transaction;
 static unsigned int transaction_rowcount;
 static struct timeval next_commit;
@@ -254,23 +245,28 @@ del_client(client_t *client)
 
 #    ifdef HAVE_UNIX_DOMAIN_SOCKETS
 
-static void
-make_unix_listener(void)
+static int
+make_unix_listener(char const *name)
 {
     char *path;
     struct sockaddr_un sa;
+    int sock;
 
-    listensock = socket(AF_UNIX, SOCK_STREAM, 0);
-    if (listensock == -1)
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == -1)
         sysdie("cannot create socket");
     memset(&sa, 0, sizeof sa);
     sa.sun_family = AF_UNIX;
-    path = concatpath(innconf->pathrun, OVSQLITE_SERVER_SOCKET);
+    path = concatpath(innconf->pathrun, name);
     strlcpy(sa.sun_path, path, sizeof(sa.sun_path));
     unlink(sa.sun_path);
     free(path);
-    if (bind(listensock, (struct sockaddr *) &sa, SUN_LEN(&sa)) != 0)
+    if (bind(sock, (struct sockaddr *) &sa, SUN_LEN(&sa)) != 0)
         sysdie("cannot bind socket");
+    if (listen(sock, innconf->maxlisten) == -1)
+        sysdie("cannot listen on socket");
+    fdflag_nonblocking(sock, 1);
+    return sock;
 }
 
 #    else /* ! HAVE_UNIX_DOMAIN_SOCKETS */
@@ -341,13 +337,13 @@ static void
 make_listener(void)
 {
 #    ifdef HAVE_UNIX_DOMAIN_SOCKETS
-    make_unix_listener();
+    listensock = make_unix_listener(OVSQLITE_SERVER_SOCKET);
 #    else
     make_inet_listener();
-#    endif
     if (listen(listensock, innconf->maxlisten) == -1)
         sysdie("cannot listen on socket");
     fdflag_nonblocking(listensock, 1);
+#    endif
     FD_SET(listensock, &read_fds);
     maxsock = listensock;
 }
@@ -383,6 +379,8 @@ load_config(void)
         config_param_boolean(top, "compress", &use_compression);
         config_param_unsigned_number(top, "pagesize", &pagesize);
         config_param_unsigned_number(top, "cachesize", &cachesize);
+        config_param_unsigned_number(top, "mmapsize", &mmapsize);
+        config_param_boolean(top, "directread", &directread);
         if (config_param_real(top, "transtimelimit", &timelimit)) {
             transaction_time_limit.tv_sec = (long) timelimit;
             transaction_time_limit.tv_usec =
@@ -393,6 +391,20 @@ load_config(void)
         }
         config_param_unsigned_number(top, "transrowlimit",
                                      &transaction_row_limit);
+        config_param_unsigned_number(top, "readers", &readers);
+        config_param_unsigned_number(top, "dictsize", &dictsize);
+        if (dictsize < 256 || dictsize > OVSQLITE_DICT_SIZE - 0x400) {
+            warn("dictsize must be between 256 and %d, using 4096",
+                 OVSQLITE_DICT_SIZE - 0x400);
+            dictsize = 4096;
+        }
+#    ifndef HAVE_UNIX_DOMAIN_SOCKETS
+        if (readers > 0) {
+            warn("reader processes need Unix domain sockets, ignoring"
+                 " readers");
+            readers = 0;
+        }
+#    endif
 
         config_free(top);
     }
@@ -433,12 +445,12 @@ setup_compression(bool init)
         }
     }
 
-#        ifdef USE_DICTIONARY
     if (init) {
-        basedict_len = snprintf(dictionary, sizeof dictionary, basedict_format,
-                                innconf->pathhost);
+        char *basedict;
+
+        xasprintf(&basedict, basedict_format, innconf->pathhost);
         sqlite3_bind_text(sql_main.setmisc, 1, "basedict", -1, SQLITE_STATIC);
-        sqlite3_bind_blob(sql_main.setmisc, 2, dictionary, basedict_len,
+        sqlite3_bind_blob(sql_main.setmisc, 2, basedict, strlen(basedict),
                           SQLITE_STATIC);
         status = sqlite3_step(sql_main.setmisc);
         if (status != SQLITE_DONE) {
@@ -446,91 +458,53 @@ setup_compression(bool init)
                 sqlite3_errmsg(connection));
         }
         resetclear(sql_main.setmisc);
-    } else {
-        void const *dict;
-        size_t size;
-
-        sqlite3_bind_text(sql_main.getmisc, 1, "basedict", -1, SQLITE_STATIC);
-        status = sqlite3_step(sql_main.getmisc);
-        if (status != SQLITE_ROW) {
-            die("cannot load compression dictionary: %s",
-                sqlite3_errmsg(connection));
-        }
-        dict = sqlite3_column_blob(sql_main.getmisc, 0);
-        size = sqlite3_column_bytes(sql_main.getmisc, 0);
-        if (!dict || size >= sizeof dictionary)
-            die("invalid compression dictionary in database");
-        memcpy(dictionary, dict, size);
-        basedict_len = size;
-        resetclear(sql_main.getmisc);
+        free(basedict);
     }
-#        endif
+    if (!ovsqlite_dicts_load(&dicts, sql_main.getmisc, sql_main.list_dicts))
+        die("cannot load compression dictionaries");
 
     flate = buffer_new();
 }
 
-static void
-pack_length(z_stream *stream, uint32_t length)
-{
-    unsigned int lenlen, n;
-    uint8_t *walk;
-
-    lenlen = 1;
-    while (lenlen < 5 && length >= pack_length_bias[lenlen])
-        lenlen++;
-    length -= pack_length_bias[lenlen - 1];
-    if (stream->avail_out < lenlen) {
-        die("BUG!  pack_length called with insufficient buffer space (%u<%u)",
-            stream->avail_out, lenlen);
-    }
-    walk = stream->next_out + lenlen;
-    stream->next_out = walk;
-    stream->avail_out -= lenlen;
-    for (n = lenlen; n > 1; n--) {
-        *--walk = length;
-        length >>= 8;
-    }
-    *--walk = length | (~0U << (9 - lenlen));
-}
-
-static uint32_t
-unpack_length(z_stream *stream)
-{
-    uint8_t *walk;
-    unsigned int c, lenlen, n;
-    uint32_t length;
-
-    if (stream->avail_in <= 0)
-        die("BUG!  unpack_length called with empty buffer");
-    walk = stream->next_in;
-    c = *walk++;
-    lenlen = 1;
-    while (c & (1U << (8 - lenlen)))
-        lenlen++;
-    if (lenlen > 5 || lenlen > stream->avail_in)
-        return ~0U;
-    length = c & ~(~0U << (8 - lenlen));
-    for (n = lenlen - 1; n > 0; n--)
-        length = (length << 8) | *walk++;
-    length += pack_length_bias[lenlen - 1];
-    stream->next_in = walk;
-    stream->avail_in -= lenlen;
-    return length;
-}
-
-#        ifdef USE_DICTIONARY
-
-static unsigned int
-make_dict(char const *groupname, int groupname_len, uint64_t artnum)
+/*
+ * How to be excessively clever and make the corner cases
+ * work for you instead of against you, part 1.
+ * a) deflation.avail_out is set to the uncompressed size.
+ * b) The uncompressed size is stored first,
+ *    consuming some of the deflation buffer.
+ * c) When deflate returns Z_STREAM_END, we know that everything
+ *    went well _and_ that compression saved at least one byte,
+ *    overhead included.
+ *
+ * Returns true if the compressed overview data was stored in out.
+ */
+static bool
+deflate_overview(buffer_t *out, char const *groupname, int groupname_len,
+                 uint64_t artnum, uint8_t const *overview,
+                 uint32_t overview_len)
 {
-    sqlite3_snprintf(sizeof dictionary - basedict_len,
-                     dictionary + basedict_len, "%.*s:%llu\r\n", groupname_len,
-                     groupname, artnum);
-    return basedict_len + strlen(dictionary + basedict_len);
-}
-
+    ovsqlite_dict *dict;
+    int status;
 
-#        endif
+    buffer_resize(out, overview_len);
+    deflation.next_out = (uint8_t *) out->data;
+    deflation.avail_out = overview_len;
+    pack_length(&deflation, overview_len);
+    deflation.next_in = (uint8_t *) overview;
+    deflation.avail_in = overview_len;
+    dict = ovsqlite_dicts_pick(&dicts, groupname, groupname_len);
+    status = deflateSetDictionary(
+        &deflation, dict->data,
+        ovsqlite_dict_make(dict, groupname, groupname_len, artnum));
+    if (status == Z_OK)
+        status = deflate(&deflation, Z_FINISH);
+    out->used = 0;
+    out->left = (char *) deflation.next_out - out->data;
+    deflation.next_in = NULL;
+    deflation.avail_in = 0;
+    deflateReset(&deflation);
+    return status == Z_STREAM_END;
+}
 
 #    endif /* HAVE_ZLIB */
 
@@ -545,7 +519,7 @@ open_db(void)
     char sqltext[64];
 
     path = concatpath(innconf->pathoverview, OVSQLITE_DB_FILE);
-    init = stat(path, &sb) == -1;
+    init = !reader && stat(path, &sb) == -1;
     if (init) {
         sql_init_t sql_init;
 
@@ -590,6 +564,21 @@ open_db(void)
                            connection, SQLITE_PREPARE_PERSISTENT, &errmsg);
     if (status != SQLITE_OK)
         die("cannot set up database session: %s", errmsg);
+    if (!reader) {
+        sqlite3_stmt *journal;
+
+        /* Readers need WAL to keep reading while a transaction is open.
+           Leaving WAL fails while a direct reader still has the database
+           open, as just after directread was turned off; the current mode
+           is then kept until the next start. */
+        journal = readers > 0 || directread ? sql_main.wal_journal
+                                            : sql_main.persist_journal;
+        status = sqlite3_step(journal);
+        if (status != SQLITE_ROW)
+            warn("cannot set journal mode, keeping the current one: %s",
+                 sqlite3_errmsg(connection));
+        sqlite3_reset(journal);
+    }
     if (init) {
         sqlite3_bind_text(sql_main.setmisc, 1, "version", -1, SQLITE_STATIC);
         sqlite3_bind_int64(sql_main.setmisc, 2, OVSQLITE_SCHEMA_VERSION);
@@ -650,13 +639,24 @@ open_db(void)
             sqlite3_free(errmsg);
         }
     }
+    if (mmapsize) {
+        snprintf(sqltext, sizeof sqltext, "pragma mmap_size = %llu;",
+                 (unsigned long long) mmapsize * 1024);
+        status = sqlite3_exec(connection, sqltext, 0, NULL, &errmsg);
+        if (status != SQLITE_OK) {
+            warn("cannot set mmap size: %s", errmsg);
+            sqlite3_free(errmsg);
+        }
+    }
 }
 
 static void
 close_db(void)
 {
-    sqlite3_step(sql_main.delete_journal);
-    sqlite3_reset(sql_main.delete_journal);
+    if (!reader) {
+        sqlite3_step(sql_main.delete_journal);
+        sqlite3_reset(sql_main.delete_journal);
+    }
     sqlite_helper_term(&sql_main_helper, (sqlite3_stmt **) &sql_main);
     sqlite3_close_v2(connection);
     connection = NULL;
@@ -666,6 +666,7 @@ close_db(void)
         deflateEnd(&deflation);
         buffer_free(flate);
         flate = NULL;
+        ovsqlite_dicts_free(&dicts);
     }
 #    endif
 }
@@ -1255,32 +1256,9 @@ do_add_article(client_t *client)
     stmt = NULL;
 
 #    ifdef HAVE_ZLIB
-    /*
-     * How to be excessively clever and make the corner cases
-     * work for you instead of against you, part 1.
-     * a) deflation.avail_out is set to the uncompressed size.
-     * b) The uncompressed size is stored first,
-     *    consuming some of the deflation buffer.
-     * c) When deflate returns Z_STREAM_END, we know that everything
-     *    went well _and_ that compression saved at least one byte,
-     *    overhead included.
-     */
     if (use_compression && overview_len > 5) {
-        buffer_resize(flate, overview_len);
-        deflation.next_out = (uint8_t *) flate->data;
-        deflation.avail_out = overview_len;
-        pack_length(&deflation, overview_len);
-        deflation.next_in = overview;
-        deflation.avail_in = overview_len;
-#        ifdef USE_DICTIONARY
-        status =
-            deflateSetDictionary(&deflation, (uint8_t *) dictionary,
-                                 make_dict(groupname, groupname_len, artnum));
-        if (status == Z_OK)
-#        endif
-            status = deflate(&deflation, Z_FINISH);
-        flate->left = (char *) deflation.next_out - flate->data;
-        if (status == Z_STREAM_END) {
+        if (deflate_overview(flate, groupname, groupname_len, artnum, overview,
+                             overview_len)) {
             overview = (uint8_t *) flate->data;
             overview_len = flate->left;
         } else {
@@ -1289,9 +1267,6 @@ do_add_article(client_t *client)
             *--overview = 0;
             overview_len++;
         }
-        deflation.next_in = NULL;
-        deflation.avail_in = 0;
-        deflateReset(&deflation);
     }
 #    endif
 
@@ -1588,52 +1563,11 @@ do_search_group(client_t *client)
                 goto corrupted;
             overview_len = size;
 #    ifdef HAVE_ZLIB
-            /*
-             * How to be excessively clever and make the corner cases
-             * work for you instead of against you, part 2.
-             * a) deflation.avail_out is set to the expected uncompressed size.
-             * b) When inflate returns Z_STREAM_END, we know that everything
-             *    went well _and_ that the uncompressed data isn't larger
-             *    than expected.
-             * c) We still need to check that the uncompressed data isn't
-             *    smaller than expected.
-             */
-            if (use_compression) {
-                uint32_t raw_len;
-
-                inflation.next_in = (uint8_t *) overview;
-                inflation.avail_in = overview_len;
-
-                raw_len = unpack_length(&inflation);
-                if (raw_len > 100000)
-                    goto corrupted;
-                if (raw_len > 0) {
-                    buffer_resize(flate, raw_len);
-                    inflation.next_out = (uint8_t *) flate->data;
-                    inflation.avail_out = raw_len;
-                    status = inflate(&inflation, Z_FINISH);
-#        ifdef USE_DICTIONARY
-                    if (status == Z_NEED_DICT) {
-                        status = inflateSetDictionary(
-                            &inflation, (uint8_t *) dictionary,
-                            make_dict(groupname, groupname_len, artnum));
-                        if (status == Z_OK)
-                            status = inflate(&inflation, Z_FINISH);
-                    }
-#        endif
-                    flate->left = (char *) inflation.next_out - flate->data;
-                    inflation.next_in = NULL;
-                    inflation.avail_in = 0;
-                    inflateReset(&inflation);
-                    if (status != Z_STREAM_END || inflation.avail_out > 0)
-                        goto corrupted;
-                    overview = (uint8_t *) flate->data;
-                    overview_len = flate->left;
-                } else {
-                    overview++;
-                    overview_len--;
-                }
-            }
+            if (use_compression
+                && !ovsqlite_inflate(&inflation, flate, &dicts, groupname,
+                                     groupname_len, artnum, &overview,
+                                     &overview_len))
+                goto corrupted;
 #    endif
             if (pack_now(respbuf, &overview_len, sizeof overview_len) > space)
                 goto flush;
@@ -1939,6 +1873,25 @@ static void (*dispatch[count_request_codes])(client_t *) =
 #        define case_NONBLOCK
 #    endif
 
+/*
+ * Whether a request can be served by a reader process.
+ */
+static bool
+read_request(unsigned int code)
+{
+    switch (code) {
+    case request_hello:
+    case request_set_cutofflow:
+    case request_get_groupinfo:
+    case request_list_groups:
+    case request_get_artinfo:
+    case request_search_group:
+        return true;
+    default:
+        return false;
+    }
+}
+
 static void
 handle_write(client_t *client)
 {
@@ -2041,6 +1994,10 @@ handle_read(client_t *client)
         simple_response(client, response_wrong_state);
         return;
     }
+    if (reader && !read_request(code)) {
+        simple_response(client, response_wrong_state);
+        return;
+    }
     (*dispatch[code])(client);
     return;
 }
@@ -2063,6 +2020,97 @@ handle_accept(void)
     add_client(sock);
 }
 
+#    ifdef HAVE_UNIX_DOMAIN_SOCKETS
+
+/*
+ * Fork the reader processes.  They share a second listening socket, on
+ * which read-only clients connect, and each has its own database
+ * connection reading from WAL snapshots, so that long searches neither wait
+ * for nor delay the writes done by the main process.  A SQLite connection
+ * must not be carried across fork, so the database is closed meanwhile.
+ * Returns in both the main process and the readers.
+ */
+static void
+start_readers(void)
+{
+    int sock;
+    unsigned long ix;
+    pid_t pid;
+
+    sock = make_unix_listener(OVSQLITE_READER_SOCKET);
+    reader_socket = concatpath(innconf->pathrun, OVSQLITE_READER_SOCKET);
+    close_db();
+    reader_pids = xcalloc(readers, sizeof(pid_t));
+    for (ix = 0; ix < readers; ix++) {
+        pid = fork();
+        if (pid == -1) {
+            syswarn("cannot fork reader process");
+            break;
+        }
+        if (pid == 0) {
+            reader = true;
+            free(reader_pids);
+            reader_pids = NULL;
+            free(reader_socket);
+            reader_socket = NULL;
+            free(pidfile);
+            pidfile = NULL;
+            FD_CLR(listensock, &read_fds);
+            close(listensock);
+            listensock = sock;
+            FD_SET(listensock, &read_fds);
+            maxsock = listensock;
+            setproctitle("reader %lu", ix + 1);
+            open_db();
+            return;
+        }
+        reader_pids[ix] = pid;
+    }
+    close(sock);
+    open_db();
+}
+
+/*
+ * Notice reader processes that went away.  They are not restarted, since
+ * the main process has an open database connection; read-only clients go
+ * to the remaining readers, or to the main process once none is left.
+ */
+static void
+reap_readers(void)
+{
+    unsigned long ix;
+    pid_t pid;
+    int status;
+
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        for (ix = 0; ix < readers; ix++)
+            if (reader_pids[ix] == pid)
+                reader_pids[ix] = 0;
+        warn("reader process %ld exited with status %d", (long) pid,
+             WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+    }
+}
+
+static void
+stop_readers(void)
+{
+    unsigned long ix;
+
+    unlink(reader_socket);
+    for (ix = 0; ix < readers; ix++)
+        if (reader_pids[ix] > 0)
+            kill(reader_pids[ix], SIGTERM);
+    for (ix = 0; ix < readers; ix++)
+        if (reader_pids[ix] > 0)
+            waitpid(reader_pids[ix], NULL, 0);
+    free(reader_pids);
+    reader_pids = NULL;
+    free(reader_socket);
+    reader_socket = NULL;
+}
+
+#    endif /* HAVE_UNIX_DOMAIN_SOCKETS */
+
 static void
 mainloop(void)
 {
@@ -2089,6 +2137,10 @@ mainloop(void)
         read_fds_out = read_fds;
         write_fds_out = write_fds;
         n = select(maxsock + 1, &read_fds_out, &write_fds_out, NULL, nap);
+#    ifdef HAVE_UNIX_DOMAIN_SOCKETS
+        if (reader_pids != NULL)
+            reap_readers();
+#    endif
         if (n <= 0)
             continue;
         if (FD_ISSET(listensock, &read_fds_out)) {
@@ -2109,10 +2161,576 @@ mainloop(void)
     commit_transaction();
 }
 
+/*
+ * Offline maintenance of the compression dictionaries, done with -T and -R
+ * while the server isn't running.
+ */
+
+static void
+check_not_running(void)
+{
+    char *path;
+    FILE *pf;
+    long pid;
+
+    path = concatpath(innconf->pathrun, OVSQLITE_SERVER_PIDFILE);
+    pf = fopen(path, "r");
+    free(path);
+    if (pf == NULL)
+        return;
+    if (fscanf(pf, "%ld", &pid) == 1 && pid > 0
+        && (kill((pid_t) pid, 0) == 0 || errno == EPERM))
+        die("ovsqlite-server is running (PID %ld), stop it first", pid);
+    fclose(pf);
+}
+
+#    ifdef HAVE_ZLIB
+
+/* At most that many articles are sampled for training. */
+#        define TRAIN_SAMPLES       100000
+/* A hierarchy needs that many samples to get its own dictionary. */
+#        define TRAIN_MIN_SAMPLES   2000
+#        define TRAIN_HIERARCHIES   32
+#        define TRAIN_FRAGMENT_MAX  128
+#        define TRAIN_CANDIDATES    100000
+#        define RECOMPRESS_BATCH    1000
+
+typedef struct group_t {
+    int64_t groupid;
+    char *name;
+    size_t name_len;
+    uint64_t count;
+    struct sampleset_t *set;
+} group_t;
+
+/*
+ * A fragment of overview text, with the number of samples it appears in.
+ */
+typedef struct fragment_t {
+    unsigned long count;
+    unsigned long sample;
+    size_t len;
+    char text[1];
+} fragment_t;
+
+/*
+ * The fragments found in the samples of a hierarchy, or of all groups when
+ * hierarchy is NULL.
+ */
+typedef struct sampleset_t {
+    char *hierarchy;
+    uint64_t articles;
+    unsigned long samples;
+    struct hash *fragments;
+} sampleset_t;
+
+typedef struct fragment_list_t {
+    fragment_t **fragment;
+    size_t count;
+} fragment_list_t;
+
+static group_t *
+load_groups(size_t *count, uint64_t *articles)
+{
+    sqlite3_stmt *stmt;
+    group_t *groups = NULL;
+    size_t n = 0;
+    int status;
+
+    *articles = 0;
+    stmt = sql_main.list_groups;
+    sqlite3_bind_int64(stmt, 1, 0);
+    while ((status = sqlite3_step(stmt)) == SQLITE_ROW) {
+        group_t *group;
+
+        groups = xreallocarray(groups, n + 1, sizeof(group_t));
+        group = groups + n++;
+        group->groupid = sqlite3_column_int64(stmt, 0);
+        group->name_len = sqlite3_column_bytes(stmt, 1);
+        group->name = xmalloc(group->name_len + 1);
+        memcpy(group->name, sqlite3_column_blob(stmt, 1), group->name_len);
+        group->name[group->name_len] = '\0';
+        group->count = sqlite3_column_int64(stmt, 4);
+        group->set = NULL;
+        *articles += group->count;
+    }
+    if (status != SQLITE_DONE)
+        die("cannot list groups: %s", sqlite3_errmsg(connection));
+    resetclear(stmt);
+    *count = n;
+    return groups;
+}
+
+static void
+free_groups(group_t *groups, size_t count)
+{
+    size_t ix;
+
+    for (ix = 0; ix < count; ix++)
+        free(groups[ix].name);
+    free(groups);
+}
+
+static const void *
+fragment_key(const void *datum)
+{
+    return ((const fragment_t *) datum)->text;
+}
+
+static bool
+fragment_equal(const void *key, const void *datum)
+{
+    return strcmp(key, ((const fragment_t *) datum)->text) == 0;
+}
+
+static const void *
+sampleset_key(const void *datum)
+{
+    return ((const sampleset_t *) datum)->hierarchy;
+}
+
+static bool
+sampleset_equal(const void *key, const void *datum)
+{
+    return strcmp(key, ((const sampleset_t *) datum)->hierarchy) == 0;
+}
+
+static void
+sampleset_free(void *datum)
+{
+    sampleset_t *set = datum;
+
+    if (set->fragments != NULL)
+        hash_free(set->fragments);
+    free(set->hierarchy);
+    free(set);
+}
+
+static void
+add_fragment(sampleset_t *set, char const *text, size_t len)
+{
+    char key[TRAIN_FRAGMENT_MAX + 1];
+    fragment_t *fragment;
+
+    if (len < 4 || len > TRAIN_FRAGMENT_MAX || memchr(text, '\0', len))
+        return;
+    memcpy(key, text, len);
+    key[len] = '\0';
+    fragment = hash_lookup(set->fragments, key);
+    if (fragment == NULL) {
+        fragment = xmalloc(offsetof(fragment_t, text) + len + 1);
+        fragment->count = 0;
+        fragment->sample = 0;
+        fragment->len = len;
+        memcpy(fragment->text, key, len + 1);
+        hash_insert(set->fragments, fragment->text, fragment);
+    }
+    if (fragment->sample != set->samples) {
+        fragment->count++;
+        fragment->sample = set->samples;
+    }
+}
+
+/*
+ * Count the fields of an overview line, with their leading tab, and the
+ * words of these fields, with their leading space or tab.  The article
+ * number is skipped.
+ */
+static void
+count_fragments(sampleset_t *set, char const *data, size_t len)
+{
+    char const *end, *field, *next, *field_end, *word, *word_end;
+
+    set->samples++;
+    end = data + len;
+    for (field = memchr(data, '\t', len); field != NULL; field = next) {
+        next = memchr(field + 1, '\t', end - field - 1);
+        field_end = next ? next : end;
+        while (field_end > field
+               && (field_end[-1] == '\r' || field_end[-1] == '\n'))
+            field_end--;
+        add_fragment(set, field, field_end - field);
+        for (word = field; word < field_end; word = word_end) {
+            word_end = memchr(word + 1, ' ', field_end - word - 1);
+            if (word_end == NULL)
+                word_end = field_end;
+            add_fragment(set, word, word_end - word);
+        }
+    }
+}
+
+static void
+collect_fragment(void *datum, void *cookie)
+{
+    fragment_list_t *list = cookie;
+    fragment_t *fragment = datum;
+
+    if (fragment->count >= 2)
+        list->fragment[list->count++] = fragment;
+}
+
+/*
+ * Fragments saving the most bytes come first.  The expected saving of a
+ * fragment is its length, less about three bytes for the match, in each
+ * sample it appears in.
+ */
+static int
+fragment_compare(const void *a, const void *b)
+{
+    const fragment_t *fa = *(const fragment_t *const *) a;
+    const fragment_t *fb = *(const fragment_t *const *) b;
+    unsigned long sa, sb;
+
+    sa = fa->count * (fa->len - 3);
+    sb = fb->count * (fb->len - 3);
+    if (sa != sb)
+        return sa < sb ? 1 : -1;
+    return strcmp(fa->text, fb->text);
+}
+
+/*
+ * Fill dict with the most useful fragments of a sample set and return its
+ * length.  Fragments already contained in the dictionary are skipped, and
+ * the most useful ones are put at the end, closest to the data being
+ * compressed.
+ */
+static size_t
+build_dict(sampleset_t *set, uint8_t *dict)
+{
+    fragment_list_t list;
+    fragment_t **picked;
+    char *chosen;
+    size_t ix, npicked, used, len;
+
+    list.fragment =
+        xmalloc((hash_count(set->fragments) + 1) * sizeof(fragment_t *));
+    list.count = 0;
+    hash_traverse(set->fragments, collect_fragment, &list);
+    qsort(list.fragment, list.count, sizeof(fragment_t *), fragment_compare);
+
+    picked = xmalloc((dictsize / 4 + 1) * sizeof(fragment_t *));
+    chosen = xmalloc(dictsize + 1);
+    chosen[0] = '\0';
+    npicked = 0;
+    used = 0;
+    for (ix = 0; ix < list.count && ix < TRAIN_CANDIDATES; ix++) {
+        fragment_t *fragment = list.fragment[ix];
+
+        if (used + fragment->len > dictsize)
+            continue;
+        if (strstr(chosen, fragment->text) != NULL)
+            continue;
+        memcpy(chosen + used, fragment->text, fragment->len + 1);
+        used += fragment->len;
+        picked[npicked++] = fragment;
+        if (used + 4 > dictsize)
+            break;
+    }
+    len = 0;
+    for (ix = npicked; ix-- > 0;) {
+        memcpy(dict + len, picked[ix]->text, picked[ix]->len);
+        len += picked[ix]->len;
+    }
+    free(chosen);
+    free(picked);
+    free(list.fragment);
+    return len;
+}
+
+static void
+store_dict(unsigned long version, char const *hierarchy, uint8_t const *dict,
+           size_t len)
+{
+    char *key;
+    int status;
+
+    xasprintf(&key, "dict:%lu:%s", version, hierarchy ? hierarchy : "");
+    sqlite3_bind_text(sql_main.setmisc, 1, key, -1, SQLITE_STATIC);
+    sqlite3_bind_blob(sql_main.setmisc, 2, dict, len, SQLITE_STATIC);
+    status = sqlite3_step(sql_main.setmisc);
+    if (status != SQLITE_DONE)
+        die("cannot store dictionary %s: %s", key, sqlite3_errmsg(connection));
+    resetclear(sql_main.setmisc);
+    free(key);
+}
+
+static int
+sampleset_compare(const void *a, const void *b)
+{
+    const sampleset_t *sa = *(const sampleset_t *const *) a;
+    const sampleset_t *sb = *(const sampleset_t *const *) b;
+
+    if (sa->articles != sb->articles)
+        return sa->articles < sb->articles ? 1 : -1;
+    return strcmp(sa->hierarchy, sb->hierarchy);
+}
+
+/*
+ * Train a new version of the dictionaries from a sample of the overview
+ * data: one for all groups, and one for each of the largest hierarchies.
+ */
+static void
+train_dicts(void)
+{
+    group_t *groups;
+    size_t ngroups, nsets, ix;
+    uint64_t articles, seen;
+    unsigned long stride, version;
+    sampleset_t global, **sets;
+    struct hash *hierarchies;
+    uint8_t *dict;
+    size_t len;
+    int status;
+
+    if (!use_compression)
+        die("the database does not use compression");
+    groups = load_groups(&ngroups, &articles);
+    if (articles == 0)
+        die("no overview data to train dictionaries from");
+    stride = articles / TRAIN_SAMPLES + 1;
+
+    /* Find the hierarchies large enough to get their own dictionary. */
+    hierarchies = hash_create(64, hash_string, sampleset_key,
+                              sampleset_equal, sampleset_free);
+    sets = NULL;
+    nsets = 0;
+    for (ix = 0; ix < ngroups; ix++) {
+        sampleset_t *set;
+        char *hierarchy;
+
+        hierarchy = xstrndup(groups[ix].name,
+                             strcspn(groups[ix].name, "."));
+        set = hash_lookup(hierarchies, hierarchy);
+        if (set == NULL) {
+            set = xcalloc(1, sizeof(sampleset_t));
+            set->hierarchy = hierarchy;
+            hash_insert(hierarchies, set->hierarchy, set);
+            sets = xreallocarray(sets, nsets + 1, sizeof(sampleset_t *));
+            sets[nsets++] = set;
+        } else {
+            free(hierarchy);
+        }
+        set->articles += groups[ix].count;
+        groups[ix].set = set;
+    }
+    qsort(sets, nsets, sizeof(sampleset_t *), sampleset_compare);
+    for (ix = 0; ix < nsets && ix < TRAIN_HIERARCHIES; ix++) {
+        if (sets[ix]->articles / stride < TRAIN_MIN_SAMPLES)
+            break;
+        sets[ix]->fragments = hash_create(0x10000, hash_string, fragment_key,
+                                          fragment_equal, free);
+    }
+    nsets = ix;
+
+    memset(&global, 0, sizeof global);
+    global.fragments = hash_create(0x10000, hash_string, fragment_key,
+                                   fragment_equal, free);
+    seen = 0;
+    for (ix = 0; ix < ngroups; ix++) {
+        group_t *group = groups + ix;
+        sqlite3_stmt *stmt = sql_main.list_articles_overview;
+
+        sqlite3_bind_blob(stmt, 1, group->name, group->name_len,
+                          SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 2, 0);
+        while ((status = sqlite3_step(stmt)) == SQLITE_ROW) {
+            uint8_t const *overview;
+            uint32_t overview_len;
+            uint64_t artnum;
+
+            if (seen++ % stride != 0)
+                continue;
+            artnum = sqlite3_column_int64(stmt, 0);
+            overview = sqlite3_column_blob(stmt, 4);
+            overview_len = sqlite3_column_bytes(stmt, 4);
+            if (!overview
+                || !ovsqlite_inflate(&inflation, flate, &dicts, group->name,
+                                     group->name_len, artnum, &overview,
+                                     &overview_len))
+                continue;
+            count_fragments(&global, (char const *) overview, overview_len);
+            if (group->set->fragments != NULL)
+                count_fragments(group->set, (char const *) overview,
+                                overview_len);
+        }
+        if (status != SQLITE_DONE)
+            die("cannot read overview data of %s: %s", group->name,
+                sqlite3_errmsg(connection));
+        resetclear(stmt);
+    }
+
+    version = dicts.version;
+    for (ix = 0; ix < dicts.count; ix++)
+        if (dicts.dict[ix].version > version)
+            version = dicts.dict[ix].version;
+    version++;
+
+    dict = xmalloc(dictsize);
+    begin_transaction();
+    len = build_dict(&global, dict);
+    store_dict(version, NULL, dict, len);
+    notice("dictionary %lu for all groups: %lu bytes from %lu samples",
+           version, (unsigned long) len, global.samples);
+    for (ix = 0; ix < nsets; ix++) {
+        len = build_dict(sets[ix], dict);
+        store_dict(version, sets[ix]->hierarchy, dict, len);
+        notice("dictionary %lu for %s.*: %lu bytes from %lu samples",
+               version, sets[ix]->hierarchy, (unsigned long) len,
+               sets[ix]->samples);
+    }
+    sqlite3_bind_text(sql_main.setmisc, 1, "dictversion", -1, SQLITE_STATIC);
+    sqlite3_bind_int64(sql_main.setmisc, 2, version);
+    status = sqlite3_step(sql_main.setmisc);
+    if (status != SQLITE_DONE)
+        die("cannot store dictionary version: %s",
+            sqlite3_errmsg(connection));
+    resetclear(sql_main.setmisc);
+    commit_transaction();
+
+    free(dict);
+    hash_free(global.fragments);
+    hash_free(hierarchies);
+    free(sets);
+    free_groups(groups, ngroups);
+}
+
+/*
+ * Recompress all the overview data with the current dictionaries, then
+ * drop the older versions, which are no longer needed.
+ */
+static void
+recompress(void)
+{
+    group_t *groups;
+    size_t ngroups, ix, i, n, changed;
+    uint64_t articles, rewritten = 0;
+    int64_t saved = 0;
+    buffer_t *out, *batch;
+    uint64_t *artnums;
+    size_t *offsets;
+    int status, listed;
+
+    if (!use_compression)
+        die("the database does not use compression");
+    groups = load_groups(&ngroups, &articles);
+    out = buffer_new();
+    batch = buffer_new();
+    artnums = xmalloc(RECOMPRESS_BATCH * sizeof(uint64_t));
+    offsets = xmalloc((RECOMPRESS_BATCH + 1) * sizeof(size_t));
+
+    for (ix = 0; ix < ngroups; ix++) {
+        group_t *group = groups + ix;
+        uint64_t low = 0;
+
+        do {
+            sqlite3_stmt *stmt = sql_main.list_articles_overview;
+
+            begin_transaction();
+            buffer_set(batch, NULL, 0);
+            n = 0;
+            changed = 0;
+            sqlite3_bind_blob(stmt, 1, group->name, group->name_len,
+                              SQLITE_STATIC);
+            sqlite3_bind_int64(stmt, 2, low);
+            while (n < RECOMPRESS_BATCH
+                   && (listed = sqlite3_step(stmt)) == SQLITE_ROW) {
+                uint8_t const *stored, *overview, *result;
+                uint32_t stored_len, overview_len, result_len;
+                uint64_t artnum;
+
+                n++;
+                artnum = sqlite3_column_int64(stmt, 0);
+                low = artnum + 1;
+                stored = sqlite3_column_blob(stmt, 4);
+                stored_len = sqlite3_column_bytes(stmt, 4);
+                overview = stored;
+                overview_len = stored_len;
+                if (!stored
+                    || !ovsqlite_inflate(&inflation, flate, &dicts,
+                                         group->name, group->name_len, artnum,
+                                         &overview, &overview_len)) {
+                    warn("%s:%llu: corrupted overview data, skipping",
+                         group->name, (unsigned long long) artnum);
+                    continue;
+                }
+                if (overview_len > 5
+                    && deflate_overview(out, group->name, group->name_len,
+                                        artnum, overview, overview_len)) {
+                    result = (uint8_t *) out->data;
+                    result_len = out->left;
+                } else {
+                    buffer_set(out, "", 1);
+                    buffer_append(out, (char const *) overview, overview_len);
+                    result = (uint8_t *) out->data;
+                    result_len = out->left;
+                }
+                if (result_len == stored_len
+                    && memcmp(result, stored, result_len) == 0)
+                    continue;
+                saved += (int64_t) stored_len - result_len;
+                artnums[changed] = artnum;
+                offsets[changed++] = batch->left;
+                buffer_append(batch, (char const *) result, result_len);
+            }
+            if (n < RECOMPRESS_BATCH && listed != SQLITE_DONE)
+                die("cannot read overview data of %s: %s", group->name,
+                    sqlite3_errmsg(connection));
+            resetclear(stmt);
+
+            offsets[changed] = batch->left;
+            stmt = sql_main.update_article_overview;
+            for (i = 0; i < changed; i++) {
+                sqlite3_bind_int64(stmt, 1, group->groupid);
+                sqlite3_bind_int64(stmt, 2, artnums[i]);
+                sqlite3_bind_blob(stmt, 3, batch->data + offsets[i],
+                                  offsets[i + 1] - offsets[i], SQLITE_STATIC);
+                status = sqlite3_step(stmt);
+                if (status != SQLITE_DONE)
+                    die("cannot update overview data of %s: %s", group->name,
+                        sqlite3_errmsg(connection));
+                resetclear(stmt);
+            }
+            commit_transaction();
+            rewritten += changed;
+        } while (n == RECOMPRESS_BATCH);
+    }
+
+    /* Drop the dictionaries nothing is compressed with anymore. */
+    begin_transaction();
+    for (ix = 1; ix < dicts.count; ix++) {
+        ovsqlite_dict *dict = dicts.dict + ix;
+        char *key;
+
+        if (dict->version == dicts.version)
+            continue;
+        xasprintf(&key, "dict:%lu:%s", dict->version,
+                  dict->hierarchy ? dict->hierarchy : "");
+        sqlite3_bind_text(sql_main.unsetmisc, 1, key, -1, SQLITE_STATIC);
+        status = sqlite3_step(sql_main.unsetmisc);
+        if (status != SQLITE_DONE)
+            die("cannot remove dictionary %s: %s", key,
+                sqlite3_errmsg(connection));
+        resetclear(sql_main.unsetmisc);
+        free(key);
+    }
+    commit_transaction();
+    notice("recompressed %llu of %llu articles, %lld bytes saved",
+           (unsigned long long) rewritten, (unsigned long long) articles,
+           (long long) saved);
+
+    free(offsets);
+    free(artnums);
+    buffer_free(batch);
+    buffer_free(out);
+    free_groups(groups, ngroups);
+}
+
+#    endif /* HAVE_ZLIB */
+
 __attribute__((__noreturn__)) static void
 usage(void)
 {
-    fputs("Usage: ovsqlite-server [ -d ]\n", stderr);
+    fputs("Usage: ovsqlite-server [ -d | -T | -R ]\n", stderr);
     exit(1);
 }
 
@@ -2120,24 +2738,31 @@ int
 main(int argc, char **argv)
 {
     bool debug = false;
+    int action = 0;
 
     setproctitle_init(argc, argv);
     message_program_name = "ovsqlite-server";
     for (;;) {
         int c;
 
-        c = getopt(argc, argv, "d");
+        c = getopt(argc, argv, "dRT");
         if (c == -1)
             break;
         switch (c) {
         case 'd':
             debug = true;
             break;
+        case 'R':
+        case 'T':
+            if (action != 0)
+                usage();
+            action = c;
+            break;
         default:
             usage();
         }
     }
-    if (debug) {
+    if (debug || action != 0) {
         message_handlers_warn(1, message_log_stderr);
         message_handlers_die(1, message_log_stderr);
     } else {
@@ -2148,6 +2773,20 @@ main(int argc, char **argv)
     if (!innconf_read(NULL))
         exit(1);
     load_config();
+    if (action != 0) {
+        check_not_running();
+        open_db();
+#    ifdef HAVE_ZLIB
+        if (action == 'T')
+            train_dicts();
+        else
+            recompress();
+#    else
+        die("INN was not built with zlib");
+#    endif
+        close_db();
+        return 0;
+    }
     if (!debug) {
         if (daemon(1, 0) < 0) {
             sysdie("cannot fork: %s", strerror(errno));
@@ -2160,12 +2799,20 @@ main(int argc, char **argv)
     make_pidfile();
     open_db();
     make_listener();
+#    ifdef HAVE_UNIX_DOMAIN_SOCKETS
+    if (readers > 0)
+        start_readers();
+#    endif
     innconf_free(innconf);
     innconf = NULL;
     if (setfdlimit(FD_SETSIZE) == -1)
         syswarn("cannot set file descriptor limit");
     mainloop();
     close_sockets();
+#    ifdef HAVE_UNIX_DOMAIN_SOCKETS
+    if (reader_pids != NULL)
+        stop_readers();
+#    endif
     close_db();
     if (pidfile)
         unlink(pidfile);
@@ -19,6 +19,7 @@
 #    endif
 
 #    include "conffile.h"
+#    include "inn/confparse.h"
 #    include "inn/fdflag.h"
 #    include "inn/innconf.h"
 #    include "inn/libinn.h"
@@ -26,9 +27,13 @@
 #    include "inn/paths.h"
 
 #    include "../ovinterface.h"
+#    include "sql-main.h"
 
 #    define SEARCHSPACE 0x20000
 
+/* Number of articles a direct search reads at a time. */
+#    define DIRECTBATCH 256
+
 typedef struct handle_t {
     uint8_t buffer[SEARCHSPACE];
     uint64_t low;
@@ -49,39 +54,80 @@ static int sock = -1;
 static buffer_t *request;
 static buffer_t *response;
 
+/*
+ * Read-only clients may open the database themselves instead of talking
+ * to the server when directread is set in ovsqlite.conf.
+ */
+static sqlite3 *connection;
+static sql_main_t sql_main;
+static bool use_compression;
+
+#    ifdef HAVE_ZLIB
+static z_stream inflation;
+static buffer_t *flate;
+static ovsqlite_dicts dicts;
+#    endif
+
 #    ifndef HAVE_UNIX_DOMAIN_SOCKETS
 static ovsqlite_port port;
 #    endif
 
-static bool
-server_connect(void)
-{
-    char *path;
-    int ret;
-
 #    ifdef HAVE_UNIX_DOMAIN_SOCKETS
 
+static int
+unix_connect(char const *name)
+{
+    char *path;
     struct sockaddr_un sa;
+    int ret;
 
     sock = socket(PF_UNIX, SOCK_STREAM, 0);
     if (sock == -1) {
         syswarn("ovsqlite: socket");
-        return false;
+        return -1;
     }
     memset(&sa, 0, sizeof sa);
     sa.sun_family = AF_UNIX;
-    path = concatpath(innconf->pathrun, OVSQLITE_SERVER_SOCKET);
+    path = concatpath(innconf->pathrun, name);
     strlcpy(sa.sun_path, path, sizeof(sa.sun_path));
     free(path);
 
     ret = connect(sock, (struct sockaddr *) &sa, SUN_LEN(&sa));
+    if (ret == -1) {
+        close(sock);
+        sock = -1;
+    }
+    return ret;
+}
+
+#    endif /* HAVE_UNIX_DOMAIN_SOCKETS */
+
+static bool
+server_connect(int mode)
+{
+    int ret;
+
+#    ifdef HAVE_UNIX_DOMAIN_SOCKETS
+
+    /*
+     * Read-only clients are served by the reader processes of the server
+     * when it has some, and by the server itself otherwise.
+     */
+    ret = -1;
+    if (!(mode & OV_WRITE))
+        ret = unix_connect(OVSQLITE_READER_SOCKET);
+    if (ret == -1)
+        ret = unix_connect(OVSQLITE_SERVER_SOCKET);
 
 #    else  /* ! HAVE_UNIX_DOMAIN_SOCKETS */
 
+    char *path;
     struct sockaddr_in sa;
     int fd;
     ssize_t got;
 
+    /* There are no reader processes to serve read-only clients. */
+    (void) mode;
     path = concatpath(innconf->pathrun, OVSQLITE_SERVER_PORT);
     fd = open(path, O_RDONLY);
     if (fd == -1) {
@@ -114,8 +160,10 @@ server_connect(void)
 
     if (ret == -1) {
         syswarn("ovsqlite: connect");
-        close(sock);
-        sock = -1;
+        if (sock != -1) {
+            close(sock);
+            sock = -1;
+        }
         return false;
     }
 
@@ -279,14 +327,381 @@ server_handshake(uint32_t mode)
     return true;
 }
 
+static bool
+direct_read(unsigned long *cachesize, unsigned long *mmapsize)
+{
+    char *path;
+    struct config_group *top;
+    bool directread = false;
+
+    path = concatpath(innconf->pathetc, "ovsqlite.conf");
+    top = config_parse_file(path);
+    free(path);
+    if (top) {
+        config_param_boolean(top, "directread", &directread);
+        config_param_unsigned_number(top, "cachesize", cachesize);
+        config_param_unsigned_number(top, "mmapsize", mmapsize);
+        config_free(top);
+    }
+    return directread;
+}
+
+static void
+direct_close(void)
+{
+    sqlite_helper_term(&sql_main_helper, (sqlite3_stmt **) &sql_main);
+    sqlite3_close_v2(connection);
+    connection = NULL;
+#    ifdef HAVE_ZLIB
+    if (flate) {
+        inflateEnd(&inflation);
+        buffer_free(flate);
+        flate = NULL;
+        ovsqlite_dicts_free(&dicts);
+    }
+#    endif
+}
+
+/*
+ * Look up a value in the misc table.  On success, the value is column 0 of
+ * sql_main.getmisc, which the caller must reset afterwards.
+ */
+static bool
+direct_getmisc(char const *key)
+{
+    int status;
+
+    sqlite3_bind_text(sql_main.getmisc, 1, key, -1, SQLITE_STATIC);
+    status = sqlite3_step(sql_main.getmisc);
+    if (status != SQLITE_ROW) {
+        warn("ovsqlite: cannot get %s from database: %s", key,
+             sqlite3_errmsg(connection));
+        sqlite3_reset(sql_main.getmisc);
+        sqlite3_clear_bindings(sql_main.getmisc);
+        return false;
+    }
+    return true;
+}
+
+static void
+direct_resetmisc(void)
+{
+    sqlite3_reset(sql_main.getmisc);
+    sqlite3_clear_bindings(sql_main.getmisc);
+}
+
+/*
+ * Open the database read-only in this process.  This is only done when the
+ * server keeps it in WAL mode, so that our read transactions never hold up
+ * its writes.  Returns false if the caller should use the server instead.
+ */
+static bool
+direct_open(unsigned long cachesize, unsigned long mmapsize)
+{
+    char *path;
+    char *errmsg;
+    char const *journal;
+    char sqltext[64];
+    int status, version;
+
+    path = concatpath(innconf->pathoverview, OVSQLITE_DB_FILE);
+    status = sqlite3_open_v2(path, &connection, SQLITE_OPEN_READONLY, NULL);
+    free(path);
+    if (status != SQLITE_OK) {
+        warn("ovsqlite: cannot open database: %s", sqlite3_errstr(status));
+        sqlite3_close_v2(connection);
+        connection = NULL;
+        return false;
+    }
+    sqlite3_extended_result_codes(connection, 1);
+    status =
+        sqlite_helper_init(&sql_main_helper, (sqlite3_stmt **) &sql_main,
+                           connection, SQLITE_PREPARE_PERSISTENT, &errmsg);
+    if (status != SQLITE_OK) {
+        warn("ovsqlite: cannot set up database session: %s", errmsg);
+        sqlite3_free(errmsg);
+        sqlite3_close_v2(connection);
+        connection = NULL;
+        return false;
+    }
+
+    status = sqlite3_step(sql_main.get_journal);
+    journal = NULL;
+    if (status == SQLITE_ROW)
+        journal = (char const *) sqlite3_column_text(sql_main.get_journal, 0);
+    if (journal == NULL || strcasecmp(journal, "wal") != 0) {
+        warn("ovsqlite: database not in WAL mode, using the server");
+        sqlite3_reset(sql_main.get_journal);
+        direct_close();
+        return false;
+    }
+    sqlite3_reset(sql_main.get_journal);
+
+    if (!direct_getmisc("version"))
+        goto fail;
+    version = sqlite3_column_int(sql_main.getmisc, 0);
+    direct_resetmisc();
+    if (version != OVSQLITE_SCHEMA_VERSION) {
+        warn("ovsqlite: incompatible database schema %d", version);
+        goto fail;
+    }
+    if (!direct_getmisc("compress"))
+        goto fail;
+    use_compression = sqlite3_column_int(sql_main.getmisc, 0);
+    direct_resetmisc();
+    if (use_compression) {
+#    ifdef HAVE_ZLIB
+        if (!ovsqlite_dicts_load(&dicts, sql_main.getmisc,
+                                 sql_main.list_dicts))
+            goto fail;
+        memset(&inflation, 0, sizeof inflation);
+        if (inflateInit(&inflation) != Z_OK) {
+            warn("ovsqlite: cannot set up decompression");
+            ovsqlite_dicts_free(&dicts);
+            goto fail;
+        }
+        flate = buffer_new();
+#    else
+        warn("ovsqlite: database uses compression but INN was not built"
+             " with zlib");
+        goto fail;
+#    endif
+    }
+
+    if (cachesize) {
+        snprintf(sqltext, sizeof sqltext, "pragma cache_size = -%lu;",
+                 cachesize);
+        if (sqlite3_exec(connection, sqltext, 0, NULL, &errmsg) != SQLITE_OK) {
+            warn("ovsqlite: cannot set cache size: %s", errmsg);
+            sqlite3_free(errmsg);
+        }
+    }
+    if (mmapsize) {
+        snprintf(sqltext, sizeof sqltext, "pragma mmap_size = %llu;",
+                 (unsigned long long) mmapsize * 1024);
+        if (sqlite3_exec(connection, sqltext, 0, NULL, &errmsg) != SQLITE_OK) {
+            warn("ovsqlite: cannot set mmap size: %s", errmsg);
+            sqlite3_free(errmsg);
+        }
+    }
+    return true;
+
+fail:
+    direct_close();
+    return false;
+}
+
+static bool
+direct_groupstats(const char *group, int *low, int *high, int *count,
+                  int *flag)
+{
+    sqlite3_stmt *stmt;
+    uint8_t const *flag_alias;
+    int status;
+
+    stmt = sql_main.get_groupinfo;
+    sqlite3_bind_blob(stmt, 1, group, strlen(group), SQLITE_STATIC);
+    status = sqlite3_step(stmt);
+    if (status != SQLITE_ROW) {
+        if (status != SQLITE_DONE)
+            warn("ovsqlite: cannot get group info: %s",
+                 sqlite3_errmsg(connection));
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+        return false;
+    }
+    if (low)
+        *low = sqlite3_column_int64(stmt, 0);
+    if (high)
+        *high = sqlite3_column_int64(stmt, 1);
+    if (count)
+        *count = sqlite3_column_int64(stmt, 2);
+    if (flag) {
+        flag_alias = sqlite3_column_blob(stmt, 3);
+        *flag = flag_alias ? *flag_alias : '\0';
+    }
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    return true;
+}
+
+static bool
+direct_getartinfo(const char *group, ARTNUM artnum, TOKEN *token)
+{
+    sqlite3_stmt *stmt;
+    void const *blob;
+    bool found = false;
+
+    stmt = sql_main.get_artinfo;
+    sqlite3_bind_blob(stmt, 1, group, strlen(group), SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, artnum);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        blob = sqlite3_column_blob(stmt, 0);
+        if (blob && sqlite3_column_bytes(stmt, 0) == sizeof(TOKEN)) {
+            memcpy(token, blob, sizeof(TOKEN));
+            found = true;
+        }
+    }
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    return found;
+}
+
+/*
+ * Return the overview data of the current row of a direct search,
+ * decompressing it if needed.  The result stays valid until the next step
+ * or reset of the statement.
+ */
+static bool
+direct_overview(handle_t *rh, sqlite3_stmt *stmt, ARTNUM artnum,
+                uint8_t const **data, uint32_t *len)
+{
+    uint8_t const *overview;
+    uint32_t overview_len;
+
+    overview = sqlite3_column_blob(stmt, 4);
+    overview_len = sqlite3_column_bytes(stmt, 4);
+    if (!overview || overview_len > 100000)
+        return false;
+#    ifdef HAVE_ZLIB
+    if (use_compression) {
+        uint8_t const *stored = overview;
+        uint32_t stored_len = overview_len;
+
+        if (!ovsqlite_inflate(&inflation, flate, &dicts, rh->groupname,
+                              rh->groupname_len, artnum, &overview,
+                              &overview_len)) {
+            /* The server may have been restarted with newly trained
+               dictionaries since we loaded ours. */
+            ovsqlite_dicts_free(&dicts);
+            if (!ovsqlite_dicts_load(&dicts, sql_main.getmisc,
+                                     sql_main.list_dicts))
+                return false;
+            overview = stored;
+            overview_len = stored_len;
+            if (!ovsqlite_inflate(&inflation, flate, &dicts, rh->groupname,
+                                  rh->groupname_len, artnum, &overview,
+                                  &overview_len))
+                return false;
+        }
+    }
+#    else
+    (void) artnum;
+#    endif
+    *data = overview;
+    *len = overview_len;
+    return true;
+}
+
+/*
+ * Fill the search buffer of a direct search with the next articles, laid
+ * out as fill_search_buffer does with a response of the server.  The
+ * listing statement is reset after each batch, so that no read transaction
+ * stays open between two calls, which would keep the server from
+ * checkpointing the WAL while nnrpd idles in a group.  This also lets all
+ * the searches nnrpd has open share the same statement.
+ */
+static bool
+direct_fill_search_buffer(handle_t *rh)
+{
+    sqlite3_stmt *listing;
+    unsigned int cols;
+    uint32_t count;
+    uint8_t *store;
+    uint8_t const *overview;
+    uint32_t overview_len;
+    void const *blob;
+    ARTNUM artnum;
+    int status;
+    bool ok = true;
+
+    rh->count = 0;
+    rh->index = 0;
+    cols = rh->cols;
+    store = rh->buffer;
+    rh->overview = (char **) (void *) store;
+    if (cols & search_col_overview)
+        store += (DIRECTBATCH + 1) * sizeof(char **);
+    rh->arrived = (time_t *) (void *) store;
+    if (cols & search_col_arrived)
+        store += DIRECTBATCH * sizeof(time_t);
+    rh->artnum = (ARTNUM *) (void *) store;
+    store += DIRECTBATCH * sizeof(ARTNUM);
+    rh->token = (TOKEN *) store;
+    if (cols & search_col_token)
+        store += DIRECTBATCH * sizeof(TOKEN);
+
+    listing = (cols & search_col_overview)
+                  ? sql_main.list_articles_high_overview
+                  : sql_main.list_articles_high;
+    sqlite3_bind_blob(listing, 1, rh->groupname, rh->groupname_len,
+                      SQLITE_STATIC);
+    sqlite3_bind_int64(listing, 2, rh->low);
+    sqlite3_bind_int64(listing, 3, rh->high);
+    for (count = 0; count < DIRECTBATCH; count++) {
+        status = sqlite3_step(listing);
+        if (status != SQLITE_ROW) {
+            if (status != SQLITE_DONE) {
+                warn("ovsqlite: cannot search group: %s",
+                     sqlite3_errmsg(connection));
+                ok = false;
+            }
+            rh->done = true;
+            break;
+        }
+        artnum = sqlite3_column_int64(listing, 0);
+        if (cols & search_col_overview) {
+            if (!direct_overview(rh, listing, artnum, &overview,
+                                 &overview_len)) {
+                warn("ovsqlite: corrupted overview data for %.*s:%lu",
+                     (int) rh->groupname_len, rh->groupname, artnum);
+                ok = false;
+                rh->done = true;
+                break;
+            }
+
+            /* The next batch starts again from this article. */
+            if (store + overview_len > rh->buffer + SEARCHSPACE)
+                break;
+            memcpy(store, overview, overview_len);
+            rh->overview[count] = (char *) store;
+            store += overview_len;
+        }
+        if (cols & search_col_token) {
+            blob = sqlite3_column_blob(listing, 3);
+            if (!blob || sqlite3_column_bytes(listing, 3) != sizeof(TOKEN)) {
+                ok = false;
+                rh->done = true;
+                break;
+            }
+            memcpy(rh->token + count, blob, sizeof(TOKEN));
+        }
+        if (cols & search_col_arrived)
+            rh->arrived[count] = sqlite3_column_int64(listing, 1);
+        rh->artnum[count] = artnum;
+    }
+    sqlite3_reset(listing);
+    sqlite3_clear_bindings(listing);
+    if (cols & search_col_overview)
+        rh->overview[count] = (char *) store;
+    rh->count = count;
+    return ok;
+}
+
 bool
 ovsqlite_open(int mode)
 {
-    if (sock != -1) {
+    unsigned long cachesize = 0;
+    unsigned long mmapsize = 0;
+
+    if (sock != -1 || connection != NULL) {
         warn("ovsqlite_open called more than once");
         return false;
     }
-    if (!server_connect())
+    if (!(mode & OV_WRITE) && direct_read(&cachesize, &mmapsize)
+        && direct_open(cachesize, mmapsize))
+        return true;
+    if (!server_connect(mode))
         return false;
     if (!server_handshake(mode))
         return false;
@@ -305,6 +720,8 @@ ovsqlite_groupstats(const char *group, int *low, int *high, int *count,
     uint16_t flag_alias_len;
     uint8_t *flag_alias;
 
+    if (connection != NULL)
+        return direct_groupstats(group, low, high, count, flag);
     if (sock == -1) {
         warn("ovsqlite: not connected to server");
         return false;
@@ -499,7 +916,7 @@ ovsqlite_opensearch(const char *group, int low, int high)
     handle_t *rh;
     uint16_t groupname_len;
 
-    if (sock == -1) {
+    if (sock == -1 && connection == NULL) {
         warn("ovsqlite: not connected to server");
         return NULL;
     }
@@ -642,7 +1059,7 @@ ovsqlite_search(void *handle, ARTNUM *artnum, char **data, int *len,
     unsigned int cols;
     unsigned int ix;
 
-    if (sock == -1) {
+    if (sock == -1 && connection == NULL) {
         warn("ovsqlite: not connected to server");
         return false;
     }
@@ -661,7 +1078,10 @@ ovsqlite_search(void *handle, ARTNUM *artnum, char **data, int *len,
         cols |= search_col_overview;
     if (cols & ~rh->cols || ix >= rh->count) {
         rh->cols = cols;
-        if (!fill_search_buffer(rh))
+        if (connection != NULL) {
+            if (!direct_fill_search_buffer(rh))
+                return false;
+        } else if (!fill_search_buffer(rh))
             return false;
         ix = rh->index;
         if (ix >= rh->count)
@@ -685,11 +1105,14 @@ ovsqlite_search(void *handle, ARTNUM *artnum, char **data, int *len,
 void
 ovsqlite_closesearch(void *handle)
 {
-    if (sock == -1)
+    handle_t *rh;
+
+    if (sock == -1 && connection == NULL)
         warn("ovsqlite: not connected to server");
-    if (!handle)
+    rh = handle;
+    if (!rh)
         return;
-    free(handle);
+    free(rh);
 }
 
 bool
@@ -699,6 +1122,8 @@ ovsqlite_getartinfo(const char *group, ARTNUM artnum, TOKEN *token)
     uint64_t r_artnum;
     unsigned int code;
 
+    if (connection != NULL)
+        return direct_getartinfo(group, artnum, token);
     if (sock == -1) {
         warn("ovsqlite: not connected to server");
         return false;
@@ -937,7 +1362,7 @@ set_cutofflow(uint8_t cutofflow)
 bool
 ovsqlite_ctl(OVCTLTYPE type, void *val)
 {
-    if (sock == -1) {
+    if (sock == -1 && connection == NULL) {
         warn("ovsqlite: not connected to server");
         return false;
     }
@@ -949,6 +1374,9 @@ ovsqlite_ctl(OVCTLTYPE type, void *val)
         *(OVSORTTYPE *) val = OVNEWSGROUP;
         return true;
     case OVCUTOFFLOW:
+        /* Only matters when adding articles, which direct readers can't. */
+        if (connection != NULL)
+            return true;
         return set_cutofflow(*(bool *) val);
     case OVSTATICSEARCH:
         *(int *) val = true;
@@ -965,6 +1393,10 @@ ovsqlite_ctl(OVCTLTYPE type, void *val)
 void
 ovsqlite_close(void)
 {
+    if (connection != NULL) {
+        direct_close();
+        return;
+    }
     if (sock == -1) {
         warn("ovsqlite: not connected to server");
         return;
@@ -24,7 +24,15 @@ create table misc (
 --         and ends with "\tXref: $pathhost ".  For the exact contents,
 --         see basedict_format in ovsqlite-server.c.
 --
--- Currently, no values that vary over the database lifetime exist.
+-- These values are set by ovsqlite-server -T and -R:
+--     * 'dictversion'
+--         The value is an integer specifying the version of the trained
+--         dictionaries used to compress new overview text.
+--     * 'dict:<version>:<hierarchy>'
+--         The value is a blob holding a dictionary trained from sample
+--         overview text, used instead of basedict for the groups of that
+--         hierarchy (all groups when <hierarchy> is empty).  Older versions
+--         stay until the overview text compressed with them is recompressed.
 
 
 create table groupinfo (
@@ -1,7 +1,5 @@
 pragma foreign_keys = 1;
 
-pragma journal_mode = 'PERSIST';
-
 pragma busy_timeout = 999999999;
 
 -- .random
@@ -19,6 +17,12 @@ insert or replace into misc (key, value)
 delete from misc
     where key=?1;
 
+-- .list_dicts
+select key, value from misc
+    where key>='dict:'
+        and key<'dict;'
+    order by key;
+
 -- .begin
 begin immediate transaction;
 
@@ -37,9 +41,18 @@ release savepoint article_group;
 -- .rollback_savepoint
 rollback to savepoint article_group;
 
+-- .persist_journal
+pragma journal_mode = 'PERSIST';
+
+-- .wal_journal
+pragma journal_mode = 'WAL';
+
 -- .delete_journal
 pragma journal_mode = 'DELETE';
 
+-- .get_journal
+pragma journal_mode;
+
 -- .add_group
 insert into groupinfo (groupname, flag_alias, low, high)
     values(?1, ?2, ?3, ?4);
@@ -91,6 +104,12 @@ select token
         and groupname=?1
         and artnum=?2;
 
+-- .update_article_overview
+update artinfo
+    set overview = ?3
+    where groupid=?1
+        and artnum=?2;
+
 -- .delete_article
 delete from artinfo
     where groupid=?1
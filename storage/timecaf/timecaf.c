@@ -60,6 +60,10 @@ typedef enum {
     FIND_TOPDIR
 } FINDTYPE;
 
+/* CAF file and article number a resumed walk starts at, until reached. */
+static char *ResumePath = NULL;
+static ARTNUM ResumeArtnum;
+
 /*
 ** Structures for the cache for stat information (to make expireover etc.)
 ** faster.
@@ -781,6 +785,24 @@ FindDir(DIR *dir, FINDTYPE type)
     return NULL;
 }
 
+/*
+**  Whether a directory of the spool or a CAF file in it is to be walked.
+**  When resuming, only the ones leading to the CAF file of the article to
+**  start at are, so the walk gets there without reading any TOC before it.
+*/
+static bool
+Resumed(const char *path)
+{
+    size_t length;
+
+    if (ResumePath == NULL)
+        return true;
+    length = strlen(path);
+    if (strncmp(ResumePath, path, length) != 0)
+        return false;
+    return ResumePath[length] == '/' || ResumePath[length] == '\0';
+}
+
 /* Grovel thru a CAF table-of-contents finding the next still-existing article
  */
 static int
@@ -814,6 +836,8 @@ timecaf_next(ARTHANDLE *article, const RETRTYPE amount)
     char *path;
     ARTHANDLE *art;
     size_t length;
+    const TOKEN *resume;
+    time_t now;
 
     length = strlen(innconf->patharticles) + 32;
     path = xmalloc(length);
@@ -825,6 +849,12 @@ timecaf_next(ARTHANDLE *article, const RETRTYPE amount)
         priv.topde = NULL;
         priv.secde = NULL;
         priv.terde = NULL;
+        free(ResumePath);
+        ResumePath = NULL;
+        if ((resume = SMresumepoint(TOKEN_TIMECAF)) != NULL) {
+            BreakToken(*resume, &now, &ResumeArtnum);
+            ResumePath = MakePath(now, resume->class);
+        }
     } else {
         priv = *(PRIV_TIMECAF *) article->private;
         free(article->private);
@@ -879,19 +909,32 @@ timecaf_next(ARTHANDLE *article, const RETRTYPE amount)
                 }
                 snprintf(path, length, "%s/%s", innconf->patharticles,
                          priv.topde->d_name);
-                if ((priv.sec = opendir(path)) == NULL)
+                if (!Resumed(path) || (priv.sec = opendir(path)) == NULL)
                     continue;
             }
             snprintf(path, length, "%s/%s/%s", innconf->patharticles,
                      priv.topde->d_name, priv.secde->d_name);
-            if ((priv.ter = opendir(path)) == NULL)
+            if (!Resumed(path) || (priv.ter = opendir(path)) == NULL)
                 continue;
         }
+        /* Each CAF file holds a range of arrival times and is a unit of the
+           spool when walking it in parts. */
+        if (!SMpartitioned(strtoul(priv.secde->d_name, NULL, 16) * 65536
+                           + strtoul(priv.terde->d_name, NULL, 16)))
+            continue;
         snprintf(path, length, "%s/%s/%s/%s", innconf->patharticles,
                  priv.topde->d_name, priv.secde->d_name, priv.terde->d_name);
-        if ((priv.curtoc = CAFReadTOC(path, &priv.curheader)) == NULL)
+        if (!Resumed(path)
+            || (priv.curtoc = CAFReadTOC(path, &priv.curheader)) == NULL)
             continue;
         priv.curartnum = 0;
+        if (ResumePath != NULL) {
+            /* Go on from the article just before the one to resume at. */
+            if (ResumeArtnum > priv.curheader.Low)
+                priv.curartnum = ResumeArtnum - 1;
+            free(ResumePath);
+            ResumePath = NULL;
+        }
     }
     snprintf(path, length, "%s/%s/%s/%s", innconf->patharticles,
              priv.topde->d_name, priv.secde->d_name, priv.terde->d_name);
@@ -902,6 +945,9 @@ timecaf_next(ARTHANDLE *article, const RETRTYPE amount)
         art->data = NULL;
         art->len = 0;
         art->private = xmalloc(sizeof(PRIV_TIMECAF));
+    } else if (art->private == NULL) {
+        /* RETR_STAT doesn't read the article. */
+        art->private = xcalloc(1, sizeof(PRIV_TIMECAF));
     }
     newpriv = (PRIV_TIMECAF *) art->private;
     newpriv->top = priv.top;
@@ -44,6 +44,9 @@ typedef enum {
 
 static int SeqNum = 0;
 
+/* Path of the article a resumed walk starts at, until it is reached. */
+static char *ResumePath = NULL;
+
 /*
 **  The token is @02nnaabbccddyyyy00000000000000000000@
 **  where "02" is the timehash method number,
@@ -461,6 +464,54 @@ FindDir(DIR *dir, FINDTYPE type)
     return NULL;
 }
 
+/*
+**  Whether a directory of the spool or an article in it is to be walked.
+**  When resuming, only the ones leading to the article to start at are, so
+**  the walk gets there without opening any article before it.
+*/
+static bool
+Resumed(const char *path)
+{
+    size_t length;
+
+    if (ResumePath == NULL)
+        return true;
+    length = strlen(path);
+    if (strncmp(ResumePath, path, length) != 0)
+        return false;
+    if (ResumePath[length] == '\0') {
+        free(ResumePath);
+        ResumePath = NULL;
+        return true;
+    }
+    return ResumePath[length] == '/';
+}
+
+/*
+**  Find the next article in the current article directory, skipping the
+**  ones before the article to start at when resuming.
+*/
+static struct dirent *
+FindArt(PRIV_TIMEHASH *priv)
+{
+    struct dirent *de;
+    char *path;
+    bool found;
+
+    while ((de = FindDir(priv->artdir, FIND_ART)) != NULL) {
+        if (ResumePath == NULL)
+            return de;
+        xasprintf(&path, "%s/%s/%s/%s/%s", innconf->patharticles,
+                  priv->topde->d_name, priv->secde->d_name,
+                  priv->terde->d_name, de->d_name);
+        found = Resumed(path);
+        free(path);
+        if (found)
+            return de;
+    }
+    return NULL;
+}
+
 ARTHANDLE *
 timehash_next(ARTHANDLE *article, const RETRTYPE amount)
 {
@@ -472,6 +523,8 @@ timehash_next(ARTHANDLE *article, const RETRTYPE amount)
     int seqnum;
     size_t length;
     TOKEN *nexttoken;
+    const TOKEN *resume;
+    time_t now;
 
     length = strlen(innconf->patharticles) + 32;
     path = xmalloc(length);
@@ -483,6 +536,12 @@ timehash_next(ARTHANDLE *article, const RETRTYPE amount)
         priv.topde = NULL;
         priv.secde = NULL;
         priv.terde = NULL;
+        free(ResumePath);
+        ResumePath = NULL;
+        if ((resume = SMresumepoint(TOKEN_TIMEHASH)) != NULL) {
+            BreakToken(*resume, &now, &seqnum);
+            ResumePath = MakePath(now, seqnum, resume->class);
+        }
     } else {
         priv = *(PRIV_TIMEHASH *) article->private;
         free(article->private);
@@ -495,7 +554,7 @@ timehash_next(ARTHANDLE *article, const RETRTYPE amount)
         }
     }
 
-    while (!priv.artdir || ((de = FindDir(priv.artdir, FIND_ART)) == NULL)) {
+    while (!priv.artdir || ((de = FindArt(&priv)) == NULL)) {
         if (priv.artdir) {
             closedir(priv.artdir);
             priv.artdir = NULL;
@@ -538,17 +597,22 @@ timehash_next(ARTHANDLE *article, const RETRTYPE amount)
                 }
                 snprintf(path, length, "%s/%s", innconf->patharticles,
                          priv.topde->d_name);
-                if ((priv.sec = opendir(path)) == NULL)
+                if (!Resumed(path) || (priv.sec = opendir(path)) == NULL)
                     continue;
             }
             snprintf(path, length, "%s/%s/%s", innconf->patharticles,
                      priv.topde->d_name, priv.secde->d_name);
-            if ((priv.ter = opendir(path)) == NULL)
+            if (!Resumed(path) || (priv.ter = opendir(path)) == NULL)
                 continue;
         }
+        /* The second and third levels of directories are ranges of arrival
+           times, the units of the spool when walking it in parts. */
+        if (!SMpartitioned(strtoul(priv.secde->d_name, NULL, 16) * 256
+                           + strtoul(priv.terde->d_name, NULL, 16)))
+            continue;
         snprintf(path, length, "%s/%s/%s/%s", innconf->patharticles,
                  priv.topde->d_name, priv.secde->d_name, priv.terde->d_name);
-        if ((priv.artdir = opendir(path)) == NULL)
+        if (!Resumed(path) || (priv.artdir = opendir(path)) == NULL)
             continue;
     }
     if (de == NULL)
@@ -566,6 +630,9 @@ timehash_next(ARTHANDLE *article, const RETRTYPE amount)
         art->private = xmalloc(sizeof(PRIV_TIMEHASH));
         newpriv = (PRIV_TIMEHASH *) art->private;
         newpriv->base = NULL;
+    } else if (art->private == NULL) {
+        /* RETR_STAT doesn't map the article. */
+        art->private = xcalloc(1, sizeof(PRIV_TIMEHASH));
     }
     newpriv = (PRIV_TIMEHASH *) art->private;
     newpriv->top = priv.top;
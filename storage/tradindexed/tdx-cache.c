@@ -4,27 +4,41 @@
 **  This code maintains a cache of open overview data files to avoid some of
 **  the overhead involved in closing and reopening files.  All opens and
 **  closes should go through this code, and the hit ratio is tracked to check
-**  cache effectiveness.
+**  cache effectiveness (see OVCACHESTATS).  Neither lookups nor insertions
+**  scan the cache.
 */
 
 #include "portable/system.h"
 
-#include <time.h>
-
 #include "inn/hashtab.h"
 #include "inn/libinn.h"
 #include "inn/messages.h"
+#include "inn/ov.h"
 #include "inn/storage.h"
 #include "tdx-private.h"
 
 /* Returned to callers as an opaque data type, this struct holds all of the
-   information about the cache. */
+   information about the cache.  Entries are kept in two lists ordered from
+   the most to the least recently used: new entries go into the probation
+   list and move to the protected list when they are used again, so that a
+   burst of newsgroups used once cannot push out the ones used all the time.
+   The protected list holds at most max * 4 / 5 entries. */
 struct cache {
     struct hash *hashtable;
     unsigned int count;
     unsigned int max;
+    unsigned int protected;
     unsigned long queries;
     unsigned long hits;
+    unsigned long evictions;
+    struct cache_entry *head[2];
+    struct cache_entry *tail[2];
+};
+
+/* Indices of the lists in the head and tail arrays. */
+enum cache_list {
+    CACHE_PROBATION = 0,
+    CACHE_PROTECTED = 1
 };
 
 /* A cache entry, holding a group_data struct and some additional information
@@ -32,7 +46,9 @@ struct cache {
 struct cache_entry {
     struct group_data *data;
     HASH hash;
-    time_t lastused;
+    enum cache_list list;
+    struct cache_entry *prev;
+    struct cache_entry *next;
 };
 
 
@@ -92,26 +108,72 @@ entry_delete(void *data)
 
 
 /*
-**  Called by hash_traverse, this function finds the oldest entry with the
-**  smallest refcount and stores it in the provided pointer so that it can be
-**  freed.  This is used when the cache is full to drop the least useful
-**  entry.
+**  Unlink an entry from the list it is in.
 */
 static void
-entry_find_oldest(void *data, void *cookie)
+list_remove(struct cache *cache, struct cache_entry *entry)
 {
-    struct cache_entry *entry = (struct cache_entry *) data;
-    struct cache_entry **oldest = (struct cache_entry **) cookie;
+    if (entry->prev != NULL)
+        entry->prev->next = entry->next;
+    else
+        cache->head[entry->list] = entry->next;
+    if (entry->next != NULL)
+        entry->next->prev = entry->prev;
+    else
+        cache->tail[entry->list] = entry->prev;
+    if (entry->list == CACHE_PROTECTED)
+        cache->protected--;
+}
 
-    if (*oldest == NULL) {
-        *oldest = entry;
-        return;
+
+/*
+**  Put an entry at the most recently used end of the given list.  When the
+**  protected list grows too long, its least recently used entry goes back to
+**  probation.
+*/
+static void
+list_push(struct cache *cache, struct cache_entry *entry, enum cache_list list)
+{
+    struct cache_entry *demoted;
+
+    entry->list = list;
+    entry->prev = NULL;
+    entry->next = cache->head[list];
+    if (entry->next != NULL)
+        entry->next->prev = entry;
+    else
+        cache->tail[list] = entry;
+    cache->head[list] = entry;
+    if (list == CACHE_PROTECTED) {
+        cache->protected++;
+        if (cache->protected > cache->max * 4 / 5) {
+            demoted = cache->tail[CACHE_PROTECTED];
+            list_remove(cache, demoted);
+            list_push(cache, demoted, CACHE_PROBATION);
+        }
     }
-    if (entry->data->refcount > (*oldest)->data->refcount)
-        return;
-    if (entry->lastused > (*oldest)->lastused)
-        return;
-    *oldest = data;
+}
+
+
+/*
+**  Find the entry to drop when the cache is full: the least recently used
+**  entry on probation, or else the least recently used protected entry.
+**  Entries still used by a search are skipped if possible, which only costs
+**  anything while searches are open.
+*/
+static struct cache_entry *
+cache_victim(struct cache *cache)
+{
+    struct cache_entry *entry;
+    int list;
+
+    for (list = CACHE_PROBATION; list <= CACHE_PROTECTED; list++)
+        for (entry = cache->tail[list]; entry != NULL; entry = entry->prev)
+            if (entry->data->refcount <= 1)
+                return entry;
+    if (cache->tail[CACHE_PROBATION] != NULL)
+        return cache->tail[CACHE_PROBATION];
+    return cache->tail[CACHE_PROTECTED];
 }
 
 
@@ -123,11 +185,8 @@ tdx_cache_create(unsigned int size)
 {
     struct cache *cache;
 
-    cache = xmalloc(sizeof(struct cache));
-    cache->count = 0;
+    cache = xcalloc(1, sizeof(struct cache));
     cache->max = size;
-    cache->queries = 0;
-    cache->hits = 0;
     cache->hashtable = hash_create(size * 4 / 3, entry_hash, entry_key,
                                    entry_equal, entry_delete);
     return cache;
@@ -135,7 +194,8 @@ tdx_cache_create(unsigned int size)
 
 
 /*
-**  Look up a particular entry and return it.
+**  Look up a particular entry and return it.  A hit moves the entry to the
+**  front of the protected list.
 */
 struct group_data *
 tdx_cache_lookup(struct cache *cache, HASH hash)
@@ -144,16 +204,17 @@ tdx_cache_lookup(struct cache *cache, HASH hash)
 
     cache->queries++;
     entry = hash_lookup(cache->hashtable, &hash);
-    if (entry != NULL) {
-        cache->hits++;
-        entry->lastused = time(NULL);
-    }
-    return (entry == NULL) ? NULL : entry->data;
+    if (entry == NULL)
+        return NULL;
+    cache->hits++;
+    list_remove(cache, entry);
+    list_push(cache, entry, CACHE_PROTECTED);
+    return entry->data;
 }
 
 
 /*
-**  Insert a new entry, clearing out the oldest entry if the cache is
+**  Insert a new entry, clearing out the least useful entry if the cache is
 **  currently full.
 */
 void
@@ -161,30 +222,32 @@ tdx_cache_insert(struct cache *cache, HASH hash, struct group_data *data)
 {
     struct cache_entry *entry;
 
-    if (cache->count == cache->max) {
-        struct cache_entry *oldest = NULL;
+    if (cache->count >= cache->max) {
+        struct cache_entry *victim;
 
-        hash_traverse(cache->hashtable, entry_find_oldest, &oldest);
-        if (oldest == NULL) {
-            warn("tradindexed: unable to find oldest cache entry");
+        victim = cache_victim(cache);
+        if (victim == NULL) {
+            warn("tradindexed: unable to find cache entry to drop");
+            return;
+        }
+        list_remove(cache, victim);
+        if (!hash_delete(cache->hashtable, &victim->hash)) {
+            warn("tradindexed: cannot delete oldest cache entry");
+            list_push(cache, victim, CACHE_PROBATION);
             return;
-        } else {
-            if (!hash_delete(cache->hashtable, &oldest->hash)) {
-                warn("tradindexed: cannot delete oldest cache entry");
-                return;
-            }
         }
         cache->count--;
+        cache->evictions++;
     }
     entry = xmalloc(sizeof(struct cache_entry));
     entry->data = data;
     entry->hash = hash;
-    entry->lastused = time(NULL);
     if (!hash_insert(cache->hashtable, &entry->hash, entry)) {
         warn("tradindexed: duplicate cache entry for %s", HashToText(hash));
         free(entry);
     } else {
         entry->data->refcount++;
+        list_push(cache, entry, CACHE_PROBATION);
         cache->count++;
     }
 }
@@ -196,12 +259,31 @@ tdx_cache_insert(struct cache *cache, HASH hash, struct group_data *data)
 void
 tdx_cache_delete(struct cache *cache, HASH hash)
 {
-    if (!hash_delete(cache->hashtable, &hash)) {
+    struct cache_entry *entry;
+
+    entry = hash_lookup(cache->hashtable, &hash);
+    if (entry == NULL) {
         warn("tradindexed: unable to remove cache entry for %s",
              HashToText(hash));
-    } else {
-        cache->count--;
+        return;
     }
+    list_remove(cache, entry);
+    hash_delete(cache->hashtable, &hash);
+    cache->count--;
+}
+
+
+/*
+**  Return the statistics of the cache.
+*/
+void
+tdx_cache_stats(struct cache *cache, struct ovcachestats *stats)
+{
+    stats->size = cache->max;
+    stats->count = cache->count;
+    stats->lookups = cache->queries;
+    stats->hits = cache->hits;
+    stats->evictions = cache->evictions;
 }
 
 
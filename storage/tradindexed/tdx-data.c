@@ -2,11 +2,12 @@
 **  Overview data file handling for the tradindexed overview method.
 **
 **  Implements the handling of the .IDX and .DAT files for the tradindexed
-**  overview method.  The .IDX files are flat arrays of binary structs
-**  specifying the offset in the data file of the overview data for a given
-**  article as well as the length of that data and some additional meta-data
-**  about that article.  The .DAT files contain all of the overview data for
-**  that group in wire format.
+**  overview method.  The .IDX files are flat arrays of entries specifying the
+**  offset in the data file of the overview data for a given article as well
+**  as the length of that data and some additional meta-data about that
+**  article, stored either as native binary structs or in the packed format
+**  described in tdx-structure.h.  The .DAT files contain all of the overview
+**  data for that group in wire format.
 **
 **  Externally visible functions have a tdx_ prefix; internal functions do
 **  not.  (Externally visible unfortunately means everything that needs to be
@@ -55,6 +56,8 @@ static bool map_data(struct group_data *data);
 static void unmap_index(struct group_data *data);
 static void unmap_data(struct group_data *data);
 static ARTNUM index_base(ARTNUM artnum);
+static bool index_packed(const unsigned char *header, off_t length);
+static bool index_header_write(int fd);
 
 
 /*
@@ -176,12 +179,39 @@ file_open_index(struct group_data *data, const char *suffix)
         return false;
     if (fstat(data->indexfd, &st) < 0) {
         syswarn("tradindexed: cannot stat %s.%s", data->path, suffix);
-        close(data->indexfd);
-        return false;
+        goto fail;
+    }
+
+    /* A new index file gets the format configured in inn.conf; an existing
+       one keeps the format it was written in. */
+    if (st.st_size == 0 && data->writable && innconf->tradindexedpacked) {
+        if (!index_header_write(data->indexfd)) {
+            syswarn("tradindexed: cannot write header to %s.%s", data->path,
+                    suffix);
+            goto fail;
+        }
+        data->packed = true;
+    } else if (st.st_size >= TDX_PACKED_HEADER) {
+        unsigned char header[TDX_PACKED_HEADER];
+
+        if (pread(data->indexfd, header, sizeof(header), 0)
+            != sizeof(header)) {
+            syswarn("tradindexed: cannot read header of %s.%s", data->path,
+                    suffix);
+            goto fail;
+        }
+        data->packed = index_packed(header, sizeof(header));
+    } else {
+        data->packed = false;
     }
     data->indexinode = st.st_ino;
     fdflag_close_exec(data->indexfd, true);
     return true;
+
+fail:
+    close(data->indexfd);
+    data->indexfd = -1;
+    return false;
 }
 
 
@@ -217,6 +247,7 @@ tdx_data_new(const char *group, bool writable)
     data->path = group_path(group);
     data->writable = writable;
     data->remapoutoforder = false;
+    data->packed = false;
     data->high = 0;
     data->base = 0;
     data->indexfd = -1;
@@ -312,7 +343,11 @@ map_index(struct group_data *data)
         return false;
     data->indexlen = st.st_size;
     data->index = map_file(data->indexfd, data->indexlen, data->path, "IDX");
-    return (data->index == NULL && data->indexlen > 0) ? false : true;
+    if (data->index == NULL && data->indexlen > 0)
+        return false;
+    data->packed =
+        index_packed((unsigned char *) data->index, data->indexlen);
+    return true;
 }
 
 
@@ -409,17 +444,202 @@ stale_data(struct group_data *data)
 }
 
 
+/*
+**  Store a number in the given number of bytes in network byte order, and
+**  read it back.
+*/
+static void
+put_number(unsigned char *p, uint64_t value, int bytes)
+{
+    while (bytes-- > 0) {
+        p[bytes] = value & 0xff;
+        value >>= 8;
+    }
+}
+
+static uint64_t
+get_number(const unsigned char *p, int bytes)
+{
+    uint64_t value = 0;
+
+    while (bytes-- > 0)
+        value = (value << 8) | *p++;
+    return value;
+}
+
+
+/*
+**  Clamp a time to what fits in the 32 bits of a packed index entry.
+*/
+static uint64_t
+packed_time(time_t when)
+{
+    if (when < 0)
+        return 0;
+    if ((uint64_t) when > 0xffffffffUL)
+        return 0xffffffffUL;
+    return (uint64_t) when;
+}
+
+
+/*
+**  Encode an index entry in the packed format into buf, which must hold
+**  TDX_PACKED_ENTRY bytes, and decode it back.  The caller is responsible
+**  for checking that the offset and the length fit.
+*/
+static void
+entry_pack(const struct index_entry *entry, unsigned char *buf)
+{
+    put_number(buf, (uint64_t) entry->offset, 5);
+    put_number(buf + 5, (uint64_t) entry->length, 3);
+    put_number(buf + 8, packed_time(entry->arrived), 4);
+    put_number(buf + 12, packed_time(entry->expires), 4);
+    buf[16] = entry->token.type;
+    buf[17] = entry->token.class;
+    memcpy(buf + 18, entry->token.token, STORAGE_TOKEN_LENGTH);
+}
+
+static void
+entry_unpack(const unsigned char *buf, struct index_entry *entry)
+{
+    memset(entry, 0, sizeof(*entry));
+    entry->offset = (off_t) get_number(buf, 5);
+    entry->length = (int) get_number(buf + 5, 3);
+    entry->arrived = (time_t) get_number(buf + 8, 4);
+    entry->expires = (time_t) get_number(buf + 12, 4);
+    entry->token.type = buf[16];
+    entry->token.class = buf[17];
+    memcpy(entry->token.token, buf + 18, STORAGE_TOKEN_LENGTH);
+}
+
+
+/*
+**  Returns whether an index entry can be stored in a packed index file.
+*/
+static bool
+entry_packable(const struct index_entry *entry)
+{
+    return entry->offset >= 0 && entry->offset <= TDX_PACKED_MAXOFFSET
+           && entry->length >= 0 && entry->length <= TDX_PACKED_MAXLENGTH;
+}
+
+
+/*
+**  Fill in the header of a packed index file, which must hold
+**  TDX_PACKED_HEADER bytes, or write it at the start of the given file
+**  descriptor.
+*/
+static void
+index_header(unsigned char *header)
+{
+    memset(header, 0, TDX_PACKED_HEADER);
+    memcpy(header, TDX_PACKED_MAGIC, 4);
+    put_number(header + 4, TDX_PACKED_VERSION, 4);
+    put_number(header + 8, TDX_PACKED_ENTRY, 4);
+}
+
+static bool
+index_header_write(int fd)
+{
+    unsigned char header[TDX_PACKED_HEADER];
+
+    index_header(header);
+    return xpwrite(fd, header, sizeof(header), 0) >= 0;
+}
+
+
+/*
+**  Determine the format of an index file from its first bytes.  The magic
+**  string alone could be the offset of a native entry, so the whole header
+**  has to match for the file to be packed.
+*/
+static bool
+index_packed(const unsigned char *header, off_t length)
+{
+    return length >= TDX_PACKED_HEADER
+           && memcmp(header, TDX_PACKED_MAGIC, 4) == 0
+           && get_number(header + 4, 4) == TDX_PACKED_VERSION
+           && get_number(header + 8, 4) == TDX_PACKED_ENTRY
+           && get_number(header + 12, 4) == 0;
+}
+
+
+/*
+**  Return the offset in an index file in the given format of the entry for
+**  the nth article past the base.
+*/
+static off_t
+index_offset(bool packed, unsigned long n)
+{
+    if (packed)
+        return TDX_PACKED_HEADER + (off_t) n * TDX_PACKED_ENTRY;
+    else
+        return (off_t) n * sizeof(struct index_entry);
+}
+
+
+/*
+**  Return the number of entries in the mapped index file.
+*/
+static unsigned long
+index_count(const struct group_data *data)
+{
+    if (!data->packed)
+        return data->indexlen / sizeof(struct index_entry);
+    if (data->indexlen <= TDX_PACKED_HEADER)
+        return 0;
+    return (data->indexlen - TDX_PACKED_HEADER) / TDX_PACKED_ENTRY;
+}
+
+
+/*
+**  Copy the nth entry of the mapped index file into entry, decoding it if
+**  needed.  The caller must check n against index_count.
+*/
+static void
+index_read(const struct group_data *data, unsigned long n,
+           struct index_entry *entry)
+{
+    const char *p = data->index + index_offset(data->packed, n);
+
+    if (data->packed)
+        entry_unpack((const unsigned char *) p, entry);
+    else
+        memcpy(entry, p, sizeof(*entry));
+}
+
+
+/*
+**  Write entry as the nth entry of an index file in the given format.
+**  Returns false on a write error, with errno set.
+*/
+static bool
+index_write(int fd, bool packed, unsigned long n,
+            const struct index_entry *entry)
+{
+    unsigned char buf[TDX_PACKED_ENTRY];
+    off_t offset;
+
+    offset = index_offset(packed, n);
+    if (!packed)
+        return xpwrite(fd, entry, sizeof(*entry), offset) >= 0;
+    entry_pack(entry, buf);
+    return xpwrite(fd, buf, sizeof(buf), offset) >= 0;
+}
+
+
 /*
 **  Retrieves the article metainformation stored in the index table (all the
 **  stuff we can return without opening the data file).  Takes the article
-**  number and returns a pointer to the index entry.  Also takes the high
-**  water mark from the group index; this is used to decide whether to attempt
-**  remapping of the index file if the current high water mark is too low.
+**  number and fills in the provided index entry, returning false if there is
+**  no entry for that article.  Also takes the high water mark from the group
+**  index; this is used to decide whether to attempt remapping of the index
+**  file if the current high water mark is too low.
 */
-const struct index_entry *
-tdx_article_entry(struct group_data *data, ARTNUM article, ARTNUM high)
+bool
+tdx_article_entry(struct group_data *data, ARTNUM article, ARTNUM high,
+                  struct index_entry *entry)
 {
-    struct index_entry *entry;
     ARTNUM offset;
 
     if (article > data->high && high > data->high) {
@@ -432,17 +652,15 @@ tdx_article_entry(struct group_data *data, ARTNUM article, ARTNUM high)
         unmap_index(data);
     if (data->index == NULL)
         if (!map_index(data))
-            return NULL;
+            return false;
 
     if (article < data->base)
-        return NULL;
+        return false;
     offset = article - data->base;
-    if (offset >= data->indexlen / sizeof(struct index_entry))
-        return NULL;
-    entry = data->index + offset;
-    if (entry->length == 0)
-        return NULL;
-    return entry;
+    if (offset >= index_count(data))
+        return false;
+    index_read(data, offset, entry);
+    return entry->length != 0;
 }
 
 
@@ -500,23 +718,22 @@ tdx_search_open(struct group_data *data, ARTNUM start, ARTNUM end, ARTNUM high)
 bool
 tdx_search(struct search *search, struct article *artdata)
 {
-    struct index_entry *entry;
-    size_t max;
+    struct index_entry entry;
+    unsigned long count;
 
     if (search == NULL || search->data == NULL)
         return false;
     if (search->data->index == NULL || search->data->data == NULL)
         return false;
 
-    max = (search->data->indexlen / sizeof(struct index_entry)) - 1;
-    entry = search->data->index + search->current;
-    while (search->current <= search->limit && search->current <= max) {
-        if (entry->length != 0)
+    count = index_count(search->data);
+    while (search->current <= search->limit && search->current < count) {
+        index_read(search->data, search->current, &entry);
+        if (entry.length != 0)
             break;
         search->current++;
-        entry++;
     }
-    if (search->current > search->limit || search->current > max)
+    if (search->current > search->limit || search->current >= count)
         return false;
 
     /* There is a small chance that remapping the data file could make this
@@ -525,22 +742,22 @@ tdx_search(struct search *search, struct article *artdata)
        seems not to be an issue in limited testing, although write caching
        that leads to on-disk IDX and DAT being out of sync could trigger a
        problem here. */
-    if (entry->offset + entry->length > search->data->datalen) {
+    if (entry.offset + entry.length > search->data->datalen) {
         search->data->remapoutoforder = true;
         warn("Invalid or inaccessible entry for article %lu in %s.IDX:"
              " offset %lu length %lu datalength %lu",
              search->current + search->data->base, search->data->path,
-             (unsigned long) entry->offset, (unsigned long) entry->length,
+             (unsigned long) entry.offset, (unsigned long) entry.length,
              (unsigned long) search->data->datalen);
         return false;
     }
 
     artdata->number = search->current + search->data->base;
-    artdata->overview = search->data->data + entry->offset;
-    artdata->overlen = entry->length;
-    artdata->token = entry->token;
-    artdata->arrived = entry->arrived;
-    artdata->expires = entry->expires;
+    artdata->overview = search->data->data + entry.offset;
+    artdata->overlen = entry.length;
+    artdata->token = entry.token;
+    artdata->arrived = entry.arrived;
+    artdata->expires = entry.expires;
 
     search->current++;
     return true;
@@ -585,7 +802,6 @@ bool
 tdx_data_store(struct group_data *data, const struct article *article)
 {
     struct index_entry entry;
-    off_t offset;
 
     if (!data->writable)
         return false;
@@ -615,10 +831,17 @@ tdx_data_store(struct group_data *data, const struct article *article)
     entry.arrived = article->arrived;
     entry.expires = article->expires;
     entry.token = article->token;
+    if (data->packed && !entry_packable(&entry)) {
+        warn("tradindexed: offset %lu or length %lu of %lu too large for"
+             " packed %s.IDX",
+             (unsigned long) entry.offset, (unsigned long) entry.length,
+             article->number, data->path);
+        return false;
+    }
 
     /* Write out the index entry. */
-    offset = (article->number - data->base) * sizeof(struct index_entry);
-    if (xpwrite(data->indexfd, &entry, sizeof(entry), offset) < 0) {
+    if (!index_write(data->indexfd, data->packed,
+                     article->number - data->base, &entry)) {
         syswarn("tradindexed: cannot write index record for %lu in %s.IDX",
                 article->number, data->path);
         return false;
@@ -636,14 +859,13 @@ bool
 tdx_data_cancel(struct group_data *data, ARTNUM artnum)
 {
     static const struct index_entry empty;
-    off_t offset;
 
     if (!data->writable)
         return false;
     if (data->base == 0 || artnum < data->base || artnum > data->high)
         return false;
-    offset = (artnum - data->base) * sizeof(struct index_entry);
-    if (xpwrite(data->indexfd, &empty, sizeof(empty), offset) < 0) {
+    if (!index_write(data->indexfd, data->packed, artnum - data->base,
+                     &empty)) {
         syswarn("tradindexed: cannot cancel index record for %lu in %s.IDX",
                 artnum, data->path);
         return false;
@@ -666,6 +888,7 @@ tdx_data_pack_start(struct group_data *data, ARTNUM artnum)
 {
     ARTNUM base;
     unsigned long delta;
+    off_t start;
     int fd;
     char *idxfile;
     struct stat st;
@@ -693,12 +916,19 @@ tdx_data_pack_start(struct group_data *data, ARTNUM artnum)
     if (!map_index(data))
         goto fail;
 
-    /* Write the contents of the old index file to the new index file. */
-    if (lseek(fd, delta * sizeof(struct index_entry), SEEK_SET) < 0) {
+    /* Write the contents of the old index file to the new index file, which
+       keeps the format of the old one. */
+    start = index_offset(data->packed, 0);
+    if (data->packed && !index_header_write(fd)) {
+        syswarn("tradindexed: cannot write header to %s.IDX-NEW", data->path);
+        goto fail;
+    }
+    if (lseek(fd, index_offset(data->packed, delta), SEEK_SET) < 0) {
         syswarn("tradindexed: cannot seek in %s.IDX-NEW", data->path);
         goto fail;
     }
-    if (xwrite(fd, data->index, data->indexlen) < 0) {
+    if (data->indexlen > start
+        && xwrite(fd, data->index + start, data->indexlen - start) < 0) {
         syswarn("tradindexed: cannot write to %s.IDX-NEW", data->path);
         goto fail;
     }
@@ -722,6 +952,92 @@ fail:
 }
 
 
+/*
+**  Start the conversion of the index file of a group to the packed format or
+**  back to the native format.  The article base doesn't change.  Returns true
+**  on success and false on failure, and sets data->indexinode to the new
+**  inode number.  As with tdx_data_pack_start, the new index file is moved
+**  into place by tdx_data_pack_finish.
+*/
+bool
+tdx_data_convert_start(struct group_data *data, bool packed)
+{
+    struct index_entry entry;
+    unsigned long count, n;
+    size_t size;
+    char *index = NULL;
+    char *idxfile;
+    struct stat st;
+    int fd = -1;
+
+    if (!data->writable)
+        return false;
+    unmap_index(data);
+    if (!map_index(data))
+        return false;
+
+    /* Build the new index in memory, leaving deleted entries zeroed. */
+    count = index_count(data);
+    size = index_offset(packed, count);
+    if (size > 0)
+        index = xcalloc(1, size);
+    if (packed)
+        index_header((unsigned char *) index);
+    for (n = 0; n < count; n++) {
+        index_read(data, n, &entry);
+        if (entry.length == 0)
+            continue;
+        if (!packed)
+            memcpy(index + index_offset(packed, n), &entry, sizeof(entry));
+        else if (entry_packable(&entry))
+            entry_pack(&entry,
+                       (unsigned char *) index + index_offset(packed, n));
+        else {
+            warn("tradindexed: offset %lu or length %lu of %lu too large for"
+                 " packed %s.IDX",
+                 (unsigned long) entry.offset, (unsigned long) entry.length,
+                 data->base + n, data->path);
+            goto fail;
+        }
+    }
+
+    /* Write it out to a fresh new index file. */
+    idxfile = concat(data->path, ".IDX-NEW", (char *) 0);
+    if (unlink(idxfile) < 0 && errno != ENOENT)
+        syswarn("tradindexed: cannot unlink %s", idxfile);
+    free(idxfile);
+    fd = file_open(data->path, "IDX-NEW", true, false);
+    if (fd < 0)
+        goto fail;
+    if (fstat(fd, &st) < 0) {
+        syswarn("tradindexed: cannot stat %s.IDX-NEW", data->path);
+        goto fail;
+    }
+    if (size > 0 && xwrite(fd, index, size) < 0) {
+        syswarn("tradindexed: cannot write to %s.IDX-NEW", data->path);
+        goto fail;
+    }
+    if (close(fd) < 0) {
+        syswarn("tradindexed: cannot close %s.IDX-NEW", data->path);
+        goto fail;
+    }
+    free(index);
+    data->indexinode = st.st_ino;
+    return true;
+
+fail:
+    free(index);
+    if (fd >= 0) {
+        close(fd);
+        idxfile = concat(data->path, ".IDX-NEW", (char *) 0);
+        if (unlink(idxfile) < 0)
+            syswarn("tradindexed: cannot unlink %s", idxfile);
+        free(idxfile);
+    }
+    return false;
+}
+
+
 /*
 **  Finish the process of packing a group by replacing the new index with the
 **  old index.  Also reopen the index file and update indexinode to keep our
@@ -957,36 +1273,35 @@ tdx_data_delete(const char *group, const char *suffix)
 void
 tdx_data_index_dump(struct group_data *data, FILE *output)
 {
-    ARTNUM current;
-    struct index_entry *entry, *end;
+    struct index_entry entry;
+    unsigned long count, n;
 
     if (data->index == NULL)
         if (!map_index(data))
             return;
 
-    current = data->base;
-    end = data->index + (data->indexlen / sizeof(struct index_entry));
-    for (entry = data->index; entry < end; entry++) {
-        fprintf(output, "%lu %lu %lu %lu %lu %s\n", current,
-                (unsigned long) entry->offset, (unsigned long) entry->length,
-                (unsigned long) entry->arrived, (unsigned long) entry->expires,
-                TokenToText(entry->token));
-        current++;
+    count = index_count(data);
+    for (n = 0; n < count; n++) {
+        index_read(data, n, &entry);
+        fprintf(output, "%lu %lu %lu %lu %lu %s\n", data->base + n,
+                (unsigned long) entry.offset, (unsigned long) entry.length,
+                (unsigned long) entry.arrived, (unsigned long) entry.expires,
+                TokenToText(entry.token));
     }
 }
 
 
 /*
-**  Audit a specific index entry for a particular article.  If there's
-**  anything wrong with it, we delete it; to repair a particular group, it's
-**  best to just regenerate it from scratch.
+**  Audit a specific index entry for a particular article, the nth one in
+**  the index file.  If there's anything wrong with it, we delete it (and
+**  clear the length in entry); to repair a particular group, it's best to
+**  just regenerate it from scratch.
 */
 static void
 entry_audit(struct group_data *data, struct index_entry *entry,
-            const char *group, ARTNUM article, bool fix)
+            unsigned long n, const char *group, ARTNUM article, bool fix)
 {
     struct index_entry new_entry;
-    off_t offset;
 
     if (entry->length < 0) {
         warn("tradindexed: negative length %d in %s:%lu", entry->length, group,
@@ -1024,9 +1339,10 @@ clear:
     new_entry = *entry;
     new_entry.offset = 0;
     new_entry.length = 0;
-    offset = (entry - data->index) * sizeof(struct index_entry);
-    if (xpwrite(data->indexfd, &new_entry, sizeof(new_entry), offset) != 0)
+    if (!index_write(data->indexfd, data->packed, n, &new_entry))
         warn("tradindexed: unable to repair %s:%lu", group, article);
+    else
+        *entry = new_entry;
 }
 
 
@@ -1039,7 +1355,7 @@ void
 tdx_data_audit(const char *group, struct group_entry *index, bool fix)
 {
     struct group_data *data;
-    struct index_entry *entry;
+    struct index_entry entry;
     long count;
     off_t expected;
     unsigned long entries, current;
@@ -1066,8 +1382,8 @@ tdx_data_audit(const char *group, struct group_entry *index, bool fix)
     }
 
     /* Check the index size. */
-    entries = data->indexlen / sizeof(struct index_entry);
-    expected = entries * sizeof(struct index_entry);
+    entries = index_count(data);
+    expected = index_offset(data->packed, entries);
     if (data->indexlen != expected) {
         warn("tradindexed: %lu bytes of trailing trash in %s.IDX",
              (unsigned long) (data->indexlen - expected), data->path);
@@ -1085,11 +1401,11 @@ tdx_data_audit(const char *group, struct group_entry *index, bool fix)
        the count in the index and verify that the low water mark is
        correct. */
     for (current = 0, count = 0; current < entries; current++) {
-        entry = &data->index[current];
-        if (entry->length == 0)
+        index_read(data, current, &entry);
+        if (entry.length == 0)
             continue;
-        entry_audit(data, entry, group, index->base + current, fix);
-        if (entry->length != 0) {
+        entry_audit(data, &entry, current, group, index->base + current, fix);
+        if (entry.length != 0) {
             if (low == 0)
                 low = index->base + current;
             count++;
@@ -1012,6 +1012,14 @@ struct audit_data {
     bool fix;
 };
 
+/* Holds information needed by hash traversal functions when converting the
+   index files of all groups. */
+struct convert_data {
+    struct group_index *index;
+    bool packed;
+    bool status;
+};
+
 
 /*
 **  Hash table functions for the mapping from group hashes to names.
@@ -1455,3 +1463,103 @@ tdx_index_audit(bool fix)
     }
     hash_free(hashmap);
 }
+
+
+/*
+**  Convert the index file of a single group to the packed or native format.
+**  The group is locked the same way as for a repack while the new index file
+**  is built and moved into place.
+*/
+static bool
+index_convert_group(struct group_index *index, const char *group, bool packed)
+{
+    struct group_entry *entry;
+    struct group_data *data;
+    ptrdiff_t offset;
+    ino_t old_inode;
+    bool status = false;
+
+    entry = tdx_index_entry(index, group);
+    if (entry == NULL) {
+        warn("tradindexed: cannot find group %s", group);
+        return false;
+    }
+    offset = entry - index->entries;
+    index_lock_group(index->fd, offset, INN_LOCK_WRITE);
+    data = tdx_data_new(group, true);
+    if (!tdx_data_open_files(data))
+        goto done;
+    data->base = entry->base;
+    if (data->packed == packed) {
+        status = true;
+        goto done;
+    }
+    if (!tdx_data_convert_start(data, packed))
+        goto done;
+    old_inode = entry->indexinode;
+    entry->indexinode = data->indexinode;
+    inn_msync_page(entry, sizeof(*entry), MS_ASYNC);
+    if (!tdx_data_pack_finish(data)) {
+        entry->indexinode = old_inode;
+        inn_msync_page(entry, sizeof(*entry), MS_ASYNC);
+        goto done;
+    }
+    status = true;
+
+done:
+    tdx_data_close(data);
+    index_lock_group(index->fd, offset, INN_LOCK_UNLOCK);
+    return status;
+}
+
+
+/*
+**  Called by hash_traverse to convert each group in the active file that has
+**  overview data.
+*/
+static void
+index_convert_active(void *value, void *cookie)
+{
+    struct hashmap *group = value;
+    struct convert_data *data = cookie;
+
+    if (tdx_index_entry(data->index, group->name) == NULL)
+        return;
+    if (!index_convert_group(data->index, group->name, data->packed))
+        data->status = false;
+}
+
+
+/*
+**  Convert the index files of a group, or of all the groups in the active
+**  file if group is NULL, to the packed format if packed is true and to the
+**  native format otherwise.  Returns false if any group failed.
+*/
+bool
+tdx_index_convert(const char *group, bool packed)
+{
+    struct group_index *index;
+    struct hash *hashmap;
+    struct convert_data data;
+
+    index = tdx_index_open(true);
+    if (index == NULL)
+        return false;
+    if (group != NULL)
+        data.status = index_convert_group(index, group, packed);
+    else {
+        hashmap = hashmap_load();
+        if (hashmap == NULL) {
+            warn("tradindexed: cannot hash active file");
+            tdx_index_close(index);
+            return false;
+        }
+        data.index = index;
+        data.packed = packed;
+        data.status = true;
+        hash_traverse(hashmap, index_convert_active, &data);
+        hash_free(hashmap);
+    }
+    tdx_index_close(index);
+    return data.status;
+}
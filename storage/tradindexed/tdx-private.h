@@ -14,6 +14,8 @@
 
 /* Forward declarations to avoid unnecessary includes. */
 struct history;
+struct index_entry;
+struct ovcachestats;
 
 /* Opaque data structure used by the cache. */
 struct cache;
@@ -29,11 +31,12 @@ struct group_data {
     char *path;
     bool writable;
     bool remapoutoforder;
+    bool packed;
     ARTNUM high;
     ARTNUM base;
     int indexfd;
     int datafd;
-    struct index_entry *index;
+    char *index;
     char *data;
     off_t indexlen;
     off_t datalen;
@@ -70,6 +73,9 @@ void tdx_cache_insert(struct cache *, HASH, struct group_data *);
 /* Delete a group entry from the cache. */
 void tdx_cache_delete(struct cache *, HASH);
 
+/* Return the size, hit and eviction statistics of the cache. */
+void tdx_cache_stats(struct cache *, struct ovcachestats *);
+
 /* Free the cache and its resources. */
 void tdx_cache_free(struct cache *);
 
@@ -119,6 +125,10 @@ bool tdx_index_rebuild_finish(struct group_index *, struct group_entry *,
 /* Expire a single group. */
 bool tdx_expire(const char *group, ARTNUM *low, struct history *);
 
+/* Convert the index files of a group, or of all groups in the active file if
+   group is NULL, to the packed or native format. */
+bool tdx_index_convert(const char *group, bool packed);
+
 
 /* tdx-data.c */
 
@@ -129,8 +139,8 @@ struct group_data *tdx_data_new(const char *group, bool writable);
 bool tdx_data_open_files(struct group_data *);
 
 /* Return the metadata about a particular article in a group. */
-const struct index_entry *tdx_article_entry(struct group_data *,
-                                            ARTNUM article, ARTNUM high);
+bool tdx_article_entry(struct group_data *, ARTNUM article, ARTNUM high,
+                       struct index_entry *);
 
 /* Create, perform, and close a search. */
 struct search *tdx_search_open(struct group_data *, ARTNUM start, ARTNUM end,
@@ -147,6 +157,10 @@ bool tdx_data_cancel(struct group_data *, ARTNUM);
 /* Start a repack of the files for a newsgroup. */
 bool tdx_data_pack_start(struct group_data *, ARTNUM);
 
+/* Start the conversion of the index file for a newsgroup to the packed or
+   native format.  Complete with tdx_data_pack_finish. */
+bool tdx_data_convert_start(struct group_data *, bool packed);
+
 /* Complete a repack of the files for a newsgroup. */
 bool tdx_data_pack_finish(struct group_data *);
 
@@ -2,10 +2,11 @@
 **  Data structures for the tradindexed overview method.
 **
 **  This header defines the data structures used by the tradindexed overview
-**  method.  Currently, these data structures are read and written directly to
-**  disk (and the disk files are therefore endian-dependent and possibly
-**  architecture-dependent due to structure padding).  This will eventually be
-**  fixed.
+**  method.  The group.index file and the native .IDX files are read and
+**  written directly to disk as these structs (and are therefore
+**  endian-dependent and possibly architecture-dependent due to structure
+**  padding).  The packed .IDX format described at the end of this file is
+**  architecture-independent.
 **
 **  The structure of a tradindexed overview spool is as follows: At the root
 **  of the spool is a group.index file composed of a struct group_header
@@ -41,6 +42,19 @@
 **  of the group_entry for that newsgroup in the group.index file and each
 **  entry stores the data for the next consecutive article.  Index entries may
 **  be tagged as deleted if that article has been deleted or expired.
+**
+**  A .IDX file may instead be in the packed format, selected for new files by
+**  the tradindexedpacked parameter in inn.conf.  A packed .IDX file starts
+**  with a header of TDX_PACKED_HEADER bytes (the TDX_PACKED_MAGIC string, then
+**  the format version and the size of an entry as 32-bit big-endian numbers,
+**  then four reserved bytes) followed by fixed-size big-endian entries
+**  addressed like the native ones.  The magic string alone could start a
+**  native entry (on a little-endian host, it reads as an offset of about
+**  1.48GB), so a .IDX file is only taken as packed if its whole header
+**  matches: the magic string, the version and entry size this code knows,
+**  and zero reserved bytes.  As a native entry, that header would also need
+**  an offset past 2^56 or a 16MB overview line.  Any other .IDX file is
+**  native.
 */
 
 #ifndef INN_TDX_STRUCTURE_H
@@ -125,4 +139,17 @@ struct index_entry {
     TOKEN token;
 };
 
+/* The packed .IDX format.  Each entry is, in order and in network byte order,
+   the offset of the data in the .DAT file (40 bits), its length (24 bits),
+   the arrival time and the expiration time (32 bits each, as unsigned
+   seconds since epoch), and the token type, class and 16 bytes of token.
+   An entry with a zero length is deleted, so holes in the file read as
+   deleted entries just like in the native format. */
+#define TDX_PACKED_MAGIC     "\377TDX"
+#define TDX_PACKED_VERSION   1
+#define TDX_PACKED_HEADER    16
+#define TDX_PACKED_ENTRY     (16 + 2 + STORAGE_TOKEN_LENGTH)
+#define TDX_PACKED_MAXOFFSET (((off_t) 1 << 40) - 1)
+#define TDX_PACKED_MAXLENGTH ((1 << 24) - 1)
+
 #endif /* INN_TDX_STRUCTURE_H */
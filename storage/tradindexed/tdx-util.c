@@ -436,6 +436,7 @@ main(int argc, char *argv[])
     char mode = '\0';
     const char *newsgroup = NULL;
     const char *path = NULL;
+    bool packed = false;
     ARTNUM artlow = 0;
     ARTNUM arthigh = 0;
 
@@ -446,7 +447,7 @@ main(int argc, char *argv[])
 
     /* Parse options. */
     opterr = 0;
-    while ((option = getopt(argc, argv, "a:f:n:p:AFR:cgiOo")) != EOF) {
+    while ((option = getopt(argc, argv, "a:f:n:p:AC:FR:cgiOo")) != EOF) {
         switch (option) {
         case 'a':
             if (!parse_range(optarg, &artlow, &arthigh))
@@ -466,6 +467,15 @@ main(int argc, char *argv[])
                 die("only one mode option allowed");
             mode = 'A';
             break;
+        case 'C':
+            if (mode != '\0')
+                die("only one mode option allowed");
+            mode = 'C';
+            if (strcmp(optarg, "packed") == 0)
+                packed = true;
+            else if (strcmp(optarg, "native") != 0)
+                die("invalid index format %s", optarg);
+            break;
         case 'F':
             if (mode != '\0')
                 die("only one mode option allowed");
@@ -517,6 +527,12 @@ main(int argc, char *argv[])
     case 'A':
         tdx_index_audit(false);
         break;
+    case 'C':
+        if (getenv("INN_TESTSUITE") == NULL)
+            ensure_news_user_grp(true, true);
+        if (!tdx_index_convert(newsgroup, packed))
+            die("cannot convert all index files");
+        break;
     case 'F':
         if (getenv("INN_TESTSUITE") == NULL)
             ensure_news_user_grp(true, true);
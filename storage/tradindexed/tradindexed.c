@@ -90,16 +90,19 @@ tradindexed_open(int mode)
     tradindexed->index = tdx_index_open((mode & OV_WRITE) ? true : false);
     tradindexed->cutoff = false;
 
-    /* Use a cache size of two for read-only connections.  We may want to
-       rethink the limitation of the cache for reading later based on
-       real-world experience. */
-    cache_size = (mode & OV_WRITE) ? innconf->overcachesize : 1;
+    /* Readers and writers have separate cache sizes, since a writer like
+       innd may have to keep thousands of newsgroups open while a reader
+       usually works on one newsgroup at a time. */
+    cache_size = (mode & OV_WRITE) ? innconf->overcachesize
+                                   : innconf->overcachereadersize;
     fdlimit = getfdlimit();
     if (fdlimit > 0 && fdlimit < cache_size * 2) {
         warn("tradindexed: not enough file descriptors for an overview cache"
-             " size of %lu; increase rlimitnofile or decrease overcachesize"
+             " size of %lu; increase rlimitnofile or decrease %s"
              " to at most %lu",
-             cache_size, fdlimit / 2);
+             cache_size,
+             (mode & OV_WRITE) ? "overcachesize" : "overcachereadersize",
+             fdlimit / 2);
         cache_size = (fdlimit > 2) ? fdlimit / 2 : 1;
     }
     tradindexed->cache = tdx_cache_create(cache_size);
@@ -316,7 +319,7 @@ tradindexed_getartinfo(const char *group, ARTNUM artnum, TOKEN *token)
 {
     struct group_entry *entry;
     struct group_data *data;
-    const struct index_entry *index_entry;
+    struct index_entry index_entry;
 
     if (tradindexed == NULL || tradindexed->index == NULL) {
         warn("tradindexed: overview method not initialized");
@@ -334,11 +337,10 @@ tradindexed_getartinfo(const char *group, ARTNUM artnum, TOKEN *token)
             if (data == NULL)
                 return false;
         }
-    index_entry = tdx_article_entry(data, artnum, entry->high);
-    if (index_entry == NULL)
+    if (!tdx_article_entry(data, artnum, entry->high, &index_entry))
         return false;
     if (token != NULL)
-        *token = index_entry->token;
+        *token = index_entry.token;
     return true;
 }
 
@@ -402,6 +404,11 @@ tradindexed_ctl(OVCTLTYPE type, void *val)
         b = (bool *) val;
         *b = false;
         return true;
+    case OVCACHESTATS:
+        if (tradindexed->cache == NULL)
+            return false;
+        tdx_cache_stats(tradindexed->cache, val);
+        return true;
     default:
         return false;
     }
@@ -80,6 +80,9 @@ static bool NGTableUpdated; /* set to true if we've added any entries since
 
 static char *TokenToPath(TOKEN token);
 
+/* Path of the article a resumed walk starts at, until it is reached. */
+static char *ResumePath = NULL;
+
 /*
 ** Convert all .s to /s in a newsgroup name.  Modifies the passed string
 ** inplace.
@@ -1092,6 +1095,44 @@ FindDir(DIR *dir, char *dirname)
     return NULL;
 }
 
+/*
+**  Whether a newsgroup directory is the one of the article to start at when
+**  resuming a walk.  The other ones are skipped without reading them.
+*/
+static bool
+ResumedGroup(const char *dirname)
+{
+    size_t length;
+
+    if (ResumePath == NULL)
+        return true;
+    length = strlen(dirname);
+    return strncmp(ResumePath, dirname, length) == 0
+           && ResumePath[length] == '/'
+           && strchr(ResumePath + length + 1, '/') == NULL;
+}
+
+/*
+**  Find the next article in a newsgroup directory, skipping the ones before
+**  the article to start at when resuming.
+*/
+static struct dirent *
+FindArt(DIR *dir, char *dirname)
+{
+    struct dirent *de;
+
+    while ((de = FindDir(dir, dirname)) != NULL) {
+        if (ResumePath == NULL)
+            return de;
+        if (strcmp(strrchr(ResumePath, '/') + 1, de->d_name) == 0) {
+            free(ResumePath);
+            ResumePath = NULL;
+            return de;
+        }
+    }
+    return NULL;
+}
+
 ARTHANDLE *
 tradspool_next(ARTHANDLE *article, const RETRTYPE amount)
 {
@@ -1108,12 +1149,17 @@ tradspool_next(ARTHANDLE *article, const RETRTYPE amount)
     unsigned int numxrefs;
     STORAGE_SUB *sub;
     size_t length;
+    const TOKEN *resume;
 
     if (article == NULL) {
         priv.ngtp = NULL;
         priv.curdir = NULL;
         priv.curdirname = NULL;
         priv.nextindex = -1;
+        free(ResumePath);
+        ResumePath = NULL;
+        if ((resume = SMresumepoint(TOKEN_TRADSPOOL)) != NULL)
+            ResumePath = TokenToPath(*resume);
     } else {
         priv = *(PRIV_TRADSPOOL *) article->private;
         free(article->private);
@@ -1127,7 +1173,7 @@ tradspool_next(ARTHANDLE *article, const RETRTYPE amount)
     }
 
     while (!priv.curdir
-           || ((de = FindDir(priv.curdir, priv.curdirname)) == NULL)) {
+           || ((de = FindArt(priv.curdir, priv.curdirname)) == NULL)) {
         if (priv.curdir) {
             closedir(priv.curdir);
             priv.curdir = NULL;
@@ -1147,13 +1193,20 @@ tradspool_next(ARTHANDLE *article, const RETRTYPE amount)
                 /* ran off the end of the table, so return. */
                 return NULL;
             }
+            /* Newsgroups are walked in parts by hash chain. */
             priv.ngtp = NGTable[priv.nextindex];
-            if (priv.ngtp != NULL)
+            if (priv.ngtp != NULL && SMpartitioned(priv.nextindex))
                 break;
+            priv.ngtp = NULL;
         }
 
         priv.curdirname = concatpath(innconf->patharticles, priv.ngtp->ngname);
-        priv.curdir = opendir(priv.curdirname);
+        if (ResumedGroup(priv.curdirname))
+            priv.curdir = opendir(priv.curdirname);
+        else {
+            free(priv.curdirname);
+            priv.curdirname = NULL;
+        }
     }
 
     path = concatpath(priv.curdirname, de->d_name);
@@ -1173,6 +1226,13 @@ tradspool_next(ARTHANDLE *article, const RETRTYPE amount)
         art->groupslen = 0;
         newpriv = (PRIV_TRADSPOOL *) art->private;
         newpriv->artbase = NULL;
+    } else if (art->private == NULL) {
+        /* RETR_STAT doesn't read the article, so there is no header field
+           to look at. */
+        art->private = xcalloc(1, sizeof(PRIV_TRADSPOOL));
+        art->expires = 0;
+        art->groups = NULL;
+        art->groupslen = 0;
     } else {
         /* Skip linked (not symlinked) crossposted articles.
 
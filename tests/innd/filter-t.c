@@ -0,0 +1,303 @@
+/* Test suite for the article filter workers of innd. */
+
+#define LIBTEST_NEW_FORMAT 1
+
+#include "portable/system.h"
+#include "portable/socket.h"
+
+#include <fcntl.h>
+#ifdef HAVE_SYS_SELECT_H
+#    include <sys/select.h>
+#endif
+#ifdef HAVE_SYS_TIME_H
+#    include <sys/time.h>
+#endif
+#include <time.h>
+
+#include "inn/buffer.h"
+#include "inn/fdflag.h"
+#include "inn/innconf.h"
+#include "inn/libinn.h"
+#include "inn/messages.h"
+#include "tap/basic.h"
+
+#include "../../innd/innd.h"
+
+#if DO_PERL
+#    include "innperl.h"
+
+/* The filter rejects every article, with a message giving its Subject, its
+   number of lines and the process that ran it.  Some subjects make it hang
+   or kill the worker running it. */
+static const char filter[] = "\
+sub filter_art {\n\
+    my $subject = $hdr{'Subject'};\n\
+    sleep 10 if $subject eq 'sleep';\n\
+    kill 'KILL', $$ if $subject eq 'crash';\n\
+    return \"$subject, $hdr{'__LINES__'} lines, by $$\";\n\
+}\n\
+1;\n";
+
+/* Initialize things enough to be able to run the filter workers and feed
+   articles to an NNTP channel. */
+static void
+initialize(void)
+{
+    FILE *f;
+
+    if (access("../data/etc/inn.conf", F_OK) < 0)
+        if (access("data/etc/inn.conf", F_OK) == 0)
+            if (chdir("innd") != 0)
+                sysbail("cannot cd to innd");
+    if (!innconf_read("../data/etc/inn.conf"))
+        exit(1);
+    innconf->artcutoff = 0;
+    innconf->filterworkers = 1;
+    innconf->filterworkertimeout = 1;
+    innconf->filterworkerreject = true;
+    innconf->maxcmdreadsize = 0;
+    innconf->remembertrash = false;
+    Log = fopen("filter-tmp.log", "w");
+    if (Log == NULL)
+        sysbail("cannot create filter-tmp.log");
+    CHANsetup(32);
+    gettimeofday(&Now, NULL);
+    buffer_set(&Path, "test.example.org!", strlen("test.example.org!") + 1);
+    ARTsetup();
+
+    f = fopen("filter-tmp.pl", "w");
+    if (f == NULL || fputs(filter, f) == EOF || fclose(f) == EOF)
+        sysbail("cannot write filter-tmp.pl");
+    PERLsetup(NULL, (char *) "./filter-tmp.pl", "filter_art");
+    PLxsinit();
+    PerlFilter(true);
+    unlink("filter-tmp.pl");
+    if (!PerlFilterActive)
+        bail("cannot load the Perl filter");
+}
+
+/* Append a TAKETHIS command for an article with the given subject to
+   commands. */
+static void
+takethis(struct buffer *commands, int n, const char *subject)
+{
+    char date[64];
+    time_t now;
+
+    now = time(NULL);
+    strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S +0000",
+             gmtime(&now));
+    buffer_append_sprintf(commands,
+                          "TAKETHIS <%d@example.com>\r\n"
+                          "Path: news.example.com!not-for-mail\r\n"
+                          "From: Test <test@example.com>\r\n"
+                          "Newsgroups: example.test\r\n"
+                          "Subject: %s\r\n"
+                          "Date: %s\r\n"
+                          "Message-ID: <%d@example.com>\r\n"
+                          "\r\n"
+                          "First line.\r\n"
+                          "Second line.\r\n"
+                          ".\r\n",
+                          n, subject, date, n);
+}
+
+/* Run the main loop of innd for the channels at hand until count replies
+   came back from the channel cp, or for at most 5 seconds.  Replies are
+   read from fd and appended to replies. */
+static void
+run(CHANNEL *cp, int fd, int count, struct buffer *replies)
+{
+    fd_set readers;
+    struct timeval timeout;
+    CHANNEL *wp;
+    char data[4096];
+    ssize_t status;
+    int i, lines, maxfd;
+    time_t end;
+
+    end = time(NULL) + 5;
+    for (;;) {
+        lines = 0;
+        for (i = 0; (size_t) i < replies->left; i++)
+            if (replies->data[replies->used + i] == '\n')
+                lines++;
+        if (lines >= count || time(NULL) > end)
+            return;
+
+        /* Wake the parked channel if it waited too long, as the main loop
+           does. */
+        gettimeofday(&Now, NULL);
+        if (CHANsleeping(cp) && cp->Waketime <= Now.tv_sec) {
+            SCHANremove(cp);
+            (*cp->Waker)(cp);
+        }
+
+        /* Send the requests to the workers, which are small enough to be
+           written at once, and hand their replies to innd. */
+        for (i = 0; (wp = CHANiter(&i, CTfilter)) != NULL;)
+            if (wp->Out.left > 0)
+                WCHANflush(wp);
+        FD_ZERO(&readers);
+        FD_SET(fd, &readers);
+        maxfd = fd;
+        for (i = 0; (wp = CHANiter(&i, CTfilter)) != NULL;) {
+            FD_SET(wp->fd, &readers);
+            if (wp->fd > maxfd)
+                maxfd = wp->fd;
+        }
+        timeout.tv_sec = 0;
+        timeout.tv_usec = 100 * 1000;
+        if (select(maxfd + 1, &readers, NULL, NULL, &timeout) < 0)
+            sysbail("cannot select");
+        for (i = 0; (wp = CHANiter(&i, CTfilter)) != NULL;)
+            if (FD_ISSET(wp->fd, &readers))
+                (*wp->Reader)(wp);
+        status = read(fd, data, sizeof(data));
+        if (status > 0)
+            buffer_append(replies, data, status);
+    }
+}
+
+/* The reply to TAKETHIS only gives the message-ID, so look for the reason
+   an article was rejected in the article log.  Returns it in a static
+   buffer, or the empty string if the article is not logged. */
+static const char *
+verdict(int n)
+{
+    static char line[1024];
+    char mid[64];
+    const char *p;
+    FILE *f;
+
+    fflush(Log);
+    snprintf(mid, sizeof(mid), " <%d@example.com> ", n);
+    f = fopen("filter-tmp.log", "r");
+    if (f == NULL)
+        sysbail("cannot open filter-tmp.log");
+    while (fgets(line, sizeof(line), f) != NULL) {
+        p = strstr(line, mid);
+        if (p != NULL) {
+            fclose(f);
+            line[strcspn(line, "\n")] = '\0';
+            return p + strlen(mid);
+        }
+    }
+    fclose(f);
+    return "";
+}
+
+/* Return the process ID a verdict says the filter ran in, or 0. */
+static long
+filtered_by(const char *verdict)
+{
+    const char *p;
+
+    p = strstr(verdict, " by ");
+    return (p == NULL) ? 0 : strtol(p + 4, NULL, 10);
+}
+
+int
+main(void)
+{
+    int fds[2];
+    CHANNEL *cp;
+    struct buffer *commands, *replies;
+    long pid;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+        sysbail("cannot create socket pair");
+    initialize();
+    message_handlers_warn(0);
+    message_handlers_notice(0);
+    plan(13);
+
+    FILTERsetup();
+    cp = NCcreate(fds[0], false, true);
+    if (cp == NULL)
+        bail("cannot create the channel");
+    cp->Streaming = true;
+    fdflag_nonblocking(fds[1], true);
+    commands = buffer_new();
+    replies = buffer_new();
+
+    /* Two pipelined articles are filtered by a worker, one after the other,
+       and answered in order with the verdict the worker sent. */
+    takethis(commands, 1, "first");
+    takethis(commands, 2, "second");
+    if (xwrite(fds[1], commands->data, commands->left) < 0)
+        sysbail("cannot write commands");
+    (*cp->Reader)(cp);
+    is_int(CSfilter, cp->State, "channel parked for the worker");
+    run(cp, fds[1], 2, replies);
+    buffer_append(replies, "", 1);
+    is_string("439 <1@example.com>\r\n439 <2@example.com>\r\n",
+              replies->data, "both articles rejected in order");
+    ok(strncmp(verdict(1), "439 first, 2 lines, by ", 23) == 0,
+       "...with the verdict of the filter");
+    ok(strncmp(verdict(2), "439 second, 2 lines, by ", 24) == 0,
+       "...for each of them");
+    pid = filtered_by(verdict(1));
+    ok(pid != 0 && pid != (long) getpid(), "...run by a worker");
+
+    /* A worker taking too long is killed, and the article is rejected. */
+    buffer_set(commands, NULL, 0);
+    buffer_set(replies, NULL, 0);
+    takethis(commands, 3, "sleep");
+    if (xwrite(fds[1], commands->data, commands->left) < 0)
+        sysbail("cannot write commands");
+    (*cp->Reader)(cp);
+    run(cp, fds[1], 1, replies);
+    buffer_append(replies, "", 1);
+    is_string("439 <3@example.com>\r\n", replies->data,
+              "article rejected on a verdict timeout");
+    is_string("439 Filter timeout", verdict(3), "...with the reason");
+    is_int(CSgetcmd, cp->State, "...and the channel resumed");
+
+    /* A worker dying on an article gets it rejected too. */
+    buffer_set(commands, NULL, 0);
+    buffer_set(replies, NULL, 0);
+    takethis(commands, 4, "crash");
+    if (xwrite(fds[1], commands->data, commands->left) < 0)
+        sysbail("cannot write commands");
+    (*cp->Reader)(cp);
+    run(cp, fds[1], 1, replies);
+    buffer_append(replies, "", 1);
+    is_string("439 <4@example.com>\r\n", replies->data,
+              "article rejected when its worker dies");
+    is_string("439 Filter worker died", verdict(4), "...with the reason");
+
+    /* And a new worker is started for the next article. */
+    buffer_set(commands, NULL, 0);
+    buffer_set(replies, NULL, 0);
+    takethis(commands, 5, "after");
+    if (xwrite(fds[1], commands->data, commands->left) < 0)
+        sysbail("cannot write commands");
+    (*cp->Reader)(cp);
+    run(cp, fds[1], 1, replies);
+    ok(strncmp(verdict(5), "439 after, 2 lines, by ", 23) == 0,
+       "verdict from a restarted worker");
+    ok(filtered_by(verdict(5)) != pid, "...which is a new process");
+    ok(filtered_by(verdict(5)) != (long) getpid(), "...and not innd itself");
+
+    FILTERclose();
+    ARTclose();
+    CHANclose(cp, CHANname(cp));
+    close(fds[1]);
+    buffer_free(commands);
+    buffer_free(replies);
+    fclose(Log);
+    unlink("filter-tmp.log");
+    return 0;
+}
+
+#else /* !DO_PERL */
+
+int
+main(void)
+{
+    skip_all("Perl filter support not built");
+    return 0;
+}
+
+#endif /* !DO_PERL */
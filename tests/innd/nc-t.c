@@ -0,0 +1,161 @@
+/* Test suite for the replies to pipelined streaming commands. */
+
+#define LIBTEST_NEW_FORMAT 1
+
+#include "portable/system.h"
+#include "portable/socket.h"
+
+#include <fcntl.h>
+#ifdef HAVE_SYS_TIME_H
+#    include <sys/time.h>
+#endif
+
+#include "inn/buffer.h"
+#include "inn/fdflag.h"
+#include "inn/innconf.h"
+#include "inn/libinn.h"
+#include "inn/messages.h"
+#include "tap/basic.h"
+
+#include "../../innd/innd.h"
+
+/* Should match NC_BATCH_SIZE in innd/nc.c. */
+#define BATCH_SIZE 4096
+
+/* Initialize things enough to be able to create NNTP channels. */
+static void
+initialize(void)
+{
+    if (access("../data/etc/inn.conf", F_OK) < 0)
+        if (access("data/etc/inn.conf", F_OK) == 0)
+            if (chdir("innd") != 0)
+                sysbail("cannot cd to innd");
+    if (!innconf_read("../data/etc/inn.conf"))
+        exit(1);
+    innconf->maxcmdreadsize = 0;
+    Log = fopen("/dev/null", "w");
+    if (Log == NULL)
+        sysbail("cannot open /dev/null");
+    CHANsetup(32);
+    gettimeofday(&Now, NULL);
+}
+
+/* Send count CHECK commands to the channel in one go, and let it process
+   them.  The reply we expect is appended to expected. */
+static void
+send_checks(CHANNEL *cp, int fd, int count, struct buffer *expected)
+{
+    struct buffer *commands;
+    int i;
+
+    commands = buffer_new();
+    for (i = 0; i < count; i++) {
+        buffer_append_sprintf(commands, "CHECK <%d@example.com>\r\n", i);
+        if (cp->Streaming)
+            buffer_append_sprintf(expected, "%d <%d@example.com> %s\r\n",
+                                  NNTP_FAIL_CHECK_DEFER, i, ModeReason);
+    }
+    if (write(fd, commands->data, commands->left) != (ssize_t) commands->left)
+        sysbail("cannot write commands");
+    buffer_free(commands);
+    cp->Reader(cp);
+}
+
+/* Read all the replies waiting on fd, appending them to replies.  Since fd
+   preserves the boundaries of the writes, return how many writes were
+   needed for them, and store in largest the size of the largest one. */
+static int
+read_replies(int fd, struct buffer *replies, size_t *largest)
+{
+    char data[64 * 1024];
+    ssize_t status;
+    int writes = 0;
+
+    *largest = 0;
+    while ((status = read(fd, data, sizeof(data))) > 0) {
+        buffer_append(replies, data, status);
+        if ((size_t) status > *largest)
+            *largest = status;
+        writes++;
+    }
+    if (status < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+        sysbail("cannot read replies");
+    return writes;
+}
+
+/* Return whether both buffers hold the same data. */
+static bool
+same_data(const struct buffer *one, const struct buffer *two)
+{
+    return one->left == two->left
+           && memcmp(one->data + one->used, two->data + two->used, one->left)
+                  == 0;
+}
+
+int
+main(void)
+{
+    int fds[2];
+    CHANNEL *cp;
+    struct buffer *expected, *replies;
+    size_t largest;
+    int writes;
+
+#ifdef SOCK_SEQPACKET
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) < 0)
+        skip_all("no sequenced-packet sockets");
+#else
+    skip_all("no sequenced-packet sockets");
+#endif
+    initialize();
+    message_handlers_notice(0);
+    alarm(10);
+    plan(8);
+
+    cp = NCcreate(fds[0], false, true);
+    if (cp == NULL)
+        bail("cannot create the channel");
+    fdflag_nonblocking(fds[1], true);
+    expected = buffer_new();
+    replies = buffer_new();
+
+    /* CHECK commands are refused without streaming, one reply at a time. */
+    send_checks(cp, fds[1], 3, expected);
+    writes = read_replies(fds[1], replies, &largest);
+    is_int(3, writes, "one write per reply without streaming");
+    ok(strncmp(replies->data, "500 ", 4) == 0, "...and CHECK is refused");
+
+    /* Once streaming, the replies to a batch of commands are written at
+       once, in order.  The server is paused so that CHECK does not need the
+       history. */
+    cp->Streaming = true;
+    Mode = OMpaused;
+    ModeReason = xstrdup("Testing");
+    buffer_set(expected, NULL, 0);
+    buffer_set(replies, NULL, 0);
+    send_checks(cp, fds[1], 20, expected);
+    writes = read_replies(fds[1], replies, &largest);
+    is_int(1, writes, "one write for a batch of 20 replies");
+    ok(same_data(expected, replies), "...with the replies in order");
+    is_int(0, cp->Out.left, "...and nothing left to write");
+
+    /* A batch is written as soon as it reaches BATCH_SIZE bytes. */
+    free(ModeReason);
+    ModeReason = xmalloc(201);
+    memset(ModeReason, 'x', 200);
+    ModeReason[200] = '\0';
+    buffer_set(expected, NULL, 0);
+    buffer_set(replies, NULL, 0);
+    send_checks(cp, fds[1], 50, expected);
+    writes = read_replies(fds[1], replies, &largest);
+    ok(writes > 1, "large batches are split");
+    ok(largest < BATCH_SIZE + 256, "...when they reach the batch size");
+    ok(same_data(expected, replies), "...with the replies in order");
+
+    CHANclose(cp, CHANname(cp));
+    close(fds[1]);
+    buffer_free(expected);
+    buffer_free(replies);
+    free(ModeReason);
+    return 0;
+}
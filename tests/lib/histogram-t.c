@@ -0,0 +1,89 @@
+/* Test suite for latency histograms. */
+
+#define LIBTEST_NEW_FORMAT 1
+
+#include "portable/system.h"
+
+#include "inn/histogram.h"
+#include "tap/basic.h"
+
+int
+main(void)
+{
+    struct histogram *h, *other;
+    unsigned long i, value;
+    double mean;
+
+    plan(26);
+
+    h = histogram_new();
+    is_int(0, h->count, "new histogram is empty");
+    is_int(0, histogram_percentile(h, 50), "percentile of empty histogram");
+    mean = histogram_mean(h);
+    is_int(0, (long) mean, "mean of empty histogram");
+
+    /* Small values are counted exactly. */
+    for (i = 1; i <= 10; i++)
+        histogram_record(h, i);
+    is_int(10, h->count, "count");
+    is_int(10, h->max, "max");
+    mean = histogram_mean(h);
+    is_int(55, (long) (mean * 10), "mean");
+    is_int(1, histogram_percentile(h, 0), "p0");
+    is_int(5, histogram_percentile(h, 50), "p50");
+    is_int(9, histogram_percentile(h, 90), "p90");
+    is_int(10, histogram_percentile(h, 99), "p99");
+    is_int(10, histogram_percentile(h, 100), "p100");
+
+    /* Larger values land in buckets no wider than 1/16 of their value. */
+    histogram_reset(h);
+    is_int(0, h->count, "reset");
+    for (i = 0; i < 1000; i++)
+        histogram_record(h, 1000 + i);
+    value = histogram_percentile(h, 50);
+    ok(value >= 1500 && value <= 1500 + 1500 / 16, "p50 of 1000..1999");
+    value = histogram_percentile(h, 99);
+    ok(value >= 1990 && value <= 1999, "p99 capped at max");
+    is_int(1999, h->max, "max of 1000..1999");
+
+    /* Every bucket boundary maps back into a bucket holding the value. */
+    histogram_reset(h);
+    histogram_record(h, 65535);
+    value = histogram_percentile(h, 50);
+    is_int(65535, value, "single value reported as itself");
+    histogram_reset(h);
+    histogram_record(h, 65536);
+    histogram_record(h, 70000);
+    value = histogram_percentile(h, 50);
+    ok(value >= 65536 && value < 65536 + 4096, "bucket upper bound");
+
+    /* Huge values are clamped into the last bucket. */
+    histogram_reset(h);
+    histogram_record(h, HISTOGRAM_MAX);
+    histogram_record(h, 0);
+    is_int(0, histogram_percentile(h, 50), "zero is counted");
+    is_int((long) HISTOGRAM_MAX, histogram_percentile(h, 99.9),
+           "largest value");
+    is_int(1, h->buckets[HISTOGRAM_BUCKETS - 1], "last bucket used");
+
+    /* Merging adds counts and keeps the larger max. */
+    histogram_reset(h);
+    other = histogram_new();
+    for (i = 0; i < 90; i++)
+        histogram_record(h, 10);
+    for (i = 0; i < 10; i++)
+        histogram_record(other, 100000);
+    histogram_merge(h, other);
+    is_int(100, h->count, "merged count");
+    is_int(100000, h->max, "merged max");
+    mean = histogram_mean(h);
+    is_int(10009, (long) mean, "merged mean");
+    is_int(10, histogram_percentile(h, 90), "merged p90");
+    is_int(100000, histogram_percentile(h, 99), "merged p99");
+    histogram_merge(other, other);
+    is_int(20, other->count, "merge into itself");
+
+    histogram_free(other);
+    histogram_free(h);
+    return 0;
+}
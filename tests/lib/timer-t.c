@@ -0,0 +1,86 @@
+/* Test suite for the removal of stale timer export files. */
+
+#define LIBTEST_NEW_FORMAT 1
+
+#include "portable/system.h"
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "inn/libinn.h"
+#include "inn/messages.h"
+#include "inn/timer.h"
+#include "tap/basic.h"
+
+static const char *const labels[] = {"test"};
+
+/* Export the timers of a child process to path and have it exit, without
+   removing the file if crash is true. */
+static void
+export_child(const char *path, bool crash)
+{
+    pid_t pid;
+    int status;
+
+    pid = fork();
+    if (pid < 0)
+        sysbail("cannot fork");
+    if (pid == 0) {
+        TMRinit(TMR_APPLICATION + 1);
+        if (!TMRexport(path, labels))
+            _exit(1);
+        TMRstart(TMR_APPLICATION);
+        TMRstop(TMR_APPLICATION);
+        if (!crash)
+            TMRfree();
+        _exit(0);
+    }
+    if (waitpid(pid, &status, 0) < 0)
+        sysbail("cannot wait for child");
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        bail("cannot export timers to %s", path);
+}
+
+int
+main(void)
+{
+    FILE *f;
+
+    if (system("/bin/rm -rf timer-tmp") < 0)
+        sysbail("cannot rm timer-tmp");
+    if (mkdir("timer-tmp", 0755) < 0)
+        sysbail("cannot mkdir timer-tmp");
+    message_handlers_warn(0);
+
+    plan(8);
+
+    /* A process exiting normally removes its file. */
+    export_child("timer-tmp/clean.timers", false);
+    ok(access("timer-tmp/clean.timers", F_OK) < 0, "export file removed");
+
+    /* One that crashed leaves it behind, for TMRexportclean to remove. */
+    export_child("timer-tmp/crashed.timers", true);
+    ok(access("timer-tmp/crashed.timers", F_OK) == 0,
+       "export file left by a crash");
+
+    /* The file of a running process, or anything that is not an export
+       file, is kept. */
+    TMRinit(TMR_APPLICATION + 1);
+    ok(TMRexport("timer-tmp/running.timers", labels), "export timers");
+    f = fopen("timer-tmp/other.timers", "w");
+    if (f == NULL || fputs("not timers\n", f) == EOF || fclose(f) == EOF)
+        sysbail("cannot create timer-tmp/other.timers");
+
+    is_int(1, TMRexportclean("timer-tmp"), "one stale file removed");
+    ok(access("timer-tmp/crashed.timers", F_OK) < 0, "...the crashed one");
+    ok(access("timer-tmp/running.timers", F_OK) == 0,
+       "...but not the one of a running process");
+    ok(access("timer-tmp/other.timers", F_OK) == 0,
+       "...nor an unrelated file");
+    is_int(0, TMRexportclean("timer-tmp"), "nothing left to remove");
+
+    TMRfree();
+    if (system("/bin/rm -rf timer-tmp") < 0)
+        sysdiag("cannot rm timer-tmp");
+    return 0;
+}
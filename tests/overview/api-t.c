@@ -87,21 +87,26 @@ fake_innconf(void)
     innconf->pathrun = xstrdup("ov-tmp");
 }
 
-/* Initialize an empty buffindexed buffer. */
+/* Initialize the empty buffindexed buffers.  The second one uses 64 KB
+   blocks (see etc/buffindexed.conf). */
 static void
 overview_init_buffindexed(void)
 {
+    static const char *const buffers[] = {"ov-tmp/buffer", "ov-tmp/buffer2"};
     int fd, i;
+    size_t n;
     char zero[1024];
 
-    fd = open("ov-tmp/buffer", O_CREAT | O_TRUNC | O_WRONLY, 0666);
-    if (fd < 0)
-        sysdie("Cannot create ov-tmp/buffer");
     memset(zero, 0, sizeof(zero));
-    for (i = 0; i < 1024; i++)
-        if (write(fd, zero, sizeof(zero)) < (ssize_t) sizeof(zero))
-            sysdie("Cannot write to ov-tmp/buffer");
-    close(fd);
+    for (n = 0; n < ARRAY_SIZE(buffers); n++) {
+        fd = open(buffers[n], O_CREAT | O_TRUNC | O_WRONLY, 0666);
+        if (fd < 0)
+            sysdie("Cannot create %s", buffers[n]);
+        for (i = 0; i < 1024; i++)
+            if (write(fd, zero, sizeof(zero)) < (ssize_t) sizeof(zero))
+                sysdie("Cannot write to %s", buffers[n]);
+        close(fd);
+    }
 }
 
 /* Initialize the overview database. */
@@ -706,7 +711,7 @@ main(void)
     }
 
     /* Cancels can't be tested with mmap, so there are only 21 tests there. */
-    test_init(27 * 2 + 21);
+    test_init(27 * 3 + 21);
 
     fake_innconf();
     innconf->ovmethod = xstrdup("tradindexed");
@@ -717,6 +722,12 @@ main(void)
     diag("tradindexed without mmap");
     n = overview_mmap_tests(n);
 
+    innconf->tradindexedmmap = true;
+    innconf->tradindexedpacked = true;
+    diag("tradindexed with packed index files");
+    n = overview_tests(n);
+    innconf->tradindexedpacked = false;
+
     free(innconf->ovmethod);
     innconf->ovmethod = xstrdup("buffindexed");
     diag("buffindexed");
@@ -0,0 +1,126 @@
+#! /bin/sh
+#
+# Test suite for defragmenting buffindexed groups with buffindexed_d -d.
+
+# The count starts at 1 and is updated each time ok is printed.  printcount
+# takes "ok" or "not ok".
+count=1
+printcount() {
+    echo "$1 $count $2"
+    count=$(expr $count + 1)
+}
+
+# Given two files, make sure that the first file exists and that its contents
+# match the contents of the second file.
+compare() {
+    if [ -r "$1" ] && diff "$1" "$2"; then
+        printcount "ok"
+    else
+        printcount "not ok"
+    fi
+}
+
+# Print the number of data blocks used by a group.
+datablocks() {
+    $buffindexed_d "$1" | sed -n 's/^\([0-9]*\) data block(s)$/\1/p'
+}
+
+# Find the right directory.
+buffindexed_d="../../storage/buffindexed/buffindexed_d"
+makehistory="../../expire/makehistory"
+dirs='../data data tests/data'
+for dir in $dirs; do
+    if [ -r "$dir/etc/buffindexed.conf" ]; then
+        cd $dir
+        break
+    fi
+done
+if [ ! -x "$buffindexed_d" ]; then
+    echo "Could not find buffindexed_d" >&2
+    exit 1
+fi
+if [ ! -x "$makehistory" ]; then
+    echo "Could not find makehistory" >&2
+    exit 1
+fi
+
+# Print out the number of tests.
+echo 6
+
+# Create a spool of articles crossposted to both test groups.  makehistory
+# stores their overview in small batches, so the blocks of the two groups
+# end up interleaved in the overview buffer.
+mkdir -p spool/example/config spool/example/test
+pad=$(printf '%0200d' 0)
+n=1
+while [ $n -le 100 ]; do
+    cat >spool/example/test/$n <<ARTICLE
+Path: news.example.com!not-for-mail
+Newsgroups: example.test,example.config
+Subject: Defragmentation test $n $pad
+From: user@example.com
+Date: Sat, 06 Mar 2004 21:39:44 -0800
+Message-ID: <defrag-$n@example.com>
+Xref: news.example.com example.test:$n example.config:$n
+
+Article $n.
+ARTICLE
+    ln -s ../test/$n spool/example/config/$n
+    n=$(expr $n + 1)
+done
+
+# Generate the buffindexed overview.
+INN_TESTSUITE=1
+export INN_TESTSUITE
+INNCONF="etc/inn-bfx.conf"
+export INNCONF
+mkdir -p ov-tmp tmp run
+dd if=/dev/zero of=ov-tmp/buffer bs=1024k count=1 >/dev/null 2>&1
+dd if=/dev/zero of=ov-tmp/buffer2 bs=1024k count=1 >/dev/null 2>&1
+if ! $makehistory -x -O -l 10 >/dev/null 2>&1; then
+    echo "makehistory failed, unable to continue" >&2
+    exit 1
+fi
+$buffindexed_d example.test | grep '^[0-9]*: ' >test.before
+$buffindexed_d example.config | grep '^[0-9]*: ' >config.before
+test_blocks=$(datablocks example.test)
+config_blocks=$(datablocks example.config)
+
+# Defragment both groups.
+out=$($buffindexed_d -d 2>&1)
+if [ $? = 0 ] && [ "$out" = "2 group(s) defragmented, 0 failed" ]; then
+    printcount "ok"
+else
+    echo "$out"
+    printcount "not ok"
+fi
+
+# Every article must still be found by a search, and each group must now use
+# fewer data blocks than before.
+$buffindexed_d example.test | grep '^[0-9]*: ' >test.after
+$buffindexed_d example.config | grep '^[0-9]*: ' >config.after
+if [ $(wc -l <test.after) -eq 100 ]; then
+    printcount "ok"
+else
+    printcount "not ok"
+fi
+compare test.after test.before
+compare config.after config.before
+blocks=$(datablocks example.test)
+if [ "$blocks" -gt 0 ] && [ "$blocks" -lt "$test_blocks" ]; then
+    printcount "ok"
+else
+    echo "example.test: $test_blocks data blocks before, $blocks after"
+    printcount "not ok"
+fi
+blocks=$(datablocks example.config)
+if [ "$blocks" -gt 0 ] && [ "$blocks" -lt "$config_blocks" ]; then
+    printcount "ok"
+else
+    echo "example.config: $config_blocks data blocks before, $blocks after"
+    printcount "not ok"
+fi
+
+# Clean up.
+rm -f test.before test.after config.before config.after
+rm -rf spool ov-tmp tmp run db/group.index
@@ -0,0 +1,251 @@
+/* Test suite for the lock-free readers of buffindexed. */
+
+#define LIBTEST_NEW_FORMAT 1
+
+#include "portable/system.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "inn/innconf.h"
+#include "inn/libinn.h"
+#include "inn/messages.h"
+#include "inn/ov.h"
+#include "tap/basic.h"
+
+#include "../storage/buffindexed/buffindexed.h"
+#include "../storage/buffindexed/shmem.h"
+
+/* The slots of buffindexed.c readers look at instead of locking groups. */
+#define GROUPSEQSIZE 4096
+struct seq {
+    unsigned int writers;
+    unsigned int version;
+    unsigned int freed;
+};
+
+/* Used as the token of all the articles. */
+static const TOKEN faketoken = {1, 1, ""};
+
+/* Build a stripped-down innconf struct for buffindexed. */
+static void
+fake_innconf(void)
+{
+    innconf = xcalloc(1, sizeof(*innconf));
+    innconf->enableoverview = true;
+    innconf->groupbaseexpiry = true;
+    innconf->icdsynccount = 10;
+    innconf->ovmethod = xstrdup("buffindexed");
+    innconf->pathdb = xstrdup("ov-tmp");
+    innconf->pathetc = xstrdup("etc");
+    innconf->pathoverview = xstrdup("ov-tmp");
+    innconf->pathrun = xstrdup("ov-tmp");
+}
+
+/* Create the empty buffers listed in etc/buffindexed.conf. */
+static void
+make_buffers(void)
+{
+    static const char *const buffers[] = {"ov-tmp/buffer", "ov-tmp/buffer2"};
+    char zero[1024];
+    size_t n;
+    int fd, i;
+
+    if (system("/bin/rm -rf ov-tmp") < 0)
+        sysbail("cannot rm ov-tmp");
+    if (mkdir("ov-tmp", 0755) < 0)
+        sysbail("cannot mkdir ov-tmp");
+    memset(zero, 0, sizeof(zero));
+    for (n = 0; n < ARRAY_SIZE(buffers); n++) {
+        fd = open(buffers[n], O_CREAT | O_TRUNC | O_WRONLY, 0666);
+        if (fd < 0)
+            sysbail("cannot create %s", buffers[n]);
+        for (i = 0; i < 1024; i++)
+            if (write(fd, zero, sizeof(zero)) < (ssize_t) sizeof(zero))
+                sysbail("cannot write to %s", buffers[n]);
+        close(fd);
+    }
+}
+
+/* Fork a process holding a write lock on all of the group index, the way a
+   writer holds the lock of a group, until it is killed. */
+static pid_t
+hold_lock(void)
+{
+    int fd, pipefd[2];
+    pid_t pid;
+    char c;
+
+    if (pipe(pipefd) < 0)
+        sysbail("cannot create pipe");
+    pid = fork();
+    if (pid < 0)
+        sysbail("cannot fork");
+    if (pid == 0) {
+        fd = open("ov-tmp/group.index", O_RDWR);
+        if (fd < 0 || !inn_lock_range(fd, INN_LOCK_WRITE, true, 0, 0))
+            _exit(1);
+        if (write(pipefd[1], "", 1) < 1)
+            _exit(1);
+        pause();
+        _exit(0);
+    }
+    close(pipefd[1]);
+    if (read(pipefd[0], &c, 1) < 1)
+        bail("cannot lock the group index");
+    close(pipefd[0]);
+    return pid;
+}
+
+static void
+release_lock(pid_t pid)
+{
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+}
+
+/* Read the group in a child process and return whether it could do so
+   without waiting for the lock held by another process. */
+static bool
+read_unlocked(void)
+{
+    pid_t pid;
+    int status, count, n;
+    void *search;
+    ARTNUM artnum;
+    char *data;
+    int len;
+    TOKEN token;
+    time_t arrived;
+
+    pid = fork();
+    if (pid < 0)
+        sysbail("cannot fork");
+    if (pid == 0) {
+        alarm(3);
+        if (!OVgroupstats("example.test", NULL, NULL, &count, NULL)
+            || count != 10)
+            _exit(1);
+        search = OVopensearch("example.test", 1, 10);
+        if (search == NULL)
+            _exit(1);
+        for (n = 0; OVsearch(search, &artnum, &data, &len, &token, &arrived);
+             n++)
+            ;
+        OVclosesearch(search);
+        _exit(n == 10 ? 0 : 1);
+    }
+    if (waitpid(pid, &status, 0) < 0)
+        sysbail("cannot wait for reader");
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/* Return the sum of the writer counts of all the slots. */
+static unsigned long
+count_writers(const struct seq *seq)
+{
+    unsigned long count = 0;
+    int i;
+
+    for (i = 0; i < GROUPSEQSIZE; i++)
+        count += seq[i].writers;
+    return count;
+}
+
+int
+main(void)
+{
+    smcd_t *smc;
+    struct seq *seq;
+    char data[64];
+    pid_t holder, pid;
+    int status, i;
+    ARTNUM n;
+
+    if (access("../data/etc/buffindexed.conf", F_OK) == 0) {
+        if (chdir("../data") < 0)
+            sysbail("cannot chdir to ../data");
+    } else if (access("data/etc/buffindexed.conf", F_OK) == 0) {
+        if (chdir("data") < 0)
+            sysbail("cannot chdir to data");
+    } else if (access("tests/data/etc/buffindexed.conf", F_OK) == 0) {
+        if (chdir("tests/data") < 0)
+            sysbail("cannot chdir to tests/data");
+    }
+
+    fake_innconf();
+    make_buffers();
+    if (!OVopen(OV_READ | OV_WRITE))
+        bail("cannot open the overview");
+    smc = smcGetShmemBuffer("ov-tmp/group.index",
+                            GROUPSEQSIZE * sizeof(struct seq));
+    if (smc == NULL) {
+        OVclose();
+        system("/bin/rm -rf ov-tmp");
+        skip_all("no lock-free readers without shared memory");
+    }
+    seq = (struct seq *) (void *) smc->addr;
+
+    plan(6);
+
+    if (!OVgroupadd("example.test", 0, 0, (char *) "y"))
+        bail("cannot add example.test");
+    for (n = 1; n <= 10; n++) {
+        snprintf(data, sizeof(data), "%lu\tSubject %lu\r\n", n, n);
+        if (!buffindexed_add("example.test", n, faketoken, data,
+                             strlen(data), 0, 0))
+            bail("cannot add article %lu", n);
+    }
+    is_int(0, count_writers(seq), "writers count themselves out");
+
+    /* Readers do not wait for the lock of the group. */
+    holder = hold_lock();
+    ok(read_unlocked(), "group read without its lock");
+
+    /* A writer dying with the lock of the group leaves its count behind,
+       and readers then fall back to the lock. */
+    for (i = 0; i < GROUPSEQSIZE; i++)
+        seq[i].writers = 1;
+    ok(!read_unlocked(), "readers lock the group after a writer died");
+
+    /* Opening the overview for writing does not clear the counts while a
+       group is locked. */
+    pid = fork();
+    if (pid < 0)
+        sysbail("cannot fork");
+    if (pid == 0) {
+        OVclose();
+        _exit(OVopen(OV_READ | OV_WRITE) ? 0 : 1);
+    }
+    waitpid(pid, &status, 0);
+    is_int(GROUPSEQSIZE, count_writers(seq), "counts kept while locked");
+
+    /* Once no group is locked, a restarting writer clears them. */
+    release_lock(holder);
+    pid = fork();
+    if (pid < 0)
+        sysbail("cannot fork");
+    if (pid == 0) {
+        OVclose();
+        _exit(OVopen(OV_READ | OV_WRITE) ? 0 : 1);
+    }
+    waitpid(pid, &status, 0);
+    is_int(0, count_writers(seq), "restart clears the counts");
+    holder = hold_lock();
+    ok(read_unlocked(), "group read without its lock again");
+    release_lock(holder);
+
+    smcClose(smc);
+    OVclose();
+    if (system("/bin/rm -rf ov-tmp") < 0)
+        sysdiag("cannot rm ov-tmp");
+    free(innconf->ovmethod);
+    free(innconf->pathdb);
+    free(innconf->pathetc);
+    free(innconf->pathoverview);
+    free(innconf->pathrun);
+    free(innconf);
+    return 0;
+}
@@ -48,7 +48,7 @@ export INN_TESTSUITE
 mkdir -p ov-tmp
 
 # Print out the number of tests
-echo 2
+echo 4
 
 # We can use a common prefix; the way overchan works isn't going to corrupt
 # tokens and arrival times differently for different articles.
@@ -74,6 +74,22 @@ $tdxutil -O -n example.config -a 2 >>output
 $tdxutil -O -n example.test -a 3 >>output
 compare input output
 
+# Convert the index files to the packed format and back, and make sure the
+# same data is returned each time.
+$tdxutil -C packed
+$tdxutil -O -n example.config -a 1 >output
+$tdxutil -O -n example.test -a 1 >>output
+$tdxutil -O -n example.config -a 2 >>output
+$tdxutil -O -n example.test -a 3 >>output
+compare input output
+$tdxutil -C native -n example.test
+$tdxutil -C native -n example.config
+$tdxutil -O -n example.config -a 1 >output
+$tdxutil -O -n example.test -a 1 >>output
+$tdxutil -O -n example.config -a 2 >>output
+$tdxutil -O -n example.test -a 3 >>output
+compare input output
+
 # All done.  Clean up.
 rm -f input output
 rm -rf ov-tmp
@@ -0,0 +1,81 @@
+/* Test suite for the cache of open newsgroups of tradindexed. */
+
+#define LIBTEST_NEW_FORMAT 1
+
+#include "portable/system.h"
+
+#include "inn/innconf.h"
+#include "inn/libinn.h"
+#include "inn/ov.h"
+#include "tap/basic.h"
+
+#include "../storage/tradindexed/tdx-private.h"
+
+#define GROUPS 9
+
+int
+main(void)
+{
+    struct cache *cache;
+    struct group_data *data[GROUPS];
+    struct ovcachestats stats;
+    HASH hash[GROUPS];
+    char name[32];
+    int i;
+
+    plan(21);
+
+    innconf = xcalloc(1, sizeof(*innconf));
+    innconf->pathoverview = xstrdup("ov-tmp");
+
+    for (i = 0; i < GROUPS; i++) {
+        snprintf(name, sizeof(name), "example.group%d", i);
+        hash[i] = Hash(name, strlen(name));
+        data[i] = tdx_data_new(name, false);
+    }
+
+    /* Fill a cache of five entries and use the first three again. */
+    cache = tdx_cache_create(5);
+    for (i = 0; i < 5; i++)
+        tdx_cache_insert(cache, hash[i], data[i]);
+    is_int(1, data[0]->refcount, "insert takes a reference");
+    for (i = 0; i < 3; i++)
+        ok(tdx_cache_lookup(cache, hash[i]) == data[i], "hit on group %d",
+           i);
+
+    /* New groups push out the ones used once, not the protected ones, and
+       skip a group still used by a search.  Group 6 is the least recently
+       used one on probation when group 8 comes in. */
+    for (i = 5; i < 8; i++)
+        tdx_cache_insert(cache, hash[i], data[i]);
+    data[6]->refcount++;
+    tdx_cache_insert(cache, hash[8], data[8]);
+    is_int(2, data[6]->refcount, "busy group kept");
+    data[6]->refcount--;
+    ok(tdx_cache_lookup(cache, hash[3]) == NULL, "group 3 evicted");
+    ok(tdx_cache_lookup(cache, hash[4]) == NULL, "group 4 evicted");
+    ok(tdx_cache_lookup(cache, hash[5]) == NULL, "group 5 evicted");
+    ok(tdx_cache_lookup(cache, hash[7]) == NULL, "group 7 evicted");
+    for (i = 0; i < 3; i++)
+        ok(tdx_cache_lookup(cache, hash[i]) == data[i], "group %d kept", i);
+    ok(tdx_cache_lookup(cache, hash[6]) == data[6], "group 6 kept");
+    ok(tdx_cache_lookup(cache, hash[8]) == data[8], "group 8 kept");
+
+    tdx_cache_stats(cache, &stats);
+    is_int(5, stats.size, "size");
+    is_int(5, stats.count, "count");
+    is_int(12, stats.lookups, "lookups");
+    is_int(8, stats.hits, "hits");
+    is_int(4, stats.evictions, "evictions");
+
+    /* Deleting drops the entry. */
+    tdx_cache_delete(cache, hash[0]);
+    ok(tdx_cache_lookup(cache, hash[0]) == NULL, "deleted group is gone");
+    tdx_cache_stats(cache, &stats);
+    is_int(4, stats.count, "count after delete");
+
+    tdx_cache_free(cache);
+    free(innconf->pathoverview);
+    free(innconf);
+    return 0;
+}
@@ -0,0 +1,167 @@
+/* Test suite for the shared article cache of the storage API. */
+
+#define LIBTEST_NEW_FORMAT 1
+
+#include "portable/system.h"
+
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "inn/innconf.h"
+#include "inn/libinn.h"
+#include "inn/storage.h"
+#include "tap/basic.h"
+
+#include "../storage/interface.h"
+
+/* Build a token of a fake article. */
+static TOKEN
+make_token(int n)
+{
+    TOKEN token;
+
+    memset(&token, 0, sizeof(token));
+    token.type = 3;
+    snprintf(token.token, sizeof(token.token), "%d", n);
+    return token;
+}
+
+/* Build the handle of an article of len bytes filled with c. */
+static ARTHANDLE
+make_article(char *data, size_t len, char c, struct iovec *iov)
+{
+    ARTHANDLE art = ARTHANDLE_INITIALIZER;
+
+    memset(data, c, len);
+    iov->iov_base = data;
+    iov->iov_len = len;
+    art.data = data;
+    art.len = len;
+    art.iov = iov;
+    art.iovcnt = 1;
+    art.arrived = 1000;
+    return art;
+}
+
+int
+main(void)
+{
+    ARTHANDLE article, other, *art;
+    struct artcache_stats stats;
+    struct iovec iov;
+    TOKEN token;
+    char *data;
+    bool admit;
+    unsigned long generation;
+    int i;
+
+    if (mkdir("artcache-tmp", 0755) < 0 && errno != EEXIST)
+        sysbail("cannot create artcache-tmp");
+    innconf = xcalloc(1, sizeof(*innconf));
+    innconf->pathrun = xstrdup("artcache-tmp");
+    innconf->articlecache = 1024;
+    innconf->articlecachestore = true;
+    if (!artcache_open()) {
+        rmdir("artcache-tmp");
+        skip_all("cannot create shared memory");
+    }
+
+    plan(28);
+
+    /* An article only gets in on its second miss. */
+    data = xmalloc(128 * 1024);
+    article = make_article(data, 3000, 'a', &iov);
+    token = make_token(1);
+    ok(artcache_lookup(token, &admit, &generation) == NULL,
+       "first lookup misses");
+    ok(!admit, "...and does not admit");
+    artcache_stats(&stats);
+    is_int(0, stats.admissions, "nothing admitted yet");
+    ok(artcache_lookup(token, &admit, &generation) == NULL,
+       "second lookup misses");
+    ok(admit, "...and admits");
+    artcache_insert(token, &article, generation);
+    art = artcache_lookup(token, &admit, &generation);
+    ok(art != NULL, "third lookup hits");
+    is_int(3000, art->len, "...with the right length");
+    ok(memcmp(art->data, data, 3000) == 0, "...and data");
+    is_int(1000, art->arrived, "...and arrival time");
+    ok(memcmp(art->token, &token, sizeof(token)) == 0, "...and token");
+    ok(artcache_free(art), "cached article freed by the cache");
+    other = make_article(data, 10, 'b', &iov);
+    ok(!artcache_free(&other), "other articles left to their method");
+
+    /* Stored articles get in at once, and cancelled ones go away. */
+    article = make_article(data, 5000, 'c', &iov);
+    token = make_token(2);
+    artcache_store(token, &article);
+    art = artcache_lookup(token, &admit, &generation);
+    ok(art != NULL, "stored article is cached");
+    if (art != NULL) {
+        ok(memcmp(art->data, data, 5000) == 0, "...with the right data");
+        artcache_free(art);
+    } else
+        ok(false, "...with the right data");
+    artcache_cancel(token);
+    ok(artcache_lookup(token, &admit, &generation) == NULL,
+       "cancelled article is gone");
+
+    /* Articles larger than an eighth of the cache never get in. */
+    article = make_article(data, 128 * 1024, 'd', &iov);
+    token = make_token(3);
+    artcache_store(token, &article);
+    ok(artcache_lookup(token, &admit, &generation) == NULL,
+       "large article not cached");
+
+    /* Writing the size of the cache over the ring pushes out the oldest
+       articles but keeps the last ones. */
+    article = make_article(data, 64 * 1024, 'e', &iov);
+    for (i = 10; i < 30; i++)
+        artcache_store(make_token(i), &article);
+    ok(artcache_lookup(make_token(1), &admit, &generation) == NULL,
+       "oldest article gone");
+    ok(artcache_lookup(make_token(10), &admit, &generation) == NULL,
+       "old article gone");
+    art = artcache_lookup(make_token(29), &admit, &generation);
+    ok(art != NULL, "last article kept");
+    if (art != NULL) {
+        is_int(64 * 1024, art->len, "...with the right length");
+        artcache_free(art);
+    } else
+        ok(false, "...with the right length");
+
+    /* Reads are counted on hits as well as on misses. */
+    is_int(4, artcache_reads(make_token(1)), "reads of the first article");
+    is_int(0, artcache_reads(make_token(999)), "unread article");
+
+    artcache_stats(&stats);
+    is_int(9, stats.lookups, "lookups");
+    is_int(3, stats.hits, "hits");
+    is_int(22, stats.admissions, "admissions");
+
+    /* An article cancelled between a miss and its insertion stays out, until
+       it is missed again. */
+    article = make_article(data, 3000, 'f', &iov);
+    token = make_token(40);
+    artcache_lookup(token, &admit, &generation);
+    art = artcache_lookup(token, &admit, &generation);
+    ok(art == NULL && admit, "racing article admitted");
+    artcache_cancel(token);
+    artcache_insert(token, &article, generation);
+    art = artcache_lookup(token, &admit, &generation);
+    ok(art == NULL, "...but not inserted after a cancel");
+    artcache_insert(token, &article, generation);
+    art = artcache_lookup(token, &admit, &generation);
+    ok(art != NULL, "...until missed again");
+    if (art != NULL)
+        artcache_free(art);
+
+    artcache_close();
+    unlink("artcache-tmp/artcache");
+    rmdir("artcache-tmp");
+    free(data);
+    free(innconf->pathrun);
+    free(innconf);
+    return 0;
+}
@@ -0,0 +1,256 @@
+/* Test suite for the recovery of CNFS cycbuff headers. */
+
+#define LIBTEST_NEW_FORMAT 1
+
+#include "portable/system.h"
+#include "portable/socket.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#include "inn/innconf.h"
+#include "inn/libinn.h"
+#include "inn/messages.h"
+#include "inn/storage.h"
+#include "tap/basic.h"
+
+#include "../storage/cnfs/cnfs-private.h"
+
+/* Size of the cycbuff, in kilobytes. */
+#define CYCBUFF_SIZE 1024
+
+/* The articles stored so far, kept by the parent. */
+static TOKEN tokens[64];
+static int stored = 0;
+
+/* Build the text of the article number n. */
+static void
+make_article(int n, char *data, size_t size)
+{
+    snprintf(data, size,
+             "Newsgroups: example.test\r\nMessage-ID: <%d@example.com>\r\n"
+             "\r\nBody of article %d.\r\n",
+             n, n);
+}
+
+/* Create the configuration files and an empty cycbuff in cnfs-tmp. */
+static void
+setup(void)
+{
+    char *cwd;
+    char zero[1024];
+    FILE *f;
+    int fd, i;
+
+    if (system("/bin/rm -rf cnfs-tmp") < 0)
+        sysbail("cannot rm cnfs-tmp");
+    if (mkdir("cnfs-tmp", 0755) < 0)
+        sysbail("cannot mkdir cnfs-tmp");
+    cwd = getcwd(NULL, 0);
+    if (cwd == NULL)
+        sysbail("cannot get the current directory");
+
+    /* Write the header back only at shutdown, as if innd crashed before
+       its next write after a few articles. */
+    f = fopen("cnfs-tmp/cycbuff.conf", "w");
+    if (f == NULL)
+        sysbail("cannot create cnfs-tmp/cycbuff.conf");
+    fprintf(f, "cycbuffupdate:1000\n");
+    fprintf(f, "cycbuff:ONE:%s/cnfs-tmp/one:%d\n", cwd, CYCBUFF_SIZE);
+    fprintf(f, "metacycbuff:META:ONE\n");
+    fclose(f);
+    free(cwd);
+    f = fopen("cnfs-tmp/storage.conf", "w");
+    if (f == NULL)
+        sysbail("cannot create cnfs-tmp/storage.conf");
+    fprintf(f, "method cnfs {\n    newsgroups: *\n    class: 0\n"
+               "    options: META\n}\n");
+    fclose(f);
+
+    memset(zero, 0, sizeof(zero));
+    fd = open("cnfs-tmp/one", O_CREAT | O_TRUNC | O_WRONLY, 0666);
+    if (fd < 0)
+        sysbail("cannot create cnfs-tmp/one");
+    for (i = 0; i < CYCBUFF_SIZE; i++)
+        if (write(fd, zero, sizeof(zero)) < (ssize_t) sizeof(zero))
+            sysbail("cannot write to cnfs-tmp/one");
+    close(fd);
+}
+
+/* Store count more articles in a child process which then exits without
+   shutting down the storage manager, so without writing the header back.
+   Returns false if they could not be stored. */
+static bool
+store(int count)
+{
+    int pipefd[2], status, i;
+    ARTHANDLE art = ARTHANDLE_INITIALIZER;
+    struct iovec iov;
+    TOKEN token;
+    char data[256];
+    pid_t pid;
+    bool value = true;
+
+    if (pipe(pipefd) < 0)
+        sysbail("cannot create pipe");
+    pid = fork();
+    if (pid < 0)
+        sysbail("cannot fork");
+    if (pid == 0) {
+        close(pipefd[0]);
+        if (!SMsetup(SM_RDWR, &value) || !SMinit())
+            _exit(1);
+        for (i = 0; i < count; i++) {
+            make_article(stored + i, data, sizeof(data));
+            iov.iov_base = data;
+            iov.iov_len = strlen(data);
+            art.data = data;
+            art.len = iov.iov_len;
+            art.iov = &iov;
+            art.iovcnt = 1;
+            art.arrived = time(NULL);
+            art.groups = (char *) "example.test";
+            art.groupslen = strlen(art.groups);
+            token = SMstore(art);
+            if (token.type == TOKEN_EMPTY)
+                _exit(1);
+            if (write(pipefd[1], &token, sizeof(token)) < 0)
+                _exit(1);
+        }
+        _exit(0);
+    }
+    close(pipefd[1]);
+    while (read(pipefd[0], &token, sizeof(token)) == sizeof(token))
+        tokens[stored++] = token;
+    close(pipefd[0]);
+    if (waitpid(pid, &status, 0) < 0)
+        sysbail("cannot wait for child");
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/* Check in a child process that all the articles stored so far can be
+   retrieved unchanged. */
+static bool
+check(void)
+{
+    int status, i;
+    ARTHANDLE *art;
+    char data[256];
+    pid_t pid;
+
+    pid = fork();
+    if (pid < 0)
+        sysbail("cannot fork");
+    if (pid == 0) {
+        if (!SMinit())
+            _exit(1);
+        for (i = 0; i < stored; i++) {
+            make_article(i, data, sizeof(data));
+            art = SMretrieve(tokens[i], RETR_ALL);
+            if (art == NULL || art->len != strlen(data)
+                || memcmp(art->data, data, art->len) != 0)
+                _exit(1);
+            SMfreearticle(art);
+        }
+        _exit(0);
+    }
+    if (waitpid(pid, &status, 0) < 0)
+        sysbail("cannot wait for child");
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/* Return the block of an article in the cycbuff, from its token. */
+static unsigned long
+block(TOKEN token)
+{
+    uint32_t block;
+
+    memcpy(&block, &token.token[8], sizeof(block));
+    return ntohl(block);
+}
+
+/* Overwrite the free pointer of the header with free unless it is 0, leaving
+   the checksum as it was, and clear the redo log if redo is true. */
+static void
+damage(off_t free, bool redo)
+{
+    char buf[CNFSLASIZ + 1];
+    char zero[CNFS_REDOCOUNT * sizeof(CNFSREDO)];
+    int fd;
+
+    fd = open("cnfs-tmp/one", O_WRONLY);
+    if (fd < 0)
+        sysbail("cannot open cnfs-tmp/one");
+    if (free != 0) {
+        snprintf(buf, sizeof(buf), "%016lx", (unsigned long) free);
+        if (pwrite(fd, buf, CNFSLASIZ, offsetof(CYCBUFFEXTERN, freea))
+            < CNFSLASIZ)
+            sysbail("cannot write the header");
+    }
+    if (redo) {
+        memset(zero, 0, sizeof(zero));
+        if (pwrite(fd, zero, sizeof(zero), CNFS_REDOOFFSET)
+            < (ssize_t) sizeof(zero))
+            sysbail("cannot clear the redo log");
+    }
+    close(fd);
+}
+
+int
+main(void)
+{
+    if (access("../data/etc/inn.conf", F_OK) == 0) {
+        if (chdir("../data") < 0)
+            sysbail("cannot chdir to ../data");
+    } else if (access("data/etc/inn.conf", F_OK) == 0) {
+        if (chdir("data") < 0)
+            sysbail("cannot chdir to data");
+    } else if (access("tests/data/etc/inn.conf", F_OK) == 0) {
+        if (chdir("tests/data") < 0)
+            sysbail("cannot chdir to tests/data");
+    }
+    if (!innconf_read("etc/inn.conf"))
+        bail("cannot read etc/inn.conf");
+    free(innconf->pathetc);
+    innconf->pathetc = xstrdup("cnfs-tmp");
+    setup();
+    message_handlers_warn(0);
+    message_handlers_notice(0);
+
+    plan(10);
+
+    /* The header lags behind after a crash, and is rolled forward with the
+       redo log so that the next articles do not overwrite those. */
+    ok(store(10), "articles stored");
+    ok(store(1), "...and stored again after a crash");
+    is_int(block(tokens[9]) + 1, block(tokens[10]),
+           "...right after the previous ones");
+    ok(check(), "...without overwriting them");
+
+    /* A damaged header pointing forward is not trusted. */
+    damage(CYCBUFF_SIZE * 1024 / 2, false);
+    ok(store(1), "articles stored with a damaged header");
+    is_int(block(tokens[10]) + 1, block(tokens[11]),
+           "...right after the previous ones");
+
+    /* Nor is one pointing backward. */
+    damage(CNFS_HDR_PAGESIZE, false);
+    ok(store(1), "articles stored with a damaged header again");
+    is_int(block(tokens[11]) + 1, block(tokens[12]),
+           "...right after the previous ones");
+    ok(check(), "...without overwriting them");
+
+    /* Without a redo log, the cycbuff is refused. */
+    damage(CYCBUFF_SIZE * 1024 / 2, true);
+    ok(!store(1), "damaged header refused without a redo log");
+
+    if (system("/bin/rm -rf cnfs-tmp") < 0)
+        sysdiag("cannot rm cnfs-tmp");
+    innconf_free(innconf);
+    innconf = NULL;
+    return 0;
+}
@@ -46,7 +46,7 @@ export INNCONF
 mkdir -p spool
 
 # Print out the number of tests
-echo 5
+echo 9
 
 # First, store the articles.
 $sm -s <articles/1 >spool/tokens
@@ -75,6 +75,43 @@ compare spool/tokens-test spool/tokens
 sed 's/^[^ ]* [^ ]* //' <spool/overview >spool/stripped
 compare spool/stripped overview/1-4
 
+# Build history walking the spool in one go and then with several workers
+# walking a part of it each, and make sure they have the same entries.  The
+# history files are put in the current directory since makehistory changes
+# to their directory and our paths are relative.
+INN_TESTSUITE=1
+export INN_TESTSUITE
+$makehistory -T spool -f "$(pwd)/history.one"
+$makehistory -T spool -P 3 -f "$(pwd)/history.parts"
+sort history.one >spool/history.one
+sort history.parts >spool/history.parts
+rm -f history.one* history.parts*
+lines=$(wc -l spool/history.parts | sed -e 's/^ *//' -e 's/ .*//')
+if [ "$lines" = 4 ]; then
+    printcount "ok"
+else
+    printcount "not ok"
+fi
+compare spool/history.parts spool/history.one
+
+# Pretend a run with checkpoints was interrupted after the second article and
+# make sure resuming it gives the same history.  The dbz index already has all
+# the entries, so the warnings about duplicates are expected.
+$makehistory -T spool -R -f "$(pwd)/history.one"
+cp history.one spool/history.full
+token=$(awk 'NR == 2 { print $3 }' history.one)
+size=$(head -n 2 history.one | wc -c | sed 's/^ *//')
+echo "$token $size" >history.one.checkpoint
+echo '[garbage]' >>history.one
+$makehistory -T spool -R -f "$(pwd)/history.one" 2>/dev/null
+compare history.one spool/history.full
+if [ -f history.one.checkpoint ]; then
+    printcount "not ok"
+else
+    printcount "ok"
+fi
+rm -f history.one*
+
 # Done with the first test.  Clean up.
 rm -rf spool
 
@@ -0,0 +1,124 @@
+#! /bin/sh
+#
+# Test suite for tiermigrate.
+
+# The count starts at 1 and is updated each time ok is printed.  printcount
+# takes "ok" or "not ok".
+count=1
+printcount() {
+    echo "$1 $count $2"
+    count=$(expr $count + 1)
+}
+
+# Given two files, make sure that the first file exists and that its contents
+# match the contents of the second file.
+compare() {
+    if [ -r "$1" ] && diff "$1" "$2"; then
+        printcount "ok"
+    else
+        printcount "not ok"
+    fi
+}
+
+# Find the right directory.
+sm="../../frontends/sm"
+makehistory="../../expire/makehistory"
+tiermigrate="../../expire/tiermigrate"
+dirs='../data data tests/data'
+for dir in $dirs; do
+    if [ -r "$dir/articles/1" ]; then
+        cd $dir
+        break
+    fi
+done
+for program in "$sm" "$makehistory" "$tiermigrate"; do
+    if [ ! -x "$program" ]; then
+        echo "Could not find $program" >&2
+        exit 1
+    fi
+done
+
+# Point the programs at the appropriate inn.conf file and create our required
+# directory structure.  The storage.conf file used stores articles in
+# tradspool, with class 0, and has a timehash entry with class 1 which is
+# only reached by tiermigrate.
+INNCONF=etc/inn.conf
+export INNCONF
+INN_TESTSUITE=1
+export INN_TESTSUITE
+mkdir -p spool
+
+# Print out the number of tests.
+echo 13
+
+# Store the articles and build a history file for them.  makehistory changes
+# to the directory of the history file, so give it a full path.
+for n in 1 2 3 4; do
+    $sm -s <articles/$n >>spool/tokens
+done
+sort <spool/tokens >spool/tokens.new
+mv spool/tokens.new spool/tokens
+$makehistory -T spool -f "$(pwd)/history"
+
+# Nothing arrived more than a day ago, so nothing is moved.
+$tiermigrate -n -a 1 -f history -s 0 -t 1 >spool/moving
+compare spool/moving /dev/null
+
+# A dry run lists all the articles of class 0 but changes nothing.
+$tiermigrate -n -f history -s 0 -t 1 | sort >spool/moving
+compare spool/moving spool/tokens
+awk '{ print $3 }' history | sort >spool/history-tokens
+compare spool/history-tokens spool/tokens
+
+# Move them all, and check that history points at new tokens, that the old
+# ones are gone and that the articles are unchanged.  Keep a copy of the
+# history as it was.
+for file in history history.*; do
+    cp "$file" "spool/old-$file"
+done
+if $tiermigrate -f history -s 0 -t 1 >spool/moved 2>&1; then
+    printcount "ok"
+else
+    printcount "not ok"
+fi
+awk '{ print $3 }' history | sort >spool/history-tokens
+if grep -F -f spool/tokens spool/history-tokens >/dev/null; then
+    printcount "not ok"
+else
+    printcount "ok"
+fi
+if $sm -q $(cat spool/tokens) >/dev/null 2>&1; then
+    printcount "not ok"
+else
+    printcount "ok"
+fi
+for n in 1 2 3 4; do
+    found=false
+    for token in $(cat spool/history-tokens); do
+        if $sm "$token" | cmp -s - articles/$n; then
+            found=true
+        fi
+    done
+    if [ "$found" = true ]; then
+        printcount "ok"
+    else
+        printcount "not ok"
+    fi
+done
+
+# Moving again from class 0 finds nothing left there.
+$tiermigrate -n -f history -s 0 -t 1 >spool/moving
+compare spool/moving /dev/null
+
+# Each article is counted once, including those already gone from the spool,
+# as with the old history pointing at the tokens just removed.
+echo "tiermigrate: moved 4 articles from class 0 to class 1, 0 gone, 0 failed" \
+    >spool/expected
+compare spool/moved spool/expected
+$tiermigrate -f "$(pwd)/spool/old-history" -s 0 -t 1 >spool/moved 2>&1
+echo "tiermigrate: moved 0 articles from class 0 to class 1, 4 gone, 0 failed" \
+    >spool/expected
+compare spool/moved spool/expected
+
+# Clean up.
+rm -rf spool history history.*
@@ -118,6 +118,7 @@ fi
 rm -rf ov-tmp
 mkdir ov-tmp
 dd if=/dev/zero of=ov-tmp/buffer bs=1024k count=1 >/dev/null 2>&1
+dd if=/dev/zero of=ov-tmp/buffer2 bs=1024k count=1 >/dev/null 2>&1
 INNCONF="etc/inn-bfx.conf"
 export INNCONF
 if ! $makehistory -x -O >/dev/null 2>&1; then
@@ -132,7 +133,7 @@ else
     printcount "not ok"
 fi
 out=$($inndf -o | sed 's/\...%/\.00%/')
-if [ "$out" = "3.00% overview space used" ]; then
+if [ "$out" = "1.00% overview space used" ]; then
     printcount "ok"
 else
     echo "$out"